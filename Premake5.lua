@@ -1,11 +1,17 @@
+newoption {
+   trigger = "no-profiler",
+   description = "Compile out the PROFILE_* markers"
+}
+
 workspace "Basics of DirectX 12"
    configurations { "Debug", "Release" }
    language "C++"
    architecture "x64"
-   systemversion "latest"
-   toolset "v142"
    optimize "Speed"
-   links { "d3d12", "dxgi", "d3dcompiler" }
+   cppdialect "C++17"
+   filter("system:windows")
+      systemversion "latest"
+      toolset "v142"
    filter("configurations:Debug")
       defines({ "DEBUG" })
       symbols("On")
@@ -15,6 +21,11 @@ workspace "Basics of DirectX 12"
       defines({ "NDEBUG" })
       symbols("On")
       targetdir ("bin/release")
+   filter("system:linux")
+      links { "pthread" }
+   filter("options:not no-profiler")
+      defines({ "ENABLE_PROFILER" })
+   filter({})
 
    project "DX12 installation check"
       kind "ConsoleApp"
@@ -23,6 +34,7 @@ workspace "Basics of DirectX 12"
       includedirs { "libs/D3DX12" }
       files { "src/dx12_labs.h" }
       files {"src/dx12_check_main.cpp" }
+      links { "d3d12", "dxgi", "d3dcompiler" }
 
    project "DX12 window"
       kind "WindowedApp"
@@ -32,11 +44,133 @@ workspace "Basics of DirectX 12"
       includedirs { "libs/tinyobjloader" }
       files { "src/dx12_labs.h" }
       files { "src/renderer.h", "src/renderer.cpp"}
+      files { "src/dx12_gpu_profiler.h"}
+      files { "src/shader_cache.h", "src/shader_cache.cpp", "src/dx12_shader_compiler.h"}
+      files { "src/hot_reload.h", "src/hot_reload.cpp"}
+      files { "src/job_system.h", "src/job_system.cpp"}
+      files { "src/frame_ring.h", "src/frame_ring.cpp", "src/dx12_fence_timeline.h"}
+      files { "src/upload_ring.h", "src/upload_ring.cpp", "src/dx12_upload_pages.h"}
+      files { "src/upload_batcher.h", "src/upload_batcher.cpp", "src/dx12_copy_queue.h"}
+      files { "src/cpu_math.h", "src/frustum_cull.h", "src/frustum_cull.cpp"}
+      files { "src/transform_hierarchy.h", "src/transform_hierarchy.cpp"}
+      files { "src/bvh.h", "src/bvh.cpp"}
+      files { "src/render_queue.h", "src/render_queue.cpp"}
+      files { "src/profiler.h", "src/profiler.cpp"}
+      files { "src/command_sink.h", "src/dx12_command_sink.h", "src/scene_pipeline.h", "src/scene_pipeline.cpp"}
+      files { "src/occlusion_cull.h", "src/occlusion_cull.cpp"}
+      files { "src/parallel_record.h", "src/parallel_record.cpp", "src/dx12_command_list_pool.h"}
+      files { "src/render_graph.h", "src/render_graph.cpp", "src/dx12_render_graph.h"}
+      files { "src/descriptor_allocator.h", "src/descriptor_allocator.cpp", "src/dx12_descriptor_heaps.h"}
+      files { "src/gpu_heap_allocator.h", "src/gpu_heap_allocator.cpp", "src/dx12_resource_heaps.h"}
+      files { "src/mesh_lod.h", "src/mesh_lod.cpp"}
+      files { "src/vertex_format.h", "src/vertex_format.cpp", "src/dx12_vertex_format.h"}
+      files { "src/asset_streamer.h", "src/asset_streamer.cpp", "src/dx12_stream_target.h"}
+      files { "src/mesh_builder.h", "src/mesh_builder.cpp"}
+      files { "src/obj_mesh.h", "src/obj_mesh.cpp"}
+      files { "src/obj_parallel.h", "src/obj_parallel.cpp"}
+      files { "src/mapped_file.h", "src/mapped_file.cpp"}
+      files { "src/mesh_cache.h", "src/mesh_cache.cpp"}
+      files { "src/frame_scheduler.h", "src/frame_scheduler.cpp"}
       files { "src/win32_window.h", "src/win32_window.cpp"}
       files { "src/win32_window_main.cpp" }
       files { "libs/tinyobjloader/tiny_obj_loader.h"}
+      links { "d3d12", "dxgi", "d3dcompiler", "winmm" }
       postbuildcommands {
          "{COPY} shaders/shaders.hlsl %{cfg.buildtarget.directory}",
          "{COPY} models/CornellBox-Original.obj %{cfg.buildtarget.directory}",
          "{COPY} models/CornellBox-Original.mtl %{cfg.buildtarget.directory}"
-       }
\ No newline at end of file
+       }
+
+   project "Mesh cook"
+      kind "ConsoleApp"
+      includedirs { "src" }
+      includedirs { "libs/tinyobjloader" }
+      files { "src/mesh_builder.h", "src/mesh_builder.cpp"}
+      files { "src/obj_mesh.h", "src/obj_mesh.cpp"}
+      files { "src/obj_parallel.h", "src/obj_parallel.cpp"}
+      files { "src/mapped_file.h", "src/mapped_file.cpp"}
+      files { "src/mesh_cache.h", "src/mesh_cache.cpp"}
+      files { "src/mesh_cook_main.cpp" }
+      files { "libs/tinyobjloader/tiny_obj_loader.h"}
+
+   project "CPU benchmarks"
+      kind "ConsoleApp"
+      -- Enables the AVX2 culling kernel; the renderer keeps the baseline SSE2 build
+      vectorextensions "AVX2"
+      includedirs { "src", "bench" }
+      includedirs { "libs/tinyobjloader" }
+      files { "bench/*.h", "bench/*.cpp" }
+      files { "src/frame_ring.h", "src/frame_ring.cpp"}
+      files { "src/upload_ring.h", "src/upload_ring.cpp"}
+      files { "src/upload_batcher.h", "src/upload_batcher.cpp"}
+      files { "src/cpu_math.h", "src/frustum_cull.h", "src/frustum_cull.cpp"}
+      files { "src/bvh.h", "src/bvh.cpp"}
+      files { "src/render_queue.h", "src/render_queue.cpp"}
+      files { "src/profiler.h", "src/profiler.cpp"}
+      files { "src/frame_scheduler.h", "src/frame_scheduler.cpp"}
+      files { "src/shader_cache.h", "src/shader_cache.cpp"}
+      files { "src/hot_reload.h", "src/hot_reload.cpp"}
+      files { "src/job_system.h", "src/job_system.cpp"}
+      files { "src/command_sink.h", "src/scene_pipeline.h", "src/scene_pipeline.cpp"}
+      files { "src/occlusion_cull.h", "src/occlusion_cull.cpp"}
+      files { "src/parallel_record.h", "src/parallel_record.cpp"}
+      files { "src/render_graph.h", "src/render_graph.cpp"}
+      files { "src/descriptor_allocator.h", "src/descriptor_allocator.cpp"}
+      files { "src/mesh_lod.h", "src/mesh_lod.cpp"}
+      files { "src/vertex_format.h", "src/vertex_format.cpp"}
+      files { "src/soft_raster.h", "src/soft_raster.cpp"}
+      files { "src/asset_streamer.h", "src/asset_streamer.cpp"}
+      files { "src/transform_hierarchy.h", "src/transform_hierarchy.cpp"}
+      files { "src/gpu_heap_allocator.h", "src/gpu_heap_allocator.cpp"}
+      files { "src/mesh_builder.h", "src/mesh_builder.cpp"}
+      files { "src/obj_mesh.h", "src/obj_mesh.cpp"}
+      files { "src/obj_parallel.h", "src/obj_parallel.cpp"}
+      files { "src/mapped_file.h", "src/mapped_file.cpp"}
+      files { "src/mesh_cache.h", "src/mesh_cache.cpp"}
+      files { "libs/tinyobjloader/tiny_obj_loader.h"}
+
+   project "Pipeline benchmarks"
+      kind "ConsoleApp"
+      includedirs { "src", "bench" }
+      includedirs { "libs/tinyobjloader" }
+      files { "bench/benchmark.h", "bench/pipeline/*.cpp" }
+      files { "src/mesh_builder.h", "src/mesh_builder.cpp"}
+      files { "src/obj_mesh.h", "src/obj_mesh.cpp"}
+      files { "src/obj_parallel.h", "src/obj_parallel.cpp"}
+      files { "src/mapped_file.h", "src/mapped_file.cpp"}
+      files { "src/cpu_math.h", "src/frustum_cull.h", "src/frustum_cull.cpp"}
+      files { "src/bvh.h", "src/bvh.cpp"}
+      files { "src/render_queue.h", "src/render_queue.cpp"}
+      files { "src/command_sink.h", "src/scene_pipeline.h", "src/scene_pipeline.cpp"}
+      files { "src/occlusion_cull.h", "src/occlusion_cull.cpp"}
+      files { "src/mesh_lod.h", "src/mesh_lod.cpp"}
+      files { "libs/tinyobjloader/tiny_obj_loader.h"}
+
+   project "Tests"
+      kind "ConsoleApp"
+      includedirs { "src", "tests" }
+      includedirs { "libs/tinyobjloader" }
+      files { "tests/*.h", "tests/*.cpp" }
+      files { "src/mesh_builder.h", "src/mesh_builder.cpp"}
+      files { "src/obj_mesh.h", "src/obj_mesh.cpp"}
+      files { "src/obj_parallel.h", "src/obj_parallel.cpp"}
+      files { "src/frame_ring.h", "src/frame_ring.cpp"}
+      files { "src/frame_scheduler.h", "src/frame_scheduler.cpp"}
+      files { "src/upload_ring.h", "src/upload_ring.cpp"}
+      files { "src/upload_batcher.h", "src/upload_batcher.cpp"}
+      files { "src/shader_cache.h", "src/shader_cache.cpp"}
+      files { "src/hot_reload.h", "src/hot_reload.cpp", "src/mapped_file.h", "src/mapped_file.cpp"}
+      files { "src/cpu_math.h", "src/frustum_cull.h", "src/frustum_cull.cpp"}
+      files { "src/bvh.h", "src/bvh.cpp"}
+      files { "src/render_queue.h", "src/render_queue.cpp"}
+      files { "src/command_sink.h", "src/scene_pipeline.h", "src/scene_pipeline.cpp"}
+      files { "src/occlusion_cull.h", "src/occlusion_cull.cpp"}
+      files { "src/mesh_lod.h", "src/mesh_lod.cpp"}
+      files { "src/job_system.h", "src/job_system.cpp"}
+      files { "src/parallel_record.h", "src/parallel_record.cpp"}
+      files { "src/profiler.h", "src/profiler.cpp"}
+      files { "src/render_graph.h", "src/render_graph.cpp"}
+      files { "src/mesh_cache.h", "src/mesh_cache.cpp"}
+      files { "src/asset_streamer.h", "src/asset_streamer.cpp"}
+      files { "src/gpu_heap_allocator.h", "src/gpu_heap_allocator.cpp"}
+      files { "libs/tinyobjloader/tiny_obj_loader.h"}
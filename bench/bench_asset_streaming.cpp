@@ -0,0 +1,291 @@
+#include "asset_streamer.h"
+#include "benchmark.h"
+#include "obj_mesh.h"
+#include "scene_pipeline.h"
+#include "upload_batcher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const double frame_interval_ms = 1000.0 / 60.0;
+
+	// Copies execute latency frames after their submission, like a copy queue running behind the CPU
+	class MockCopyBackend : public CopyBackend
+	{
+	public:
+		MockCopyBackend(uint64_t staging_size, uint64_t latency) : staging(staging_size), latency(latency), frame(0), next_fence(1), completed(0) {};
+
+		uint8_t *GetStagingMemory() override { return staging.data(); }
+
+		void CopyToBuffer(void *destination, uint64_t destination_offset, uint64_t staging_offset, uint64_t size) override
+		{
+			recording.push_back({static_cast<uint8_t *>(destination), destination_offset, staging_offset, size});
+		}
+
+		uint64_t Submit() override
+		{
+			in_flight.push_back({next_fence, frame, recording});
+			recording.clear();
+			return next_fence++;
+		}
+
+		uint64_t GetCompletedValue() override { return completed; }
+
+		void WaitForValue(uint64_t value) override
+		{
+			while (completed < value && !in_flight.empty()) {
+				Execute();
+			}
+		}
+
+		// End of a frame
+		void Tick()
+		{
+			frame++;
+			while (!in_flight.empty() && in_flight.front().frame + latency <= frame) {
+				Execute();
+			}
+		}
+
+	private:
+		struct Copy
+		{
+			uint8_t *destination;
+			uint64_t destination_offset;
+			uint64_t staging_offset;
+			uint64_t size;
+		};
+
+		struct Batch
+		{
+			uint64_t fence;
+			uint64_t frame;
+			std::vector<Copy> copies;
+		};
+
+		void Execute()
+		{
+			for (const Copy &copy : in_flight.front().copies) {
+				memcpy(copy.destination + copy.destination_offset, staging.data() + copy.staging_offset, copy.size);
+			}
+			completed = in_flight.front().fence;
+			in_flight.pop_front();
+		}
+
+		std::vector<uint8_t> staging;
+		std::vector<Copy> recording;
+		std::deque<Batch> in_flight;
+		uint64_t latency;
+		uint64_t frame;
+		uint64_t next_fence;
+		uint64_t completed;
+	};
+
+	// Vertex and index buffers in uninitialized memory like fresh GPU buffers, filled through the batcher
+	class MockStreamTarget : public StreamTarget
+	{
+	public:
+		MockStreamTarget(MockCopyBackend &backend, uint64_t staging_size) :
+			backend(backend), batcher(backend, staging_size) {};
+
+		void Reserve(uint64_t vertex_count, uint64_t index_count, const float *, const float *) override
+		{
+			vertices.reset(new uint8_t[vertex_count * sizeof(MeshVertex)]);
+			indices.reset(new uint8_t[index_count * sizeof(uint32_t)]);
+		}
+
+		uint64_t GetUploadSize(uint64_t vertex_count, uint64_t index_count) const override
+		{
+			return vertex_count * sizeof(MeshVertex) + index_count * sizeof(uint32_t);
+		}
+
+		void UploadVertices(uint64_t first_vertex, const MeshVertex *data, size_t count) override
+		{
+			batcher.Upload(vertices.get(), first_vertex * sizeof(MeshVertex), data, count * sizeof(MeshVertex));
+		}
+
+		void UploadIndices(uint64_t first_index, const uint32_t *data, size_t count) override
+		{
+			batcher.Upload(indices.get(), first_index * sizeof(uint32_t), data, count * sizeof(uint32_t));
+		}
+
+		uint64_t Submit() override { return batcher.Flush(); }
+
+		uint64_t GetCompletedValue() override { return backend.GetCompletedValue(); }
+
+	private:
+		MockCopyBackend &backend;
+		UploadBatcher batcher;
+		std::unique_ptr<uint8_t[]> vertices;
+		std::unique_ptr<uint8_t[]> indices;
+	};
+
+	// A city block grid: one group per tile, each a noisy height field, four materials
+	size_t WriteSyntheticScene(const std::string &path, size_t quad_count, uint32_t tiles_per_side)
+	{
+		const std::string mtlName = path.substr(0, path.size() - 3) + "mtl";
+		std::ofstream mtl(mtlName, std::ios::binary);
+		for (int m = 0; m < 4; m++) {
+			mtl << "newmtl tile_" << m << "\nKd " << 0.2 + 0.2 * m << " 0.5 " << 0.8 - 0.2 * m << "\n";
+		}
+		mtl.close();
+
+		const uint32_t tileCount = tiles_per_side * tiles_per_side;
+		const size_t side = std::max<size_t>(2, static_cast<size_t>(sqrt(static_cast<double>(quad_count / tileCount)))) + 1;
+		const float tileSize = 10.0f;
+		std::ofstream obj(path, std::ios::binary);
+		obj << "# synthetic streaming scene\nmtllib " << mtlName.substr(mtlName.find_last_of("\\/") + 1) << "\n";
+		char line[128];
+		for (uint32_t tile = 0; tile < tileCount; tile++) {
+			const float x0 = (tile % tiles_per_side) * tileSize;
+			const float z0 = (tile / tiles_per_side) * tileSize;
+			obj << "g tile_" << tile << "\nusemtl tile_" << tile % 4 << "\n";
+			for (size_t z = 0; z < side; z++) {
+				for (size_t x = 0; x < side; x++) {
+					const float u = static_cast<float>(x) / (side - 1);
+					const float v = static_cast<float>(z) / (side - 1);
+					snprintf(line, sizeof(line), "v %.4f %.4f %.4f\n", x0 + u * tileSize * 0.9f,
+						sinf(u * 9.0f + tile) * cosf(v * 7.0f) * 0.5f + 0.5f, z0 + v * tileSize * 0.9f);
+					obj << line;
+				}
+			}
+			// Relative indices, so every tile is self-contained like an exported group
+			const long long count = static_cast<long long>(side * side);
+			for (size_t z = 0; z + 1 < side; z++) {
+				for (size_t x = 0; x + 1 < side; x++) {
+					const long long a = static_cast<long long>(z * side + x) - count;
+					const long long d = a + static_cast<long long>(side);
+					snprintf(line, sizeof(line), "f %lld %lld %lld %lld\n", a, d, d + 1, a + 1);
+					obj << line;
+				}
+			}
+		}
+		obj.close();
+		std::ifstream size(path, std::ios::binary | std::ios::ate);
+		return static_cast<size_t>(size.tellg());
+	}
+
+	Camera GetCamera()
+	{
+		Camera camera = {};
+		camera.eye = {-5.0f, 8.0f, -5.0f};
+		camera.look_at = {40.0f, 0.0f, 40.0f};
+		camera.up = {0.0f, 1.0f, 0.0f};
+		camera.fov_y = 3.14159265f / 3.0f;
+		camera.aspect = 16.0f / 9.0f;
+		camera.near_z = 0.1f;
+		camera.far_z = 1000.0f;
+		return camera;
+	}
+
+	struct FrameResults
+	{
+		double first_visible_ms;
+		double finished_ms;
+		double worst_frame_ms;
+		double p99_frame_ms;
+		size_t frames;
+	};
+
+	// Paced at 60 Hz so the streaming threads get the idle part of each frame, as they would behind vsync
+	FrameResults RunFrames(AssetStreamer &streamer, MockCopyBackend &backend, double timeout_ms)
+	{
+		FrameResults results = {-1.0, -1.0, 0.0, 0.0, 0};
+		ScenePipeline scene;
+		scene.SetLodSelection(720.0f, 1.0f);
+		scene.UpdateCamera(GetCamera());
+		NullCommandSink sink;
+		std::vector<double> frameTimes;
+
+		BenchmarkTimer total;
+		while (total.Milliseconds() < timeout_ms) {
+			BenchmarkTimer frame;
+			if (streamer.Update(GetCamera().eye)) {
+				scene.SetShapes(streamer.GetShapes().data(), streamer.GetShapes().size());
+				scene.SetLods(streamer.GetLods());
+			}
+			scene.UpdateCamera(GetCamera());
+			scene.Cull();
+			scene.SortDraws();
+			sink.draw_count = 0;
+			scene.Record(sink, 0x1000);
+			backend.Tick();
+			frameTimes.push_back(frame.Milliseconds());
+
+			if (results.first_visible_ms < 0.0 && sink.draw_count > 0) {
+				results.first_visible_ms = total.Milliseconds();
+			}
+			if (streamer.GetState() != StreamState::Streaming && streamer.GetState() != StreamState::Opening) {
+				results.finished_ms = total.Milliseconds();
+				break;
+			}
+			const double rest = frame_interval_ms - frame.Milliseconds();
+			if (rest > 0.0) {
+				std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(rest));
+			}
+		}
+
+		results.frames = frameTimes.size();
+		if (!frameTimes.empty()) {
+			std::sort(frameTimes.begin(), frameTimes.end());
+			results.worst_frame_ms = frameTimes.back();
+			results.p99_frame_ms = frameTimes[std::min(frameTimes.size() - 1, frameTimes.size() * 99 / 100)];
+		}
+		return results;
+	}
+
+	bool AssetStreamingBenchmark(const BenchmarkArgs &args)
+	{
+		const size_t quads = std::max<size_t>(20000, static_cast<size_t>(500000 * args.scale));
+		const std::string path = "streaming_bench.obj";
+		const size_t bytes = WriteSyntheticScene(path, quads, 8);
+		std::cout << "Synthetic scene: 64 tiles, " << quads * 2 << " triangles, " << bytes / (1024.0 * 1024.0) << " MB" << std::endl;
+
+		// Blocking load: nothing is drawn until the whole model is parsed, welded and uploaded
+		Mesh mesh;
+		MeshStats meshStats;
+		std::string warn;
+		std::string err;
+		BenchmarkTimer timer;
+		if (!LoadObjMesh(path, mesh, meshStats, warn, err)) {
+			std::cout << "  " << err << std::endl;
+			return false;
+		}
+		const double blockingMs = timer.Milliseconds();
+		std::cout << "Blocking LoadObjMesh: first frame after " << blockingMs << " ms, stalled for all of it" << std::endl;
+
+		const unsigned threads = std::max(1u, args.threads);
+		ObjStreamSource source(path);
+		MockCopyBackend backend(4 << 20, 2);
+		MockStreamTarget target(backend, 4 << 20);
+		AssetStreamerSettings settings;
+		settings.thread_count = threads;
+		AssetStreamer streamer(source, target, settings);
+		streamer.Start();
+		const FrameResults frames = RunFrames(streamer, backend, 120000.0);
+		const AssetStreamerStats stats = streamer.GetStats();
+
+		std::cout << "Streaming (" << threads << " threads, " << stats.chunk_count << " chunks, " << settings.frame_upload_budget / 1024
+			<< " KiB per frame): first visible frame after " << frames.first_visible_ms << " ms, complete after " << frames.finished_ms
+			<< " ms (" << frames.frames << " frames), frame time worst " << frames.worst_frame_ms << " ms, p99 " << frames.p99_frame_ms
+			<< " ms, most bytes in a frame " << stats.max_frame_bytes / 1024 << " KiB" << std::endl;
+
+		const bool ok = Check("finished", streamer.GetState() == StreamState::Finished && stats.failed_chunks == 0);
+
+		std::remove(path.c_str());
+		std::remove((path.substr(0, path.size() - 3) + "mtl").c_str());
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("asset_streaming", AssetStreamingBenchmark);
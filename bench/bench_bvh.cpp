@@ -0,0 +1,162 @@
+#include "benchmark.h"
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	bool BoxInFrustum(const Frustum &frustum, const Aabb &box)
+	{
+		for (const Plane &p : frustum.planes) {
+			const float px = p.a >= 0.0f ? box.bounds_max[0] : box.bounds_min[0];
+			const float py = p.b >= 0.0f ? box.bounds_max[1] : box.bounds_min[1];
+			const float pz = p.c >= 0.0f ? box.bounds_max[2] : box.bounds_min[2];
+			if (p.a * px + p.b * py + p.c * pz + p.d < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	float BruteForceRay(const std::vector<Aabb> &boxes, const Float3 &origin, const Float3 &direction, float max_distance)
+	{
+		const float o[3] = {origin.x, origin.y, origin.z};
+		const float d[3] = {direction.x, direction.y, direction.z};
+		float best = FLT_MAX;
+		for (const Aabb &box : boxes) {
+			float nearT = 0.0f, farT = max_distance;
+			for (int axis = 0; axis < 3; axis++) {
+				float t0 = (box.bounds_min[axis] - o[axis]) / d[axis];
+				float t1 = (box.bounds_max[axis] - o[axis]) / d[axis];
+				if (t0 > t1) {
+					std::swap(t0, t1);
+				}
+				nearT = std::max(nearT, t0);
+				farT = std::min(farT, t1);
+			}
+			if (nearT <= farT) {
+				best = std::min(best, nearT);
+			}
+		}
+		return best;
+	}
+
+	bool BvhBenchmark(const BenchmarkArgs &args)
+	{
+		const size_t objects = std::max<size_t>(1024, static_cast<size_t>(200000 * args.scale));
+
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+		std::uniform_real_distribution<float> size(0.5f, 5.0f);
+		std::vector<Aabb> boxes(objects);
+		for (Aabb &box : boxes) {
+			for (int axis = 0; axis < 3; axis++) {
+				box.bounds_min[axis] = position(random);
+				box.bounds_max[axis] = box.bounds_min[axis] + size(random);
+			}
+		}
+
+		Bvh bvh;
+		BenchmarkTimer timer;
+		bvh.Build(boxes.data(), boxes.size());
+		const double buildMs = timer.Milliseconds();
+		std::cout << objects << " objects: build " << buildMs << " ms, " << bvh.GetNodes().size() << " nodes, depth "
+			<< bvh.GetDepth() << std::endl;
+
+		// Move every object a little, as animated objects would between frames
+		std::uniform_real_distribution<float> jitter(-0.5f, 0.5f);
+		for (Aabb &box : boxes) {
+			for (int axis = 0; axis < 3; axis++) {
+				const float offset = jitter(random);
+				box.bounds_min[axis] += offset;
+				box.bounds_max[axis] += offset;
+			}
+		}
+		timer.Reset();
+		bvh.Refit(boxes.data());
+		std::cout << "Refit: " << timer.Milliseconds() << " ms" << std::endl;
+
+		// Frustum queries from cameras spread through the scene, checked against a brute-force box test
+		const Float4x4 projection = MatrixPerspectiveFovLH(60.0f / 180.0f * 3.14159265f, 16.0f / 9.0f, 0.1f, 100.0f);
+		const int cameras = 64;
+		std::vector<Frustum> frustums;
+		for (int i = 0; i < cameras; i++) {
+			const Float3 eye = {position(random), position(random), position(random)};
+			const Float3 at = eye + Float3{jitter(random), jitter(random), 1.0f};
+			frustums.push_back(ExtractFrustum(MatrixMultiply(MatrixLookAtLH(eye, at, {0.0f, 1.0f, 0.0f}), projection)));
+		}
+
+		size_t frustumMismatches = 0;
+		size_t visibleTotal = 0;
+		std::vector<uint32_t> visible;
+		for (const Frustum &frustum : frustums) {
+			visible.clear();
+			bvh.QueryFrustum(frustum, visible);
+			std::sort(visible.begin(), visible.end());
+			std::vector<uint32_t> reference;
+			for (size_t i = 0; i < boxes.size(); i++) {
+				if (BoxInFrustum(frustum, boxes[i])) {
+					reference.push_back(static_cast<uint32_t>(i));
+				}
+			}
+			frustumMismatches += visible != reference ? 1 : 0;
+			visibleTotal += reference.size();
+		}
+
+		timer.Reset();
+		for (const Frustum &frustum : frustums) {
+			visible.clear();
+			bvh.QueryFrustum(frustum, visible);
+			DoNotOptimize(visible.size());
+		}
+		const double bvhUs = timer.Milliseconds() * 1000.0 / cameras;
+
+		CullBounds bounds;
+		bounds.Reserve(objects);
+		for (const Aabb &box : boxes) {
+			bounds.Add(box.bounds_min, box.bounds_max);
+		}
+		visible.resize(objects);
+		timer.Reset();
+		for (const Frustum &frustum : frustums) {
+			DoNotOptimize(CullFrustum(frustum, bounds, visible.data()));
+		}
+		const double flatUs = timer.Milliseconds() * 1000.0 / cameras;
+
+		std::cout << "Frustum query: " << bvhUs << " us (BVH) vs " << flatUs << " us (flat " << GetCullKernelName()
+			<< "), " << visibleTotal / cameras << " visible on average, " << frustumMismatches << " mismatches" << std::endl;
+
+		// Picking rays, the first few checked against brute force
+		const int rays = std::max(1000, static_cast<int>(100000 * args.scale));
+		std::vector<Float3> origins(rays), directions(rays);
+		for (int i = 0; i < rays; i++) {
+			origins[i] = {position(random), position(random), position(random)};
+			directions[i] = Normalize({jitter(random), jitter(random), jitter(random) + 0.01f});
+		}
+
+		// Brute force divides where the BVH multiplies by the inverse direction, so allow rounding differences
+		size_t rayMismatches = 0;
+		for (int i = 0; i < 200; i++) {
+			RayHit hit;
+			const float expected = BruteForceRay(boxes, origins[i], directions[i], 1000.0f);
+			const float got = bvh.Raycast(origins[i], directions[i], 1000.0f, hit) ? hit.distance : FLT_MAX;
+			rayMismatches += fabsf(got - expected) > 1e-3f * std::max(1.0f, expected) ? 1 : 0;
+		}
+
+		size_t hits = 0;
+		timer.Reset();
+		for (int i = 0; i < rays; i++) {
+			RayHit hit;
+			hits += bvh.Raycast(origins[i], directions[i], 1000.0f, hit) ? 1 : 0;
+		}
+		const double rayMs = timer.Milliseconds();
+		std::cout << "Raycast: " << rays / rayMs * 1e-3 << " Mrays/s, " << hits << " hits, " << rayMismatches
+			<< " mismatches in 200 brute-force checks" << std::endl;
+		return frustumMismatches == 0 && rayMismatches == 0;
+	}
+}
+
+REGISTER_BENCHMARK("bvh", BvhBenchmark);
@@ -0,0 +1,174 @@
+#include "benchmark.h"
+#include "descriptor_allocator.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	// Pages are plain address ranges; nothing is ever written to them
+	class FakeDescriptorPageSource : public DescriptorPageSource
+	{
+	public:
+		FakeDescriptorPageSource() : next_address(0x10000), live_pages(0) {};
+
+		bool CreatePage(uint32_t capacity, DescriptorPage &page) override
+		{
+			page.cpu_start = next_address;
+			page.gpu_start = 0;
+			page.capacity = capacity;
+			page.heap = nullptr;
+			next_address += static_cast<uint64_t>(capacity) * descriptor_size + 0x10000;
+			live_pages++;
+			return true;
+		}
+
+		void DestroyPage(DescriptorPage &page) override
+		{
+			live_pages--;
+			page = {};
+		}
+
+		uint32_t GetDescriptorSize() const override { return descriptor_size; }
+
+		static const uint32_t descriptor_size = 32;
+		uint64_t next_address;
+		int live_pages;
+	};
+
+	bool CheckAllocator()
+	{
+		bool ok = true;
+		FakeDescriptorPageSource source;
+		{
+			DescriptorAllocator allocator(source, 256);
+			const DescriptorAllocation first = allocator.Allocate();
+			const DescriptorAllocation second = allocator.Allocate();
+			ok &= Check("adjacent", second.cpu_address == first.cpu_address + FakeDescriptorPageSource::descriptor_size);
+			allocator.Free(first);
+			ok &= Check("reuse", allocator.Allocate().cpu_address == first.cpu_address);
+
+			// A range of 5 takes a block of 8; freeing it lets two ranges of 4 split it
+			const DescriptorAllocation table = allocator.Allocate(5);
+			ok &= Check("rounding", allocator.GetStats().reserved - allocator.GetStats().allocated == 3);
+			allocator.Free(table);
+			const DescriptorAllocation low = allocator.Allocate(8);
+			ok &= Check("class reuse", low.cpu_address == table.cpu_address);
+			allocator.Free(low);
+
+			// Filling the page adds another; every range stays inside its page
+			std::vector<DescriptorAllocation> allocations;
+			for (int i = 0; i < 200; i++) {
+				allocations.push_back(allocator.Allocate(1 + i % 7));
+			}
+			ok &= Check("growth", allocator.GetStats().page_count > 1 && source.live_pages == static_cast<int>(allocator.GetStats().page_count));
+			for (const DescriptorAllocation &allocation : allocations) {
+				ok &= Check("inside page", allocation.index + allocation.count <= allocator.GetPage(allocation.page).capacity);
+				ok &= Check("address", allocation.cpu_address == allocator.GetPage(allocation.page).cpu_start +
+					static_cast<uint64_t>(allocation.index) * FakeDescriptorPageSource::descriptor_size);
+			}
+
+			// Live ranges never overlap
+			std::sort(allocations.begin(), allocations.end(), [](const DescriptorAllocation &a, const DescriptorAllocation &b) {
+				return a.cpu_address < b.cpu_address;
+			});
+			for (size_t i = 1; i < allocations.size(); i++) {
+				ok &= Check("overlap", allocations[i - 1].cpu_address + allocations[i - 1].count * FakeDescriptorPageSource::descriptor_size <=
+					allocations[i].cpu_address);
+			}
+
+			bool threw = false;
+			try {
+				allocator.Allocate(257);
+			} catch (const std::bad_alloc &) {
+				threw = true;
+			}
+			ok &= Check("oversized range", threw);
+		}
+		ok &= Check("pages released", source.live_pages == 0);
+		std::cout << "Allocator: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+
+	bool CheckRing()
+	{
+		bool ok = true;
+		DescriptorRing ring(100);
+		uint32_t index = 0;
+		ok &= Check("first", ring.Allocate(40, index) && index == 0);
+		ring.Close(1);
+		ok &= Check("second", ring.Allocate(40, index) && index == 40);
+		ring.Close(2);
+		// 30 do not fit before the end and the start is still in flight
+		ok &= Check("full", !ring.Allocate(30, index));
+		ring.Retire(1);
+		ok &= Check("wrap", ring.Allocate(30, index) && index == 0 && ring.GetStats().wrap_waste == 20);
+		ring.Close(3);
+		ok &= Check("in use", ring.GetStats().in_use == 90);
+		ring.Retire(3);
+		ok &= Check("retired", ring.GetStats().in_use == 0 && ring.GetStats().peak_in_use == 90);
+		std::cout << "Descriptor ring: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+
+	// Churn like streaming objects in and out: random frees and allocations of mixed table sizes
+	void MeasureChurn(const BenchmarkArgs &args)
+	{
+		const size_t operationCount = std::max<size_t>(10000, static_cast<size_t>(2000000 * args.scale));
+		FakeDescriptorPageSource source;
+		DescriptorAllocator allocator(source, 4096);
+		std::vector<DescriptorAllocation> live;
+		uint32_t random = 12345;
+		// Mostly single descriptors, some tables of up to 16
+		auto nextCount = [&random]() {
+			random = random * 1664525u + 1013904223u;
+			return (random >> 28) < 12 ? 1u : 1u + (random >> 24) % 16;
+		};
+		for (int i = 0; i < 20000; i++) {
+			live.push_back(allocator.Allocate(nextCount()));
+		}
+		const uint32_t filledPages = allocator.GetStats().page_count;
+
+		BenchmarkTimer timer;
+		for (size_t i = 0; i < operationCount; i++) {
+			random = random * 1664525u + 1013904223u;
+			const size_t victim = (random >> 8) % live.size();
+			allocator.Free(live[victim]);
+			live[victim] = allocator.Allocate(nextCount());
+		}
+		const double ms = timer.Milliseconds();
+
+		const DescriptorAllocatorStats &stats = allocator.GetStats();
+		std::cout << operationCount << " free/allocate pairs: " << ms * 1e6 / operationCount << " ns per pair, " << filledPages << " pages after filling, "
+			<< stats.page_count << " after churn, " << stats.allocated << " descriptors live in " << stats.reserved << " reserved of " << stats.capacity
+			<< ", largest free block " << stats.largest_free << ", " << stats.merges << " merges, fragmentation " << stats.GetFragmentation() * 100.0
+			<< "% of free, rounding waste " << stats.GetRoundingWaste() * 100.0 << "% of reserved" << std::endl;
+
+		DescriptorRing ring(16384);
+		uint32_t index = 0;
+		uint64_t failures = 0;
+		timer.Reset();
+		for (size_t frame = 0; frame < operationCount / 1000; frame++) {
+			for (int table = 0; table < 1000; table++) {
+				failures += ring.Allocate(1 + table % 8, index) ? 0 : 1;
+			}
+			ring.Close(frame + 1);
+			// Three frames in flight
+			if (frame >= 2) {
+				ring.Retire(frame - 1);
+			}
+		}
+		std::cout << "Descriptor ring: " << timer.Milliseconds() * 1e6 / (operationCount / 1000 * 1000) << " ns per table, peak "
+			<< ring.GetStats().peak_in_use << " of " << ring.GetStats().capacity << ", " << failures << " failed" << std::endl;
+	}
+
+	bool DescriptorAllocatorBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = CheckAllocator();
+		ok &= CheckRing();
+		MeasureChurn(args);
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("descriptor_allocator", DescriptorAllocatorBenchmark);
@@ -0,0 +1,131 @@
+#include "benchmark.h"
+#include "frame_ring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	// Queue whose "GPU" executes submitted work on its own thread and then signals fence values
+	class SimulatedQueue : public FenceTimeline
+	{
+	public:
+		SimulatedQueue() : completed(0), stop(false)
+		{
+			worker = std::thread([this]() { Run(); });
+		}
+
+		~SimulatedQueue()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stop = true;
+			}
+			work_added.notify_all();
+			worker.join();
+		}
+
+		void Submit(double milliseconds)
+		{
+			Push({milliseconds, 0});
+		}
+
+		void Signal(uint64_t value) override
+		{
+			Push({0.0, value});
+		}
+
+		uint64_t GetCompletedValue() override
+		{
+			return completed.load();
+		}
+
+		void WaitForValue(uint64_t value) override
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			value_completed.wait(lock, [&]() { return completed.load() >= value; });
+		}
+
+	private:
+		struct Item
+		{
+			double milliseconds;
+			uint64_t signal;
+		};
+
+		void Push(const Item &item)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				items.push_back(item);
+			}
+			work_added.notify_one();
+		}
+
+		void Run()
+		{
+			for (;;) {
+				Item item;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work_added.wait(lock, [&]() { return stop || !items.empty(); });
+					if (items.empty()) {
+						return;
+					}
+					item = items.front();
+					items.pop_front();
+				}
+
+				if (item.milliseconds > 0.0) {
+					std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(item.milliseconds));
+				}
+				if (item.signal != 0) {
+					std::lock_guard<std::mutex> lock(mutex);
+					completed.store(item.signal);
+					value_completed.notify_all();
+				}
+			}
+		}
+
+		std::thread worker;
+		std::mutex mutex;
+		std::condition_variable work_added;
+		std::condition_variable value_completed;
+		std::deque<Item> items;
+		std::atomic<uint64_t> completed;
+		bool stop;
+	};
+
+	bool FrameRingBenchmark(const BenchmarkArgs &args)
+	{
+		const double cpuMs = 2.0;
+		const double gpuMs = 3.0;
+		const int frames = std::max(20, static_cast<int>(200 * args.scale));
+		std::cout << "CPU " << cpuMs << " ms + GPU " << gpuMs << " ms per frame, " << frames << " frames" << std::endl;
+
+		for (uint32_t framesInFlight = 1; framesInFlight <= 3; framesInFlight++) {
+			SimulatedQueue queue;
+			FrameRing ring(queue, framesInFlight);
+
+			BenchmarkTimer timer;
+			for (int i = 0; i < frames; i++) {
+				ring.BeginFrame();
+				std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(cpuMs));
+				queue.Submit(gpuMs);
+				ring.EndFrame();
+			}
+			ring.WaitForIdle();
+			const double elapsed = timer.Milliseconds();
+
+			std::cout << framesInFlight << " in flight: " << elapsed / frames << " ms/frame, " << ring.GetWaitCount() << " CPU waits" << std::endl;
+		}
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("frame_ring", FrameRingBenchmark);
@@ -0,0 +1,135 @@
+#include "benchmark.h"
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Sleeps return immediately and move time forward, so a run takes as long as the bookkeeping
+	class SimulatedClock : public SchedulerClock
+	{
+	public:
+		SimulatedClock() : now(1000000000) {};
+
+		uint64_t Now() override { return now; }
+		void SleepUntil(uint64_t time) override { now = std::max(now, time); }
+		void Advance(uint64_t duration) { now += duration; }
+
+	private:
+		uint64_t now;
+	};
+
+	FrameSchedulerSettings MakeSettings(FramePacing pacing, double frameRate)
+	{
+		FrameSchedulerSettings settings = GetDefaultSchedulerSettings();
+		settings.pacing = pacing;
+		settings.max_frame_rate = frameRate;
+		return settings;
+	}
+
+	// A body moving at 1 unit/s must end up at the elapsed time whatever the render cost
+	void MeasureRateIndependence(const BenchmarkArgs &args)
+	{
+		const double seconds = std::max(1.0, 10.0 * args.scale);
+		const double workMs[] = {0.5, 4.0, 16.7, 33.3, 45.0};
+		for (double work : workMs) {
+			SimulatedClock clock;
+			FrameScheduler scheduler(clock, MakeSettings(FramePacing::None, 0.0));
+			const uint64_t start = clock.Now();
+
+			double previous = 0.0;
+			double position = 0.0;
+			double rendered = 0.0;
+			uint64_t updates = 0;
+			while (clock.Now() - start < static_cast<uint64_t>(seconds * 1e9)) {
+				const FrameTiming timing = scheduler.BeginFrame();
+				for (uint32_t i = 0; i < timing.update_count; i++) {
+					previous = position;
+					position += timing.fixed_step;
+				}
+				updates += timing.update_count;
+				rendered = previous + (position - previous) * timing.alpha;
+				clock.Advance(static_cast<uint64_t>(work * 1e6));
+				scheduler.EndFrame();
+			}
+
+			// The rendered position trails the last frame start by one step through interpolation
+			const FrameTimeStats stats = scheduler.GetStats();
+			const double expected = (clock.Now() - start) * 1e-9 - work * 1e-3 - 1.0 / scheduler.GetSettings().update_rate;
+			const double error = std::fabs(rendered - expected);
+			std::cout << "Work " << work << " ms: " << stats.fps << " fps, " << updates << " updates, position " << rendered
+				<< " (error " << error * 1e3 << " ms)" << std::endl;
+		}
+	}
+
+	// Frame period and how late each frame starts relative to its presentation deadline
+	void MeasurePacing()
+	{
+		const FramePacing modes[] = {FramePacing::None, FramePacing::Cap, FramePacing::LowLatency};
+		const char *names[] = {"none", "cap", "low latency"};
+		for (int mode = 0; mode < 3; mode++) {
+			SimulatedClock clock;
+			FrameScheduler scheduler(clock, MakeSettings(modes[mode], 60.0));
+
+			// Alternating 2 and 3 ms of work; latency is frame start to the end of its 16.7 ms slot
+			double latency = 0.0;
+			const int frameCount = 600;
+			uint64_t slotEnd = 0;
+			for (int frame = 0; frame < frameCount; frame++) {
+				scheduler.BeginFrame();
+				const uint64_t start = clock.Now();
+				if (frame == 0) {
+					slotEnd = start;
+				}
+				clock.Advance(frame % 2 ? 3000000 : 2000000);
+				slotEnd = std::max(slotEnd + 16666666, clock.Now());
+				latency += (slotEnd - start) * 1e-6;
+				scheduler.EndFrame();
+			}
+
+			const FrameTimeStats stats = scheduler.GetStats();
+			const double busy = 100.0 * stats.work_ms / stats.avg_ms;
+			std::cout << "Pacing " << names[mode] << ": avg " << stats.avg_ms << " ms, p99 " << stats.p99_ms << " ms, busy " << busy
+				<< "%, slept " << stats.slept_ms << " ms";
+			if (modes[mode] != FramePacing::None) {
+				std::cout << ", input to deadline " << latency / frameCount << " ms";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	// Real clock: how closely sleeps hit a 120 Hz cap
+	void MeasureSteadyClock(const BenchmarkArgs &args)
+	{
+		SteadyClock clock;
+		FrameScheduler scheduler(clock, MakeSettings(FramePacing::Cap, 120.0));
+		const int frameCount = std::max(30, static_cast<int>(120 * args.scale));
+
+		BenchmarkTimer timer;
+		for (int frame = 0; frame < frameCount; frame++) {
+			scheduler.BeginFrame();
+			const uint64_t end = clock.Now() + 1000000;
+			while (clock.Now() < end) {
+			}
+			scheduler.EndFrame();
+		}
+		const double ms = timer.Milliseconds();
+
+		const FrameTimeStats stats = scheduler.GetStats();
+		std::cout << "Steady clock at 120 Hz: " << frameCount << " frames in " << ms << " ms, min " << stats.min_ms << " ms, avg "
+			<< stats.avg_ms << " ms, p99 " << stats.p99_ms << " ms, max " << stats.max_ms << " ms, " << 100.0 * stats.slept_ms / ms
+			<< "% asleep" << std::endl;
+	}
+
+	bool FrameSchedulerBenchmark(const BenchmarkArgs &args)
+	{
+		MeasureRateIndependence(args);
+		MeasurePacing();
+		MeasureSteadyClock(args);
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("frame_scheduler", FrameSchedulerBenchmark);
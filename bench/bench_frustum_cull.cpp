@@ -0,0 +1,79 @@
+#include "benchmark.h"
+#include "frustum_cull.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	typedef size_t (*CullKernel)(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible);
+
+	// Best of a few runs, in ns per object; also checks the result against the scalar kernel
+	double Measure(CullKernel kernel, const Frustum &frustum, const CullBounds &bounds,
+		const std::vector<uint32_t> &reference, size_t referenceCount, bool &matches)
+	{
+		std::vector<uint32_t> visible(bounds.GetCount());
+		double best = 1e30;
+		size_t count = 0;
+		for (int run = 0; run < 5; run++) {
+			BenchmarkTimer timer;
+			count = kernel(frustum, bounds, visible.data());
+			best = std::min(best, timer.Milliseconds());
+			DoNotOptimize(count);
+		}
+		matches = count == referenceCount && std::equal(visible.begin(), visible.begin() + count, reference.begin());
+		return best * 1e6 / bounds.GetCount();
+	}
+
+	bool FrustumCullBenchmark(const BenchmarkArgs &args)
+	{
+		const size_t objects = std::max<size_t>(1024, static_cast<size_t>(1000000 * args.scale));
+
+		// Boxes scattered around the camera, about a tenth of them in view
+		std::mt19937 random(7);
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> size(0.1f, 4.0f);
+		CullBounds bounds;
+		bounds.Reserve(objects);
+		for (size_t i = 0; i < objects; i++) {
+			const float x = position(random), y = position(random), z = position(random);
+			const float boundsMin[3] = {x, y, z};
+			const float boundsMax[3] = {x + size(random), y + size(random), z + size(random)};
+			bounds.Add(boundsMin, boundsMax);
+		}
+
+		const Float4x4 view = MatrixLookAtLH({0.0f, 1.0f, -5.0f}, {0.3f, 1.0f, -4.0f}, {0.0f, 1.0f, 0.0f});
+		const Float4x4 projection = MatrixPerspectiveFovLH(60.0f / 180.0f * 3.14159265f, 16.0f / 9.0f, 0.001f, 100.0f);
+		const Frustum frustum = ExtractFrustum(MatrixMultiply(view, projection));
+
+		std::vector<uint32_t> reference(objects);
+		const size_t referenceCount = CullScalar(frustum, bounds, reference.data());
+		std::cout << objects << " boxes, " << referenceCount << " visible" << std::endl;
+
+		struct
+		{
+			const char *name;
+			CullKernel kernel;
+		} kernels[] = {
+			{"scalar", CullScalar},
+#ifdef FRUSTUM_CULL_SSE
+			{"SSE", CullSSE},
+#endif
+#ifdef FRUSTUM_CULL_AVX2
+			{"AVX2", CullAVX2},
+#endif
+		};
+
+		bool ok = true;
+		for (const auto &k : kernels) {
+			bool matches;
+			const double ns = Measure(k.kernel, frustum, bounds, reference, referenceCount, matches);
+			std::cout << k.name << ": " << ns << " ns/object" << (matches ? "" : " (MISMATCH)") << std::endl;
+			ok &= matches;
+		}
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("frustum_cull", FrustumCullBenchmark);
@@ -0,0 +1,124 @@
+#include "benchmark.h"
+#include "gpu_heap_allocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	// Heaps are plain numbers; nothing is ever placed in them
+	class FakeGpuHeapSource : public GpuHeapSource
+	{
+	public:
+		FakeGpuHeapSource() : next_heap(1), live_heaps(0), live_bytes(0) {};
+
+		bool CreateHeap(uint64_t size, uint64_t alignment, GpuHeap &heap) override
+		{
+			if (size % alignment != 0) {
+				return false;
+			}
+			heap.size = size;
+			heap.heap = reinterpret_cast<void *>(next_heap++);
+			live_heaps++;
+			live_bytes += size;
+			return true;
+		}
+
+		void DestroyHeap(GpuHeap &heap) override
+		{
+			live_heaps--;
+			live_bytes -= heap.size;
+			heap = {};
+		}
+
+		uintptr_t next_heap;
+		int live_heaps;
+		uint64_t live_bytes;
+	};
+
+	// Sizes of buffers and textures: mostly small, a tail up to 8 MiB
+	uint64_t RandomSize(std::mt19937 &random)
+	{
+		const uint32_t bucket = random() % 100;
+		if (bucket < 60) {
+			return 1 + random() % (256 * 1024);
+		}
+		if (bucket < 95) {
+			return 1 + random() % (2 * 1024 * 1024);
+		}
+		return 1 + random() % (8 * 1024 * 1024);
+	}
+
+	uint64_t RandomAlignment(std::mt19937 &random)
+	{
+		const uint32_t kind = random() % 20;
+		return kind == 0 ? msaa_placement_alignment : kind < 5 ? small_placement_alignment : default_placement_alignment;
+	}
+
+	void PrintStats(const char *name, const GpuHeapAllocator &allocator)
+	{
+		const GpuHeapAllocatorStats stats = allocator.GetStats();
+		std::cout << name << ": " << stats.heap_count << " heaps, " << stats.used / (1024 * 1024) << " of " << stats.capacity / (1024 * 1024)
+			<< " MiB used (" << stats.requested / (1024 * 1024) << " MiB requested), " << stats.allocation_count << " allocations, "
+			<< stats.free_block_count << " free blocks, largest " << stats.largest_free / 1024 << " KiB, fragmentation "
+			<< stats.GetFragmentation() * 100.0 << "%" << std::endl;
+		std::cout << "  heap usage:";
+		for (uint32_t heap = 0; heap < allocator.GetHeapCount(); heap++) {
+			if (allocator.GetHeap(heap).heap != nullptr) {
+				const GpuHeapStats heapStats = allocator.GetHeapStats(heap);
+				std::cout << " " << heapStats.used * 100 / heapStats.size << "%";
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	// Churn like meshes streaming in and out, then a defragmentation pass over what is left
+	void MeasureChurn(const BenchmarkArgs &args)
+	{
+		const size_t operationCount = std::max<size_t>(10000, static_cast<size_t>(1000000 * args.scale));
+		FakeGpuHeapSource source;
+		GpuHeapAllocator allocator(source, 64 * 1024 * 1024);
+		std::mt19937 random(23);
+		std::vector<GpuAllocation> live;
+		for (int i = 0; i < 5000; i++) {
+			live.push_back(allocator.Allocate(RandomSize(random), default_placement_alignment));
+		}
+
+		BenchmarkTimer timer;
+		for (size_t i = 0; i < operationCount; i++) {
+			const size_t victim = random() % live.size();
+			allocator.Free(live[victim]);
+			live[victim] = allocator.Allocate(RandomSize(random), RandomAlignment(random));
+		}
+		const double ms = timer.Milliseconds();
+		std::cout << operationCount << " free/allocate pairs: " << ms * 1e6 / operationCount << " ns per pair" << std::endl;
+
+		// A level unloads: most of the objects go
+		std::shuffle(live.begin(), live.end(), random);
+		for (size_t i = live.size() / 4; i < live.size(); i++) {
+			allocator.Free(live[i]);
+		}
+		live.resize(live.size() / 4);
+		PrintStats("After unloading 75%", allocator);
+
+		std::vector<GpuAllocationMove> moves;
+		timer.Reset();
+		allocator.Defragment(UINT64_MAX, moves);
+		const double defragmentMs = timer.Milliseconds();
+		for (const GpuAllocationMove &move : moves) {
+			allocator.Free(move.source);
+		}
+		std::cout << "Defragment: " << moves.size() << " moves, " << allocator.GetStats().moved_bytes / (1024 * 1024) << " MiB in "
+			<< defragmentMs << " ms" << std::endl;
+		PrintStats("After defragmenting", allocator);
+	}
+
+	bool GpuHeapAllocatorBenchmark(const BenchmarkArgs &args)
+	{
+		MeasureChurn(args);
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("gpu_heap_allocator", GpuHeapAllocatorBenchmark);
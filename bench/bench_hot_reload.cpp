@@ -0,0 +1,164 @@
+#include "benchmark.h"
+#include "hot_reload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	// In-memory files; every write bumps the stamp like an editor save would
+	class FakeFileSystem : public FileSystem
+	{
+	public:
+		FakeFileSystem() : write_count(0) {};
+
+		bool GetStamp(const std::string &path, FileStamp &stamp) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = files.find(path);
+			if (found == files.end()) {
+				return false;
+			}
+			stamp = found->second.stamp;
+			return true;
+		}
+
+		bool ReadFile(const std::string &path, std::string &content) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = files.find(path);
+			if (found == files.end()) {
+				return false;
+			}
+			content = found->second.content;
+			return true;
+		}
+
+		void Write(const std::string &path, const std::string &content)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			files[path] = {content, {content.size(), static_cast<int64_t>(++write_count)}};
+		}
+
+		void Delete(const std::string &path)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			files.erase(path);
+		}
+
+	private:
+		struct File
+		{
+			std::string content;
+			FileStamp stamp;
+		};
+
+		std::mutex mutex;
+		std::map<std::string, File> files;
+		int64_t write_count;
+	};
+
+	// Counts live instances so retirement can be checked
+	struct GpuObject
+	{
+		static std::atomic<int> live;
+		std::string content;
+
+		explicit GpuObject(const std::string &content) : content(content) { live++; }
+		~GpuObject() { live--; }
+	};
+
+	std::atomic<int> GpuObject::live(0);
+
+	const uint64_t ms = 1000000;
+
+	// Builds run on the worker while a 2 ms "render loop" keeps going; new objects are swapped in at frame
+	// boundaries and old ones live until the simulated GPU passes their frame
+	bool MeasureRenderLoop(const BenchmarkArgs &args)
+	{
+		FakeFileSystem files;
+		files.Write("shaders.hlsl", "v0");
+		SteadyClock clock;
+		const int buildMs = std::max(50, static_cast<int>(300 * args.scale));
+
+		std::shared_ptr<GpuObject> current = std::make_shared<GpuObject>("v0");
+		RetireQueue retired;
+		uint64_t frameFence = 0;
+		uint64_t gpuFence = 0;
+		const uint64_t framesInFlight = 3;
+
+		HotReloader reloader(files, clock, 20 * ms);
+		reloader.AddReload("shaders.hlsl", {"shaders.hlsl"}, [&](HotReloader::ApplyFunction &apply, std::string &err) {
+			std::string content;
+			files.ReadFile("shaders.hlsl", content);
+			if (content.find("error") != std::string::npos) {
+				err = "syntax error";
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(buildMs));
+			std::shared_ptr<GpuObject> built = std::make_shared<GpuObject>(content);
+			apply = [&, built]() {
+				retired.Retire(frameFence, [old = current]() {});
+				current = built;
+			};
+			return true;
+		});
+		reloader.Start(5 * ms);
+
+		double maxFrameMs = 0.0;
+		std::vector<std::string> seen;
+		const char *edits[] = {"v1", "error", "v2", "v3"};
+		size_t edit = 0;
+		BenchmarkTimer total;
+		// Runs until the last edit is in and its predecessor released, or gives up after twice the expected time
+		const double editSpacingMs = buildMs * 0.5 + 100.0;
+		const double timeoutMs = 2.0 * (4.0 * editSpacingMs + buildMs + 200.0);
+		while (total.Milliseconds() < timeoutMs && (edit < 4 || current->content != "v3" || retired.GetPendingCount() > 0)) {
+			// Edits arrive while the previous build may still be running; "v2" is immediately replaced by "v3"
+			if (edit < 4 && total.Milliseconds() >= (edit + 1) * editSpacingMs) {
+				files.Write("shaders.hlsl", edits[edit]);
+				if (edit == 2) {
+					files.Write("shaders.hlsl", edits[++edit]);
+				}
+				edit++;
+			}
+
+			BenchmarkTimer timer;
+			reloader.ApplyFinished();
+			retired.Collect(gpuFence);
+			maxFrameMs = std::max(maxFrameMs, timer.Milliseconds());
+			if (seen.empty() || seen.back() != current->content) {
+				seen.push_back(current->content);
+			}
+
+			// The GPU runs framesInFlight frames behind the CPU
+			frameFence++;
+			gpuFence = frameFence > framesInFlight ? frameFence - framesInFlight : 0;
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+		reloader.Stop();
+		retired.Collect(frameFence);
+
+		const HotReloadStats stats = reloader.GetStats();
+		const bool ok = seen.size() == 3 && seen[1] == "v1" && seen[2] == "v3" && stats.failures == 1 && GpuObject::live == 1;
+		std::cout << "Render loop with " << buildMs << " ms builds: " << stats.builds << " builds, " << stats.failures << " failed ("
+			<< stats.last_error << "), " << stats.applied << " applied, longest frame boundary " << maxFrameMs * 1e3
+			<< " us, versions";
+		for (const std::string &version : seen) {
+			std::cout << " " << version;
+		}
+		std::cout << (ok ? "" : " (WRONG RELOAD SEQUENCE)") << std::endl;
+		return ok;
+	}
+
+	bool HotReloadBenchmark(const BenchmarkArgs &args)
+	{
+		return MeasureRenderLoop(args);
+	}
+}
+
+REGISTER_BENCHMARK("hot_reload", HotReloadBenchmark);
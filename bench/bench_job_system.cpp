@@ -0,0 +1,178 @@
+#include "benchmark.h"
+#include "command_sink.h"
+#include "cpu_math.h"
+#include "frustum_cull.h"
+#include "job_system.h"
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	struct SyntheticFrame
+	{
+		size_t object_count;
+		std::vector<float> base;
+		std::vector<float> position;
+		std::vector<float> radius;
+		std::vector<uint32_t> visible_flags;
+		std::vector<uint32_t> visible;
+		std::vector<float> particle;
+		RenderQueue queue;
+		std::vector<RecordingCommandSink> chunks;
+		size_t command_count;
+		int picked;
+	};
+
+	// input -> update -> cull -> sort -> record -> submit, with picking and particles as side branches
+	void BuildFrameGraph(TaskGraph &graph, JobSystem &jobs, SyntheticFrame &frame, const int &frameIndex)
+	{
+		const TaskGraph::TaskId input = graph.AddTask("Input", []() {});
+		const TaskGraph::TaskId update = graph.AddTask("Update", [&]() {
+			const float t = frameIndex * 0.016f;
+			jobs.ParallelFor(frame.object_count, 2048, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					const float phase = t + i * 0.001f;
+					frame.position[i * 3 + 0] = frame.base[i * 3 + 0] + std::sin(phase) * 0.5f;
+					frame.position[i * 3 + 1] = frame.base[i * 3 + 1] + std::cos(phase * 1.3f) * 0.5f;
+					frame.position[i * 3 + 2] = frame.base[i * 3 + 2] + std::sin(phase * 0.7f) * 0.5f;
+				}
+			});
+		}, {input});
+		const TaskGraph::TaskId cull = graph.AddTask("Cull", [&]() {
+			const Float4x4 view = MatrixLookAtLH({0.0f, 0.0f, -120.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f});
+			const Frustum frustum = ExtractFrustum(MatrixMultiply(view, MatrixPerspectiveFovLH(1.0f, 16.0f / 9.0f, 0.1f, 300.0f)));
+			jobs.ParallelFor(frame.object_count, 4096, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					uint32_t inside = 1;
+					for (const Plane &plane : frustum.planes) {
+						const float distance = plane.a * frame.position[i * 3] + plane.b * frame.position[i * 3 + 1] +
+							plane.c * frame.position[i * 3 + 2] + plane.d;
+						inside &= distance > -frame.radius[i] ? 1u : 0u;
+					}
+					frame.visible_flags[i] = inside;
+				}
+			});
+			frame.visible.clear();
+			for (size_t i = 0; i < frame.object_count; i++) {
+				if (frame.visible_flags[i]) {
+					frame.visible.push_back(static_cast<uint32_t>(i));
+				}
+			}
+		}, {update});
+		const TaskGraph::TaskId pick = graph.AddTask("Pick", [&]() {
+			float nearest = 1e30f;
+			frame.picked = -1;
+			for (size_t i = 0; i < frame.object_count; i++) {
+				const float dx = frame.position[i * 3];
+				const float dy = frame.position[i * 3 + 1];
+				if (dx * dx + dy * dy < frame.radius[i] * frame.radius[i] && frame.position[i * 3 + 2] < nearest) {
+					nearest = frame.position[i * 3 + 2];
+					frame.picked = static_cast<int>(i);
+				}
+			}
+		}, {update});
+		graph.AddTask("Particles", [&]() {
+			jobs.ParallelFor(frame.particle.size(), 8192, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++) {
+					frame.particle[i] = std::fmod(frame.particle[i] * 1.0001f + 0.01f, 100.0f);
+				}
+			});
+		}, {input});
+		const TaskGraph::TaskId sort = graph.AddTask("Sort", [&]() {
+			frame.queue.Clear();
+			for (uint32_t index : frame.visible) {
+				frame.queue.Push({index % 4, index % 61, index % 509, index, frame.position[index * 3 + 2] + 120.0f, false});
+			}
+			frame.queue.Sort(300.0f);
+		}, {cull});
+		const TaskGraph::TaskId record = graph.AddTask("Record", [&]() {
+			const std::vector<DrawBatch> &batches = frame.queue.GetBatches();
+			const size_t chunkSize = (batches.size() + frame.chunks.size() - 1) / frame.chunks.size();
+			jobs.ParallelFor(frame.chunks.size(), 1, [&](size_t begin, size_t end) {
+				for (size_t chunk = begin; chunk < end; chunk++) {
+					RecordingCommandSink &sink = frame.chunks[chunk];
+					sink.Clear();
+					sink.SetConstants(0x1000);
+					for (size_t i = chunk * chunkSize; i < std::min(batches.size(), (chunk + 1) * chunkSize); i++) {
+						sink.SetPipeline(batches[i].pipeline);
+						sink.DrawIndexedInstanced(36, batches[i].instance_count, batches[i].mesh * 36, 0, batches[i].first_instance);
+					}
+				}
+			});
+		}, {sort, pick});
+		graph.AddTask("Submit", [&]() {
+			frame.command_count = 0;
+			for (const RecordingCommandSink &sink : frame.chunks) {
+				frame.command_count += sink.GetCommands().size();
+			}
+		}, {record});
+	}
+
+	bool MeasureScaling(const BenchmarkArgs &args)
+	{
+		const size_t objectCount = std::max<size_t>(10000, static_cast<size_t>(300000 * args.scale));
+		const int frameCount = 30;
+		const unsigned maxThreads = std::max(1u, args.threads != 0 ? args.threads : std::thread::hardware_concurrency());
+
+		SyntheticFrame frame;
+		frame.object_count = objectCount;
+		frame.base.resize(objectCount * 3);
+		frame.position.resize(objectCount * 3);
+		frame.radius.resize(objectCount);
+		frame.visible_flags.resize(objectCount);
+		frame.particle.assign(objectCount * 2, 1.0f);
+		frame.chunks.resize(64);
+		uint32_t random = 12345;
+		for (size_t i = 0; i < objectCount; i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				random = random * 1664525u + 1013904223u;
+				frame.base[i * 3 + axis] = (random >> 8) * (1.0f / 16777216.0f) * 400.0f - 200.0f;
+			}
+			frame.radius[i] = 0.5f + (i % 7) * 0.25f;
+		}
+
+		bool ok = true;
+		double singleMs = 0.0;
+		size_t referenceCommands = 0;
+		for (unsigned threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2) {
+			JobSystem jobs(threads);
+			TaskGraph graph;
+			int frameIndex = 0;
+			BuildFrameGraph(graph, jobs, frame, frameIndex);
+
+			// Warm up, then keep the best frame to suppress noise from the host
+			graph.Run(jobs);
+			double bestMs = 1e30;
+			for (frameIndex = 0; frameIndex < frameCount; frameIndex++) {
+				BenchmarkTimer timer;
+				graph.Run(jobs);
+				bestMs = std::min(bestMs, timer.Milliseconds());
+			}
+			if (threads == 1) {
+				singleMs = bestMs;
+				referenceCommands = frame.command_count;
+			}
+
+			const JobSystemStats stats = jobs.GetStats();
+			std::cout << threads << " threads: " << bestMs << " ms/frame, speedup " << singleMs / bestMs << "x, "
+				<< frame.visible.size() << " visible, " << frame.command_count << " commands, " << stats.stolen << " steals"
+				<< (frame.command_count == referenceCommands ? "" : " (OUTPUT DIFFERS)") << std::endl;
+			ok &= frame.command_count == referenceCommands;
+			if (threads == maxThreads) {
+				break;
+			}
+		}
+		return ok;
+	}
+
+	bool JobSystemBenchmark(const BenchmarkArgs &args)
+	{
+		return MeasureScaling(args);
+	}
+}
+
+REGISTER_BENCHMARK("job_system", JobSystemBenchmark);
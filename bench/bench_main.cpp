@@ -0,0 +1,84 @@
+#include "benchmark.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	size_t failed_checks = 0;
+}
+
+std::vector<Benchmark> &GetBenchmarks()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+bool Check(const char *name, bool condition)
+{
+	if (!condition) {
+		std::cout << "  " << name << ": FAILED" << std::endl;
+		failed_checks++;
+	}
+	return condition;
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkArgs args;
+	args.model_dir = "models/";
+	args.scale = 1.0;
+	args.threads = std::thread::hardware_concurrency();
+	std::string filter;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--models") == 0 && i + 1 < argc) {
+			args.model_dir = argv[++i];
+			if (!args.model_dir.empty() && args.model_dir.back() != '/' && args.model_dir.back() != '\\') {
+				args.model_dir += '/';
+			}
+		} else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+			args.scale = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			args.threads = static_cast<unsigned>(atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--list") == 0) {
+			for (const Benchmark &benchmark : GetBenchmarks()) {
+				std::cout << benchmark.name << std::endl;
+			}
+			return 0;
+		} else if (argv[i][0] == '-') {
+			std::cout << "Usage: " << argv[0] << " [name filter] [--models dir] [--scale factor] [--threads count] [--list]" << std::endl;
+			return 1;
+		} else {
+			filter = argv[i];
+		}
+	}
+	if (args.threads == 0) {
+		args.threads = 1;
+	}
+
+	// Checks fail the run, so a regression fails the build that runs the benchmarks
+	std::vector<const char *> failed;
+	for (const Benchmark &benchmark : GetBenchmarks()) {
+		if (!filter.empty() && strstr(benchmark.name, filter.c_str()) == nullptr) {
+			continue;
+		}
+		std::cout << "== " << benchmark.name << std::endl;
+		const size_t failedBefore = failed_checks;
+		if (!benchmark.function(args) || failed_checks != failedBefore) {
+			failed.push_back(benchmark.name);
+		}
+	}
+
+	if (!failed.empty()) {
+		std::cout << "FAILED:";
+		for (const char *name : failed) {
+			std::cout << " " << name;
+		}
+		std::cout << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+#include "benchmark.h"
+#include "mesh_lod.h"
+#include "obj_mesh.h"
+#include "scene_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	const float sphere_radius = 1.0f;
+
+	MeshView GetView(const Mesh &mesh)
+	{
+		MeshView view = {};
+		view.vertices = mesh.vertices.data();
+		view.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+		view.indices = mesh.indices.data();
+		view.index_count = static_cast<uint32_t>(mesh.indices.size());
+		view.index_size = 4;
+		view.shapes = mesh.shapes.data();
+		view.shape_count = static_cast<uint32_t>(mesh.shapes.size());
+		view.materials = mesh.materials.data();
+		view.material_count = static_cast<uint32_t>(mesh.materials.size());
+		return view;
+	}
+
+	// Dense closed sphere like a scanned model; the lower half has a second material, so the equator is a seam
+	Mesh BuildSphere(uint32_t rings)
+	{
+		MeshBuilder builder;
+		const float white[3] = {1.0f, 1.0f, 1.0f};
+		const float red[3] = {1.0f, 0.0f, 0.0f};
+		const int top = builder.AddMaterial("top", white);
+		const int bottom = builder.AddMaterial("bottom", red);
+		builder.BeginShape("sphere");
+
+		const uint32_t segments = rings * 2;
+		auto point = [rings, segments](uint32_t ring, uint32_t segment, float *p) {
+			const float theta = 3.14159265f * ring / rings;
+			const float phi = 2.0f * 3.14159265f * (segment % segments) / segments;
+			// Exact poles, so their corners weld into one vertex
+			const float ringRadius = ring == 0 || ring == rings ? 0.0f : sphere_radius * sinf(theta);
+			p[0] = ringRadius * cosf(phi);
+			p[1] = ring == rings ? -sphere_radius : sphere_radius * cosf(theta);
+			p[2] = ringRadius * sinf(phi);
+		};
+		for (uint32_t ring = 0; ring < rings; ring++) {
+			for (uint32_t segment = 0; segment < segments; segment++) {
+				float corners[12];
+				point(ring, segment, corners);
+				point(ring + 1, segment, corners + 3);
+				point(ring + 1, segment + 1, corners + 6);
+				point(ring, segment + 1, corners + 9);
+				const int material = ring < rings / 2 ? top : bottom;
+				// The poles are fans of triangles
+				if (ring == 0) {
+					builder.AddPolygon(corners, 3, material);
+				} else if (ring == rings - 1) {
+					const float triangle[9] = {corners[0], corners[1], corners[2], corners[3], corners[4], corners[5], corners[9], corners[10], corners[11]};
+					builder.AddPolygon(triangle, 3, material);
+				} else {
+					builder.AddPolygon(corners, 4, material);
+				}
+			}
+		}
+		return builder.Build(false);
+	}
+
+	// Largest distance of a triangle centroid from the sphere surface; flat triangles deviate most there
+	float MeasureSphereError(const Mesh &mesh, const uint32_t *indices, uint32_t index_count)
+	{
+		float error = 0.0f;
+		for (uint32_t i = 0; i < index_count; i += 3) {
+			float c[3] = {};
+			for (int corner = 0; corner < 3; corner++) {
+				for (int axis = 0; axis < 3; axis++) {
+					c[axis] += mesh.vertices[indices[i + corner]].position[axis] / 3.0f;
+				}
+			}
+			error = std::max(error, fabsf(sphere_radius - sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2])));
+		}
+		return error;
+	}
+
+	const uint32_t *GetLevelIndices(const Mesh &mesh, const MeshLods &lods, const MeshLodLevel &level)
+	{
+		return level.index_offset < mesh.indices.size() ? &mesh.indices[level.index_offset] : &lods.indices[level.index_offset - mesh.indices.size()];
+	}
+
+	void PrintLevels(const Mesh &mesh, const MeshLods &lods, bool sphere)
+	{
+		for (size_t s = 0; s + 1 < lods.first_level.size(); s++) {
+			for (uint32_t l = lods.first_level[s]; l < lods.first_level[s + 1]; l++) {
+				const MeshLodLevel &level = lods.levels[l];
+				std::cout << "  " << mesh.shapes[s].name << " LOD " << l - lods.first_level[s] << ": " << level.index_count / 3 << " triangles, error " << level.error;
+				if (sphere) {
+					std::cout << ", measured " << MeasureSphereError(mesh, GetLevelIndices(mesh, lods, level), level.index_count);
+				}
+				std::cout << std::endl;
+			}
+		}
+	}
+
+	bool CheckSphere(const BenchmarkArgs &args)
+	{
+		bool ok = true;
+		const uint32_t rings = std::max<uint32_t>(32, static_cast<uint32_t>(256 * sqrt(args.scale)));
+		const Mesh mesh = BuildSphere(rings);
+		const MeshView view = GetView(mesh);
+
+		MeshLods lods;
+		BenchmarkTimer timer;
+		BuildMeshLods(view, MeshLodSettings(), lods);
+		const double ms = timer.Milliseconds();
+		std::cout << "Sphere, " << lods.stats.source_triangles << " triangles: chain of " << lods.stats.level_count << " levels in " << ms << " ms ("
+			<< lods.stats.source_triangles / ms / 1000.0 << " M source triangles/s), " << lods.stats.collapses << " collapses, "
+			<< lods.stats.flip_rejects << " flips refused" << std::endl;
+		PrintLevels(mesh, lods, true);
+
+		ok &= Check("levels", lods.stats.level_count >= 3 * mesh.shapes.size());
+		for (uint32_t l = 0; l < lods.stats.level_count; l++) {
+			// Level 0 of a shape is its own range
+			if (std::count(lods.first_level.begin(), lods.first_level.end(), l) > 0) {
+				continue;
+			}
+			const MeshLodLevel &level = lods.levels[l];
+			ok &= Check("reduction", level.index_count < lods.levels[l - 1].index_count);
+			ok &= Check("error order", level.error >= lods.levels[l - 1].error);
+			ok &= Check("error bound", MeasureSphereError(mesh, GetLevelIndices(mesh, lods, level), level.index_count) <= 2.0f * level.error + 1e-4f);
+			const uint32_t *indices = GetLevelIndices(mesh, lods, level);
+			bool degenerate = false;
+			for (uint32_t i = 0; i < level.index_count; i += 3) {
+				degenerate |= indices[i] == indices[i + 1] || indices[i + 1] == indices[i + 2] || indices[i] == indices[i + 2];
+			}
+			ok &= Check("degenerate", !degenerate);
+		}
+
+		// Moving away coarsens the selection; the chosen level's error stays under a pixel
+		ScenePipeline scene;
+		scene.SetShapes(view.shapes, view.shape_count);
+		scene.SetLods(lods);
+		scene.SetLodSelection(1080.0f, 1.0f);
+		uint32_t previousCount = UINT32_MAX;
+		bool coarsest = false;
+		std::cout << "  Selection at 1080p, 1 pixel:";
+		for (float distance = 2.0f; distance <= 256.0f; distance *= 2.0f) {
+			scene.UpdateCamera({{0.0f, 0.0f, -distance}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, 1.0f, 16.0f / 9.0f, 0.1f, 1000.0f});
+			scene.Cull();
+			scene.SortDraws();
+			uint32_t drawnCount = 0;
+			coarsest = true;
+			for (const DrawBatch &batch : scene.GetRenderQueue().GetBatches()) {
+				const MeshLodLevel &level = scene.GetLodLevels()[batch.mesh];
+				drawnCount += level.index_count;
+				coarsest &= std::count(lods.first_level.begin(), lods.first_level.end(), batch.mesh + 1) > 0;
+				ok &= Check("pixel error", level.error * 540.0f / tanf(0.5f) / (distance - sphere_radius) <= 1.0f);
+			}
+			std::cout << " " << distance << "=" << drawnCount / 3;
+			ok &= Check("monotonic", drawnCount <= previousCount);
+			previousCount = drawnCount;
+		}
+		std::cout << std::endl;
+		ok &= Check("coarsest far away", coarsest);
+		std::cout << "Sphere LODs: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+
+	bool MeasureModel(const BenchmarkArgs &args)
+	{
+		Mesh mesh;
+		MeshStats meshStats;
+		std::string warn;
+		std::string err;
+		if (!LoadObjMesh(args.model_dir + "CornellBox-Original.obj", mesh, meshStats, warn, err)) {
+			std::cout << "CornellBox-Original.obj: " << err << std::endl;
+			return false;
+		}
+		MeshLods lods;
+		BenchmarkTimer timer;
+		BuildMeshLods(GetView(mesh), MeshLodSettings(), lods);
+		std::cout << "CornellBox-Original.obj, " << lods.stats.source_triangles << " triangles in " << mesh.shapes.size() << " shapes: "
+			<< lods.stats.level_count - mesh.shapes.size() << " extra levels in " << timer.Milliseconds() << " ms" << std::endl;
+		PrintLevels(mesh, lods, false);
+		return true;
+	}
+
+	bool MeshLodBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = CheckSphere(args);
+		ok &= MeasureModel(args);
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("mesh_lod", MeshLodBenchmark);
@@ -0,0 +1,162 @@
+#include "benchmark.h"
+#include "obj_parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	struct ObjData
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+	};
+
+	bool SameReals(const std::vector<tinyobj::real_t> &a, const std::vector<tinyobj::real_t> &b)
+	{
+		if (a.size() != b.size()) {
+			return false;
+		}
+		for (size_t i = 0; i < a.size(); i++) {
+			if (fabs(a[i] - b[i]) > 1e-6f * std::max(1.0f, fabsf(a[i]))) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Empty string when both loads produced the same geometry
+	std::string Compare(const ObjData &a, const ObjData &b)
+	{
+		if (!SameReals(a.attrib.vertices, b.attrib.vertices)) return "vertices differ";
+		if (!SameReals(a.attrib.normals, b.attrib.normals)) return "normals differ";
+		if (!SameReals(a.attrib.texcoords, b.attrib.texcoords)) return "texcoords differ";
+		if (a.materials.size() != b.materials.size()) return "material count differs";
+		if (a.shapes.size() != b.shapes.size()) return "shape count differs";
+
+		for (size_t s = 0; s < a.shapes.size(); s++) {
+			const tinyobj::mesh_t &ma = a.shapes[s].mesh;
+			const tinyobj::mesh_t &mb = b.shapes[s].mesh;
+			if (a.shapes[s].name != b.shapes[s].name) return "shape name differs: " + a.shapes[s].name;
+			if (ma.indices.size() != mb.indices.size()) return "index count differs in " + a.shapes[s].name;
+			if (ma.num_face_vertices != mb.num_face_vertices) return "face sizes differ in " + a.shapes[s].name;
+			if (ma.material_ids != mb.material_ids) return "material ids differ in " + a.shapes[s].name;
+			if (ma.smoothing_group_ids != mb.smoothing_group_ids) return "smoothing groups differ in " + a.shapes[s].name;
+			for (size_t i = 0; i < ma.indices.size(); i++) {
+				if (ma.indices[i].vertex_index != mb.indices[i].vertex_index ||
+					ma.indices[i].normal_index != mb.indices[i].normal_index ||
+					ma.indices[i].texcoord_index != mb.indices[i].texcoord_index) {
+					return "indices differ in " + a.shapes[s].name;
+				}
+			}
+		}
+		return std::string();
+	}
+
+	// Grid of quads with groups, materials, smoothing groups, normals and both absolute and relative indices
+	size_t WriteSyntheticObj(const std::string &path, size_t quad_count)
+	{
+		const size_t width = static_cast<size_t>(sqrt(static_cast<double>(quad_count))) + 1;
+		const size_t rows = quad_count / (width - 1);
+
+		std::ofstream obj(path, std::ios::binary);
+		obj << "# synthetic benchmark mesh\nvn 0 0 1\nvt 0 0\n";
+		char line[128];
+		for (size_t x = 0; x < width; x++) {
+			snprintf(line, sizeof(line), "v %.4f 0.0 %.4f\n", x * 0.01, 0.0);
+			obj << line;
+		}
+
+		for (size_t r = 0; r < rows; r++) {
+			if (r % 64 == 0) {
+				obj << "g rows_" << r << "\nusemtl material_" << (r / 64) % 4 << "\ns " << (r / 64) % 3 << "\n";
+			}
+			for (size_t x = 0; x < width; x++) {
+				snprintf(line, sizeof(line), "v %.4f %.4f %.4f\n", x * 0.01, sin(x * 0.05 + r * 0.03) * 0.1, (r + 1) * 0.01);
+				obj << line;
+			}
+
+			const long long count = static_cast<long long>((r + 2) * width);
+			for (size_t x = 0; x + 1 < width; x++) {
+				const long long a = static_cast<long long>(r * width + x);
+				const long long b = a + 1;
+				const long long c = a + static_cast<long long>(width) + 1;
+				const long long d = a + static_cast<long long>(width);
+				if (r % 2 == 0) {
+					snprintf(line, sizeof(line), "f %lld %lld %lld %lld\n", a + 1, b + 1, c + 1, d + 1);
+				} else {
+					snprintf(line, sizeof(line), "f %lld/1/1 %lld/1/1 %lld//1 %lld//1\n", a - count, b - count, c - count, d - count);
+				}
+				obj << line;
+			}
+		}
+
+		obj.close();
+		std::ifstream size(path, std::ios::binary | std::ios::ate);
+		return static_cast<size_t>(size.tellg());
+	}
+
+	double LoadTinyObj(const std::string &path, const std::string &base_dir, ObjData &data)
+	{
+		std::string warn, err;
+		BenchmarkTimer timer;
+		tinyobj::LoadObj(&data.attrib, &data.shapes, &data.materials, &warn, &err, path.c_str(), base_dir.c_str());
+		return timer.Milliseconds();
+	}
+
+	double LoadParallel(const std::string &path, const std::string &base_dir, unsigned threads, ObjData &data)
+	{
+		std::string warn, err;
+		BenchmarkTimer timer;
+		LoadObjParallel(&data.attrib, &data.shapes, &data.materials, &warn, &err, path.c_str(), base_dir.c_str(), threads);
+		return timer.Milliseconds();
+	}
+
+	bool ObjParseBenchmark(const BenchmarkArgs &args)
+	{
+		// Same output as tinyobj on the bundled model
+		const std::string cornell = args.model_dir + "CornellBox-Original.obj";
+		ObjData reference, parallel;
+		LoadTinyObj(cornell, args.model_dir, reference);
+		LoadParallel(cornell, args.model_dir, args.threads, parallel);
+		std::string mismatch = Compare(reference, parallel);
+		std::cout << "Cornell Box: " << (mismatch.empty() ? "matches tinyobj" : "MISMATCH: " + mismatch) << std::endl;
+		bool ok = mismatch.empty();
+
+		const size_t quads = static_cast<size_t>(1000000 * args.scale);
+		const std::string path = "synthetic_bench.obj";
+		const size_t bytes = WriteSyntheticObj(path, quads);
+		const double megabytes = bytes / (1024.0 * 1024.0);
+		std::cout << "Synthetic: " << quads * 2 << " triangles, " << megabytes << " MB" << std::endl;
+
+		ObjData tinyData;
+		const double tinyMs = LoadTinyObj(path, std::string(), tinyData);
+		std::cout << "tinyobj:            " << tinyMs << " ms, " << megabytes / (tinyMs / 1000.0) << " MB/s" << std::endl;
+
+		std::vector<unsigned> threadCounts = {1};
+		if (args.threads > 1) {
+			threadCounts.push_back(args.threads);
+		}
+		for (unsigned threads : threadCounts) {
+			double best = 1e30;
+			ObjData data;
+			for (int i = 0; i < 3; i++) {
+				data = ObjData();
+				best = std::min(best, LoadParallel(path, std::string(), threads, data));
+			}
+			mismatch = Compare(tinyData, data);
+			std::cout << "parallel (" << threads << " threads): " << best << " ms, " << megabytes / (best / 1000.0) << " MB/s"
+				<< (mismatch.empty() ? "" : ", MISMATCH: " + mismatch) << std::endl;
+			ok &= mismatch.empty();
+		}
+
+		std::remove(path.c_str());
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("obj_parse", ObjParseBenchmark);
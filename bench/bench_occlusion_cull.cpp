@@ -0,0 +1,343 @@
+#include "benchmark.h"
+#include "job_system.h"
+#include "obj_mesh.h"
+#include "occlusion_cull.h"
+#include "scene_pipeline.h"
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace
+{
+	// Smaller than the window, so the occlusion buffer's pixels do not line up with the image's
+	const uint32_t image_width = 640;
+	const uint32_t image_height = 360;
+
+	void AddBox(MeshBuilder &builder, const std::string &name, const float *min, const float *max, int material)
+	{
+		builder.BeginShape(name);
+		float corners[8][3];
+		for (int c = 0; c < 8; c++) {
+			corners[c][0] = c & 1 ? max[0] : min[0];
+			corners[c][1] = c & 2 ? max[1] : min[1];
+			corners[c][2] = c & 4 ? max[2] : min[2];
+		}
+		const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+		for (const int *face : faces) {
+			float polygon[12];
+			for (int c = 0; c < 4; c++) {
+				std::copy(corners[face[c]], corners[face[c]] + 3, polygon + c * 3);
+			}
+			builder.AddPolygon(polygon, 4, material);
+		}
+	}
+
+	// Blocks of buildings between streets, on a ground plane, with crates scattered along the streets: from
+	// street level the nearest buildings hide most of the city
+	Mesh BuildCity(uint32_t side)
+	{
+		MeshBuilder builder;
+		const int materialCount = 13;
+		for (int i = 0; i < materialCount; i++) {
+			const float color[3] = {(i * 37 % 13) / 12.0f, (i * 11 % 13) / 12.0f, (i * 5 % 13) / 12.0f};
+			builder.AddMaterial("material" + std::to_string(i), color);
+		}
+		const float block = 8.0f;
+		const float street = 4.0f;
+		const float extent = side * (block + street);
+		const float groundMin[3] = {-street, -1.0f, -street};
+		const float groundMax[3] = {extent, 0.0f, extent};
+		AddBox(builder, "ground", groundMin, groundMax, 0);
+
+		std::mt19937 random(7);
+		for (uint32_t z = 0; z < side; z++) {
+			for (uint32_t x = 0; x < side; x++) {
+				const float x0 = x * (block + street);
+				const float z0 = z * (block + street);
+				const float height = 4.0f + static_cast<float>(random() % 24);
+				const float buildingMin[3] = {x0, 0.0f, z0};
+				const float buildingMax[3] = {x0 + block, height, z0 + block};
+				const int material = 1 + static_cast<int>(random() % (materialCount - 1));
+				AddBox(builder, "building" + std::to_string(z * side + x), buildingMin, buildingMax, material);
+				for (int crate = 0; crate < 2; crate++) {
+					const float cx = x0 + block + 0.5f + static_cast<float>(random() % 20) * 0.1f;
+					const float cz = z0 + static_cast<float>(random() % 70) * 0.1f;
+					const float crateMin[3] = {cx, 0.0f, cz};
+					const float crateMax[3] = {cx + 1.0f, 1.0f, cz + 1.0f};
+					AddBox(builder, "crate" + std::to_string((z * side + x) * 2 + crate), crateMin, crateMax, material);
+				}
+			}
+		}
+		return builder.Build(false);
+	}
+
+	Camera StreetCamera(uint32_t side, float t)
+	{
+		// Walks down the first street, looking across the city at an angle that changes as it goes
+		const float extent = side * 12.0f;
+		const Float3 eye = {-2.0f, 1.7f, t * extent};
+		const float angle = 0.3f + 1.0f * t;
+		return {eye, {eye.x + sinf(angle), 1.5f, eye.z + cosf(angle)}, {0.0f, 1.0f, 0.0f}, 60.0f / 180.0f * 3.14159265f,
+			static_cast<float>(image_width) / image_height, 0.1f, extent * 2.0f};
+	}
+
+	SoftwareImage Render(JobSystem &jobs, const Mesh &mesh, const ScenePipeline &scene)
+	{
+		SoftwareRasterizer raster(jobs, image_width, image_height);
+		raster.SetGeometry(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), mesh.indices.data(),
+			static_cast<uint32_t>(mesh.indices.size()), 4);
+		const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+		raster.Clear(black);
+		scene.Record(raster, reinterpret_cast<uint64_t>(&scene.GetWorldViewProj()));
+		raster.Flush();
+		return raster.GetImage();
+	}
+
+	// The scene renders the same with occlusion culling as without, apart from what shows through gaps between
+	// occluders narrower than an occlusion pixel: a few pixels in ten thousand at most
+	bool CheckConservative(JobSystem &jobs, const char *name, const Mesh &mesh, const std::vector<Camera> &cameras)
+	{
+		bool ok = true;
+		ScenePipeline scene;
+		scene.SetShapes(mesh.shapes.data(), mesh.shapes.size());
+		scene.SetOccluderGeometry(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), mesh.indices.data(),
+			static_cast<uint32_t>(mesh.indices.size()));
+		uint32_t tested = 0;
+		uint32_t culled = 0;
+		uint32_t differentPixels = 0;
+		for (const Camera &camera : cameras) {
+			scene.UpdateCamera(camera);
+			scene.SetOcclusionCulling(false);
+			scene.Cull();
+			scene.SortDraws();
+			const SoftwareImage reference = Render(jobs, mesh, scene);
+
+			scene.SetOcclusionCulling(true);
+			scene.Cull();
+			scene.CullOccluded();
+			scene.SortDraws();
+			differentPixels += CompareImages(Render(jobs, mesh, scene), reference, 0).different_pixels;
+			tested += scene.GetOcclusionStats().tested;
+			culled += scene.GetOcclusionStats().culled;
+		}
+		std::cout << "  " << name << ": " << cameras.size() << " views, " << culled << " of " << tested << " visible shapes culled, "
+			<< differentPixels << " pixels differ" << std::endl;
+		ok &= Check("same image with occlusion culling", differentPixels * 10000 <= cameras.size() * image_width * image_height);
+		return ok;
+	}
+
+	bool CheckResults(const BenchmarkArgs &args)
+	{
+		bool ok = true;
+		JobSystem jobs(std::max(1u, args.threads));
+
+		// A wall in front of a box hides it; a box in front of the wall or crossing the near plane stays
+		MeshBuilder builder;
+		const float white[3] = {1.0f, 1.0f, 1.0f};
+		builder.AddMaterial("white", white);
+		const float wallMin[3] = {-5.0f, -5.0f, 10.0f}, wallMax[3] = {5.0f, 5.0f, 10.5f};
+		const float hiddenMin[3] = {-1.0f, -1.0f, 15.0f}, hiddenMax[3] = {1.0f, 1.0f, 17.0f};
+		const float frontMin[3] = {-1.0f, -1.0f, 5.0f}, frontMax[3] = {1.0f, 1.0f, 7.0f};
+		const float peekingMin[3] = {4.0f, -1.0f, 15.0f}, peekingMax[3] = {9.0f, 1.0f, 17.0f};
+		const float nearMin[3] = {-0.5f, -0.5f, -1.0f}, nearMax[3] = {0.5f, 0.5f, 0.5f};
+		AddBox(builder, "wall", wallMin, wallMax, 0);
+		AddBox(builder, "hidden", hiddenMin, hiddenMax, 0);
+		AddBox(builder, "front", frontMin, frontMax, 0);
+		AddBox(builder, "peeking", peekingMin, peekingMax, 0);
+		AddBox(builder, "near", nearMin, nearMax, 0);
+		const Mesh mesh = builder.Build(false);
+		const Camera camera = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f, 0.0f}, 60.0f / 180.0f * 3.14159265f,
+			static_cast<float>(image_width) / image_height, 0.1f, 100.0f};
+		const Float4x4 viewProj = MatrixMultiply(MatrixLookAtLH(camera.eye, camera.look_at, camera.up),
+			MatrixPerspectiveFovLH(camera.fov_y, camera.aspect, camera.near_z, camera.far_z));
+
+		std::vector<float> depths[2];
+		for (bool simd : {false, true}) {
+			OcclusionBuffer buffer(200, 100, simd);
+			const MeshShape &wall = mesh.shapes[0];
+			const uint32_t drawn = buffer.RasterizeTriangles(viewProj, mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()),
+				mesh.indices.data() + wall.index_offset, wall.index_count);
+			buffer.Finish();
+			const std::string kernel = buffer.GetKernelName();
+			ok &= Check((kernel + " wall rasterized").c_str(), drawn > 0 && drawn <= wall.index_count / 3);
+			ok &= Check((kernel + " box behind the wall culled").c_str(), buffer.IsOccluded(viewProj, hiddenMin, hiddenMax));
+			ok &= Check((kernel + " box in front kept").c_str(), !buffer.IsOccluded(viewProj, frontMin, frontMax));
+			ok &= Check((kernel + " box reaching past the wall kept").c_str(), !buffer.IsOccluded(viewProj, peekingMin, peekingMax));
+			ok &= Check((kernel + " box crossing the near plane kept").c_str(), !buffer.IsOccluded(viewProj, nearMin, nearMax));
+			depths[simd] = buffer.GetDepth();
+		}
+		ok &= Check("scalar matches SIMD", depths[0] == depths[1]);
+
+		// Occluders crossing the near plane are clipped, not dropped: from inside the wall, its far face and the
+		// clipped sides still hide the box behind it
+		OcclusionBuffer inside(64, 32);
+		const Float4x4 insideViewProj = MatrixMultiply(MatrixLookAtLH({0.0f, 0.0f, 10.2f}, {0.0f, 0.0f, 11.0f}, {0.0f, 1.0f, 0.0f}),
+			MatrixPerspectiveFovLH(camera.fov_y, 2.0f, 0.1f, 100.0f));
+		inside.RasterizeTriangles(insideViewProj, mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()),
+			mesh.indices.data() + mesh.shapes[0].index_offset, mesh.shapes[0].index_count);
+		inside.Finish();
+		ok &= Check("clipped occluder", inside.IsOccluded(insideViewProj, hiddenMin, hiddenMax));
+
+		// Scalar and SSE agree on a whole city, pixel for pixel and test for test
+		const uint32_t side = 12;
+		const Mesh city = BuildCity(side);
+		const Camera street = StreetCamera(side, 0.4f);
+		const Float4x4 streetViewProj = MatrixMultiply(MatrixLookAtLH(street.eye, street.look_at, street.up),
+			MatrixPerspectiveFovLH(street.fov_y, street.aspect, street.near_z, street.far_z));
+		OcclusionBuffer scalar(256, 128, false);
+		OcclusionBuffer simd(256, 128, true);
+		for (OcclusionBuffer *buffer : {&scalar, &simd}) {
+			buffer->RasterizeTriangles(streetViewProj, city.vertices.data(), static_cast<uint32_t>(city.vertices.size()),
+				city.indices.data(), static_cast<uint32_t>(city.indices.size()));
+			buffer->Finish();
+		}
+		bool same = scalar.GetDepth() == simd.GetDepth();
+		for (const MeshShape &shape : city.shapes) {
+			same &= scalar.IsOccluded(streetViewProj, shape.bounds_min, shape.bounds_max) == simd.IsOccluded(streetViewProj, shape.bounds_min, shape.bounds_max);
+		}
+		ok &= Check("scalar matches SIMD on the city", same);
+
+		// Against full-resolution renders of the scene, from the street and from above the roofs
+		std::vector<Camera> cameras;
+		for (int i = 0; i < 32; i++) {
+			Camera view = StreetCamera(side, i / 32.0f);
+			if (i % 2 == 1) {
+				view.eye.y += 10.0f + (i % 3) * 6.0f;
+				view.look_at.y = view.eye.y - 1.0f;
+			}
+			cameras.push_back(view);
+		}
+		ok &= CheckConservative(jobs, "city", city, cameras);
+
+		Mesh cornell;
+		MeshStats meshStats;
+		std::string warn;
+		std::string err;
+		if (LoadObjMesh(args.model_dir + "CornellBox-Original.obj", cornell, meshStats, warn, err)) {
+			// The window's starting view, outside the back wall, and views into the open side past the boxes
+			const float fov = 60.0f / 180.0f * 3.14159265f;
+			const float aspect = static_cast<float>(image_width) / image_height;
+			ok &= CheckConservative(jobs, "CornellBox-Original.obj", cornell, {
+				{{0.0f, 1.0f, -5.0f}, {0.0f, 1.0f, -4.0f}, {0.0f, 1.0f, 0.0f}, fov, aspect, 0.001f, 100.0f},
+				{{0.0f, 1.0f, 4.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, fov, aspect, 0.001f, 100.0f},
+				{{-0.3f, 0.4f, 1.5f}, {0.3f, 0.5f, -1.0f}, {0.0f, 1.0f, 0.0f}, fov, aspect, 0.001f, 100.0f},
+				{{0.5f, 0.3f, 0.9f}, {-0.4f, 0.6f, -1.0f}, {0.0f, 1.0f, 0.0f}, fov, aspect, 0.001f, 100.0f}});
+		} else {
+			std::cout << "  CornellBox-Original.obj: " << err << std::endl;
+			ok = false;
+		}
+
+		std::cout << "Occlusion culling checks: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+
+	// Occluder rasterization and box tests on their own, then the whole stage as a frame runs it
+	void MeasureCity(const BenchmarkArgs &args)
+	{
+		const uint32_t side = std::max(8u, static_cast<uint32_t>(48 * std::sqrt(args.scale)));
+		const Mesh city = BuildCity(side);
+		const int frames = 16;
+		std::cout << "City of " << city.shapes.size() << " shapes, " << city.indices.size() / 3 << " triangles:" << std::endl;
+
+		std::vector<Float4x4> viewProjs;
+		for (int frame = 0; frame < frames; frame++) {
+			const Camera c = StreetCamera(side, (frame + 0.5f) / frames);
+			viewProjs.push_back(MatrixMultiply(MatrixLookAtLH(c.eye, c.look_at, c.up), MatrixPerspectiveFovLH(c.fov_y, c.aspect, c.near_z, c.far_z)));
+		}
+		// The buildings along the first street, the ones CullOccluded would pick
+		const uint32_t occluderTriangles = side * 12;
+
+		for (bool simd : {false, true}) {
+			const OcclusionSettings settings;
+			OcclusionBuffer buffer(settings.width, settings.height, simd);
+			double rasterizeMs = 1e30;
+			double testMs = 1e30;
+			uint32_t drawn = 0;
+			uint32_t occluded = 0;
+			for (int repeat = 0; repeat < 3; repeat++) {
+				BenchmarkTimer timer;
+				drawn = 0;
+				for (const Float4x4 &viewProj : viewProjs) {
+					buffer.Clear();
+					for (uint32_t building = 0; building < side; building++) {
+						const MeshShape &shape = city.shapes[1 + building * side * 3];
+						drawn += buffer.RasterizeTriangles(viewProj, city.vertices.data(), static_cast<uint32_t>(city.vertices.size()),
+							city.indices.data() + shape.index_offset, shape.index_count);
+					}
+					buffer.Finish();
+				}
+				rasterizeMs = std::min(rasterizeMs, timer.Milliseconds());
+
+				timer.Reset();
+				occluded = 0;
+				for (const MeshShape &shape : city.shapes) {
+					occluded += buffer.IsOccluded(viewProjs.back(), shape.bounds_min, shape.bounds_max);
+				}
+				testMs = std::min(testMs, timer.Milliseconds());
+			}
+			DoNotOptimize(buffer.GetDepth()[0]);
+			std::cout << "  " << buffer.GetKernelName() << " rasterize: " << frames << " frames of " << occluderTriangles << " triangles in "
+				<< rasterizeMs << " ms, " << frames * occluderTriangles / rasterizeMs / 1000.0 << " M triangles/s (" << drawn
+				<< " on screen)" << std::endl;
+			std::cout << "  " << buffer.GetKernelName() << " test: " << city.shapes.size() << " boxes in " << testMs << " ms, "
+				<< city.shapes.size() / testMs / 1000.0 << " M tests/s, " << occluded << " occluded" << std::endl;
+		}
+
+		// Cull, occlusion and sort together, against cull and sort alone. What culling saves comes later, in
+		// recording and drawing, so the difference is reported as the cost per draw that makes it even.
+		ScenePipeline scene;
+		double frameMs[2] = {};
+		size_t frameDraws[2] = {};
+		scene.SetShapes(city.shapes.data(), city.shapes.size());
+		scene.SetOccluderGeometry(city.vertices.data(), static_cast<uint32_t>(city.vertices.size()), city.indices.data(),
+			static_cast<uint32_t>(city.indices.size()));
+		for (bool occlusion : {false, true}) {
+			scene.SetOcclusionCulling(occlusion);
+			OcclusionStats total = {};
+			size_t draws = 0;
+			BenchmarkTimer timer;
+			for (int frame = 0; frame < frames; frame++) {
+				scene.UpdateCamera(StreetCamera(side, (frame + 0.5f) / frames));
+				scene.Cull();
+				scene.CullOccluded();
+				scene.SortDraws();
+				const OcclusionStats &stats = scene.GetOcclusionStats();
+				total.occluders += stats.occluders;
+				total.occluder_triangles += stats.occluder_triangles;
+				total.tested += stats.tested;
+				total.culled += stats.culled;
+				total.rasterize_ms += stats.rasterize_ms;
+				total.test_ms += stats.test_ms;
+				draws += scene.GetRenderQueue().GetBatches().size();
+			}
+			frameMs[occlusion] = timer.Milliseconds() / frames;
+			frameDraws[occlusion] = draws / frames;
+			std::cout << "  scene " << (occlusion ? "with" : "without") << " occlusion culling: " << frameMs[occlusion] << " ms per frame, "
+				<< frameDraws[occlusion] << " draws per frame";
+			if (occlusion) {
+				std::cout << "; per frame " << total.occluders / frames << " occluders (" << total.occluder_triangles / frames
+					<< " triangles) in " << total.rasterize_ms / frames << " ms, " << total.culled / frames << " of "
+					<< total.tested / frames << " shapes culled in " << total.test_ms / frames << " ms";
+			}
+			std::cout << std::endl;
+		}
+		const size_t saved = frameDraws[0] - frameDraws[1];
+		std::cout << "  occlusion culling costs " << frameMs[1] - frameMs[0] << " ms per frame and saves " << saved << " draws: it pays "
+			<< "for itself once recording and drawing one takes more than " << (frameMs[1] - frameMs[0]) * 1e6 / std::max<size_t>(saved, 1)
+			<< " ns" << std::endl;
+	}
+
+	bool OcclusionCullBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = CheckResults(args);
+		MeasureCity(args);
+		std::cout << "Occlusion culling: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("occlusion_cull", OcclusionCullBenchmark);
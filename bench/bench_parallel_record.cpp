@@ -0,0 +1,85 @@
+#include "benchmark.h"
+#include "parallel_record.h"
+#include "scene_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+	// Shapes on a grid of small boxes in front of the camera, materials cycling so pipelines and constants vary
+	void BuildGridScene(size_t shape_count, std::vector<MeshShape> &shapes)
+	{
+		const size_t side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(shape_count))));
+		shapes.resize(shape_count);
+		for (size_t i = 0; i < shape_count; i++) {
+			MeshShape &shape = shapes[i];
+			memset(&shape, 0, sizeof(shape));
+			shape.index_offset = static_cast<uint32_t>(i * 36);
+			shape.index_count = 36;
+			shape.material = static_cast<int32_t>(i % 17);
+			const float x = static_cast<float>(i % side) * 1.5f - side * 0.75f;
+			const float z = static_cast<float>(i / side) * 1.5f + 2.0f;
+			const float min[3] = {x - 0.5f, -0.5f, z - 0.5f};
+			for (int axis = 0; axis < 3; axis++) {
+				shape.bounds_min[axis] = min[axis];
+				shape.bounds_max[axis] = min[axis] + 1.0f;
+			}
+		}
+	}
+
+	bool ParallelRecordBenchmark(const BenchmarkArgs &args)
+	{
+		const size_t shapeCount = std::max<size_t>(1000, static_cast<size_t>(40000 * args.scale));
+		const int frameCount = 20;
+		const unsigned maxThreads = std::max(1u, args.threads != 0 ? args.threads : std::thread::hardware_concurrency());
+
+		std::vector<MeshShape> shapes;
+		BuildGridScene(shapeCount, shapes);
+		ScenePipeline scene;
+		scene.SetShapes(shapes.data(), shapes.size());
+		const float side = std::sqrt(static_cast<float>(shapeCount)) * 1.5f;
+		scene.UpdateCamera({{0.0f, 4.0f, 0.0f}, {0.0f, 0.0f, side * 0.5f}, {0.0f, 1.0f, 0.0f}, 1.5f, 16.0f / 9.0f, 0.1f, side * 2.0f});
+		scene.Cull();
+		scene.SortDraws();
+
+		RecordingCommandSink serialSink;
+		double serialMs = 1e30;
+		for (int frame = 0; frame < frameCount; frame++) {
+			serialSink.Clear();
+			BenchmarkTimer timer;
+			scene.Record(serialSink, 0x1000);
+			serialMs = std::min(serialMs, timer.Milliseconds());
+		}
+		std::cout << scene.GetRenderQueue().GetBatches().size() << " draws, serial recording " << serialMs << " ms" << std::endl;
+
+		ParallelRecorder recorder(256, 64);
+		RecordingCommandListBackend backend;
+		double singleMs = 0.0;
+		for (unsigned threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2) {
+			JobSystem jobs(threads);
+			double bestMs = 1e30;
+			for (int frame = 0; frame < frameCount; frame++) {
+				backend.Clear();
+				BenchmarkTimer timer;
+				recorder.Record(scene, 0x1000, backend, jobs);
+				bestMs = std::min(bestMs, timer.Milliseconds());
+				backend.Submit();
+			}
+			if (threads == 1) {
+				singleMs = bestMs;
+			}
+			std::cout << threads << " threads: " << recorder.GetChunks().size() << " chunks, " << bestMs << " ms, speedup "
+				<< singleMs / bestMs << "x" << std::endl;
+			if (threads == maxThreads) {
+				break;
+			}
+		}
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("parallel_record", ParallelRecordBenchmark);
@@ -0,0 +1,154 @@
+#include "benchmark.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	size_t CountOccurrences(const std::string &text, const std::string &pattern)
+	{
+		size_t count = 0;
+		for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + pattern.size())) {
+			count++;
+		}
+		return count;
+	}
+
+	// Cost of one scoped marker; frames are closed often enough that the ring never fills
+	void MeasureOverhead(const BenchmarkArgs &args)
+	{
+		const int iterations = std::max(100000, static_cast<int>(2000000 * args.scale));
+		Profiler &profiler = Profiler::Get();
+		profiler.Reset();
+
+		BenchmarkTimer timer;
+		for (int i = 0; i < iterations; i++) {
+			DoNotOptimize(i);
+		}
+		const double baselineNs = timer.Milliseconds() * 1e6 / iterations;
+
+		timer.Reset();
+		for (int i = 0; i < iterations; i++) {
+			PROFILE_SCOPE("marker");
+			DoNotOptimize(i);
+			if (i % 4096 == 4095) {
+				profiler.EndFrame();
+			}
+		}
+		const double scopeNs = timer.Milliseconds() * 1e6 / iterations;
+
+#ifdef ENABLE_PROFILER
+		const char *build = "compiled in";
+#else
+		const char *build = "compiled out";
+#endif
+		timer.Reset();
+		uint64_t sum = 0;
+		for (int i = 0; i < iterations; i++) {
+			sum += ProfilerNow();
+		}
+		DoNotOptimize(sum);
+		const double clockNs = timer.Milliseconds() * 1e6 / iterations;
+
+		std::cout << "Scope overhead: " << scopeNs - baselineNs << " ns (one clock read is " << clockNs << " ns), PROFILE_SCOPE is "
+			<< build << ", " << profiler.GetDroppedCount() << " dropped" << std::endl;
+		profiler.Reset();
+	}
+
+	// Producers on several threads, one collector
+	void MeasureThreads(const BenchmarkArgs &args)
+	{
+		const unsigned threadCount = std::max(2u, args.threads);
+		const int eventsPerThread = std::max(10000, static_cast<int>(200000 * args.scale));
+		Profiler profiler(1 << 20);
+		std::atomic<unsigned> running(threadCount);
+
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < threadCount; t++) {
+			threads.emplace_back([&]() {
+				ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+				for (int i = 0; i < eventsPerThread; i++) {
+					const uint64_t now = ProfilerNow();
+					buffer.Push({"worker", now, now + 1, buffer.GetThreadId(), 0});
+				}
+				running--;
+			});
+		}
+
+		BenchmarkTimer timer;
+		uint64_t frames = 0;
+		while (running > 0) {
+			profiler.EndFrame();
+			frames++;
+		}
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		profiler.EndFrame();
+		const double ms = timer.Milliseconds();
+
+		const FrameStats stats = profiler.GetStats();
+		const uint64_t collected = stats.scopes.empty() ? 0 : stats.scopes[0].count;
+		const uint64_t dropped = profiler.GetDroppedCount();
+		const uint64_t expected = static_cast<uint64_t>(threadCount) * eventsPerThread;
+		std::cout << threadCount << " threads: " << collected << " collected + " << dropped << " dropped of " << expected << ", "
+			<< frames << " collections in " << ms << " ms" << std::endl;
+	}
+
+	// Nested scopes over simulated frames, then both export formats
+	void MeasureExport(const BenchmarkArgs &args)
+	{
+		const int frameCount = std::max(10, static_cast<int>(300 * args.scale));
+		Profiler profiler(frameCount);
+		ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+		profiler.SetThreadName("Main \"render\" thread");
+
+		// Frames on a simulated 16 ms clock with a spike every 100 frames
+		profiler.Reset();
+		uint64_t clock = ProfilerNow();
+		for (int frame = 0; frame < frameCount; frame++) {
+			const uint64_t frameBegin = clock;
+			buffer.Push({"Update", clock, clock + 200000, buffer.GetThreadId(), 1});
+			clock += 200000;
+			buffer.Push({"Record", clock, clock + 500000 + (frame % 100 == 0 ? 20000000 : 0), buffer.GetThreadId(), 1});
+			clock += 500000 + (frame % 100 == 0 ? 20000000 : 0);
+			buffer.Push({"Render", frameBegin, clock, buffer.GetThreadId(), 0});
+			profiler.AddGpuEvent("Draw", clock + 100000, clock + 2100000);
+			clock = frameBegin + std::max<uint64_t>(16000000, clock - frameBegin);
+			profiler.EndFrame(clock);
+		}
+
+		const FrameStats stats = profiler.GetStats();
+		std::cout << stats.frame_count << " frames: min " << stats.min_ms << " ms, avg " << stats.avg_ms << " ms, p99 "
+			<< stats.p99_ms << " ms, max " << stats.max_ms << " ms" << std::endl;
+		for (const ScopeStats &scope : stats.scopes) {
+			std::cout << "  " << (scope.gpu ? "GPU " : "CPU ") << scope.name << ": " << scope.count << " calls, avg " << scope.avg_ms
+				<< " ms, p99 " << scope.p99_ms << " ms, " << scope.per_frame_ms << " ms/frame" << std::endl;
+		}
+
+		BenchmarkTimer timer;
+		std::ostringstream trace;
+		profiler.WriteChromeTrace(trace);
+		std::ostringstream csv;
+		profiler.WriteCsv(csv);
+		const double ms = timer.Milliseconds();
+
+		const std::string json = trace.str();
+		std::cout << "Export: " << json.size() << " bytes of trace with " << CountOccurrences(json, "\"ph\":\"X\"") << " spans, "
+			<< csv.str().size() << " bytes of CSV in " << ms << " ms" << std::endl;
+	}
+
+	bool ProfilerBenchmark(const BenchmarkArgs &args)
+	{
+		MeasureOverhead(args);
+		MeasureThreads(args);
+		MeasureExport(args);
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("profiler", ProfilerBenchmark);
@@ -0,0 +1,60 @@
+#include "benchmark.h"
+#include "render_graph.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	const uint64_t mib = 1024 * 1024;
+	const uint64_t texture_alignment = 64 * 1024;
+
+	// A long post-processing chain: every pass reads two earlier outputs and writes its own target
+	bool MeasureCompile(const BenchmarkArgs &args)
+	{
+		const uint32_t passCount = std::max<uint32_t>(64, static_cast<uint32_t>(2000 * args.scale));
+		RenderGraph graph;
+		const RenderGraph::ResourceId backBuffer = graph.ImportResource("Back buffer", ResourceState::Present, ResourceState::Present);
+		std::vector<RenderGraph::ResourceId> targets;
+		uint32_t random = 12345;
+		for (uint32_t i = 0; i < passCount; i++) {
+			random = random * 1664525u + 1013904223u;
+			const RenderGraph::ResourceId target = graph.CreateTransient("Target", (1 + (random >> 28)) * mib, texture_alignment);
+			const RenderGraph::PassId pass = graph.AddPass("Post", nullptr);
+			for (int input = 0; input < 2 && !targets.empty(); input++) {
+				random = random * 1664525u + 1013904223u;
+				// Mostly recent outputs, so lifetimes stay short and memory is reused
+				const size_t back = std::min<size_t>(targets.size(), 1 + (random >> 16) % 8);
+				graph.Read(pass, targets[targets.size() - back], ResourceState::ShaderResource);
+			}
+			graph.Write(pass, target, ResourceState::RenderTarget);
+			targets.push_back(target);
+		}
+		const RenderGraph::PassId present = graph.AddPass("Present", nullptr);
+		graph.Read(present, targets.back(), ResourceState::ShaderResource);
+		graph.Write(present, backBuffer, ResourceState::RenderTarget);
+
+		std::string err;
+		double bestMs = 1e30;
+		for (int run = 0; run < 5; run++) {
+			BenchmarkTimer timer;
+			if (!graph.Compile(err)) {
+				std::cout << "Compile failed: " << err << std::endl;
+				return false;
+			}
+			bestMs = std::min(bestMs, timer.Milliseconds());
+		}
+		const RenderGraphStats &stats = graph.GetStats();
+		std::cout << passCount + 1 << " passes compiled in " << bestMs << " ms: " << stats.pass_count << " kept, "
+			<< stats.barrier_count << " barriers in " << stats.batch_count << " batches, transients " << stats.transient_size / mib
+			<< " MiB in a " << stats.transient_heap_size / mib << " MiB heap" << std::endl;
+		return true;
+	}
+
+	bool RenderGraphBenchmark(const BenchmarkArgs &args)
+	{
+		return MeasureCompile(args);
+	}
+}
+
+REGISTER_BENCHMARK("render_graph", RenderGraphBenchmark);
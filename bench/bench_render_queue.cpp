@@ -0,0 +1,89 @@
+#include "benchmark.h"
+#include "render_queue.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	const float max_depth = 100.0f;
+
+	std::vector<DrawItem> MakeItems(size_t count, std::mt19937 &random)
+	{
+		// Scenes repeat a few meshes many times, which is what makes instancing pay off
+		std::uniform_int_distribution<uint32_t> mesh(0, 63);
+		std::uniform_int_distribution<uint32_t> variant(0, 3);
+		std::uniform_real_distribution<float> depth(0.0f, max_depth);
+		std::uniform_int_distribution<int> translucent(0, 9);
+
+		std::vector<DrawItem> items(count);
+		for (size_t i = 0; i < count; i++) {
+			const uint32_t m = mesh(random);
+			items[i] = {m % 8, m * 4 + variant(random), m, static_cast<uint32_t>(i), depth(random), translucent(random) == 0};
+		}
+		return items;
+	}
+
+	// Opaque before translucent, depth buckets near-to-far and translucent depth far-to-near
+	bool CheckOrder(const RenderQueue &queue, float max_depth)
+	{
+		const std::vector<SortEntry> &entries = queue.GetSortedEntries();
+		const std::vector<DrawItem> &items = queue.GetItems();
+		for (size_t i = 1; i < entries.size(); i++) {
+			const DrawItem &a = items[entries[i - 1].item];
+			const DrawItem &b = items[entries[i].item];
+			if (entries[i - 1].key > entries[i].key || (a.translucent && !b.translucent)) {
+				return false;
+			}
+			if (a.translucent && b.translucent && a.depth < b.depth - max_depth / (1 << 23)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool RenderQueueBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = true;
+		std::mt19937 random(3);
+		for (size_t count : {10000, 100000, 1000000}) {
+			count = std::max<size_t>(1000, static_cast<size_t>(count * args.scale));
+			std::vector<DrawItem> items = MakeItems(count, random);
+
+			RenderQueue queue;
+			queue.Reserve(count);
+			double best = 1e30;
+			for (int run = 0; run < 5; run++) {
+				queue.Clear();
+				for (const DrawItem &item : items) {
+					queue.Push(item);
+				}
+				BenchmarkTimer timer;
+				queue.Sort(max_depth);
+				best = std::min(best, timer.Milliseconds());
+			}
+
+			// Same keys through std::sort for reference
+			std::vector<SortEntry> entries(count);
+			for (size_t i = 0; i < count; i++) {
+				entries[i] = {MakeSortKey(items[i], max_depth), static_cast<uint32_t>(i)};
+			}
+			BenchmarkTimer timer;
+			std::stable_sort(entries.begin(), entries.end(), [](const SortEntry &a, const SortEntry &b) { return a.key < b.key; });
+			const double stdMs = timer.Milliseconds();
+
+			const bool same = std::equal(entries.begin(), entries.end(), queue.GetSortedEntries().begin(),
+				[](const SortEntry &a, const SortEntry &b) { return a.key == b.key && a.item == b.item; }) &&
+				CheckOrder(queue, max_depth);
+
+			std::cout << count << " items: sort+merge " << best << " ms (" << best * 1e6 / count << " ns/item), std::stable_sort "
+				<< stdMs << " ms, " << queue.GetBatches().size() << " draws" << (same ? "" : " (WRONG ORDER)")
+				<< std::endl;
+			ok &= same;
+		}
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("render_queue", RenderQueueBenchmark);
@@ -0,0 +1,129 @@
+#include "benchmark.h"
+#include "mapped_file.h"
+#include "shader_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace
+{
+	// Deterministic "bytecode" derived from the key inputs; burns CPU to stand in for FXC
+	class StubShaderCompiler : public ShaderCompiler
+	{
+	public:
+		explicit StubShaderCompiler(int work) : work(work), compile_count(0) {};
+
+		std::string GetVersion() const override { return "stub-1"; }
+
+		bool Compile(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+			std::string &err) override
+		{
+			compile_count++;
+			if (source.find("#error") != std::string::npos) {
+				err = request.source_name + ": #error";
+				return false;
+			}
+
+			uint64_t hash = HashBytes(source.data(), source.size());
+			for (int i = 0; i < work; i++) {
+				hash = HashBytes(&hash, sizeof(hash), hash ^ i);
+			}
+			hash = HashBytes(request.entry_point.data(), request.entry_point.size(), hash);
+			for (const ShaderDefine &define : request.defines) {
+				hash = HashBytes(define.value.data(), define.value.size(), hash);
+			}
+
+			bytecode.resize(2048 + hash % 2048);
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				bytecode[i] = static_cast<uint8_t>(hash >> (i % 8 * 8)) ^ static_cast<uint8_t>(i);
+			}
+			return true;
+		}
+
+		int GetCompileCount() const { return compile_count; }
+
+	private:
+		int work;
+		int compile_count;
+	};
+
+	const char *stub_source = "float4 PSMain(float4 color : COLOR) : SV_TARGET { return color * SCALE; }";
+
+	std::vector<ShaderCompileRequest> MakePermutations(size_t count)
+	{
+		std::vector<ShaderCompileRequest> requests;
+		for (size_t i = 0; i < count; i++) {
+			requests.push_back({"stub.hlsl", i % 2 ? "PSMain" : "VSMain", i % 2 ? "ps_5_0" : "vs_5_0",
+				{{"SCALE", std::to_string(i / 2)}, {"USE_FOG", i % 3 ? "1" : "0"}}, 0});
+		}
+		return requests;
+	}
+
+	// Runs every permutation once; returns ms per request
+	double RunPermutations(ShaderCache &cache, const std::vector<ShaderCompileRequest> &requests, bool &ok)
+	{
+		std::vector<uint8_t> bytecode;
+		std::string err;
+		BenchmarkTimer timer;
+		for (const ShaderCompileRequest &request : requests) {
+			ok &= cache.GetShader(stub_source, request, bytecode, err);
+		}
+		return timer.Milliseconds() / requests.size();
+	}
+
+
+	bool MeasureMemoryStore(const BenchmarkArgs &args)
+	{
+		const std::vector<ShaderCompileRequest> requests = MakePermutations(std::max<size_t>(16, static_cast<size_t>(256 * args.scale)));
+		StubShaderCompiler compiler(20000);
+		MemoryCacheStore store(64 * 1024 * 1024);
+		ShaderCache cache(store, compiler);
+
+		bool ok = true;
+		const double coldMs = RunPermutations(cache, requests, ok);
+		const double warmMs = RunPermutations(cache, requests, ok);
+
+		const ShaderCacheStats &stats = cache.GetStats();
+		std::cout << "Memory store, " << requests.size() << " permutations: miss " << coldMs * 1e3 << " us, hit " << warmMs * 1e3
+			<< " us, " << stats.shader_hits << " hits, " << stats.shader_misses << " misses" << std::endl;
+		return ok;
+	}
+
+	bool MeasureDirectoryStore(const BenchmarkArgs &args)
+	{
+		const std::string directory = (std::filesystem::temp_directory_path() / "shader_cache_bench").string();
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+
+		const std::vector<ShaderCompileRequest> requests = MakePermutations(std::max<size_t>(16, static_cast<size_t>(256 * args.scale)));
+		StubShaderCompiler compiler(20000);
+		bool ok = true;
+		double coldMs;
+		{
+			DirectoryCacheStore store(directory, 256 * 1024 * 1024);
+			ShaderCache cache(store, compiler);
+			coldMs = RunPermutations(cache, requests, ok);
+		}
+
+		// A new process: the store rebuilds its index from the directory
+		DirectoryCacheStore store(directory, 256 * 1024 * 1024);
+		ShaderCache cache(store, compiler);
+		const double warmMs = RunPermutations(cache, requests, ok);
+		std::cout << "Directory store, " << requests.size() << " permutations: miss " << coldMs * 1e3 << " us, hit after restart "
+			<< warmMs * 1e3 << " us, " << store.GetSize() / 1024 << " KiB on disk" << std::endl;
+
+		std::filesystem::remove_all(directory, error);
+		return ok;
+	}
+
+	// Hit/miss counts, key inputs, corruption and eviction are covered by the shader_cache_* tests
+	bool ShaderCacheBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = MeasureMemoryStore(args);
+		ok &= MeasureDirectoryStore(args);
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("shader_cache", ShaderCacheBenchmark);
\ No newline at end of file
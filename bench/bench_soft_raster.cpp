@@ -0,0 +1,253 @@
+#include "benchmark.h"
+#include "job_system.h"
+#include "obj_mesh.h"
+#include "scene_pipeline.h"
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+namespace
+{
+	const uint32_t image_width = 1280;
+	const uint32_t image_height = 720;
+	// Next to the model, so it is versioned with it; small enough to keep in the repository
+	const char *golden_name = "CornellBox-Original.golden.ppm";
+	const uint32_t golden_width = 320;
+	const uint32_t golden_height = 180;
+	// Leaves room for compilers contracting the vertex transform differently, not for a changed image
+	const uint32_t golden_channel_tolerance = 2;
+
+	// Draws triangles given directly in clip space
+	void DrawClipSpace(SoftwareRasterizer &raster, const std::vector<MeshVertex> &vertices)
+	{
+		std::vector<uint32_t> indices(vertices.size());
+		for (uint32_t i = 0; i < indices.size(); i++) {
+			indices[i] = i;
+		}
+		const Float4x4 identity = MatrixIdentity();
+		raster.SetGeometry(vertices.data(), static_cast<uint32_t>(vertices.size()), indices.data(), static_cast<uint32_t>(indices.size()), 4);
+		raster.SetConstants(reinterpret_cast<uint64_t>(&identity));
+		raster.DrawIndexedInstanced(static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		raster.Flush();
+	}
+
+	MeshVertex Corner(float x, float y, float z, float gray)
+	{
+		return {{x, y, z}, {gray, gray, gray, 1.0f}};
+	}
+
+	// Rules every rasterizer has to get right, on small images
+	bool CheckRules(JobSystem &jobs)
+	{
+		bool ok = true;
+		const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+
+		// A full-screen quad of two triangles covers each pixel once, whichever way the triangles wind
+		SoftwareRasterizer raster(jobs, 97, 61);
+		DrawClipSpace(raster, {Corner(-1, -1, 0.5f, 1), Corner(-1, 1, 0.5f, 1), Corner(1, 1, 0.5f, 1),
+			Corner(-1, -1, 0.5f, 1), Corner(1, -1, 0.5f, 1), Corner(1, 1, 0.5f, 1)});
+		ok &= Check("quad covers each pixel once", raster.GetStats().covered_pixels == 97 * 61 && raster.GetStats().written_pixels == 97 * 61);
+
+		// A fan of thin triangles around a center point shares every edge: still no gaps or double hits
+		raster.Clear(black);
+		raster.ResetStats();
+		std::vector<MeshVertex> fan;
+		const int slices = 37;
+		for (int i = 0; i < slices; i++) {
+			const float a0 = 6.2831853f * i / slices;
+			const float a1 = 6.2831853f * (i + 1) / slices;
+			fan.push_back(Corner(0.013f, -0.021f, 0.5f, 1));
+			fan.push_back(Corner(3.0f * cosf(a0), 3.0f * sinf(a0), 0.5f, 1));
+			fan.push_back(Corner(3.0f * cosf(a1), 3.0f * sinf(a1), 0.5f, 1));
+		}
+		DrawClipSpace(raster, fan);
+		ok &= Check("fan covers each pixel once", raster.GetStats().covered_pixels == 97 * 61);
+
+		// The depth test makes the result independent of drawing order
+		SoftwareRasterizer nearFirst(jobs, 64, 64);
+		SoftwareRasterizer farFirst(jobs, 64, 64);
+		const std::vector<MeshVertex> nearTriangle = {Corner(-1, -1, 0.2f, 1), Corner(0.5f, 1, 0.2f, 1), Corner(1, -1, 0.8f, 1)};
+		const std::vector<MeshVertex> farTriangle = {Corner(-1, 1, 0.6f, 0.5f), Corner(1, 1, 0.6f, 0.5f), Corner(0, -1, 0.6f, 0.5f)};
+		DrawClipSpace(nearFirst, nearTriangle);
+		DrawClipSpace(nearFirst, farTriangle);
+		DrawClipSpace(farFirst, farTriangle);
+		DrawClipSpace(farFirst, nearTriangle);
+		ok &= Check("depth order", CompareImages(nearFirst.GetImage(), farFirst.GetImage(), 0).different_pixels == 0);
+		ok &= Check("depth values", nearFirst.GetDepth() == farFirst.GetDepth());
+
+		// Crossing the near plane and the guard band: clipped, not dropped. w = 1 here, so z < 0 is in front of
+		// the near plane and the visible part is the half with z >= 0.
+		raster.Clear(black);
+		raster.ResetStats();
+		DrawClipSpace(raster, {Corner(-1e5f, -1, 0.9f, 1), Corner(1e5f, -1, 0.9f, 1), Corner(0, 3, -1.0f, 1)});
+		const SoftwareRasterStats &clipped = raster.GetStats();
+		ok &= Check("clipping", clipped.clipped_triangles == 1 && clipped.covered_pixels > 0 && clipped.covered_pixels < 97 * 61);
+		ok &= Check("clipped depth", *std::max_element(raster.GetDepth().begin(), raster.GetDepth().end()) <= 1.0f &&
+			*std::min_element(raster.GetDepth().begin(), raster.GetDepth().end()) >= 0.0f);
+
+		std::cout << "Rasterization rules: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+
+	// One cube per shape on a grid, like a large scene of small objects
+	Mesh BuildCubeGrid(size_t count)
+	{
+		MeshBuilder builder;
+		const int materialCount = 17;
+		for (int i = 0; i < materialCount; i++) {
+			const float color[3] = {(i * 37 % 17) / 16.0f, (i * 11 % 17) / 16.0f, (i * 5 % 17) / 16.0f};
+			builder.AddMaterial("material" + std::to_string(i), color);
+		}
+		const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+		for (size_t i = 0; i < count; i++) {
+			builder.BeginShape("cube" + std::to_string(i));
+			const float x = static_cast<float>(i % side) * 1.5f - side * 0.75f;
+			const float z = static_cast<float>(i / side) * 1.5f + 2.0f;
+			const float y = sinf(static_cast<float>(i)) * 0.5f;
+			float corners[8][3];
+			for (int c = 0; c < 8; c++) {
+				corners[c][0] = x + (c & 1 ? 0.5f : -0.5f);
+				corners[c][1] = y + (c & 2 ? 0.5f : -0.5f);
+				corners[c][2] = z + (c & 4 ? 0.5f : -0.5f);
+			}
+			const int faces[6][4] = {{0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1}, {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3}};
+			for (const int *face : faces) {
+				float polygon[12];
+				for (int c = 0; c < 4; c++) {
+					std::copy(corners[face[c]], corners[face[c]] + 3, polygon + c * 3);
+				}
+				builder.AddPolygon(polygon, 4, static_cast<int>(i % materialCount));
+			}
+		}
+		return builder.Build(false);
+	}
+
+	struct Frame
+	{
+		double ms;
+		SoftwareRasterStats stats;
+		SoftwareImage image;
+	};
+
+	// Culls, sorts and records the scene into the rasterizer, as the renderer would into its command list
+	Frame RenderScene(const Mesh &mesh, const ScenePipeline &scene, unsigned threads, int repeats, uint32_t width, uint32_t height)
+	{
+		JobSystem jobs(threads);
+		SoftwareRasterizer raster(jobs, width, height);
+		raster.SetGeometry(mesh.vertices.data(), static_cast<uint32_t>(mesh.vertices.size()), mesh.indices.data(),
+			static_cast<uint32_t>(mesh.indices.size()), 4);
+		const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+		Frame frame = {1e30, {}, {}};
+		for (int repeat = 0; repeat < repeats; repeat++) {
+			raster.Clear(black);
+			raster.ResetStats();
+			BenchmarkTimer timer;
+			scene.Record(raster, reinterpret_cast<uint64_t>(&scene.GetWorldViewProj()));
+			raster.Flush();
+			frame.ms = std::min(frame.ms, timer.Milliseconds());
+		}
+		frame.stats = raster.GetStats();
+		frame.image = raster.GetImage();
+		return frame;
+	}
+
+	// Times 1 to max_threads workers; every thread count has to produce the same image
+	bool MeasureScene(const char *name, const Mesh &mesh, const ScenePipeline &scene, unsigned max_threads, int repeats)
+	{
+		bool ok = true;
+		Frame single = {};
+		for (unsigned threads = 1; threads <= max_threads; threads = threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2) {
+			const Frame frame = RenderScene(mesh, scene, threads, repeats, image_width, image_height);
+			if (threads == 1) {
+				single = frame;
+				const SoftwareRasterStats &s = frame.stats;
+				std::cout << name << ": " << s.draws << " draws, " << s.triangles << " triangles (" << s.culled_triangles << " culled, "
+					<< s.clipped_triangles << " clipped), " << s.bin_entries << " bin entries, " << s.covered_pixels << " pixels covered, "
+					<< s.written_pixels << " written" << std::endl;
+			}
+			std::cout << "  " << threads << " threads: " << frame.ms << " ms, " << frame.stats.triangles / frame.ms / 1000.0 << " M triangles/s, "
+				<< frame.stats.covered_pixels / frame.ms / 1000.0 << " M pixels/s";
+			if (threads > 1) {
+				std::cout << " (" << single.ms / frame.ms << "x)";
+			}
+			std::cout << std::endl;
+			ok &= Check("same image on every thread count", CompareImages(frame.image, single.image, 0).different_pixels == 0);
+		}
+		return ok;
+	}
+
+	// The window's projection, 60 degrees vertically. Its starting view at z = -5 faces the outside of the back
+	// wall, which hides everything once triangles are filled, so this view looks in through the open side.
+	bool RenderCornellBox(const BenchmarkArgs &args, unsigned max_threads)
+	{
+		Mesh mesh;
+		MeshStats meshStats;
+		std::string warn;
+		std::string err;
+		if (!LoadObjMesh(args.model_dir + "CornellBox-Original.obj", mesh, meshStats, warn, err)) {
+			std::cout << "CornellBox-Original.obj: " << err << std::endl;
+			return false;
+		}
+		ScenePipeline scene;
+		scene.SetShapes(mesh.shapes.data(), mesh.shapes.size());
+		scene.UpdateCamera({{0.0f, 1.0f, 4.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, 60.0f / 180.0f * 3.14159265f,
+			static_cast<float>(image_width) / image_height, 0.001f, 100.0f});
+		scene.Cull();
+		scene.SortDraws();
+
+		bool ok = MeasureScene("CornellBox-Original.obj", mesh, scene, max_threads, 20);
+
+		// The golden image is rendered at a quarter of the size, with the same aspect ratio and view
+		const SoftwareImage image = RenderScene(mesh, scene, max_threads, 1, golden_width, golden_height).image;
+		const std::string outputPath = (std::filesystem::temp_directory_path() / "soft_raster_cornell.ppm").string();
+		if (!WritePpm(outputPath, image, err)) {
+			std::cout << err << std::endl;
+			return false;
+		}
+
+		// Copy the output over the golden image to accept a change
+		const std::string goldenPath = args.model_dir + golden_name;
+		SoftwareImage golden;
+		if (!ReadPpm(goldenPath, golden, err)) {
+			std::cout << "  " << err << "; the output is in " << outputPath << std::endl;
+			return false;
+		}
+		const ImageDifference difference = CompareImages(image, golden, golden_channel_tolerance);
+		std::cout << "  " << outputPath << " against " << goldenPath << ": " << difference.different_pixels << " pixels differ, by up to "
+			<< difference.max_channel_difference << std::endl;
+		// Allows a few pixels in ten thousand to change along edges
+		ok &= Check("golden image", difference.different_pixels * 10000 <= 5ull * golden_width * golden_height);
+		return ok;
+	}
+
+	bool SoftRasterBenchmark(const BenchmarkArgs &args)
+	{
+		const unsigned maxThreads = std::max(1u, args.threads);
+		bool ok = true;
+		{
+			JobSystem jobs(maxThreads);
+			ok &= CheckRules(jobs);
+		}
+		ok &= RenderCornellBox(args, maxThreads);
+
+		// Many small objects across the view, with the near ones cut by the near plane
+		const size_t cubeCount = std::max<size_t>(100, static_cast<size_t>(40000 * args.scale));
+		const Mesh cubes = BuildCubeGrid(cubeCount);
+		const float side = std::sqrt(static_cast<float>(cubeCount)) * 1.5f;
+		ScenePipeline scene;
+		scene.SetShapes(cubes.shapes.data(), cubes.shapes.size());
+		scene.UpdateCamera({{0.0f, 2.0f, 0.0f}, {0.0f, 0.0f, side * 0.5f}, {0.0f, 1.0f, 0.0f}, 1.5f,
+			static_cast<float>(image_width) / image_height, 0.1f, side * 2.0f});
+		scene.Cull();
+		scene.SortDraws();
+		ok &= MeasureScene("Cube grid", cubes, scene, maxThreads, 5);
+
+		std::cout << "Software rasterizer: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("soft_raster", SoftRasterBenchmark);
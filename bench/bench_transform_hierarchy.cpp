@@ -0,0 +1,247 @@
+#include "benchmark.h"
+#include "job_system.h"
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	struct Local
+	{
+		Float3 translation;
+		Quaternion rotation;
+		Float3 scale;
+	};
+
+	Local RandomLocal(std::mt19937 &random)
+	{
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> angle(-3.14159265f, 3.14159265f);
+		std::uniform_real_distribution<float> size(0.5f, 1.5f);
+		Float3 axis = {unit(random), unit(random), unit(random) + 2.0f};
+		axis = axis * (1.0f / sqrtf(Dot(axis, axis)));
+		return {{unit(random) * 4.0f, unit(random) * 4.0f, unit(random) * 4.0f}, QuaternionRotationAxis(axis, angle(random)),
+			{size(random), size(random), size(random)}};
+	}
+
+	// A forest of small trees, like the objects of a scene added model by model: each tree has up to 128 nodes,
+	// and a node's parent is one of the earlier nodes of its tree
+	void BuildForest(size_t count, std::vector<uint32_t> &parents, std::vector<Local> &locals)
+	{
+		std::mt19937 random(11);
+		parents.resize(count);
+		locals.resize(count);
+		size_t root = 0;
+		size_t treeEnd = 0;
+		for (size_t i = 0; i < count; i++) {
+			if (i == treeEnd) {
+				root = i;
+				treeEnd = i + 1 + random() % 128;
+				parents[i] = TransformHierarchy::no_parent;
+			} else {
+				parents[i] = static_cast<uint32_t>(root + random() % (i - root));
+			}
+			locals[i] = RandomLocal(random);
+		}
+	}
+
+	void Fill(TransformHierarchy &hierarchy, const std::vector<uint32_t> &parents, const std::vector<Local> &locals)
+	{
+		hierarchy.Clear();
+		hierarchy.Reserve(parents.size());
+		for (size_t i = 0; i < parents.size(); i++) {
+			hierarchy.Add(parents[i], locals[i].translation, locals[i].rotation, locals[i].scale);
+		}
+	}
+
+	Float4x4 CameraMatrix(float angle)
+	{
+		const Float3 eye = {cosf(angle) * 60.0f, 20.0f, sinf(angle) * 60.0f};
+		const Float4x4 view = MatrixLookAtLH(eye, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f});
+		const Float4x4 projection = MatrixPerspectiveFovLH(60.0f / 180.0f * 3.14159265f, 16.0f / 9.0f, 0.1f, 500.0f);
+		return MatrixMultiply(view, projection);
+	}
+
+	float MaxDifference(const Float4x4 &a, const Float4x4 &b)
+	{
+		float difference = 0.0f;
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++) {
+				// Relative to the magnitude, since world matrices grow along deep chains of scales
+				const float magnitude = std::max(1.0f, std::max(fabsf(a.m[i][j]), fabsf(b.m[i][j])));
+				difference = std::max(difference, fabsf(a.m[i][j] - b.m[i][j]) / magnitude);
+			}
+		}
+		return difference;
+	}
+
+	// World matrices against MatrixMultiply of the documented scale, rotation, translation order; an
+	// incremental update against a full one; SSE against scalar
+	bool CheckResults()
+	{
+		bool ok = true;
+		std::vector<uint32_t> parents;
+		std::vector<Local> locals;
+		BuildForest(20000, parents, locals);
+
+		TransformHierarchy hierarchy;
+		Fill(hierarchy, parents, locals);
+		ok &= Check("first update recomputes every node", hierarchy.UpdateWorld() == parents.size());
+		std::vector<Float4x4> reference(parents.size());
+		float error = 0.0f;
+		for (size_t i = 0; i < parents.size(); i++) {
+			const Local &l = locals[i];
+			const Float4x4 local = MatrixMultiply(MatrixMultiply(MatrixScaling(l.scale.x, l.scale.y, l.scale.z),
+				MatrixRotationQuaternion(l.rotation)), MatrixTranslation(l.translation.x, l.translation.y, l.translation.z));
+			reference[i] = parents[i] == TransformHierarchy::no_parent ? local : MatrixMultiply(local, reference[parents[i]]);
+			error = std::max(error, MaxDifference(reference[i], hierarchy.GetWorld(static_cast<uint32_t>(i))));
+		}
+		ok &= Check("world matches MatrixMultiply", error < 1e-4f);
+		ok &= Check("clean update recomputes nothing", hierarchy.UpdateWorld() == 0);
+
+		// Move a few nodes over several frames, then rebuild from the final locals
+		std::mt19937 random(5);
+		size_t descendants = 0;
+		for (int frame = 0; frame < 4; frame++) {
+			for (int moved = 0; moved < 50; moved++) {
+				const uint32_t node = static_cast<uint32_t>(random() % parents.size());
+				locals[node] = RandomLocal(random);
+				hierarchy.SetLocal(node, locals[node].translation, locals[node].rotation, locals[node].scale);
+			}
+			descendants = hierarchy.UpdateWorld();
+		}
+		TransformHierarchy rebuilt;
+		Fill(rebuilt, parents, locals);
+		rebuilt.UpdateWorld();
+		bool same = true;
+		for (uint32_t i = 0; i < parents.size(); i++) {
+			same &= memcmp(&hierarchy.GetWorld(i), &rebuilt.GetWorld(i), sizeof(Float4x4)) == 0;
+		}
+		ok &= Check("incremental update matches a full one", same);
+		ok &= Check("moves reach the subtrees", descendants >= 50 && descendants < parents.size());
+
+		TransformHierarchy scalar(false);
+		Fill(scalar, parents, locals);
+		scalar.UpdateWorld();
+		const Float4x4 viewProj = CameraMatrix(0.3f);
+		std::vector<Float4x4> clip(parents.size()), scalarClip(parents.size());
+		rebuilt.WriteClipMatrices(viewProj, 0, parents.size(), false, clip.data(), sizeof(Float4x4));
+		scalar.WriteClipMatrices(viewProj, 0, parents.size(), false, scalarClip.data(), sizeof(Float4x4));
+		error = 0.0f;
+		for (uint32_t i = 0; i < parents.size(); i++) {
+			error = std::max(error, MaxDifference(rebuilt.GetWorld(i), scalar.GetWorld(i)));
+			error = std::max(error, MaxDifference(clip[i], scalarClip[i]));
+		}
+		// Same tolerance as against MatrixMultiply: with FMA the compiler may contract the scalar kernel's
+		// multiply-adds, which rounds differently from the SSE kernel
+		ok &= Check("scalar matches SIMD", error < 1e-4f);
+		return ok;
+	}
+
+	struct Timing
+	{
+		double update_ms;
+		double clip_ms;
+		size_t updated;
+		size_t written;
+	};
+
+	// Best of a few frames of moving nodes (all of them, or those listed), UpdateWorld() and WriteClipMatrices()
+	Timing MeasureFrames(TransformHierarchy &hierarchy, const std::vector<uint32_t> &nodes, bool moveCamera, bool all,
+		std::vector<Float4x4> &slots)
+	{
+		Timing best = {1e30, 1e30, 0, 0};
+		for (int frame = 0; frame < 5; frame++) {
+			if (all) {
+				for (uint32_t i = 0; i < hierarchy.GetCount(); i++)
+					hierarchy.SetTranslation(i, {0.01f * frame, 1.0f, 2.0f});
+			} else {
+				for (uint32_t node : nodes)
+					hierarchy.SetRotation(node, QuaternionRotationAxis({0.0f, 1.0f, 0.0f}, 0.1f * frame));
+			}
+			BenchmarkTimer timer;
+			const size_t updated = hierarchy.UpdateWorld();
+			const double updateMs = timer.Milliseconds();
+			timer.Reset();
+			const Float4x4 viewProj = CameraMatrix(moveCamera ? 0.01f * frame : 0.0f);
+			const size_t written = hierarchy.WriteClipMatrices(viewProj, 0, hierarchy.GetCount(), !moveCamera, slots.data(),
+				sizeof(Float4x4));
+			const double clipMs = timer.Milliseconds();
+			DoNotOptimize(slots[written / 2]);
+			if (updateMs + clipMs < best.update_ms + best.clip_ms)
+				best = {updateMs, clipMs, updated, written};
+		}
+		return best;
+	}
+
+	void Report(const char *kernel, const char *name, const Timing &t)
+	{
+		const double ms = t.update_ms + t.clip_ms;
+		std::cout << "  " << kernel << " " << name << ": " << t.updated << " world + " << t.written << " clip matrices in "
+			<< ms << " ms (update " << t.update_ms << ", clip " << t.clip_ms << "), "
+			<< (t.updated + t.written) / std::max(ms, 1e-6) / 1000.0 << " M matrices/s" << std::endl;
+	}
+
+	bool TransformHierarchyBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = CheckResults();
+
+		const size_t sizes[] = {10000, 100000, 1000000};
+		for (size_t size : sizes) {
+			const size_t count = std::max<size_t>(1024, static_cast<size_t>(size * args.scale));
+			std::vector<uint32_t> parents;
+			std::vector<Local> locals;
+			BuildForest(count, parents, locals);
+			// The clip matrices are packed the way a structured buffer of per-object matrices would hold them
+			std::vector<Float4x4> slots(count);
+
+			// 1% of the nodes move each frame, as animated objects and their attachments would
+			std::mt19937 random(3);
+			std::vector<uint32_t> moving(std::max<size_t>(1, count / 100));
+			for (uint32_t &node : moving)
+				node = static_cast<uint32_t>(random() % count);
+
+			std::cout << count << " nodes:" << std::endl;
+			for (bool simd : {false, true}) {
+				TransformHierarchy hierarchy(simd);
+				Fill(hierarchy, parents, locals);
+				hierarchy.UpdateWorld();
+				const char *kernel = hierarchy.GetKernelName();
+				const Timing all = MeasureFrames(hierarchy, moving, true, true, slots);
+				Report(kernel, "all dirty, camera moving", all);
+				const Timing sparse = MeasureFrames(hierarchy, moving, false, false, slots);
+				Report(kernel, "1% moved, camera still", sparse);
+				const Timing clean = MeasureFrames(hierarchy, {}, true, false, slots);
+				Report(kernel, "nothing moved, camera moving", clean);
+				ok &= Check("sparse update skips unchanged nodes", sparse.updated < count / 2 && sparse.written == sparse.updated);
+				ok &= Check("clean update recomputes nothing", clean.updated == 0 && clean.written == count);
+			}
+
+			// Clip matrices split across the job system, as a frame writing its per-object constants would
+			TransformHierarchy hierarchy;
+			Fill(hierarchy, parents, locals);
+			hierarchy.UpdateWorld();
+			JobSystem jobs(args.threads);
+			const Float4x4 viewProj = CameraMatrix(1.0f);
+			double best = 1e30;
+			for (int frame = 0; frame < 5; frame++) {
+				BenchmarkTimer timer;
+				jobs.ParallelFor(count, 4096, [&](size_t begin, size_t end) {
+					hierarchy.WriteClipMatrices(viewProj, begin, end, false, slots.data(), sizeof(Float4x4));
+				});
+				best = std::min(best, timer.Milliseconds());
+			}
+			std::cout << "  " << hierarchy.GetKernelName() << " clip on " << jobs.GetThreadCount() << " threads: " << best
+				<< " ms, " << count / std::max(best, 1e-6) / 1000.0 << " M matrices/s" << std::endl;
+		}
+
+		std::cout << "Transform hierarchy: " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("transform_hierarchy", TransformHierarchyBenchmark);
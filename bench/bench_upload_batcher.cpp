@@ -0,0 +1,120 @@
+#include "benchmark.h"
+#include "upload_batcher.h"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Copies execute only when their submission "completes", so reusing staging space too early corrupts the result
+	class MockCopyBackend : public CopyBackend
+	{
+	public:
+		MockCopyBackend(uint64_t staging_size, size_t latency) : staging(staging_size), latency(latency), next_fence(1), completed(0) {};
+
+		uint8_t *GetStagingMemory() override { return staging.data(); }
+
+		void CopyToBuffer(void *destination, uint64_t destination_offset, uint64_t staging_offset, uint64_t size) override
+		{
+			recording.push_back({static_cast<std::vector<uint8_t> *>(destination), destination_offset, staging_offset, size});
+		}
+
+		uint64_t Submit() override
+		{
+			in_flight.push_back({next_fence, recording});
+			recording.clear();
+			// Older submissions finish as new ones arrive
+			while (in_flight.size() > latency) {
+				Execute();
+			}
+			return next_fence++;
+		}
+
+		uint64_t GetCompletedValue() override { return completed; }
+
+		void WaitForValue(uint64_t value) override
+		{
+			while (completed < value && !in_flight.empty()) {
+				Execute();
+			}
+		}
+
+	private:
+		struct Copy
+		{
+			std::vector<uint8_t> *destination;
+			uint64_t destination_offset;
+			uint64_t staging_offset;
+			uint64_t size;
+		};
+
+		struct Batch
+		{
+			uint64_t fence;
+			std::vector<Copy> copies;
+		};
+
+		void Execute()
+		{
+			for (const Copy &copy : in_flight.front().copies) {
+				memcpy(copy.destination->data() + copy.destination_offset, staging.data() + copy.staging_offset, copy.size);
+			}
+			completed = in_flight.front().fence;
+			in_flight.pop_front();
+		}
+
+		std::vector<uint8_t> staging;
+		std::vector<Copy> recording;
+		std::deque<Batch> in_flight;
+		size_t latency;
+		uint64_t next_fence;
+		uint64_t completed;
+	};
+
+	bool UploadBatcherBenchmark(const BenchmarkArgs &args)
+	{
+		const size_t bufferCount = std::max<size_t>(100, static_cast<size_t>(20000 * args.scale));
+		std::mt19937 random(7);
+		std::uniform_int_distribution<int> sizeDistribution(1, 16 * 1024);
+
+		// Many small vertex/index buffers plus a few large ones that exceed the staging ring
+		std::vector<std::vector<uint8_t>> sources(bufferCount);
+		uint64_t totalBytes = 0;
+		for (size_t i = 0; i < bufferCount; i++) {
+			size_t size = i % 1000 == 0 ? 12 * 1024 * 1024 : static_cast<size_t>(sizeDistribution(random));
+			sources[i].resize(size);
+			for (size_t b = 0; b < size; b += 61) {
+				sources[i][b] = static_cast<uint8_t>(random());
+			}
+			totalBytes += size;
+		}
+
+		for (uint64_t stagingSize : {1ull << 20, 4ull << 20, 16ull << 20}) {
+			MockCopyBackend backend(stagingSize, 2);
+			UploadBatcher batcher(backend, stagingSize);
+			std::vector<std::vector<uint8_t>> destinations(bufferCount);
+			for (size_t i = 0; i < bufferCount; i++) {
+				destinations[i].resize(sources[i].size());
+			}
+
+			BenchmarkTimer timer;
+			for (size_t i = 0; i < bufferCount; i++) {
+				batcher.Upload(&destinations[i], 0, sources[i].data(), sources[i].size());
+			}
+			batcher.WaitForIdle();
+			const double ms = timer.Milliseconds();
+
+			const UploadBatcherStats &stats = batcher.GetStats();
+			std::cout << "staging " << (stagingSize >> 20) << " MB: " << stats.uploads << " uploads, " << stats.copies << " copies, "
+				<< stats.submissions << " submissions, " << stats.stalls << " stalls, "
+				<< totalBytes / (1024.0 * 1024.0) / (ms / 1000.0) << " MB/s" << std::endl;
+		}
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("upload_batcher", UploadBatcherBenchmark);
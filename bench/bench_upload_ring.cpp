@@ -0,0 +1,78 @@
+#include "benchmark.h"
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	// Pages in plain CPU memory with made-up GPU addresses
+	class HeapPageSource : public UploadPageSource
+	{
+	public:
+		HeapPageSource() : next_gpu_address(0x100000000ull) {};
+
+		bool CreatePage(uint64_t size, UploadPage &page) override
+		{
+			page.cpu_address = new uint8_t[size];
+			page.gpu_address = next_gpu_address;
+			page.size = size;
+			page.resource = page.cpu_address;
+			next_gpu_address += (size + 0xFFFF) & ~0xFFFFull;
+			return true;
+		}
+
+		void DestroyPage(UploadPage &page) override
+		{
+			delete[] page.cpu_address;
+			page = {};
+		}
+
+	private:
+		uint64_t next_gpu_address;
+	};
+
+	// Runs frames whose GPU completion lags `latency` frames behind
+	void Simulate(uint64_t page_size, int frames, int latency, UploadRingStats &stats, uint64_t &allocations)
+	{
+		HeapPageSource source;
+		UploadRing ring(source, page_size);
+		std::mt19937 random(42);
+		std::uniform_int_distribution<int> countDistribution(1, 64);
+		std::uniform_int_distribution<int> sizeDistribution(1, 1024);
+		allocations = 0;
+
+		for (int frame = 1; frame <= frames; frame++) {
+			ring.Retire(frame > latency ? static_cast<uint64_t>(frame - latency) : 0);
+
+			const int count = countDistribution(random);
+			for (int i = 0; i < count; i++) {
+				const uint64_t size = static_cast<uint64_t>(sizeDistribution(random)) * (i % 17 == 0 ? 16 : 1);
+				UploadAllocation allocation = ring.Allocate(size);
+				allocations++;
+				allocation.cpu_address[0] = static_cast<uint8_t>(i);
+			}
+
+			ring.Close(static_cast<uint64_t>(frame));
+		}
+
+		stats = ring.GetStats();
+	}
+
+	bool UploadRingBenchmark(const BenchmarkArgs &args)
+	{
+		UploadRingStats stats;
+		uint64_t allocations;
+		const int frames = std::max(1000, static_cast<int>(50000 * args.scale));
+		BenchmarkTimer timer;
+		Simulate(64 * 1024, frames, 2, stats, allocations);
+		const double ms = timer.Milliseconds();
+		std::cout << allocations << " allocations in " << ms << " ms, " << ms * 1e6 / allocations << " ns/allocation, "
+			<< stats.page_count << " pages, " << stats.padding_bytes * 100.0 / (stats.allocated_bytes + stats.padding_bytes)
+			<< "% padding" << std::endl;
+		return true;
+	}
+}
+
+REGISTER_BENCHMARK("upload_ring", UploadRingBenchmark);
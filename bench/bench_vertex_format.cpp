@@ -0,0 +1,128 @@
+#include "benchmark.h"
+#include "obj_mesh.h"
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// Round trip through the quantized format; errors against the bound of half a step per axis
+	bool ReportModel(const std::string &name, const std::vector<MeshVertex> &vertices)
+	{
+		bool ok = true;
+		const VertexQuantization quantization = ComputeVertexQuantization(vertices.data(), vertices.size());
+		std::vector<QuantizedVertex> encoded(vertices.size());
+		std::vector<MeshVertex> decoded(vertices.size());
+		EncodeVertices(vertices.data(), vertices.size(), quantization, encoded.data());
+		DecodeVertices(encoded.data(), encoded.size(), quantization, decoded.data());
+
+		float positionError = 0.0f;
+		float colorError = 0.0f;
+		float bound = 0.0f;
+		float extent = 0.0f;
+		for (int axis = 0; axis < 3; axis++) {
+			bound = std::max(bound, quantization.scale[axis] / 65535.0f * 0.5f);
+			extent = std::max(extent, quantization.scale[axis]);
+		}
+		for (size_t i = 0; i < vertices.size(); i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				positionError = std::max(positionError, fabsf(decoded[i].position[axis] - vertices[i].position[axis]));
+			}
+			for (int channel = 0; channel < 4; channel++) {
+				colorError = std::max(colorError, fabsf(decoded[i].color[channel] - std::min(std::max(vertices[i].color[channel], 0.0f), 1.0f)));
+			}
+		}
+
+		std::cout << name << ": " << vertices.size() << " vertices, " << GetVertexStride(VertexFormat::Float) << " -> "
+			<< GetVertexStride(VertexFormat::Quantized) << " bytes per vertex (" << vertices.size() * GetVertexStride(VertexFormat::Float) / 1024 << " -> "
+			<< vertices.size() * GetVertexStride(VertexFormat::Quantized) / 1024 << " KiB), max position error " << positionError << " (bound " << bound
+			<< ", " << positionError / extent * 100.0f << "% of the largest extent), max color error " << colorError << std::endl;
+
+		// Float rounding of the decode adds a little on top of the half step
+		ok &= Check("position error", positionError <= bound * 1.01f + extent * 1e-6f);
+		ok &= Check("color error", colorError <= 0.5f / 255.0f + 1e-6f);
+		return ok;
+	}
+
+	// Dense synthetic scan: a noisy terrain of varying materials
+	std::vector<MeshVertex> BuildSyntheticVertices(size_t count)
+	{
+		std::vector<MeshVertex> vertices(count);
+		uint32_t random = 12345;
+		auto next = [&random]() {
+			random = random * 1664525u + 1013904223u;
+			return static_cast<float>(random >> 8) / 16777216.0f;
+		};
+		const size_t side = static_cast<size_t>(sqrt(static_cast<double>(count))) + 1;
+		for (size_t i = 0; i < count; i++) {
+			MeshVertex &v = vertices[i];
+			v.position[0] = static_cast<float>(i % side) * 0.01f - 20.0f;
+			v.position[1] = sinf(static_cast<float>(i % side) * 0.05f) * 2.0f + next() * 0.1f;
+			v.position[2] = static_cast<float>(i / side) * 0.01f + 3.0f;
+			const float shade = next();
+			v.color[0] = shade;
+			v.color[1] = 1.0f - shade;
+			v.color[2] = 0.5f;
+			v.color[3] = 1.0f;
+		}
+		return vertices;
+	}
+
+	bool MeasureKernels(const BenchmarkArgs &args)
+	{
+		bool ok = true;
+		const size_t count = std::max<size_t>(1000, static_cast<size_t>(4000000 * args.scale));
+		const std::vector<MeshVertex> vertices = BuildSyntheticVertices(count);
+		ok &= ReportModel("Synthetic", vertices);
+
+		const VertexQuantization quantization = ComputeVertexQuantization(vertices.data(), vertices.size());
+		std::vector<QuantizedVertex> scalar(count);
+		std::vector<MeshVertex> decodedScalar(count);
+		BenchmarkTimer timer;
+		EncodeVerticesScalar(vertices.data(), count, quantization, scalar.data());
+		const double encodeScalar = timer.Milliseconds();
+		timer.Reset();
+		DecodeVerticesScalar(scalar.data(), count, quantization, decodedScalar.data());
+		const double decodeScalar = timer.Milliseconds();
+		std::cout << "  scalar: encode " << count / encodeScalar / 1000.0 << " M vertices/s, decode " << count / decodeScalar / 1000.0 << " M vertices/s" << std::endl;
+
+#ifdef VERTEX_FORMAT_SSE
+		std::vector<QuantizedVertex> simd(count);
+		std::vector<MeshVertex> decodedSimd(count);
+		timer.Reset();
+		EncodeVerticesSSE(vertices.data(), count, quantization, simd.data());
+		const double encodeSimd = timer.Milliseconds();
+		timer.Reset();
+		DecodeVerticesSSE(simd.data(), count, quantization, decodedSimd.data());
+		const double decodeSimd = timer.Milliseconds();
+		std::cout << "  SSE:    encode " << count / encodeSimd / 1000.0 << " M vertices/s (" << encodeScalar / encodeSimd << "x), decode "
+			<< count / decodeSimd / 1000.0 << " M vertices/s (" << decodeScalar / decodeSimd << "x)" << std::endl;
+		ok &= Check("SSE encode matches scalar", memcmp(simd.data(), scalar.data(), count * sizeof(QuantizedVertex)) == 0);
+		ok &= Check("SSE decode matches scalar", memcmp(decodedSimd.data(), decodedScalar.data(), count * sizeof(MeshVertex)) == 0);
+#endif
+		return ok;
+	}
+
+	bool VertexFormatBenchmark(const BenchmarkArgs &args)
+	{
+		bool ok = true;
+		Mesh mesh;
+		MeshStats meshStats;
+		std::string warn;
+		std::string err;
+		if (LoadObjMesh(args.model_dir + "CornellBox-Original.obj", mesh, meshStats, warn, err)) {
+			ok &= ReportModel("CornellBox-Original.obj", mesh.vertices);
+		} else {
+			std::cout << "CornellBox-Original.obj: " << err << std::endl;
+			ok = false;
+		}
+		ok &= MeasureKernels(args);
+		std::cout << "Vertex format (" << GetVertexKernelName() << "): " << (ok ? "ok" : "FAILED") << std::endl;
+		return ok;
+	}
+}
+
+REGISTER_BENCHMARK("vertex_format", VertexFormatBenchmark);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+struct BenchmarkArgs
+{
+	std::string model_dir;
+	// Multiplies synthetic workload sizes
+	double scale;
+	unsigned threads;
+};
+
+// Returns false when one of the benchmark's checks failed
+typedef bool (*BenchmarkFunction)(const BenchmarkArgs &args);
+
+struct Benchmark
+{
+	const char *name;
+	BenchmarkFunction function;
+};
+
+std::vector<Benchmark> &GetBenchmarks();
+
+// Prints the name of a failed check and fails the running benchmark, whatever it returns; returns condition
+bool Check(const char *name, bool condition);
+
+struct BenchmarkRegistrar
+{
+	BenchmarkRegistrar(const char *name, BenchmarkFunction function)
+	{
+		GetBenchmarks().push_back({name, function});
+	}
+};
+
+#define REGISTER_BENCHMARK(name, function) static BenchmarkRegistrar function##_registrar(name, function)
+
+class BenchmarkTimer
+{
+public:
+	BenchmarkTimer() : start(std::chrono::steady_clock::now()) {};
+
+	void Reset() { start = std::chrono::steady_clock::now(); }
+	double Milliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// The pointer itself is volatile, so every store to it happens; at namespace scope it draws no unused warning
+inline const void *volatile do_not_optimize_sink;
+
+// Keeps the optimizer from dropping a computed value
+template <typename T>
+inline void DoNotOptimize(const T &value)
+{
+	do_not_optimize_sink = &value;
+}
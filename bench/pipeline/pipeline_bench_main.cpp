@@ -0,0 +1,339 @@
+// Headless benchmark of the renderer's CPU stages: OBJ load, mesh build, scene setup, camera update,
+// culling, draw sorting and command recording into null/recording sinks. Results go to a JSON file
+// that a later run can use as a baseline; a stage slower than the baseline by more than the threshold
+// makes the run exit with code 1.
+
+#include "benchmark.h"
+#include "obj_mesh.h"
+#include "obj_parallel.h"
+#include "scene_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	// Differences below this are timer noise, not regressions
+	const double noise_floor_ms = 0.01;
+	// Every measurement keeps the best of this many runs
+	const int runs = 3;
+
+	struct Options
+	{
+		std::string model_dir = "models/";
+		double scale = 1.0;
+		int frames = 200;
+		unsigned threads = 0;
+		std::string output = "pipeline_results.json";
+		std::string baseline;
+		double threshold = 10.0;
+	};
+
+	struct Result
+	{
+		std::string name;
+		double ms;
+		int samples;
+	};
+
+	struct ObjData
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+	};
+
+	// copies instances of the model on a square grid, each group renamed so every copy is its own shape
+	bool WriteGridScene(const std::string &path, const std::string &mtl_name, const ObjData &model, size_t copies)
+	{
+		std::ofstream obj(path, std::ios::binary);
+		if (!obj) {
+			return false;
+		}
+
+		const size_t side = static_cast<size_t>(ceil(sqrt(static_cast<double>(copies))));
+		const size_t vertexCount = model.attrib.vertices.size() / 3;
+		char line[160];
+		obj << "mtllib " << mtl_name << "\n";
+
+		for (size_t copy = 0; copy < copies; copy++) {
+			const float offsetX = static_cast<float>(copy % side) * 2.5f;
+			const float offsetZ = static_cast<float>(copy / side) * 2.5f;
+			for (size_t v = 0; v < vertexCount; v++) {
+				snprintf(line, sizeof(line), "v %.5f %.5f %.5f\n", model.attrib.vertices[v * 3] + offsetX,
+					model.attrib.vertices[v * 3 + 1], model.attrib.vertices[v * 3 + 2] + offsetZ);
+				obj << line;
+			}
+
+			const size_t base = copy * vertexCount + 1;
+			for (const tinyobj::shape_t &shape : model.shapes) {
+				obj << "g " << shape.name << "_" << copy << "\n";
+				int material = -2;
+				size_t index = 0;
+				for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+					if (shape.mesh.material_ids[f] != material) {
+						material = shape.mesh.material_ids[f];
+						if (material >= 0) {
+							obj << "usemtl " << model.materials[material].name << "\n";
+						}
+					}
+					obj << "f";
+					for (size_t v = 0; v < shape.mesh.num_face_vertices[f]; v++) {
+						obj << " " << base + shape.mesh.indices[index++].vertex_index;
+					}
+					obj << "\n";
+				}
+			}
+		}
+		return static_cast<bool>(obj);
+	}
+
+	double LoadObj(const std::string &path, const std::string &mtl_dir, unsigned threads, ObjData &data)
+	{
+		std::string warn, err;
+		data = ObjData();
+		BenchmarkTimer timer;
+		if (!LoadObjParallel(&data.attrib, &data.shapes, &data.materials, &warn, &err, path.c_str(), mtl_dir.c_str(), threads)) {
+			std::cerr << "Failed to load " << path << ": " << err << std::endl;
+			exit(2);
+		}
+		return timer.Milliseconds();
+	}
+
+	// Camera circling inside the scene and looking across it, so culling keeps a varying part
+	Camera GetCamera(const float bounds_min[3], const float bounds_max[3], int frame, int frames)
+	{
+		const float centerX = 0.5f * (bounds_min[0] + bounds_max[0]);
+		const float centerZ = 0.5f * (bounds_min[2] + bounds_max[2]);
+		const float radius = 0.3f * std::max(bounds_max[0] - bounds_min[0], bounds_max[2] - bounds_min[2]) + 1.0f;
+		const float angle = 6.2831853f * frame / frames;
+		const Float3 eye = {centerX + radius * sinf(angle), 1.0f, centerZ - radius * cosf(angle)};
+		const Float3 at = {eye.x + cosf(angle), 1.0f, eye.z + sinf(angle)};
+		return {eye, at, {0.0f, 1.0f, 0.0f}, 60.0f / 180.0f * 3.14159265f, 16.0f / 9.0f, 0.001f, 100.0f};
+	}
+
+	void RunScene(const std::string &scene_name, const std::string &path, const std::string &mtl_dir, const Options &options,
+		std::vector<Result> &results)
+	{
+		ObjData data;
+		double loadMs = 1e30;
+		for (int run = 0; run < runs; run++) {
+			loadMs = std::min(loadMs, LoadObj(path, mtl_dir, options.threads, data));
+		}
+		results.push_back({scene_name + "/obj_load", loadMs, runs});
+
+		Mesh mesh;
+		MeshStats stats;
+		double buildMs = 1e30;
+		for (int run = 0; run < runs; run++) {
+			BenchmarkTimer timer;
+			BuildObjMesh(data.attrib, data.shapes, data.materials, mesh, stats);
+			buildMs = std::min(buildMs, timer.Milliseconds());
+		}
+		results.push_back({scene_name + "/mesh_build", buildMs, runs});
+
+		ScenePipeline scene;
+		double setupMs = 1e30;
+		for (int run = 0; run < runs; run++) {
+			BenchmarkTimer timer;
+			scene.SetShapes(mesh.shapes.data(), mesh.shapes.size());
+			setupMs = std::min(setupMs, timer.Milliseconds());
+		}
+		results.push_back({scene_name + "/scene_setup", setupMs, runs});
+
+		float boundsMin[3] = {1e30f, 1e30f, 1e30f};
+		float boundsMax[3] = {-1e30f, -1e30f, -1e30f};
+		for (const MeshShape &shape : mesh.shapes) {
+			for (int axis = 0; axis < 3; axis++) {
+				boundsMin[axis] = std::min(boundsMin[axis], shape.bounds_min[axis]);
+				boundsMax[axis] = std::max(boundsMax[axis], shape.bounds_max[axis]);
+			}
+		}
+
+		// Per-frame stages, each timed on its own and averaged over the camera path
+		enum { camera_update, cull, sort, record_null, record_recording, stage_count };
+		const char *stageNames[stage_count] = {"camera_update", "cull", "sort", "record_null", "record_recording"};
+		double bestMs[stage_count];
+		std::fill(bestMs, bestMs + stage_count, 1e30);
+		size_t visible = 0;
+		size_t draws = 0;
+		NullCommandSink nullSink;
+		RecordingCommandSink recordingSink;
+		BenchmarkTimer timer;
+
+		for (int run = 0; run < runs; run++) {
+			double stageMs[stage_count] = {};
+			visible = 0;
+			draws = 0;
+			for (int frame = 0; frame < options.frames; frame++) {
+				const Camera camera = GetCamera(boundsMin, boundsMax, frame, options.frames);
+
+				timer.Reset();
+				scene.UpdateCamera(camera);
+				stageMs[camera_update] += timer.Milliseconds();
+
+				timer.Reset();
+				scene.Cull();
+				stageMs[cull] += timer.Milliseconds();
+
+				timer.Reset();
+				scene.SortDraws();
+				stageMs[sort] += timer.Milliseconds();
+
+				timer.Reset();
+				scene.Record(nullSink, 0);
+				stageMs[record_null] += timer.Milliseconds();
+
+				recordingSink.Clear();
+				timer.Reset();
+				scene.Record(recordingSink, 0);
+				stageMs[record_recording] += timer.Milliseconds();
+
+				visible += scene.GetVisibleShapes().size();
+				draws += scene.GetRenderQueue().GetBatches().size();
+			}
+			for (int stage = 0; stage < stage_count; stage++) {
+				bestMs[stage] = std::min(bestMs[stage], stageMs[stage] / options.frames);
+			}
+		}
+
+		for (int stage = 0; stage < stage_count; stage++) {
+			results.push_back({scene_name + "/" + stageNames[stage], bestMs[stage], options.frames});
+		}
+
+		std::cout << scene_name << ": " << mesh.vertices.size() << " vertices, " << mesh.indices.size() / 3 << " triangles, "
+			<< mesh.shapes.size() << " shapes, " << visible / options.frames << " visible and " << draws / options.frames
+			<< " draws per frame" << std::endl;
+	}
+
+	void WriteResults(const std::string &path, const Options &options, const std::vector<Result> &results)
+	{
+		std::ofstream json(path, std::ios::binary);
+		json << "{\n\"scale\": " << options.scale << ",\n\"frames\": " << options.frames << ",\n\"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++) {
+			json << "{\"name\": \"" << results[i].name << "\", \"ms\": " << results[i].ms << ", \"samples\": " << results[i].samples << "}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		json << "]\n}\n";
+	}
+
+	// Reads the result lines WriteResults produced
+	bool ReadResults(const std::string &path, std::map<std::string, double> &results)
+	{
+		std::ifstream json(path, std::ios::binary);
+		if (!json) {
+			return false;
+		}
+		std::string line;
+		while (std::getline(json, line)) {
+			const size_t nameAt = line.find("\"name\": \"");
+			const size_t msAt = line.find("\"ms\": ");
+			if (nameAt == std::string::npos || msAt == std::string::npos) {
+				continue;
+			}
+			const size_t nameBegin = nameAt + 9;
+			const size_t nameEnd = line.find('"', nameBegin);
+			results[line.substr(nameBegin, nameEnd - nameBegin)] = atof(line.c_str() + msAt + 6);
+		}
+		return true;
+	}
+
+	void PrintUsage(const char *program)
+	{
+		std::cout << "Usage: " << program << " [--models dir] [--scale factor] [--frames count] [--threads count]"
+			" [--output results.json] [--baseline baseline.json] [--threshold percent]" << std::endl;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--models") == 0 && hasValue) {
+			options.model_dir = argv[++i];
+			if (!options.model_dir.empty() && options.model_dir.back() != '/' && options.model_dir.back() != '\\') {
+				options.model_dir += '/';
+			}
+		} else if (strcmp(argv[i], "--scale") == 0 && hasValue) {
+			options.scale = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--frames") == 0 && hasValue) {
+			options.frames = std::max(1, atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--threads") == 0 && hasValue) {
+			options.threads = static_cast<unsigned>(atoi(argv[++i]));
+		} else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+			options.output = argv[++i];
+		} else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+			options.baseline = argv[++i];
+		} else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+			options.threshold = atof(argv[++i]);
+		} else {
+			PrintUsage(argv[0]);
+			return 2;
+		}
+	}
+
+	std::vector<Result> results;
+	const std::string modelName = "CornellBox-Original";
+	const std::string modelPath = options.model_dir + modelName + ".obj";
+	RunScene("cornell", modelPath, options.model_dir, options, results);
+
+	// Scaled-up scenes: copies of the bundled model on a grid
+	ObjData model;
+	LoadObj(modelPath, options.model_dir, options.threads, model);
+	const struct
+	{
+		const char *name;
+		size_t copies;
+	} gridScenes[] = {{"grid_100", 100}, {"grid_2500", 2500}};
+	for (const auto &grid : gridScenes) {
+		const size_t copies = std::max<size_t>(1, static_cast<size_t>(grid.copies * options.scale));
+		const std::string path = std::string("pipeline_") + grid.name + ".obj";
+		if (!WriteGridScene(path, modelName + ".mtl", model, copies)) {
+			std::cerr << "Failed to write " << path << std::endl;
+			return 2;
+		}
+		RunScene(grid.name, path, options.model_dir, options, results);
+		std::remove(path.c_str());
+	}
+
+	WriteResults(options.output, options, results);
+
+	std::map<std::string, double> baseline;
+	const bool compare = !options.baseline.empty();
+	if (compare && !ReadResults(options.baseline, baseline)) {
+		std::cerr << "Failed to read baseline " << options.baseline << std::endl;
+		return 2;
+	}
+
+	int regressions = 0;
+	for (const Result &result : results) {
+		char line[200];
+		snprintf(line, sizeof(line), "%-28s %12.4f ms", result.name.c_str(), result.ms);
+		std::cout << line;
+
+		auto reference = baseline.find(result.name);
+		if (compare && reference != baseline.end()) {
+			const double change = reference->second > 0.0 ? (result.ms / reference->second - 1.0) * 100.0 : 0.0;
+			const bool regressed = change > options.threshold && result.ms - reference->second > noise_floor_ms;
+			snprintf(line, sizeof(line), "  %+7.1f%%%s", change, regressed ? "  REGRESSION" : "");
+			std::cout << line;
+			regressions += regressed ? 1 : 0;
+		}
+		std::cout << std::endl;
+	}
+
+	std::cout << "Results written to " << options.output << std::endl;
+	if (compare) {
+		std::cout << regressions << " regression(s) over " << options.threshold << "% against " << options.baseline << std::endl;
+	}
+	return regressions > 0 ? 1 : 0;
+}
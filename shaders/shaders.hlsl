@@ -1,5 +1,8 @@
 cbuffer ConstantBuffer : register(b0) {
 	float4x4 mwpMatrix;
+	// Quantized positions are in [0, 1] over the mesh bounds: position * scale + offset
+	float4 positionScale;
+	float4 positionOffset;
 }
 
 struct PSInput {
@@ -10,6 +13,9 @@ struct PSInput {
 PSInput VSMain(float4 position : POSITION, float4 color : COLOR) {
 	PSInput result;
 
+#ifdef QUANTIZED_VERTICES
+	position = float4(position.xyz * positionScale.xyz + positionOffset.xyz, 1.0f);
+#endif
 	result.position = mul(mwpMatrix, position);
 	result.color = color;
 
@@ -0,0 +1,763 @@
+#include "asset_streamer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char *SkipSpace(const char *p, const char *end)
+	{
+		while (p < end && IsSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	inline const char *SkipToken(const char *p, const char *end)
+	{
+		while (p < end && !IsSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	bool IsKeyword(const char *p, const char *end, const char *keyword)
+	{
+		const size_t length = strlen(keyword);
+		return static_cast<size_t>(end - p) >= length && memcmp(p, keyword, length) == 0 &&
+			(p + length == end || IsSpace(p[length]));
+	}
+
+	// Exact for the short decimals OBJ exporters write; anything else goes through strtod
+	bool ParseReal(const char *&p, const char *end, float &value)
+	{
+		static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+		p = SkipSpace(p, end);
+		const char *start = p;
+		const char *tokenEnd = SkipToken(p, end);
+		bool negative = false;
+		if (p < tokenEnd && (*p == '+' || *p == '-')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int fraction = 0;
+		bool point = false;
+		for (; p < tokenEnd && digits < 16; p++) {
+			if (*p >= '0' && *p <= '9') {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				digits++;
+				fraction += point;
+			} else if (*p == '.' && !point) {
+				point = true;
+			} else {
+				break;
+			}
+		}
+		if (p == tokenEnd && digits > 0) {
+			const double result = mantissa / powers[fraction];
+			value = static_cast<float>(negative ? -result : result);
+			return true;
+		}
+
+		char token[64];
+		const size_t length = static_cast<size_t>(tokenEnd - start);
+		p = tokenEnd;
+		if (length == 0 || length >= sizeof(token)) {
+			return false;
+		}
+		memcpy(token, start, length);
+		token[length] = '\0';
+		char *parsed;
+		value = static_cast<float>(strtod(token, &parsed));
+		return parsed != token;
+	}
+
+	bool ParseInt(const char *&p, const char *end, int &value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-')) {
+			negative = *p == '-';
+			p++;
+		}
+		if (p >= end || *p < '0' || *p > '9') {
+			return false;
+		}
+		int result = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			result = result * 10 + (*p - '0');
+			p++;
+		}
+		value = negative ? -result : result;
+		return true;
+	}
+
+	std::string ReadName(const char *p, const char *end)
+	{
+		p = SkipSpace(p, end);
+		while (end > p && IsSpace(end[-1])) {
+			end--;
+		}
+		return std::string(p, end);
+	}
+
+	float DistanceSquared(const Float3 &point, const float *bounds_min, const float *bounds_max)
+	{
+		const float p[3] = {point.x, point.y, point.z};
+		float result = 0.0f;
+		for (int axis = 0; axis < 3; axis++) {
+			const float d = std::max(std::max(bounds_min[axis] - p[axis], p[axis] - bounds_max[axis]), 0.0f);
+			result += d * d;
+		}
+		return result;
+	}
+
+	void ResetBounds(float *bounds_min, float *bounds_max)
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			bounds_min[axis] = FLT_MAX;
+			bounds_max[axis] = -FLT_MAX;
+		}
+	}
+
+	void GrowBounds(const float *position, float *bounds_min, float *bounds_max)
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			bounds_min[axis] = std::min(bounds_min[axis], position[axis]);
+			bounds_max[axis] = std::max(bounds_max[axis], position[axis]);
+		}
+	}
+}
+
+bool MeshViewStreamSource::Open(std::string &)
+{
+	materials.assign(view.materials, view.materials + view.material_count);
+
+	// Shapes share no vertices in practice, but count exactly so the reservation holds either way
+	std::vector<uint32_t> stamp(view.vertex_count, UINT32_MAX);
+	vertex_counts.assign(view.shape_count, 0);
+	for (uint32_t s = 0; s < view.shape_count; s++) {
+		const MeshShape &shape = view.shapes[s];
+		for (uint32_t i = shape.index_offset; i < shape.index_offset + shape.index_count; i++) {
+			const uint32_t v = GetIndex(i);
+			if (stamp[v] != s) {
+				stamp[v] = s;
+				vertex_counts[s]++;
+			}
+		}
+	}
+
+	ResetBounds(bounds_min, bounds_max);
+	for (uint32_t v = 0; v < view.vertex_count; v++) {
+		GrowBounds(view.vertices[v].position, bounds_min, bounds_max);
+	}
+	return true;
+}
+
+uint32_t MeshViewStreamSource::GetIndex(uint32_t i) const
+{
+	return view.index_size == 2 ? static_cast<const uint16_t *>(view.indices)[i] : static_cast<const uint32_t *>(view.indices)[i];
+}
+
+void MeshViewStreamSource::GetChunkCapacity(uint32_t chunk, uint32_t &vertex_count, uint32_t &index_count) const
+{
+	vertex_count = vertex_counts[chunk];
+	index_count = view.shapes[chunk].index_count;
+}
+
+bool MeshViewStreamSource::GetChunkBounds(uint32_t chunk, float *bounds_min, float *bounds_max) const
+{
+	memcpy(bounds_min, view.shapes[chunk].bounds_min, sizeof(float) * 3);
+	memcpy(bounds_max, view.shapes[chunk].bounds_max, sizeof(float) * 3);
+	return true;
+}
+
+void MeshViewStreamSource::GetBounds(float *bounds_min, float *bounds_max) const
+{
+	memcpy(bounds_min, this->bounds_min, sizeof(float) * 3);
+	memcpy(bounds_max, this->bounds_max, sizeof(float) * 3);
+}
+
+bool MeshViewStreamSource::LoadChunk(uint32_t chunk, Mesh &mesh, std::string &)
+{
+	const MeshShape &shape = view.shapes[chunk];
+	mesh = {};
+	mesh.vertices.reserve(vertex_counts[chunk]);
+	mesh.indices.resize(shape.index_count);
+
+	// Renumbered in first-use order, which keeps the fetch order the cook optimized for
+	std::unordered_map<uint32_t, uint32_t> remap;
+	remap.reserve(vertex_counts[chunk]);
+	for (uint32_t i = 0; i < shape.index_count; i++) {
+		const uint32_t v = GetIndex(shape.index_offset + i);
+		auto inserted = remap.emplace(v, static_cast<uint32_t>(mesh.vertices.size()));
+		if (inserted.second) {
+			mesh.vertices.push_back(view.vertices[v]);
+		}
+		mesh.indices[i] = inserted.first->second;
+	}
+
+	MeshShape local = shape;
+	local.index_offset = 0;
+	mesh.shapes.push_back(local);
+	mesh.materials = materials;
+	return true;
+}
+
+void ObjStreamSource::GetChunkCapacity(uint32_t chunk, uint32_t &vertex_count, uint32_t &index_count) const
+{
+	vertex_count = chunks[chunk].vertex_count;
+	index_count = chunks[chunk].index_count;
+}
+
+void ObjStreamSource::GetBounds(float *bounds_min, float *bounds_max) const
+{
+	memcpy(bounds_min, this->bounds_min, sizeof(float) * 3);
+	memcpy(bounds_max, this->bounds_max, sizeof(float) * 3);
+}
+
+void ObjStreamSource::ReadMaterials(const std::string &library)
+{
+	// Like tinyobj, a missing library only loses the colors
+	std::ifstream input(library);
+
+	std::string line;
+	while (std::getline(input, line)) {
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+		if (keyword == "newmtl") {
+			MeshMaterial material = {};
+			std::string name = ReadName(line.c_str() + line.find("newmtl") + 6, line.c_str() + line.size());
+			memcpy(material.name, name.c_str(), std::min(name.size(), sizeof(material.name) - 1));
+			materials.push_back(material);
+			material_names.push_back(name);
+		} else if (keyword == "Kd" && !materials.empty()) {
+			float *diffuse = materials.back().diffuse;
+			tokens >> diffuse[0] >> diffuse[1] >> diffuse[2];
+		}
+	}
+}
+
+bool ObjStreamSource::Open(std::string &err)
+{
+	if (!file.Open(path)) {
+		err = "Cannot open " + path;
+		return false;
+	}
+
+	const std::string baseDir = path.substr(0, path.find_last_of("\\/") + 1);
+	const char *data = reinterpret_cast<const char *>(file.GetData());
+	const char *end = data + file.GetSize();
+
+	ResetBounds(bounds_min, bounds_max);
+	chunks.clear();
+	positions.clear();
+
+	Chunk chunk = {};
+	chunk.material = -1;
+	int material = -1;
+	// Vertices are welded per material, so a chunk makes at most its corners, and at most the positions it
+	// references once per material it uses
+	uint64_t corners = 0;
+	uint32_t chunkMaterials = 1;
+	int64_t firstPosition = INT64_MAX;
+	int64_t lastPosition = -1;
+
+	auto closeChunk = [&](size_t offset) {
+		chunk.end = offset;
+		if (chunk.index_count > 0) {
+			const uint64_t referenced = static_cast<uint64_t>(lastPosition - firstPosition + 1) * chunkMaterials;
+			chunk.vertex_count = static_cast<uint32_t>(std::min(corners, referenced));
+			chunks.push_back(chunk);
+		}
+	};
+	auto beginChunk = [&](size_t offset, const std::string &group) {
+		chunk.begin = offset;
+		chunk.group = group;
+		chunk.material = material;
+		chunk.vertex_base = static_cast<uint32_t>(positions.size() / 3);
+		chunk.index_count = 0;
+		corners = 0;
+		chunkMaterials = 1;
+		firstPosition = INT64_MAX;
+		lastPosition = -1;
+	};
+	beginChunk(0, std::string());
+
+	for (const char *line = data; line < end;) {
+		const char *lineEnd = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+		lineEnd = lineEnd ? lineEnd : end;
+		const char *next = lineEnd < end ? lineEnd + 1 : end;
+		const char *p = SkipSpace(line, lineEnd);
+
+		if (IsKeyword(p, lineEnd, "v")) {
+			float position[3] = {};
+			p += 1;
+			for (int axis = 0; axis < 3; axis++) {
+				ParseReal(p, lineEnd, position[axis]);
+			}
+			positions.insert(positions.end(), position, position + 3);
+			GrowBounds(position, bounds_min, bounds_max);
+		} else if (IsKeyword(p, lineEnd, "f")) {
+			uint32_t faceCorners = 0;
+			const int64_t positionCount = static_cast<int64_t>(positions.size() / 3);
+			for (p = SkipSpace(p + 1, lineEnd); p < lineEnd; p = SkipSpace(SkipToken(p, lineEnd), lineEnd)) {
+				int vertex = 0;
+				const char *q = p;
+				if (ParseInt(q, lineEnd, vertex)) {
+					const int64_t resolved = vertex > 0 ? vertex - 1 : positionCount + vertex;
+					firstPosition = std::min(firstPosition, resolved);
+					lastPosition = std::max(lastPosition, resolved);
+				}
+				faceCorners++;
+			}
+			if (faceCorners >= 3) {
+				corners += faceCorners;
+				chunk.index_count += 3 * (faceCorners - 2);
+			}
+			// Split long groups so no single chunk stalls the first frames
+			if (static_cast<size_t>(next - data) - chunk.begin >= max_chunk_bytes && chunk.index_count > 0) {
+				const std::string group = chunk.group;
+				closeChunk(static_cast<size_t>(next - data));
+				beginChunk(static_cast<size_t>(next - data), group);
+			}
+		} else if (IsKeyword(p, lineEnd, "g") || IsKeyword(p, lineEnd, "o")) {
+			closeChunk(static_cast<size_t>(line - data));
+			beginChunk(static_cast<size_t>(next - data), ReadName(p + 1, lineEnd));
+		} else if (IsKeyword(p, lineEnd, "usemtl")) {
+			const std::string name = ReadName(p + 6, lineEnd);
+			auto found = std::find(material_names.begin(), material_names.end(), name);
+			material = found != material_names.end() ? static_cast<int>(found - material_names.begin()) : -1;
+			chunkMaterials++;
+		} else if (IsKeyword(p, lineEnd, "mtllib")) {
+			for (p = SkipSpace(p + 6, lineEnd); p < lineEnd;) {
+				const char *tokenEnd = SkipToken(p, lineEnd);
+				ReadMaterials(baseDir + std::string(p, tokenEnd));
+				p = SkipSpace(tokenEnd, lineEnd);
+			}
+		}
+		line = next;
+	}
+	closeChunk(file.GetSize());
+
+	if (positions.empty()) {
+		memset(bounds_min, 0, sizeof(bounds_min));
+		memset(bounds_max, 0, sizeof(bounds_max));
+	}
+	return true;
+}
+
+bool ObjStreamSource::LoadChunk(uint32_t index, Mesh &mesh, std::string &err)
+{
+	const Chunk &chunk = chunks[index];
+	const char *data = reinterpret_cast<const char *>(file.GetData());
+	const char *end = data + chunk.end;
+	const uint32_t positionCount = static_cast<uint32_t>(positions.size() / 3);
+
+	MeshBuilder builder;
+	for (const MeshMaterial &material : materials) {
+		builder.AddMaterial(material.name, material.diffuse);
+	}
+	builder.BeginShape(chunk.group);
+
+	int material = chunk.material;
+	uint32_t vertexCount = chunk.vertex_base;
+	std::vector<float> corners;
+	for (const char *line = data + chunk.begin; line < end;) {
+		const char *lineEnd = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+		lineEnd = lineEnd ? lineEnd : end;
+		const char *p = SkipSpace(line, lineEnd);
+
+		if (IsKeyword(p, lineEnd, "v")) {
+			vertexCount++;
+		} else if (IsKeyword(p, lineEnd, "f")) {
+			corners.clear();
+			for (p = SkipSpace(p + 1, lineEnd); p < lineEnd; p = SkipSpace(SkipToken(p, lineEnd), lineEnd)) {
+				int vertex;
+				const char *q = p;
+				if (!ParseInt(q, lineEnd, vertex) || vertex == 0) {
+					err = "Malformed face in " + path;
+					return false;
+				}
+				// 1-based, or counting back from the last position read so far
+				const int64_t resolved = vertex > 0 ? vertex - 1 : static_cast<int64_t>(vertexCount) + vertex;
+				if (resolved < 0 || resolved >= positionCount) {
+					err = "Face index out of range in " + path;
+					return false;
+				}
+				corners.insert(corners.end(), &positions[3 * resolved], &positions[3 * resolved] + 3);
+			}
+			if (corners.size() >= 9) {
+				builder.AddPolygon(corners.data(), corners.size() / 3, material);
+			}
+		} else if (IsKeyword(p, lineEnd, "usemtl")) {
+			const std::string name = ReadName(p + 6, lineEnd);
+			auto found = std::find(material_names.begin(), material_names.end(), name);
+			material = found != material_names.end() ? static_cast<int>(found - material_names.begin()) : -1;
+		}
+		line = lineEnd < end ? lineEnd + 1 : end;
+	}
+
+	mesh = builder.Build();
+	return true;
+}
+
+AssetStreamer::AssetStreamer(StreamSource &source, StreamTarget &target, const AssetStreamerSettings &settings) :
+	source(source), target(target), settings(settings), state(StreamState::Opening), open_started(false), opened(false),
+	stopping(false), eye(), loading(0), stats(), reserved(false), vertex_capacity(0), index_capacity(0), next_vertex(0),
+	next_index(0)
+{
+}
+
+AssetStreamer::~AssetStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		pending.clear();
+	}
+	wake.notify_all();
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+}
+
+void AssetStreamer::Start()
+{
+	for (unsigned i = 0; i < settings.thread_count; i++) {
+		threads.emplace_back(&AssetStreamer::WorkerMain, this);
+	}
+}
+
+void AssetStreamer::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		lock.unlock();
+		const bool worked = LoadOnce();
+		lock.lock();
+		if (!worked) {
+			wake.wait(lock, [this]() {
+				return stopping || !open_started ||
+					(state == StreamState::Streaming && !pending.empty() && loaded.size() + loading < settings.max_loaded_chunks);
+			});
+		}
+	}
+}
+
+bool AssetStreamer::LoadOnce()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (stopping) {
+		return false;
+	}
+
+	if (!open_started) {
+		open_started = true;
+		lock.unlock();
+		std::string err;
+		const bool ok = source.Open(err);
+		lock.lock();
+		opened = ok;
+		if (!ok) {
+			stats.last_error = err;
+			if (state == StreamState::Opening) {
+				state = StreamState::Failed;
+			}
+		} else {
+			stats.chunk_count = source.GetChunkCount();
+			if (state == StreamState::Opening) {
+				state = StreamState::Streaming;
+				for (uint32_t chunk = 0; chunk < stats.chunk_count; chunk++) {
+					pending.push_back(chunk);
+				}
+			}
+		}
+		lock.unlock();
+		wake.notify_all();
+		return true;
+	}
+
+	if (state != StreamState::Streaming || pending.empty() || loaded.size() + loading >= settings.max_loaded_chunks) {
+		return false;
+	}
+
+	// Nearest known bounds first, the rest in file order
+	size_t best = 0;
+	float bestDistance = FLT_MAX;
+	for (size_t i = 0; i < pending.size(); i++) {
+		float bounds_min[3];
+		float bounds_max[3];
+		if (source.GetChunkBounds(pending[i], bounds_min, bounds_max)) {
+			const float distance = DistanceSquared(eye, bounds_min, bounds_max);
+			if (distance < bestDistance) {
+				best = i;
+				bestDistance = distance;
+			}
+		} else if (bestDistance == FLT_MAX && pending[i] < pending[best]) {
+			best = i;
+		}
+	}
+	std::unique_ptr<LoadedChunk> chunk(new LoadedChunk());
+	chunk->chunk = pending[best];
+	pending.erase(pending.begin() + best);
+	loading++;
+	lock.unlock();
+
+	std::string err;
+	const bool ok = source.LoadChunk(chunk->chunk, chunk->mesh, err);
+	if (ok) {
+		const Mesh &mesh = chunk->mesh;
+		if (settings.build_lods) {
+			std::vector<uint8_t> packed;
+			BuildMeshLods(GetMeshView(mesh, packed), settings.lod_settings, chunk->lods);
+		} else {
+			for (const MeshShape &shape : mesh.shapes) {
+				chunk->lods.first_level.push_back(static_cast<uint32_t>(chunk->lods.levels.size()));
+				chunk->lods.levels.push_back({shape.index_offset, shape.index_count, 0.0f});
+			}
+			chunk->lods.first_level.push_back(static_cast<uint32_t>(chunk->lods.levels.size()));
+		}
+		ResetBounds(chunk->bounds_min, chunk->bounds_max);
+		for (const MeshShape &shape : mesh.shapes) {
+			GrowBounds(shape.bounds_min, chunk->bounds_min, chunk->bounds_max);
+			GrowBounds(shape.bounds_max, chunk->bounds_min, chunk->bounds_max);
+		}
+	}
+
+	lock.lock();
+	loading--;
+	if (state != StreamState::Streaming) {
+		// Cancelled while loading
+		return true;
+	}
+	if (!ok) {
+		stats.failed_chunks++;
+		stats.last_error = err;
+	} else {
+		stats.loaded_chunks++;
+		loaded.push_back(std::move(chunk));
+	}
+	return true;
+}
+
+void AssetStreamer::Cancel()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (state == StreamState::Opening || state == StreamState::Streaming) {
+			state = StreamState::Cancelled;
+		}
+		pending.clear();
+		loaded.clear();
+	}
+	ready.clear();
+	wake.notify_all();
+}
+
+bool AssetStreamer::UploadChunk(const LoadedChunk &chunk, ResidentChunk &result)
+{
+	const Mesh &mesh = chunk.mesh;
+	const uint64_t vertexCount = mesh.vertices.size();
+	const uint64_t indexCount = mesh.indices.size();
+	if (next_vertex + vertexCount > vertex_capacity || next_index + indexCount > index_capacity) {
+		return false;
+	}
+	// Levels only come along while there is room for them
+	const bool withLods = next_index + indexCount + chunk.lods.indices.size() <= index_capacity;
+
+	std::vector<uint32_t> indices(mesh.indices);
+	if (withLods) {
+		indices.insert(indices.end(), chunk.lods.indices.begin(), chunk.lods.indices.end());
+	}
+	const uint32_t base = static_cast<uint32_t>(next_vertex);
+	for (uint32_t &index : indices) {
+		index += base;
+	}
+	target.UploadVertices(next_vertex, mesh.vertices.data(), mesh.vertices.size());
+	target.UploadIndices(next_index, indices.data(), indices.size());
+
+	result.chunk = chunk.chunk;
+	result.shapes = mesh.shapes;
+	result.levels.clear();
+	result.first_level.clear();
+	const uint32_t offset = static_cast<uint32_t>(next_index);
+	for (size_t s = 0; s < mesh.shapes.size(); s++) {
+		result.shapes[s].index_offset += offset;
+		result.first_level.push_back(static_cast<uint32_t>(result.levels.size()));
+		const uint32_t last = withLods ? chunk.lods.first_level[s + 1] : chunk.lods.first_level[s] + 1;
+		for (uint32_t level = chunk.lods.first_level[s]; level < last; level++) {
+			MeshLodLevel rebased = chunk.lods.levels[level];
+			rebased.index_offset += offset;
+			result.levels.push_back(rebased);
+		}
+	}
+	result.first_level.push_back(static_cast<uint32_t>(result.levels.size()));
+
+	next_vertex += vertexCount;
+	next_index += indices.size();
+	return true;
+}
+
+void AssetStreamer::RebuildResidentShapes()
+{
+	shapes.clear();
+	lods.levels.clear();
+	lods.first_level.clear();
+	for (const ResidentChunk &chunk : resident) {
+		for (size_t s = 0; s < chunk.shapes.size(); s++) {
+			shapes.push_back(chunk.shapes[s]);
+			lods.first_level.push_back(static_cast<uint32_t>(lods.levels.size()));
+			lods.levels.insert(lods.levels.end(), chunk.levels.begin() + chunk.first_level[s], chunk.levels.begin() + chunk.first_level[s + 1]);
+		}
+	}
+	lods.first_level.push_back(static_cast<uint32_t>(lods.levels.size()));
+	lods.stats.level_count = static_cast<uint32_t>(lods.levels.size());
+}
+
+bool AssetStreamer::Update(const Float3 &eye)
+{
+	bool isOpen;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		this->eye = eye;
+		isOpen = opened;
+		for (std::unique_ptr<LoadedChunk> &chunk : loaded) {
+			ready.push_back(std::move(chunk));
+		}
+		loaded.clear();
+	}
+	// Room for more loads
+	wake.notify_all();
+
+	if (!isOpen) {
+		return false;
+	}
+
+	if (!reserved) {
+		// Generated levels take another half, a quarter, ... of a chunk's indices; past the reservation they are dropped
+		for (uint32_t chunk = 0; chunk < source.GetChunkCount(); chunk++) {
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			source.GetChunkCapacity(chunk, vertexCount, indexCount);
+			vertex_capacity += vertexCount;
+			index_capacity += settings.build_lods ? 2ull * indexCount : indexCount;
+		}
+		float bounds_min[3];
+		float bounds_max[3];
+		source.GetBounds(bounds_min, bounds_max);
+		target.Reserve(vertex_capacity, index_capacity, bounds_min, bounds_max);
+		resident.resize(source.GetChunkCount());
+		reserved = true;
+	}
+
+	std::sort(ready.begin(), ready.end(), [&eye](const std::unique_ptr<LoadedChunk> &a, const std::unique_ptr<LoadedChunk> &b) {
+		return DistanceSquared(eye, a->bounds_min, a->bounds_max) < DistanceSquared(eye, b->bounds_min, b->bounds_max);
+	});
+
+	uint64_t frameBytes = 0;
+	size_t uploaded = 0;
+	uint32_t failed = 0;
+	const size_t firstSubmitted = submitted.size();
+	for (; uploaded < ready.size(); uploaded++) {
+		const LoadedChunk &chunk = *ready[uploaded];
+		const uint64_t bytes = target.GetUploadSize(chunk.mesh.vertices.size(), chunk.mesh.indices.size() + chunk.lods.indices.size());
+		if (frameBytes > 0 && frameBytes + bytes > settings.frame_upload_budget) {
+			break;
+		}
+		ResidentChunk result;
+		const uint64_t before = next_index;
+		if (!UploadChunk(chunk, result)) {
+			failed++;
+			continue;
+		}
+		frameBytes += target.GetUploadSize(chunk.mesh.vertices.size(), next_index - before);
+		submitted.push_back(std::move(result));
+	}
+	ready.erase(ready.begin(), ready.begin() + uploaded);
+
+	if (submitted.size() > firstSubmitted) {
+		const uint64_t fence = target.Submit();
+		for (size_t i = firstSubmitted; i < submitted.size(); i++) {
+			submitted[i].fence = fence;
+		}
+	}
+
+	// Fences complete in order
+	const uint64_t completed = target.GetCompletedValue();
+	size_t drawable = 0;
+	uint64_t triangles = 0;
+	while (drawable < submitted.size() && submitted[drawable].fence <= completed) {
+		for (const MeshShape &shape : submitted[drawable].shapes) {
+			triangles += shape.index_count / 3;
+		}
+		resident[submitted[drawable].chunk] = std::move(submitted[drawable]);
+		drawable++;
+	}
+	submitted.erase(submitted.begin(), submitted.begin() + drawable);
+	if (drawable > 0) {
+		RebuildResidentShapes();
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.resident_chunks += static_cast<uint32_t>(drawable);
+	stats.triangles += triangles;
+	stats.uploaded_bytes += frameBytes;
+	stats.max_frame_bytes = std::max(stats.max_frame_bytes, frameBytes);
+	if (failed > 0) {
+		stats.failed_chunks += failed;
+		stats.last_error = "Streamed chunks exceed the reserved buffers";
+	}
+	if (state == StreamState::Streaming && stats.resident_chunks + stats.failed_chunks == stats.chunk_count) {
+		state = StreamState::Finished;
+	}
+	return drawable > 0;
+}
+
+void AssetStreamer::GetStreamedMesh(const MeshVertex *target_vertices, const uint32_t *target_indices, Mesh &mesh) const
+{
+	mesh.vertices.clear();
+	mesh.indices.clear();
+	mesh.shapes = shapes;
+	mesh.materials = source.GetMaterials();
+
+	std::vector<uint32_t> remap(next_vertex, UINT32_MAX);
+	for (MeshShape &shape : mesh.shapes) {
+		const uint32_t offset = static_cast<uint32_t>(mesh.indices.size());
+		for (uint32_t i = shape.index_offset; i < shape.index_offset + shape.index_count; i++) {
+			uint32_t &vertex = remap[target_indices[i]];
+			if (vertex == UINT32_MAX) {
+				vertex = static_cast<uint32_t>(mesh.vertices.size());
+				mesh.vertices.push_back(target_vertices[target_indices[i]]);
+			}
+			mesh.indices.push_back(vertex);
+		}
+		shape.index_offset = offset;
+	}
+}
+
+StreamState AssetStreamer::GetState()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return state;
+}
+
+AssetStreamerStats AssetStreamer::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cpu_math.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+
+// A model split into chunks that load independently. Implementations must allow LoadChunk on several
+// threads at once.
+class StreamSource
+{
+public:
+	virtual ~StreamSource() {};
+
+	// Worker thread, once, before any other call
+	virtual bool Open(std::string &err) = 0;
+
+	virtual uint32_t GetChunkCount() const = 0;
+	// Most vertices and indices the chunk's mesh can have; the target reserves the sum over all chunks
+	virtual void GetChunkCapacity(uint32_t chunk, uint32_t &vertex_count, uint32_t &index_count) const = 0;
+	// Bounds known before loading, which lets near chunks load first; false when only loading tells
+	virtual bool GetChunkBounds(uint32_t chunk, float *bounds_min, float *bounds_max) const = 0;
+	// Bounds of every position of the model
+	virtual void GetBounds(float *bounds_min, float *bounds_max) const = 0;
+	virtual const std::vector<MeshMaterial> &GetMaterials() const = 0;
+
+	// Worker threads. Shapes index the chunk's own vertices and materials index GetMaterials().
+	virtual bool LoadChunk(uint32_t chunk, Mesh &mesh, std::string &err) = 0;
+};
+
+// One chunk per shape of a mesh that is already in memory, e.g. a mapped mesh cache. Copying a shape's
+// vertices out of the mapping is the I/O, so it happens on the streaming threads.
+class MeshViewStreamSource : public StreamSource
+{
+public:
+	// The view has to stay valid while the source is used
+	explicit MeshViewStreamSource(const MeshView &view) : view(view) {};
+
+	bool Open(std::string &err) override;
+	uint32_t GetChunkCount() const override { return view.shape_count; }
+	void GetChunkCapacity(uint32_t chunk, uint32_t &vertex_count, uint32_t &index_count) const override;
+	bool GetChunkBounds(uint32_t chunk, float *bounds_min, float *bounds_max) const override;
+	void GetBounds(float *bounds_min, float *bounds_max) const override;
+	const std::vector<MeshMaterial> &GetMaterials() const override { return materials; }
+	bool LoadChunk(uint32_t chunk, Mesh &mesh, std::string &err) override;
+
+private:
+	uint32_t GetIndex(uint32_t i) const;
+
+	MeshView view;
+	std::vector<uint32_t> vertex_counts;
+	std::vector<MeshMaterial> materials;
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+// Streams an OBJ group by group. Open() maps the file, reads the positions and the MTL colors and cuts the
+// faces into chunks at every group and at most max_chunk_bytes apart; each chunk's faces are parsed and
+// welded by LoadChunk. Positions, faces (polygons are fanned), groups and usemtl are read; texture
+// coordinates, normals and smoothing groups are not needed by the renderer and are skipped.
+class ObjStreamSource : public StreamSource
+{
+public:
+	static const size_t default_chunk_bytes = 1024 * 1024;
+
+	explicit ObjStreamSource(const std::string &path, size_t max_chunk_bytes = default_chunk_bytes) :
+		path(path), max_chunk_bytes(max_chunk_bytes) {};
+
+	bool Open(std::string &err) override;
+	uint32_t GetChunkCount() const override { return static_cast<uint32_t>(chunks.size()); }
+	void GetChunkCapacity(uint32_t chunk, uint32_t &vertex_count, uint32_t &index_count) const override;
+	bool GetChunkBounds(uint32_t, float *, float *) const override { return false; }
+	void GetBounds(float *bounds_min, float *bounds_max) const override;
+	const std::vector<MeshMaterial> &GetMaterials() const override { return materials; }
+	bool LoadChunk(uint32_t chunk, Mesh &mesh, std::string &err) override;
+
+private:
+	struct Chunk
+	{
+		size_t begin;
+		size_t end;
+		std::string group;
+		// Material of the faces before the chunk's first usemtl
+		int material;
+		// v lines before the chunk, for relative indices
+		uint32_t vertex_base;
+		// Upper bound of the welded vertices
+		uint32_t vertex_count;
+		uint32_t index_count;
+	};
+
+	void ReadMaterials(const std::string &library);
+
+	std::string path;
+	size_t max_chunk_bytes;
+	MappedFile file;
+	std::vector<float> positions;
+	std::vector<MeshMaterial> materials;
+	std::vector<std::string> material_names;
+	std::vector<Chunk> chunks;
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+// Render-thread side of streaming: owns the destination buffers and uploads into them. The renderer
+// implements it with D3D12 buffers and the copy queue; the benchmark with vectors and a mock copy queue.
+class StreamTarget
+{
+public:
+	virtual ~StreamTarget() {};
+
+	// Once, before the first upload, with the capacity of all chunks and the bounds of every position
+	virtual void Reserve(uint64_t vertex_count, uint64_t index_count, const float *bounds_min, const float *bounds_max) = 0;
+	// Bytes the uploads of this many vertices and indices take, for the frame budget
+	virtual uint64_t GetUploadSize(uint64_t vertex_count, uint64_t index_count) const = 0;
+	virtual void UploadVertices(uint64_t first_vertex, const MeshVertex *vertices, size_t count) = 0;
+	virtual void UploadIndices(uint64_t first_index, const uint32_t *indices, size_t count) = 0;
+	// Submits the uploads so far and returns the value GetCompletedValue() reaches once they can be drawn
+	virtual uint64_t Submit() = 0;
+	virtual uint64_t GetCompletedValue() = 0;
+};
+
+enum class StreamState
+{
+	Opening,
+	Streaming,
+	// Every chunk was drawable or failed to load
+	Finished,
+	// The source did not open
+	Failed,
+	Cancelled
+};
+
+struct AssetStreamerSettings
+{
+	// Streaming threads, apart from the job system so a frame never runs a load inline; 0 only loads in LoadOnce()
+	unsigned thread_count = 2;
+	// Bytes uploaded per Update(); a chunk over the budget goes alone
+	uint64_t frame_upload_budget = 1024 * 1024;
+	// Loading pauses while this many loaded chunks wait for upload
+	uint32_t max_loaded_chunks = 32;
+	// Chains built per chunk on the streaming threads; their indices go after the chunk's own
+	bool build_lods = true;
+	MeshLodSettings lod_settings;
+};
+
+struct AssetStreamerStats
+{
+	uint32_t chunk_count;
+	uint32_t loaded_chunks;
+	uint32_t resident_chunks;
+	uint32_t failed_chunks;
+	uint64_t uploaded_bytes;
+	// Most bytes uploaded in one Update()
+	uint64_t max_frame_bytes;
+	uint64_t triangles;
+	std::string last_error;
+};
+
+// Loads a StreamSource on background threads and uploads the loaded chunks within a per-frame budget, so the
+// renderer can draw what has arrived from the first frame on. Chunks load nearest to the camera first when
+// the source knows their bounds, and upload nearest first in any case. Vertices and indices are appended to
+// the target's buffers in upload order; shapes and LOD levels are reported in chunk order.
+class AssetStreamer
+{
+public:
+	AssetStreamer(StreamSource &source, StreamTarget &target, const AssetStreamerSettings &settings);
+	// Cancels and waits for the loads in progress
+	~AssetStreamer();
+
+	AssetStreamer(const AssetStreamer &) = delete;
+	AssetStreamer &operator=(const AssetStreamer &) = delete;
+
+	// Starts the streaming threads, which open the source and load chunks
+	void Start();
+	// Opens the source or loads the chunk with the highest priority on the calling thread; false when there is
+	// nothing to do right now. The streaming threads run this, and benchmarks can drive it deterministically.
+	bool LoadOnce();
+	// Drops the chunks that are not loaded or uploaded yet; what is drawable stays so. Loads in progress
+	// finish on their thread and are thrown away.
+	void Cancel();
+
+	// Render thread, once per frame before culling: uploads loaded chunks nearest to eye first within the budget
+	// and makes submitted ones drawable. Returns true when GetShapes() and GetLods() changed.
+	bool Update(const Float3 &eye);
+
+	// Drawable shapes, indexing the target's buffers
+	const std::vector<MeshShape> &GetShapes() const { return shapes; }
+	// Levels of the drawable shapes, for ScenePipeline::SetLods; indices are in the target's index buffer
+	const MeshLods &GetLods() const { return lods; }
+	// Valid once the state has left Opening
+	const std::vector<MeshMaterial> &GetMaterials() const { return source.GetMaterials(); }
+	// Vertices and indices written to the target so far
+	uint64_t GetVertexCount() const { return next_vertex; }
+	uint64_t GetIndexCount() const { return next_index; }
+	// The drawable shapes as a mesh, e.g. for CookMeshCache, from CPU copies of what was written to the target:
+	// their own indices without generated levels, and the vertices those use in first-use order
+	void GetStreamedMesh(const MeshVertex *target_vertices, const uint32_t *target_indices, Mesh &mesh) const;
+
+	StreamState GetState();
+	AssetStreamerStats GetStats();
+
+private:
+	struct LoadedChunk
+	{
+		uint32_t chunk;
+		Mesh mesh;
+		MeshLods lods;
+		float bounds_min[3];
+		float bounds_max[3];
+	};
+
+	// Shapes and levels of an uploaded chunk, rebased into the target's buffers
+	struct ResidentChunk
+	{
+		uint32_t chunk;
+		uint64_t fence;
+		std::vector<MeshShape> shapes;
+		std::vector<MeshLodLevel> levels;
+		std::vector<uint32_t> first_level;
+	};
+
+	void WorkerMain();
+	// Render thread; false when the chunk does not fit the reserved buffers
+	bool UploadChunk(const LoadedChunk &loaded, ResidentChunk &resident);
+	void RebuildResidentShapes();
+
+	StreamSource &source;
+	StreamTarget &target;
+	AssetStreamerSettings settings;
+
+	// Shared with the streaming threads
+	std::mutex mutex;
+	std::condition_variable wake;
+	StreamState state;
+	bool open_started;
+	// The source is open and no longer changes
+	bool opened;
+	bool stopping;
+	Float3 eye;
+	std::vector<uint32_t> pending;
+	uint32_t loading;
+	std::vector<std::unique_ptr<LoadedChunk>> loaded;
+	AssetStreamerStats stats;
+	std::vector<std::thread> threads;
+
+	// Render thread
+	bool reserved;
+	uint64_t vertex_capacity;
+	uint64_t index_capacity;
+	uint64_t next_vertex;
+	uint64_t next_index;
+	std::vector<std::unique_ptr<LoadedChunk>> ready;
+	std::vector<ResidentChunk> submitted;
+	// Per chunk, empty until drawable
+	std::vector<ResidentChunk> resident;
+	std::vector<MeshShape> shapes;
+	MeshLods lods;
+};
@@ -0,0 +1,347 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	void ResetBounds(float bounds_min[3], float bounds_max[3])
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			bounds_min[axis] = FLT_MAX;
+			bounds_max[axis] = -FLT_MAX;
+		}
+	}
+
+	void GrowBounds(float bounds_min[3], float bounds_max[3], const float other_min[3], const float other_max[3])
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			bounds_min[axis] = std::min(bounds_min[axis], other_min[axis]);
+			bounds_max[axis] = std::max(bounds_max[axis], other_max[axis]);
+		}
+	}
+
+	// Half of the surface area, which is all SAH needs
+	float HalfArea(const float bounds_min[3], const float bounds_max[3])
+	{
+		const float dx = bounds_max[0] - bounds_min[0];
+		const float dy = bounds_max[1] - bounds_min[1];
+		const float dz = bounds_max[2] - bounds_min[2];
+		return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+	}
+
+	float Component(const Float3 &v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	struct Bin
+	{
+		float bounds_min[3];
+		float bounds_max[3];
+		uint32_t count;
+	};
+
+	// -1: outside, 1: inside every plane in mask, 0: crossing. Planes the box is fully inside are removed from mask.
+	int ClassifyBox(const Frustum &frustum, const float bounds_min[3], const float bounds_max[3], uint32_t &mask)
+	{
+		const float cx = 0.5f * (bounds_min[0] + bounds_max[0]);
+		const float cy = 0.5f * (bounds_min[1] + bounds_max[1]);
+		const float cz = 0.5f * (bounds_min[2] + bounds_max[2]);
+		const float ex = 0.5f * (bounds_max[0] - bounds_min[0]);
+		const float ey = 0.5f * (bounds_max[1] - bounds_min[1]);
+		const float ez = 0.5f * (bounds_max[2] - bounds_min[2]);
+
+		for (uint32_t i = 0; i < 6; i++) {
+			if (!(mask & (1u << i))) {
+				continue;
+			}
+			const Plane &p = frustum.planes[i];
+			const float distance = p.a * cx + p.b * cy + p.c * cz + p.d;
+			const float reach = fabsf(p.a) * ex + fabsf(p.b) * ey + fabsf(p.c) * ez;
+			if (distance + reach < 0.0f) {
+				return -1;
+			}
+			if (distance - reach >= 0.0f) {
+				mask &= ~(1u << i);
+			}
+		}
+		return mask == 0 ? 1 : 0;
+	}
+
+	// Entry distance of the ray into the box, or FLT_MAX when it misses within [0, max_distance]
+	float IntersectRay(const float bounds_min[3], const float bounds_max[3], const float origin[3], const float inverse_direction[3], float max_distance)
+	{
+		float nearT = 0.0f;
+		float farT = max_distance;
+		for (int axis = 0; axis < 3; axis++) {
+			float t0 = (bounds_min[axis] - origin[axis]) * inverse_direction[axis];
+			float t1 = (bounds_max[axis] - origin[axis]) * inverse_direction[axis];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			// Written so that NaN (origin on a slab of an axis-parallel ray) keeps the current interval
+			nearT = t0 > nearT ? t0 : nearT;
+			farT = t1 < farT ? t1 : farT;
+		}
+		return nearT <= farT ? nearT : FLT_MAX;
+	}
+}
+
+void Bvh::Build(const Aabb *boxes, size_t count, uint32_t max_leaf_size)
+{
+	this->boxes.assign(boxes, boxes + count);
+	this->max_leaf_size = std::max(1u, max_leaf_size);
+	nodes.clear();
+	depth = 0;
+
+	object_indices.resize(count);
+	centroids.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		object_indices[i] = static_cast<uint32_t>(i);
+		centroids[i] = {
+			0.5f * (boxes[i].bounds_min[0] + boxes[i].bounds_max[0]),
+			0.5f * (boxes[i].bounds_min[1] + boxes[i].bounds_max[1]),
+			0.5f * (boxes[i].bounds_min[2] + boxes[i].bounds_max[2])
+		};
+	}
+
+	if (count == 0) {
+		return;
+	}
+
+	// A binary tree with leaves of at least one object never has more than 2n - 1 nodes
+	nodes.reserve(2 * count - 1);
+	nodes.push_back({});
+	BuildNode(0, 0, static_cast<uint32_t>(count), 1);
+	centroids.clear();
+	centroids.shrink_to_fit();
+}
+
+void Bvh::BuildNode(uint32_t node_index, uint32_t first, uint32_t count, uint32_t level)
+{
+	depth = std::max(depth, level);
+
+	BvhNode node;
+	float centroidMin[3];
+	float centroidMax[3];
+	ResetBounds(node.bounds_min, node.bounds_max);
+	ResetBounds(centroidMin, centroidMax);
+	for (uint32_t i = first; i < first + count; i++) {
+		const uint32_t object = object_indices[i];
+		const float centroid[3] = {centroids[object].x, centroids[object].y, centroids[object].z};
+		GrowBounds(node.bounds_min, node.bounds_max, boxes[object].bounds_min, boxes[object].bounds_max);
+		GrowBounds(centroidMin, centroidMax, centroid, centroid);
+	}
+
+	if (count <= max_leaf_size) {
+		node.offset = first;
+		node.count = count;
+		nodes[node_index] = node;
+		return;
+	}
+
+	// Pick the bin boundary with the lowest SAH cost over all three axes
+	int bestAxis = -1;
+	uint32_t bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		const float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.0f) {
+			continue;
+		}
+
+		Bin bins[bin_count];
+		for (Bin &bin : bins) {
+			ResetBounds(bin.bounds_min, bin.bounds_max);
+			bin.count = 0;
+		}
+		const float scale = bin_count / extent;
+		for (uint32_t i = first; i < first + count; i++) {
+			const uint32_t object = object_indices[i];
+			const uint32_t b = std::min(bin_count - 1, static_cast<uint32_t>((Component(centroids[object], axis) - centroidMin[axis]) * scale));
+			GrowBounds(bins[b].bounds_min, bins[b].bounds_max, boxes[object].bounds_min, boxes[object].bounds_max);
+			bins[b].count++;
+		}
+
+		// rightCost[b]: cost of bins b..end on the right side of a split before bin b
+		float rightCost[bin_count];
+		float boundsMin[3];
+		float boundsMax[3];
+		uint32_t sideCount = 0;
+		ResetBounds(boundsMin, boundsMax);
+		for (uint32_t b = bin_count - 1; b > 0; b--) {
+			GrowBounds(boundsMin, boundsMax, bins[b].bounds_min, bins[b].bounds_max);
+			sideCount += bins[b].count;
+			rightCost[b] = sideCount == 0 ? -1.0f : HalfArea(boundsMin, boundsMax) * sideCount;
+		}
+
+		sideCount = 0;
+		ResetBounds(boundsMin, boundsMax);
+		for (uint32_t b = 1; b < bin_count; b++) {
+			GrowBounds(boundsMin, boundsMax, bins[b - 1].bounds_min, bins[b - 1].bounds_max);
+			sideCount += bins[b - 1].count;
+			if (sideCount == 0 || rightCost[b] < 0.0f) {
+				continue;
+			}
+			const float cost = HalfArea(boundsMin, boundsMax) * sideCount + rightCost[b];
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0) {
+		const float scale = bin_count / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		const float axisMin = centroidMin[bestAxis];
+		uint32_t *split = std::partition(object_indices.data() + first, object_indices.data() + first + count, [&](uint32_t object) {
+			return std::min(bin_count - 1, static_cast<uint32_t>((Component(centroids[object], bestAxis) - axisMin) * scale)) < bestSplit;
+		});
+		middle = static_cast<uint32_t>(split - object_indices.data());
+	} else {
+		// Every centroid is in the same place, any split is as good as another
+		middle = first + count / 2;
+	}
+
+	const uint32_t left = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+	BuildNode(left, first, middle - first, level + 1);
+
+	const uint32_t right = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({});
+	BuildNode(right, middle, first + count - middle, level + 1);
+
+	node.offset = right;
+	node.count = 0;
+	nodes[node_index] = node;
+}
+
+void Bvh::Refit(const Aabb *boxes)
+{
+	std::copy(boxes, boxes + this->boxes.size(), this->boxes.begin());
+
+	// Children always come after their parent, so a reverse walk sees them first
+	for (size_t i = nodes.size(); i-- > 0;) {
+		BvhNode &node = nodes[i];
+		ResetBounds(node.bounds_min, node.bounds_max);
+		if (node.count > 0) {
+			for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+				const Aabb &box = boxes[object_indices[j]];
+				GrowBounds(node.bounds_min, node.bounds_max, box.bounds_min, box.bounds_max);
+			}
+		} else {
+			GrowBounds(node.bounds_min, node.bounds_max, nodes[i + 1].bounds_min, nodes[i + 1].bounds_max);
+			GrowBounds(node.bounds_min, node.bounds_max, nodes[node.offset].bounds_min, nodes[node.offset].bounds_max);
+		}
+	}
+}
+
+void Bvh::QueryFrustum(const Frustum &frustum, std::vector<uint32_t> &visible) const
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	struct Entry
+	{
+		uint32_t node;
+		// Planes the node is not yet known to be fully inside
+		uint32_t mask;
+	};
+
+	// Depth-first traversal never holds more than one pending sibling per level
+	std::vector<Entry> stack;
+	stack.reserve(depth + 1);
+	stack.push_back({0, 0x3F});
+
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		const BvhNode &node = nodes[entry.node];
+		if (entry.mask != 0 && ClassifyBox(frustum, node.bounds_min, node.bounds_max, entry.mask) < 0) {
+			continue;
+		}
+
+		if (node.count > 0) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+				const uint32_t object = object_indices[i];
+				uint32_t mask = entry.mask;
+				if (mask == 0 || ClassifyBox(frustum, boxes[object].bounds_min, boxes[object].bounds_max, mask) >= 0) {
+					visible.push_back(object);
+				}
+			}
+			continue;
+		}
+
+		stack.push_back({node.offset, entry.mask});
+		stack.push_back({entry.node + 1, entry.mask});
+	}
+}
+
+bool Bvh::Raycast(const Float3 &origin, const Float3 &direction, float max_distance, RayHit &hit) const
+{
+	if (nodes.empty()) {
+		return false;
+	}
+
+	const float o[3] = {origin.x, origin.y, origin.z};
+	const float inverse[3] = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+	float best = max_distance;
+	bool found = false;
+
+	struct Entry
+	{
+		uint32_t node;
+		float distance;
+	};
+
+	std::vector<Entry> stack;
+	stack.reserve(depth + 1);
+	const float rootT = IntersectRay(nodes[0].bounds_min, nodes[0].bounds_max, o, inverse, best);
+	if (rootT != FLT_MAX) {
+		stack.push_back({0, rootT});
+	}
+
+	while (!stack.empty()) {
+		const Entry entry = stack.back();
+		stack.pop_back();
+		// A closer hit may have been found since the node was pushed
+		if (entry.distance > best) {
+			continue;
+		}
+
+		const BvhNode &node = nodes[entry.node];
+		if (node.count > 0) {
+			for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+				const uint32_t object = object_indices[i];
+				const float t = IntersectRay(boxes[object].bounds_min, boxes[object].bounds_max, o, inverse, best);
+				if (t != FLT_MAX && (!found || t < best)) {
+					best = t;
+					hit = {object, t};
+					found = true;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the farther one is usually rejected by the shortened ray
+		Entry nearChild = {entry.node + 1, 0.0f};
+		Entry farChild = {node.offset, 0.0f};
+		nearChild.distance = IntersectRay(nodes[nearChild.node].bounds_min, nodes[nearChild.node].bounds_max, o, inverse, best);
+		farChild.distance = IntersectRay(nodes[farChild.node].bounds_min, nodes[farChild.node].bounds_max, o, inverse, best);
+		if (farChild.distance < nearChild.distance) {
+			std::swap(nearChild, farChild);
+		}
+		if (farChild.distance != FLT_MAX) {
+			stack.push_back(farChild);
+		}
+		if (nearChild.distance != FLT_MAX) {
+			stack.push_back(nearChild);
+		}
+	}
+
+	return found;
+}
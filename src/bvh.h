@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_math.h"
+#include "frustum_cull.h"
+
+struct Aabb
+{
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+// Two nodes per cache line. Nodes are stored depth-first, so the first child of an interior node
+// always follows it and only the second child needs an index.
+struct BvhNode
+{
+	float bounds_min[3];
+	// Interior: index of the second child; leaf: first entry in the object index list
+	uint32_t offset;
+	float bounds_max[3];
+	// Number of objects in a leaf, 0 for interior nodes
+	uint32_t count;
+};
+
+struct RayHit
+{
+	uint32_t object;
+	float distance;
+};
+
+// Bounding volume hierarchy over object AABBs, built with binned SAH. Refit() keeps the topology and
+// only recomputes bounds, which is enough for objects that move a little between frames.
+class Bvh
+{
+public:
+	static const uint32_t bin_count = 16;
+	static const uint32_t default_leaf_size = 4;
+
+	Bvh() : max_leaf_size(default_leaf_size), depth(0) {};
+
+	void Build(const Aabb *boxes, size_t count, uint32_t max_leaf_size = default_leaf_size);
+	// boxes must have the same count and order as in Build()
+	void Refit(const Aabb *boxes);
+
+	// Appends the indices of objects whose box intersects the frustum
+	void QueryFrustum(const Frustum &frustum, std::vector<uint32_t> &visible) const;
+	// Nearest object box hit by origin + t * direction with 0 <= t <= max_distance
+	bool Raycast(const Float3 &origin, const Float3 &direction, float max_distance, RayHit &hit) const;
+
+	const std::vector<BvhNode> &GetNodes() const { return nodes; }
+	size_t GetObjectCount() const { return boxes.size(); }
+	uint32_t GetDepth() const { return depth; }
+
+private:
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> object_indices;
+	std::vector<Aabb> boxes;
+	std::vector<Float3> centroids;
+	uint32_t max_leaf_size;
+	uint32_t depth;
+
+	void BuildNode(uint32_t node_index, uint32_t first, uint32_t count, uint32_t level);
+};
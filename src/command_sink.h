@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// The part of command recording that scales with scene size. The renderer records into a D3D12
+// command list through D3D12CommandSink; benchmarks record into the null or recording sinks below.
+class CommandSink
+{
+public:
+	virtual ~CommandSink() {};
+
+	virtual void SetPipeline(uint32_t pipeline) = 0;
+	// Constant buffer for the following draws, by GPU address or descriptor table as the backend binds it
+	virtual void SetConstants(uint64_t gpu_address) = 0;
+	virtual void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+		int32_t base_vertex, uint32_t first_instance) = 0;
+};
+
+// Counts what would have been recorded
+class NullCommandSink : public CommandSink
+{
+public:
+	NullCommandSink() : pipeline_changes(0), constant_changes(0), draw_count(0), index_count(0) {};
+
+	void SetPipeline(uint32_t) override { pipeline_changes++; }
+	void SetConstants(uint64_t) override { constant_changes++; }
+	void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t, int32_t, uint32_t) override
+	{
+		draw_count++;
+		this->index_count += static_cast<uint64_t>(index_count) * instance_count;
+	}
+
+	uint64_t pipeline_changes;
+	uint64_t constant_changes;
+	uint64_t draw_count;
+	uint64_t index_count;
+};
+
+enum class CommandType : uint32_t
+{
+	SetPipeline,
+	SetConstants,
+	DrawIndexedInstanced
+};
+
+struct RecordedCommand
+{
+	CommandType type;
+	uint32_t args[5];
+	uint64_t address;
+};
+
+// Keeps every command, so tests and benchmarks can compare or replay what a frame recorded
+class RecordingCommandSink : public CommandSink
+{
+public:
+	RecordingCommandSink() {};
+
+	void SetPipeline(uint32_t pipeline) override
+	{
+		commands.push_back({CommandType::SetPipeline, {pipeline, 0, 0, 0, 0}, 0});
+	}
+
+	void SetConstants(uint64_t gpu_address) override
+	{
+		commands.push_back({CommandType::SetConstants, {0, 0, 0, 0, 0}, gpu_address});
+	}
+
+	void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+		int32_t base_vertex, uint32_t first_instance) override
+	{
+		commands.push_back({CommandType::DrawIndexedInstanced,
+			{index_count, instance_count, first_index, static_cast<uint32_t>(base_vertex), first_instance}, 0});
+	}
+
+	void Clear() { commands.clear(); }
+	const std::vector<RecordedCommand> &GetCommands() const { return commands; }
+
+private:
+	std::vector<RecordedCommand> commands;
+};
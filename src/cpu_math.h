@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cmath>
+
+// Minimal portable counterparts of the DirectXMath functions the renderer uses.
+// Matrices are row-major with the row-vector convention (v' = v * M), like XMMATRIX.
+
+struct Float3
+{
+	float x, y, z;
+};
+
+struct Float4x4
+{
+	float m[4][4];
+};
+
+// Unit quaternion, w is the real part
+struct Quaternion
+{
+	float x, y, z, w;
+};
+
+inline Float3 operator+(const Float3 &a, const Float3 &b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline Float3 operator-(const Float3 &a, const Float3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Float3 operator*(const Float3 &a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+inline float Dot(const Float3 &a, const Float3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Float3 Cross(const Float3 &a, const Float3 &b) { return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+inline Float3 Normalize(const Float3 &a) { return a * (1.0f / sqrtf(Dot(a, a))); }
+
+inline Float4x4 MatrixIdentity()
+{
+	Float4x4 r = {};
+	r.m[0][0] = r.m[1][1] = r.m[2][2] = r.m[3][3] = 1.0f;
+	return r;
+}
+
+inline Float4x4 MatrixMultiply(const Float4x4 &a, const Float4x4 &b)
+{
+	Float4x4 r;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		}
+	}
+	return r;
+}
+
+inline Float4x4 MatrixTranslation(float x, float y, float z)
+{
+	Float4x4 r = MatrixIdentity();
+	r.m[3][0] = x;
+	r.m[3][1] = y;
+	r.m[3][2] = z;
+	return r;
+}
+
+inline Float4x4 MatrixScaling(float x, float y, float z)
+{
+	Float4x4 r = {};
+	r.m[0][0] = x;
+	r.m[1][1] = y;
+	r.m[2][2] = z;
+	r.m[3][3] = 1.0f;
+	return r;
+}
+
+// Same as XMQuaternionRotationNormal
+inline Quaternion QuaternionRotationAxis(const Float3 &unit_axis, float angle)
+{
+	const float s = sinf(0.5f * angle);
+	return {unit_axis.x * s, unit_axis.y * s, unit_axis.z * s, cosf(0.5f * angle)};
+}
+
+// Same as XMMatrixRotationQuaternion
+inline Float4x4 MatrixRotationQuaternion(const Quaternion &q)
+{
+	Float4x4 r = {};
+	r.m[0][0] = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);
+	r.m[0][1] = 2.0f * (q.x * q.y + q.z * q.w);
+	r.m[0][2] = 2.0f * (q.x * q.z - q.y * q.w);
+	r.m[1][0] = 2.0f * (q.x * q.y - q.z * q.w);
+	r.m[1][1] = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);
+	r.m[1][2] = 2.0f * (q.y * q.z + q.x * q.w);
+	r.m[2][0] = 2.0f * (q.x * q.z + q.y * q.w);
+	r.m[2][1] = 2.0f * (q.y * q.z - q.x * q.w);
+	r.m[2][2] = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+	r.m[3][3] = 1.0f;
+	return r;
+}
+
+// Same as XMMatrixPerspectiveFovLH
+inline Float4x4 MatrixPerspectiveFovLH(float fov_y, float aspect, float near_z, float far_z)
+{
+	const float height = 1.0f / tanf(0.5f * fov_y);
+	const float range = far_z / (far_z - near_z);
+	Float4x4 r = {};
+	r.m[0][0] = height / aspect;
+	r.m[1][1] = height;
+	r.m[2][2] = range;
+	r.m[2][3] = 1.0f;
+	r.m[3][2] = -range * near_z;
+	return r;
+}
+
+// Same as XMMatrixLookAtLH
+inline Float4x4 MatrixLookAtLH(const Float3 &eye, const Float3 &at, const Float3 &up)
+{
+	const Float3 z = Normalize(at - eye);
+	const Float3 x = Normalize(Cross(up, z));
+	const Float3 y = Cross(z, x);
+	Float4x4 r = {};
+	r.m[0][0] = x.x; r.m[0][1] = y.x; r.m[0][2] = z.x;
+	r.m[1][0] = x.y; r.m[1][1] = y.y; r.m[1][2] = z.y;
+	r.m[2][0] = x.z; r.m[2][1] = y.z; r.m[2][2] = z.z;
+	r.m[3][0] = -Dot(x, eye);
+	r.m[3][1] = -Dot(y, eye);
+	r.m[3][2] = -Dot(z, eye);
+	r.m[3][3] = 1.0f;
+	return r;
+}
+
+inline Float4x4 MatrixTranspose(const Float4x4 &a)
+{
+	Float4x4 r;
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) {
+			r.m[i][j] = a.m[j][i];
+		}
+	}
+	return r;
+}
@@ -0,0 +1,180 @@
+#include "descriptor_allocator.h"
+
+#include <new>
+
+double DescriptorAllocatorStats::GetFragmentation() const
+{
+	const uint64_t freeDescriptors = capacity - reserved;
+	return freeDescriptors == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free) / static_cast<double>(freeDescriptors);
+}
+
+double DescriptorAllocatorStats::GetRoundingWaste() const
+{
+	return reserved == 0 ? 0.0 : static_cast<double>(reserved - allocated) / static_cast<double>(reserved);
+}
+
+DescriptorAllocator::DescriptorAllocator(DescriptorPageSource &source, uint32_t page_capacity) :
+	source(source), page_class(GetSizeClass(page_capacity)), descriptor_size(source.GetDescriptorSize()), stats()
+{
+	this->page_capacity = 1u << page_class;
+	free_lists.resize(page_class + 1);
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	for (Page &page : pages) {
+		source.DestroyPage(page.memory);
+	}
+}
+
+uint32_t DescriptorAllocator::GetSizeClass(uint32_t count)
+{
+	uint32_t sizeClass = 0;
+	while ((1u << sizeClass) < count) {
+		sizeClass++;
+	}
+	return sizeClass;
+}
+
+void DescriptorAllocator::PushFree(uint32_t size_class, const Block &block)
+{
+	Page &page = pages[block.page];
+	page.free_class[block.index] = static_cast<uint8_t>(size_class);
+	page.list_position[block.index] = static_cast<uint32_t>(free_lists[size_class].size());
+	free_lists[size_class].push_back(block);
+}
+
+void DescriptorAllocator::RemoveFree(uint32_t size_class, const Block &block)
+{
+	std::vector<Block> &list = free_lists[size_class];
+	const uint32_t position = pages[block.page].list_position[block.index];
+	list[position] = list.back();
+	pages[list[position].page].list_position[list[position].index] = position;
+	list.pop_back();
+	pages[block.page].free_class[block.index] = not_free;
+}
+
+void DescriptorAllocator::AddPage()
+{
+	Page page;
+	if (!source.CreatePage(page_capacity, page.memory)) {
+		throw std::bad_alloc();
+	}
+	page.free_class.assign(page_capacity, not_free);
+	page.list_position.assign(page_capacity, 0);
+	pages.push_back(std::move(page));
+	PushFree(page_class, {static_cast<uint32_t>(pages.size() - 1), 0});
+	stats.page_count++;
+	stats.capacity += page_capacity;
+}
+
+void DescriptorAllocator::UpdateLargestFree()
+{
+	stats.largest_free = 0;
+	for (uint32_t sizeClass = page_class + 1; sizeClass-- > 0;) {
+		if (!free_lists[sizeClass].empty()) {
+			stats.largest_free = 1u << sizeClass;
+			break;
+		}
+	}
+}
+
+DescriptorAllocation DescriptorAllocator::Allocate(uint32_t count)
+{
+	if (count == 0 || count > page_capacity) {
+		throw std::bad_alloc();
+	}
+
+	const uint32_t sizeClass = GetSizeClass(count);
+	uint32_t source_class = sizeClass;
+	while (source_class <= page_class && free_lists[source_class].empty()) {
+		source_class++;
+	}
+	if (source_class > page_class) {
+		AddPage();
+		source_class = page_class;
+	}
+
+	const Block block = free_lists[source_class].back();
+	RemoveFree(source_class, block);
+	// Split down to the requested class; the upper halves stay free
+	while (source_class > sizeClass) {
+		source_class--;
+		PushFree(source_class, {block.page, block.index + (1u << source_class)});
+		stats.splits++;
+	}
+
+	stats.allocated += count;
+	stats.reserved += 1u << sizeClass;
+	stats.allocation_count++;
+	UpdateLargestFree();
+
+	const DescriptorPage &page = pages[block.page].memory;
+	const uint64_t offset = static_cast<uint64_t>(block.index) * descriptor_size;
+	return {page.cpu_start + offset, page.gpu_start != 0 ? page.gpu_start + offset : 0, block.page, block.index, count};
+}
+
+void DescriptorAllocator::Free(const DescriptorAllocation &allocation)
+{
+	uint32_t sizeClass = GetSizeClass(allocation.count);
+	stats.allocated -= allocation.count;
+	stats.reserved -= 1u << sizeClass;
+	stats.free_count++;
+
+	Block block = {allocation.page, allocation.index};
+	const Page &page = pages[block.page];
+	while (sizeClass < page_class) {
+		const Block buddy = {block.page, block.index ^ (1u << sizeClass)};
+		if (page.free_class[buddy.index] != sizeClass) {
+			break;
+		}
+		RemoveFree(sizeClass, buddy);
+		block.index &= ~(1u << sizeClass);
+		sizeClass++;
+		stats.merges++;
+	}
+	PushFree(sizeClass, block);
+	UpdateLargestFree();
+}
+
+DescriptorRing::DescriptorRing(uint32_t capacity) : head(0), open_size(0), stats()
+{
+	stats.capacity = capacity;
+}
+
+bool DescriptorRing::Allocate(uint32_t count, uint32_t &index)
+{
+	// A table never wraps; the tail it skips belongs to the open frame
+	const uint32_t waste = head + count > stats.capacity ? stats.capacity - head : 0;
+	if (count == 0 || stats.in_use + waste + count > stats.capacity) {
+		stats.failed_count++;
+		return false;
+	}
+	if (waste > 0) {
+		head = 0;
+		stats.wrap_waste += waste;
+	}
+	index = head;
+	head += count;
+	open_size += waste + count;
+	stats.in_use += waste + count;
+	stats.peak_in_use = stats.in_use > stats.peak_in_use ? stats.in_use : stats.peak_in_use;
+	stats.allocation_count++;
+	return true;
+}
+
+void DescriptorRing::Close(uint64_t fence_value)
+{
+	if (open_size > 0) {
+		frames.push_back({fence_value, open_size});
+		open_size = 0;
+	}
+}
+
+void DescriptorRing::Retire(uint64_t completed_value)
+{
+	while (!frames.empty() && frames.front().fence <= completed_value) {
+		stats.in_use -= frames.front().size;
+		frames.pop_front();
+	}
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Block of descriptors, one descriptor heap in D3D12
+struct DescriptorPage
+{
+	uint64_t cpu_start;
+	// 0 for heaps the shader cannot see
+	uint64_t gpu_start;
+	uint32_t capacity;
+	// Backend object (ID3D12DescriptorHeap * for D3D12)
+	void *heap;
+};
+
+class DescriptorPageSource
+{
+public:
+	virtual ~DescriptorPageSource() {};
+
+	virtual bool CreatePage(uint32_t capacity, DescriptorPage &page) = 0;
+	virtual void DestroyPage(DescriptorPage &page) = 0;
+	// Bytes between two descriptors
+	virtual uint32_t GetDescriptorSize() const = 0;
+};
+
+struct DescriptorAllocation
+{
+	uint64_t cpu_address;
+	uint64_t gpu_address;
+	uint32_t page;
+	uint32_t index;
+	uint32_t count;
+};
+
+struct DescriptorAllocatorStats
+{
+	uint32_t page_count;
+	uint64_t capacity;
+	// Descriptors asked for, and what they occupy after rounding to size classes
+	uint64_t allocated;
+	uint64_t reserved;
+	// Largest free block, bounding the biggest table that fits without a new page
+	uint64_t largest_free;
+	uint64_t allocation_count;
+	uint64_t free_count;
+	uint64_t splits;
+	uint64_t merges;
+
+	// 0 when all free descriptors form one block, towards 1 when they are scattered in small ones. Rounding waste
+	// is reserved, so it does not count here.
+	double GetFragmentation() const;
+	// Share of the reserved descriptors that only pad ranges up to their size class
+	double GetRoundingWaste() const;
+};
+
+// Persistent descriptors in CPU-only heaps, the source of copies into shader-visible tables. A buddy allocator per
+// page: ranges round up to power-of-two size classes with a free list each, a free block merges with its free
+// buddy, and every step is bounded by the number of classes, so Allocate and Free are O(1). Unlike a first-fit
+// free list over exact ranges this pads tables up to their class; GetRoundingWaste reports the cost. Allocate adds
+// a page when no block is large enough, and throws std::bad_alloc when the source fails or count exceeds the page
+// capacity.
+class DescriptorAllocator
+{
+public:
+	// page_capacity is rounded up to a power of two
+	DescriptorAllocator(DescriptorPageSource &source, uint32_t page_capacity);
+	~DescriptorAllocator();
+
+	DescriptorAllocator(const DescriptorAllocator &) = delete;
+	DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+
+	DescriptorAllocation Allocate(uint32_t count = 1);
+	void Free(const DescriptorAllocation &allocation);
+
+	const DescriptorPage &GetPage(uint32_t page) const { return pages[page].memory; }
+	const DescriptorAllocatorStats &GetStats() const { return stats; }
+
+private:
+	static const uint8_t not_free = 0xFF;
+
+	struct Page
+	{
+		DescriptorPage memory;
+		// Size class of the free block starting at each index, not_free elsewhere
+		std::vector<uint8_t> free_class;
+		// Position of that block in its free list, for O(1) removal when its buddy merges
+		std::vector<uint32_t> list_position;
+	};
+
+	struct Block
+	{
+		uint32_t page;
+		uint32_t index;
+	};
+
+	static uint32_t GetSizeClass(uint32_t count);
+	void PushFree(uint32_t size_class, const Block &block);
+	void RemoveFree(uint32_t size_class, const Block &block);
+	void AddPage();
+	void UpdateLargestFree();
+
+	DescriptorPageSource &source;
+	uint32_t page_capacity;
+	uint32_t page_class;
+	uint32_t descriptor_size;
+	std::vector<Page> pages;
+	std::vector<std::vector<Block>> free_lists;
+	DescriptorAllocatorStats stats;
+};
+
+struct DescriptorRingStats
+{
+	uint32_t capacity;
+	uint32_t in_use;
+	uint32_t peak_in_use;
+	uint64_t allocation_count;
+	uint64_t failed_count;
+	// Descriptors skipped at the end when a table did not fit before wrapping
+	uint64_t wrap_waste;
+};
+
+// Contiguous descriptor tables in one shader-visible heap. Tables written between two Close() calls retire
+// together with the fence value passed to Close(). The heap cannot grow while command lists reference it, so
+// Allocate fails instead when the frames in flight hold too much.
+class DescriptorRing
+{
+public:
+	DescriptorRing(uint32_t capacity);
+
+	bool Allocate(uint32_t count, uint32_t &index);
+	void Close(uint64_t fence_value);
+	void Retire(uint64_t completed_value);
+
+	const DescriptorRingStats &GetStats() const { return stats; }
+
+private:
+	struct Frame
+	{
+		uint64_t fence;
+		uint32_t size;
+	};
+
+	uint32_t head;
+	// Descriptors taken since the last Close()
+	uint32_t open_size;
+	std::deque<Frame> frames;
+	DescriptorRingStats stats;
+};
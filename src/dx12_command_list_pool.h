@@ -0,0 +1,118 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "dx12_command_sink.h"
+#include "parallel_record.h"
+
+#include <functional>
+#include <vector>
+
+// Draw chunk lists plus an epilogue list, each with an allocator per frame slot. The caller's prologue list,
+// the chunks and the epilogue go to the queue in one ExecuteCommandLists call.
+class D3D12CommandListPool : public CommandListBackend
+{
+public:
+	// Sets the state a chunk list needs before its draws: root signature, viewport, render target, buffers
+	typedef std::function<void(ID3D12GraphicsCommandList *)> SetupFunction;
+
+	D3D12CommandListPool(ID3D12Device *device, ID3D12CommandQueue *command_queue, UINT frames_in_flight, UINT max_chunks) :
+		command_queue(command_queue), max_chunks(max_chunks), frame_slot(0), chunk_count(0), prologue(nullptr),
+		pipelines(nullptr), pipeline_count(0), sinks(max_chunks, D3D12CommandSink(nullptr, nullptr, 0))
+	{
+		chunk_allocators.resize(frames_in_flight * max_chunks);
+		epilogue_allocators.resize(frames_in_flight);
+		chunk_lists.resize(max_chunks);
+		for (ComPtr<ID3D12CommandAllocator> &allocator : chunk_allocators) {
+			ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator)));
+		}
+		for (ComPtr<ID3D12CommandAllocator> &allocator : epilogue_allocators) {
+			ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator)));
+		}
+		for (ComPtr<ID3D12GraphicsCommandList> &list : chunk_lists) {
+			ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, chunk_allocators[0].Get(), nullptr, IID_PPV_ARGS(&list)));
+			ThrowIfFailed(list->Close());
+			list->SetName(L"Draw chunk");
+		}
+		ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, epilogue_allocators[0].Get(), nullptr, IID_PPV_ARGS(&epilogue)));
+		ThrowIfFailed(epilogue->Close());
+		epilogue->SetName(L"Frame epilogue");
+	}
+
+	// Render thread, once the frame ring handed out frame_slot. The closed prologue runs first; pipelines and
+	// setup are only used while the chunks are recorded.
+	void BeginFrame(UINT frame_slot, ID3D12GraphicsCommandList *prologue, ID3D12PipelineState *const *pipelines,
+		UINT pipeline_count, SetupFunction setup)
+	{
+		this->frame_slot = frame_slot;
+		this->prologue = prologue;
+		this->pipelines = pipelines;
+		this->pipeline_count = pipeline_count;
+		this->setup = setup;
+		chunk_count = 0;
+	}
+
+	void BeginChunks(uint32_t chunk_count) override
+	{
+		// Chunks past the pool size would need more lists; ParallelRecorder is created with the same limit
+		if (chunk_count > max_chunks) {
+			ThrowIfFailed(E_INVALIDARG);
+		}
+		this->chunk_count = chunk_count;
+	}
+
+	CommandSink &OpenChunk(uint32_t chunk) override
+	{
+		ID3D12CommandAllocator *allocator = chunk_allocators[frame_slot * max_chunks + chunk].Get();
+		ID3D12GraphicsCommandList *list = chunk_lists[chunk].Get();
+		ThrowIfFailed(allocator->Reset());
+		ThrowIfFailed(list->Reset(allocator, pipeline_count > 0 ? pipelines[0] : nullptr));
+		setup(list);
+		sinks[chunk] = D3D12CommandSink(list, pipelines, pipeline_count);
+		return sinks[chunk];
+	}
+
+	void CloseChunk(uint32_t chunk) override
+	{
+		ThrowIfFailed(chunk_lists[chunk]->Close());
+	}
+
+	// Render thread, after the chunks; the caller records into it and Submit() closes it
+	ID3D12GraphicsCommandList *OpenEpilogue()
+	{
+		ID3D12CommandAllocator *allocator = epilogue_allocators[frame_slot].Get();
+		ThrowIfFailed(allocator->Reset());
+		ThrowIfFailed(epilogue->Reset(allocator, nullptr));
+		return epilogue.Get();
+	}
+
+	void Submit() override
+	{
+		ThrowIfFailed(epilogue->Close());
+
+		submit_lists.clear();
+		submit_lists.push_back(prologue);
+		for (uint32_t i = 0; i < chunk_count; i++) {
+			submit_lists.push_back(chunk_lists[i].Get());
+		}
+		submit_lists.push_back(epilogue.Get());
+		command_queue->ExecuteCommandLists(static_cast<UINT>(submit_lists.size()), submit_lists.data());
+	}
+
+private:
+	ID3D12CommandQueue *command_queue;
+	UINT max_chunks;
+	UINT frame_slot;
+	uint32_t chunk_count;
+	ID3D12GraphicsCommandList *prologue;
+	ID3D12PipelineState *const *pipelines;
+	UINT pipeline_count;
+	SetupFunction setup;
+
+	// frames_in_flight * max_chunks, grouped by frame slot
+	std::vector<ComPtr<ID3D12CommandAllocator>> chunk_allocators;
+	std::vector<ComPtr<ID3D12CommandAllocator>> epilogue_allocators;
+	std::vector<ComPtr<ID3D12GraphicsCommandList>> chunk_lists;
+	ComPtr<ID3D12GraphicsCommandList> epilogue;
+	std::vector<D3D12CommandSink> sinks;
+	std::vector<ID3D12CommandList *> submit_lists;
+};
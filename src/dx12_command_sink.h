@@ -0,0 +1,38 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "command_sink.h"
+
+// Records into a graphics command list; pipeline indices select from the renderer's PSOs
+class D3D12CommandSink : public CommandSink
+{
+public:
+	D3D12CommandSink(ID3D12GraphicsCommandList *command_list, ID3D12PipelineState *const *pipelines, UINT pipeline_count) :
+		command_list(command_list), pipelines(pipelines), pipeline_count(pipeline_count)
+	{
+	}
+
+	void SetPipeline(uint32_t pipeline) override
+	{
+		if (pipeline < pipeline_count) {
+			command_list->SetPipelineState(pipelines[pipeline]);
+		}
+	}
+
+	// The constants are a descriptor table in the renderer's descriptor ring
+	void SetConstants(uint64_t gpu_address) override
+	{
+		command_list->SetGraphicsRootDescriptorTable(0, {gpu_address});
+	}
+
+	void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+		int32_t base_vertex, uint32_t first_instance) override
+	{
+		command_list->DrawIndexedInstanced(index_count, instance_count, first_index, base_vertex, first_instance);
+	}
+
+private:
+	ID3D12GraphicsCommandList *command_list;
+	ID3D12PipelineState *const *pipelines;
+	UINT pipeline_count;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "dx12_fence_timeline.h"
+#include "upload_batcher.h"
+
+#include <deque>
+#include <memory>
+
+// Dedicated copy queue with a mapped staging buffer; command allocators are recycled once their submission retired
+class D3D12CopyBackend : public CopyBackend
+{
+public:
+	D3D12CopyBackend(ID3D12Device *device, uint64_t staging_size) : device(device), fence_value(0), recording(false)
+	{
+		D3D12_COMMAND_QUEUE_DESC queueDescriptor = {};
+		queueDescriptor.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+		queueDescriptor.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		ThrowIfFailed(device->CreateCommandQueue(&queueDescriptor, IID_PPV_ARGS(&queue)));
+		queue->SetName(L"Copy queue");
+
+		timeline = std::make_unique<D3D12FenceTimeline>(device, queue.Get());
+
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(staging_size),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&staging)
+		));
+		staging->SetName(L"Upload staging");
+
+		CD3DX12_RANGE readRange(0, 0);
+		ThrowIfFailed(staging->Map(0, &readRange, reinterpret_cast<void **>(&staging_memory)));
+	}
+
+	uint8_t *GetStagingMemory() override
+	{
+		return staging_memory;
+	}
+
+	void CopyToBuffer(void *destination, uint64_t destination_offset, uint64_t staging_offset, uint64_t size) override
+	{
+		BeginRecording();
+		command_list->CopyBufferRegion(static_cast<ID3D12Resource *>(destination), destination_offset, staging.Get(), staging_offset, size);
+	}
+
+	uint64_t Submit() override
+	{
+		BeginRecording();
+		ThrowIfFailed(command_list->Close());
+		recording = false;
+
+		ID3D12CommandList *commandLists[] = {command_list.Get()};
+		queue->ExecuteCommandLists(_countof(commandLists), commandLists);
+
+		timeline->Signal(++fence_value);
+		allocators.push_back({current_allocator, fence_value});
+		current_allocator.Reset();
+		return fence_value;
+	}
+
+	uint64_t GetCompletedValue() override
+	{
+		return timeline->GetCompletedValue();
+	}
+
+	void WaitForValue(uint64_t value) override
+	{
+		timeline->WaitForValue(value);
+	}
+
+	ID3D12CommandQueue *GetQueue() const { return queue.Get(); }
+	ID3D12Fence *GetFence() const { return timeline->GetFence(); }
+
+private:
+	struct RetiringAllocator
+	{
+		ComPtr<ID3D12CommandAllocator> allocator;
+		uint64_t fence;
+	};
+
+	void BeginRecording()
+	{
+		if (recording) {
+			return;
+		}
+
+		if (!allocators.empty() && allocators.front().fence <= timeline->GetCompletedValue()) {
+			current_allocator = allocators.front().allocator;
+			allocators.pop_front();
+			ThrowIfFailed(current_allocator->Reset());
+		} else {
+			ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&current_allocator)));
+		}
+
+		if (command_list) {
+			ThrowIfFailed(command_list->Reset(current_allocator.Get(), nullptr));
+		} else {
+			ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, current_allocator.Get(), nullptr, IID_PPV_ARGS(&command_list)));
+		}
+		recording = true;
+	}
+
+	ID3D12Device *device;
+	ComPtr<ID3D12CommandQueue> queue;
+	std::unique_ptr<D3D12FenceTimeline> timeline;
+	ComPtr<ID3D12Resource> staging;
+	uint8_t *staging_memory;
+	ComPtr<ID3D12GraphicsCommandList> command_list;
+	ComPtr<ID3D12CommandAllocator> current_allocator;
+	std::deque<RetiringAllocator> allocators;
+	uint64_t fence_value;
+	bool recording;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "descriptor_allocator.h"
+
+// Descriptor heaps of one type as allocator pages; shader-visible pages also get a GPU start
+class D3D12DescriptorPageSource : public DescriptorPageSource
+{
+public:
+	D3D12DescriptorPageSource(ID3D12Device *device, D3D12_DESCRIPTOR_HEAP_TYPE type, bool shader_visible, LPCWSTR name) :
+		device(device), type(type), shader_visible(shader_visible), name(name),
+		descriptor_size(device->GetDescriptorHandleIncrementSize(type))
+	{
+	}
+
+	bool CreatePage(uint32_t capacity, DescriptorPage &page) override
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC heapDescriptor = {};
+		heapDescriptor.NumDescriptors = capacity;
+		heapDescriptor.Type = type;
+		heapDescriptor.Flags = shader_visible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		ComPtr<ID3D12DescriptorHeap> heap;
+		if (FAILED(device->CreateDescriptorHeap(&heapDescriptor, IID_PPV_ARGS(&heap)))) {
+			return false;
+		}
+
+		heap->SetName(name);
+		page.cpu_start = heap->GetCPUDescriptorHandleForHeapStart().ptr;
+		page.gpu_start = shader_visible ? heap->GetGPUDescriptorHandleForHeapStart().ptr : 0;
+		page.capacity = capacity;
+		page.heap = heap.Detach();
+		return true;
+	}
+
+	void DestroyPage(DescriptorPage &page) override
+	{
+		if (page.heap != nullptr) {
+			static_cast<ID3D12DescriptorHeap *>(page.heap)->Release();
+		}
+		page = {};
+	}
+
+	uint32_t GetDescriptorSize() const override { return descriptor_size; }
+
+private:
+	ID3D12Device *device;
+	D3D12_DESCRIPTOR_HEAP_TYPE type;
+	bool shader_visible;
+	LPCWSTR name;
+	uint32_t descriptor_size;
+};
+
+// Shader-visible CBV/SRV/UAV heap whose tables are copied from persistent descriptors every frame
+class D3D12DescriptorRing
+{
+public:
+	D3D12DescriptorRing(ID3D12Device *device, uint32_t capacity) :
+		device(device), pages(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, true, L"Descriptor ring"), ring(capacity)
+	{
+		if (!pages.CreatePage(capacity, page)) {
+			ThrowIfFailed(E_OUTOFMEMORY);
+		}
+	}
+
+	~D3D12DescriptorRing() { pages.DestroyPage(page); }
+
+	D3D12DescriptorRing(const D3D12DescriptorRing &) = delete;
+	D3D12DescriptorRing &operator=(const D3D12DescriptorRing &) = delete;
+
+	ID3D12DescriptorHeap *GetHeap() const { return static_cast<ID3D12DescriptorHeap *>(page.heap); }
+
+	// Copies a contiguous range of persistent descriptors into a table valid for the open frame
+	bool CopyTable(const DescriptorAllocation &source, D3D12_GPU_DESCRIPTOR_HANDLE &table)
+	{
+		uint32_t index = 0;
+		if (!ring.Allocate(source.count, index)) {
+			return false;
+		}
+		const uint64_t offset = static_cast<uint64_t>(index) * pages.GetDescriptorSize();
+		device->CopyDescriptorsSimple(source.count, {static_cast<SIZE_T>(page.cpu_start + offset)}, {static_cast<SIZE_T>(source.cpu_address)},
+			D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		table.ptr = page.gpu_start + offset;
+		return true;
+	}
+
+	void Close(uint64_t fence_value) { ring.Close(fence_value); }
+	void Retire(uint64_t completed_value) { ring.Retire(completed_value); }
+	const DescriptorRingStats &GetStats() const { return ring.GetStats(); }
+
+private:
+	ID3D12Device *device;
+	D3D12DescriptorPageSource pages;
+	DescriptorPage page;
+	DescriptorRing ring;
+};
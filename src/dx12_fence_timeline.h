@@ -0,0 +1,47 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "frame_ring.h"
+
+class D3D12FenceTimeline : public FenceTimeline
+{
+public:
+	D3D12FenceTimeline(ID3D12Device *device, ID3D12CommandQueue *queue) : queue(queue)
+	{
+		ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
+		fence_event = CreateEvent(nullptr, false, false, nullptr);
+		if (fence_event == nullptr) {
+			ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+		}
+	}
+
+	~D3D12FenceTimeline()
+	{
+		CloseHandle(fence_event);
+	}
+
+	void Signal(uint64_t value) override
+	{
+		ThrowIfFailed(queue->Signal(fence.Get(), value));
+	}
+
+	uint64_t GetCompletedValue() override
+	{
+		return fence->GetCompletedValue();
+	}
+
+	void WaitForValue(uint64_t value) override
+	{
+		if (fence->GetCompletedValue() < value) {
+			ThrowIfFailed(fence->SetEventOnCompletion(value, fence_event));
+			WaitForSingleObject(fence_event, INFINITE);
+		}
+	}
+
+	ID3D12Fence *GetFence() const { return fence.Get(); }
+
+private:
+	ID3D12CommandQueue *queue;
+	ComPtr<ID3D12Fence> fence;
+	HANDLE fence_event;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "profiler.h"
+
+#include <vector>
+
+// GPU scopes from timestamp queries. Each frame slot owns a range of the query heap and of a readback
+// buffer; EndFrame() resolves the slot's queries on the command list and BeginFrame() reads them back
+// once the frame ring has retired the slot. Timestamps are moved onto the ProfilerNow() timeline with
+// the queue's clock calibration, which is refreshed every calibration_interval frames to follow drift.
+class D3D12GpuProfiler
+{
+public:
+	static const UINT max_scopes_per_frame = 64;
+	static const UINT calibration_interval = 120;
+
+	D3D12GpuProfiler(ID3D12Device *device, ID3D12CommandQueue *queue, UINT frame_count) :
+		queue(queue), slots(frame_count), current_slot(0), frames_since_calibration(0)
+	{
+		const UINT queryCount = max_scopes_per_frame * 2 * frame_count;
+
+		D3D12_QUERY_HEAP_DESC heapDescriptor = {};
+		heapDescriptor.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+		heapDescriptor.Count = queryCount;
+		ThrowIfFailed(device->CreateQueryHeap(&heapDescriptor, IID_PPV_ARGS(&query_heap)));
+
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(UINT64) * queryCount),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&readback)
+		));
+		readback->SetName(L"Timestamp readback");
+
+		ThrowIfFailed(queue->GetTimestampFrequency(&gpu_frequency));
+		LARGE_INTEGER cpuFrequency;
+		QueryPerformanceFrequency(&cpuFrequency);
+		cpu_frequency = static_cast<UINT64>(cpuFrequency.QuadPart);
+		Calibrate();
+	}
+
+	// The slot must have retired (FrameRing::BeginFrame returned it)
+	void BeginFrame(UINT slot)
+	{
+		current_slot = slot;
+		Slot &frame = slots[slot];
+		if (!frame.scopes.empty()) {
+			const UINT first = slot * max_scopes_per_frame * 2;
+			D3D12_RANGE readRange = {sizeof(UINT64) * first, sizeof(UINT64) * (first + frame.scopes.size() * 2)};
+			UINT64 *timestamps;
+			ThrowIfFailed(readback->Map(0, &readRange, reinterpret_cast<void **>(&timestamps)));
+			for (size_t i = 0; i < frame.scopes.size(); i++) {
+				const UINT64 begin = timestamps[first + i * 2];
+				const UINT64 end = timestamps[first + i * 2 + 1];
+				Profiler::Get().AddGpuEvent(frame.scopes[i].name, ToProfilerTime(begin), ToProfilerTime(end), frame.scopes[i].depth);
+			}
+			D3D12_RANGE writeRange = {0, 0};
+			readback->Unmap(0, &writeRange);
+			frame.scopes.clear();
+		}
+		frame.depth = 0;
+
+		if (++frames_since_calibration >= calibration_interval) {
+			Calibrate();
+		}
+	}
+
+	// Returns the scope index for EndScope, or UINT_MAX when the frame is out of queries
+	UINT BeginScope(ID3D12GraphicsCommandList *command_list, const char *name)
+	{
+		Slot &frame = slots[current_slot];
+		if (frame.scopes.size() >= max_scopes_per_frame) {
+			return UINT_MAX;
+		}
+		const UINT scope = static_cast<UINT>(frame.scopes.size());
+		frame.scopes.push_back({name, frame.depth++});
+		command_list->EndQuery(query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, QueryIndex(scope, 0));
+		return scope;
+	}
+
+	void EndScope(ID3D12GraphicsCommandList *command_list, UINT scope)
+	{
+		if (scope == UINT_MAX) {
+			return;
+		}
+		slots[current_slot].depth--;
+		command_list->EndQuery(query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, QueryIndex(scope, 1));
+	}
+
+	// Record after the last scope of the frame
+	void EndFrame(ID3D12GraphicsCommandList *command_list)
+	{
+		const Slot &frame = slots[current_slot];
+		if (frame.scopes.empty()) {
+			return;
+		}
+		const UINT first = QueryIndex(0, 0);
+		command_list->ResolveQueryData(query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first,
+			static_cast<UINT>(frame.scopes.size() * 2), readback.Get(), sizeof(UINT64) * first);
+	}
+
+private:
+	struct Scope
+	{
+		const char *name;
+		uint32_t depth;
+	};
+
+	struct Slot
+	{
+		std::vector<Scope> scopes;
+		uint32_t depth;
+	};
+
+	UINT QueryIndex(UINT scope, UINT end) const
+	{
+		return (current_slot * max_scopes_per_frame + scope) * 2 + end;
+	}
+
+	void Calibrate()
+	{
+		ThrowIfFailed(queue->GetClockCalibration(&gpu_calibration, &cpu_calibration));
+		frames_since_calibration = 0;
+	}
+
+	// Offset from the calibration point in GPU ticks, added to the calibration QPC value in nanoseconds,
+	// which is what steady_clock reports on Windows
+	uint64_t ToProfilerTime(UINT64 gpu_timestamp) const
+	{
+		const double gpuDeltaNs = (static_cast<double>(gpu_timestamp) - static_cast<double>(gpu_calibration)) * 1e9 / gpu_frequency;
+		const UINT64 cpuNs = cpu_calibration / cpu_frequency * 1000000000ull + cpu_calibration % cpu_frequency * 1000000000ull / cpu_frequency;
+		return static_cast<uint64_t>(static_cast<int64_t>(cpuNs) + static_cast<int64_t>(gpuDeltaNs));
+	}
+
+	ID3D12CommandQueue *queue;
+	ComPtr<ID3D12QueryHeap> query_heap;
+	ComPtr<ID3D12Resource> readback;
+	std::vector<Slot> slots;
+	UINT current_slot;
+	UINT frames_since_calibration;
+	UINT64 gpu_frequency;
+	UINT64 cpu_frequency;
+	UINT64 gpu_calibration;
+	UINT64 cpu_calibration;
+};
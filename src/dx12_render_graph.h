@@ -0,0 +1,108 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "render_graph.h"
+
+#include <vector>
+
+// Records a render graph's barrier batches into the current command list. Imported resources are bound each
+// frame; transients are placed into one heap sized by the compiled graph.
+class D3D12RenderGraphBackend : public RenderGraphBackend
+{
+public:
+	D3D12RenderGraphBackend() : command_list(nullptr) {};
+
+	static D3D12_RESOURCE_STATES GetD3D12State(ResourceState state)
+	{
+		static const D3D12_RESOURCE_STATES states[] = {
+			D3D12_RESOURCE_STATE_RENDER_TARGET,
+			D3D12_RESOURCE_STATE_DEPTH_WRITE,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			D3D12_RESOURCE_STATE_DEPTH_READ,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+			D3D12_RESOURCE_STATE_COPY_SOURCE,
+			D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER,
+			D3D12_RESOURCE_STATE_PRESENT
+		};
+		D3D12_RESOURCE_STATES result = D3D12_RESOURCE_STATE_COMMON;
+		for (UINT bit = 0; bit < _countof(states); bit++) {
+			if (static_cast<uint32_t>(state) & (1u << bit)) {
+				result |= states[bit];
+			}
+		}
+		return result;
+	}
+
+	// Passes may switch lists while they run; later batches go to the new one
+	void SetCommandList(ID3D12GraphicsCommandList *command_list) { this->command_list = command_list; }
+	ID3D12GraphicsCommandList *GetCommandList() const { return command_list; }
+
+	void SetResource(RenderGraph::ResourceId id, ID3D12Resource *resource)
+	{
+		if (resources.size() <= id) {
+			resources.resize(id + 1, nullptr);
+		}
+		resources[id] = resource;
+	}
+
+	// Heap for the transients of a compiled graph; heap_flags select the resource category on tier 1 hardware
+	void CreateTransientHeap(ID3D12Device *device, const RenderGraph &graph, D3D12_HEAP_FLAGS heap_flags)
+	{
+		transient_heap.Reset();
+		if (graph.GetStats().transient_heap_size == 0) {
+			return;
+		}
+		D3D12_HEAP_DESC heapDescriptor = {};
+		heapDescriptor.SizeInBytes = graph.GetStats().transient_heap_size;
+		heapDescriptor.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		heapDescriptor.Alignment = graph.GetTransientHeapAlignment();
+		heapDescriptor.Flags = heap_flags;
+		ThrowIfFailed(device->CreateHeap(&heapDescriptor, IID_PPV_ARGS(&transient_heap)));
+		transient_heap->SetName(L"Render graph transients");
+	}
+
+	// The descriptor's allocation size must match the size the transient was created with
+	ComPtr<ID3D12Resource> CreateTransient(ID3D12Device *device, const RenderGraph &graph, RenderGraph::ResourceId id,
+		const D3D12_RESOURCE_DESC &descriptor, const D3D12_CLEAR_VALUE *clear_value)
+	{
+		ComPtr<ID3D12Resource> resource;
+		ThrowIfFailed(device->CreatePlacedResource(transient_heap.Get(), graph.GetTransientOffset(id), &descriptor,
+			GetD3D12State(graph.GetTransientCreateState(id)), clear_value, IID_PPV_ARGS(&resource)));
+		SetResource(id, resource.Get());
+		return resource;
+	}
+
+	void ResourceBarriers(const RenderBarrier *barriers, uint32_t count) override
+	{
+		batch.clear();
+		for (uint32_t i = 0; i < count; i++) {
+			const RenderBarrier &barrier = barriers[i];
+			D3D12_RESOURCE_BARRIER d3dBarrier = {};
+			switch (barrier.type) {
+				case BarrierType::Transition:
+					d3dBarrier = CD3DX12_RESOURCE_BARRIER::Transition(resources[barrier.resource],
+						GetD3D12State(barrier.state_before), GetD3D12State(barrier.state_after));
+					d3dBarrier.Flags = barrier.split == BarrierSplit::Begin ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY :
+						(barrier.split == BarrierSplit::End ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY : D3D12_RESOURCE_BARRIER_FLAG_NONE);
+					break;
+				case BarrierType::Aliasing:
+					d3dBarrier = CD3DX12_RESOURCE_BARRIER::Aliasing(
+						barrier.before_resource != RenderGraph::no_resource ? resources[barrier.before_resource] : nullptr,
+						resources[barrier.resource]);
+					break;
+				case BarrierType::Uav:
+					d3dBarrier = CD3DX12_RESOURCE_BARRIER::UAV(resources[barrier.resource]);
+					break;
+			}
+			batch.push_back(d3dBarrier);
+		}
+		command_list->ResourceBarrier(static_cast<UINT>(batch.size()), batch.data());
+	}
+
+private:
+	ID3D12GraphicsCommandList *command_list;
+	std::vector<ID3D12Resource *> resources;
+	ComPtr<ID3D12Heap> transient_heap;
+	std::vector<D3D12_RESOURCE_BARRIER> batch;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "gpu_heap_allocator.h"
+
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// ID3D12Heaps of one type as allocator heaps
+class D3D12HeapSource : public GpuHeapSource
+{
+public:
+	D3D12HeapSource(ID3D12Device *device, D3D12_HEAP_TYPE type, D3D12_HEAP_FLAGS flags, LPCWSTR name) :
+		device(device), type(type), flags(flags), name(name)
+	{
+	}
+
+	bool CreateHeap(uint64_t size, uint64_t alignment, GpuHeap &heap) override
+	{
+		D3D12_HEAP_DESC heapDescriptor = {};
+		heapDescriptor.SizeInBytes = size;
+		heapDescriptor.Properties = CD3DX12_HEAP_PROPERTIES(type);
+		heapDescriptor.Alignment = alignment;
+		heapDescriptor.Flags = flags;
+		ComPtr<ID3D12Heap> d3dHeap;
+		if (FAILED(device->CreateHeap(&heapDescriptor, IID_PPV_ARGS(&d3dHeap)))) {
+			return false;
+		}
+
+		d3dHeap->SetName(name);
+		heap.size = size;
+		heap.heap = d3dHeap.Detach();
+		return true;
+	}
+
+	void DestroyHeap(GpuHeap &heap) override
+	{
+		if (heap.heap != nullptr) {
+			static_cast<ID3D12Heap *>(heap.heap)->Release();
+		}
+		heap = {};
+	}
+
+private:
+	ID3D12Device *device;
+	D3D12_HEAP_TYPE type;
+	D3D12_HEAP_FLAGS flags;
+	LPCWSTR name;
+};
+
+class D3D12BufferHeap;
+
+// Buffer placed in a D3D12BufferHeap. Copies share it like a ComPtr, and its range returns to the heap when the
+// last copy is dropped, e.g. by the retire queue; hold the resource only through these, and create the heap first.
+class PlacedBuffer
+{
+public:
+	PlacedBuffer() {};
+
+	ID3D12Resource *Get() const { return placement ? placement->resource.Get() : nullptr; }
+	ID3D12Resource *operator->() const { return Get(); }
+	explicit operator bool() const { return placement != nullptr; }
+
+private:
+	friend class D3D12BufferHeap;
+
+	struct Placement
+	{
+		// Frees the range, then the resource goes
+		~Placement();
+
+		D3D12BufferHeap *heap;
+		GpuAllocation allocation;
+		ComPtr<ID3D12Resource> resource;
+	};
+
+	explicit PlacedBuffer(std::shared_ptr<Placement> placement) : placement(std::move(placement)) {};
+
+	std::shared_ptr<Placement> placement;
+};
+
+// Buffers placed in heaps of one type, heap_size bytes each, instead of a committed allocation each. DEFAULT
+// buffers start in COMMON, so copies and draws promote them implicitly; UPLOAD buffers start in GENERIC_READ and
+// READBACK ones in COPY_DEST, the only states those heaps allow. Thread-safe.
+class D3D12BufferHeap
+{
+public:
+	D3D12BufferHeap(ID3D12Device *device, D3D12_HEAP_TYPE type, uint64_t heap_size, LPCWSTR name) :
+		device(device), type(type), source(device, type, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS, name),
+		allocator(source, heap_size, default_placement_alignment)
+	{
+	}
+
+	D3D12BufferHeap(const D3D12BufferHeap &) = delete;
+	D3D12BufferHeap &operator=(const D3D12BufferHeap &) = delete;
+
+	PlacedBuffer CreateBuffer(uint64_t size, LPCWSTR name)
+	{
+		const D3D12_RESOURCE_DESC resourceDescriptor = CD3DX12_RESOURCE_DESC::Buffer(size);
+		const D3D12_RESOURCE_ALLOCATION_INFO info = device->GetResourceAllocationInfo(0, 1, &resourceDescriptor);
+		std::lock_guard<std::mutex> lock(mutex);
+		const GpuAllocation allocation = allocator.Allocate(info.SizeInBytes, info.Alignment);
+		PlacedBuffer buffer = Track(allocation, resourceDescriptor);
+		buffer->SetName(name);
+		return buffer;
+	}
+
+	// Moves up to max_bytes of buffers out of the least used heaps and records their copies into command_list, which
+	// must see the buffers in COMMON or COPY_SOURCE. Returns old and new buffer of each move: owners switch to the
+	// new one, and its GPU address, for work recorded after command_list, and retire the old one with that list's
+	// fence, which frees its range.
+	std::vector<std::pair<PlacedBuffer, PlacedBuffer>> Defragment(ID3D12GraphicsCommandList *command_list, uint64_t max_bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<GpuAllocationMove> moves;
+		allocator.Defragment(max_bytes, moves);
+
+		std::vector<std::pair<PlacedBuffer, PlacedBuffer>> moved;
+		for (const GpuAllocationMove &move : moves) {
+			// A buffer dropped on another thread waits on the lock to free its range; it needs no copy
+			PlacedBuffer source(placements[move.source.block].lock());
+			if (!source) {
+				allocator.Free(move.destination);
+				continue;
+			}
+			const D3D12_RESOURCE_DESC resourceDescriptor = source->GetDesc();
+			PlacedBuffer destination = Track(move.destination, resourceDescriptor);
+			destination->SetName(L"Moved buffer");
+			command_list->CopyBufferRegion(destination.Get(), 0, source.Get(), 0, resourceDescriptor.Width);
+			moved.push_back({source, destination});
+		}
+		return moved;
+	}
+
+	D3D12_HEAP_TYPE GetType() const { return type; }
+	GpuHeapAllocatorStats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return allocator.GetStats();
+	}
+
+private:
+	friend struct PlacedBuffer::Placement;
+
+	PlacedBuffer Track(const GpuAllocation &allocation, const D3D12_RESOURCE_DESC &resourceDescriptor)
+	{
+		ComPtr<ID3D12Resource> resource;
+		const HRESULT result = device->CreatePlacedResource(
+			static_cast<ID3D12Heap *>(allocator.GetHeap(allocation.heap).heap),
+			allocation.offset,
+			&resourceDescriptor,
+			GetInitialState(),
+			nullptr,
+			IID_PPV_ARGS(&resource)
+		);
+		if (FAILED(result)) {
+			allocator.Free(allocation);
+			ThrowIfFailed(result);
+		}
+
+		std::shared_ptr<PlacedBuffer::Placement> placement = std::make_shared<PlacedBuffer::Placement>();
+		placement->heap = this;
+		placement->allocation = allocation;
+		placement->resource = resource;
+		if (placements.size() <= allocation.block) {
+			placements.resize(allocation.block + 1);
+		}
+		placements[allocation.block] = placement;
+		return PlacedBuffer(placement);
+	}
+
+	void Free(const GpuAllocation &allocation)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		placements[allocation.block].reset();
+		allocator.Free(allocation);
+	}
+
+	D3D12_RESOURCE_STATES GetInitialState() const
+	{
+		switch (type) {
+		case D3D12_HEAP_TYPE_UPLOAD:
+			return D3D12_RESOURCE_STATE_GENERIC_READ;
+		case D3D12_HEAP_TYPE_READBACK:
+			return D3D12_RESOURCE_STATE_COPY_DEST;
+		default:
+			return D3D12_RESOURCE_STATE_COMMON;
+		}
+	}
+
+	ID3D12Device *device;
+	D3D12_HEAP_TYPE type;
+	D3D12HeapSource source;
+	mutable std::mutex mutex;
+	GpuHeapAllocator allocator;
+	// The buffer of each allocated block, for Defragment()
+	std::vector<std::weak_ptr<PlacedBuffer::Placement>> placements;
+};
+
+inline PlacedBuffer::Placement::~Placement()
+{
+	if (heap != nullptr) {
+		heap->Free(allocation);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "shader_cache.h"
+
+// FXC through D3DCompile. Includes are rejected because ComputeShaderKey only hashes the main source.
+class D3DShaderCompiler : public ShaderCompiler
+{
+public:
+	std::string GetVersion() const override
+	{
+		return "d3dcompiler_" + std::to_string(D3D_COMPILER_VERSION);
+	}
+
+	bool Compile(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+		std::string &err) override
+	{
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (const ShaderDefine &define : request.defines) {
+			macros.push_back({define.name.c_str(), define.value.c_str()});
+		}
+		macros.push_back({nullptr, nullptr});
+
+		ComPtr<ID3DBlob> code;
+		ComPtr<ID3DBlob> errors;
+		HRESULT hr = D3DCompile(source.data(), source.size(), request.source_name.c_str(), macros.data(), nullptr,
+			request.entry_point.c_str(), request.target.c_str(), request.flags, 0, &code, &errors);
+		if (errors) {
+			err.assign(static_cast<const char *>(errors->GetBufferPointer()), errors->GetBufferSize());
+		}
+		if (FAILED(hr)) {
+			if (err.empty()) {
+				err = "D3DCompile failed for " + request.source_name + ":" + request.entry_point;
+			}
+			return false;
+		}
+
+		const uint8_t *data = static_cast<const uint8_t *>(code->GetBufferPointer());
+		bytecode.assign(data, data + code->GetBufferSize());
+		return true;
+	}
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "dx12_copy_queue.h"
+#include "dx12_resource_heaps.h"
+#include "asset_streamer.h"
+#include "upload_batcher.h"
+#include "vertex_format.h"
+
+#include <vector>
+
+// Streamed geometry in buffers of the buffer heap, written by the copy queue while the direct queue draws what
+// arrived before. The buffers stay in COMMON: copies promote them to COPY_DEST and draws to vertex or index reads,
+// and both decay back after each ExecuteCommandLists, so uploads into new ranges need no barriers on the direct queue.
+// Given cpu_vertices and cpu_indices, it also copies everything it uploads into them, sized at Reserve().
+class D3D12StreamTarget : public StreamTarget
+{
+public:
+	D3D12StreamTarget(ID3D12CommandQueue *direct_queue, D3D12BufferHeap &buffer_heap, D3D12CopyBackend &copy_backend,
+		UploadBatcher &upload_batcher, VertexFormat vertex_format, std::vector<MeshVertex> *cpu_vertices = nullptr,
+		std::vector<uint32_t> *cpu_indices = nullptr) :
+		direct_queue(direct_queue), buffer_heap(buffer_heap), copy_backend(copy_backend), upload_batcher(upload_batcher),
+		vertex_format(vertex_format), vertex_stride(static_cast<UINT>(GetVertexStride(vertex_format))),
+		cpu_vertices(cpu_vertices), cpu_indices(cpu_indices), submitted(0)
+	{
+		vertex_quantization = {{1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+		vertex_buffer_view = {};
+		index_buffer_view = {};
+	}
+
+	void Reserve(uint64_t vertex_count, uint64_t index_count, const float *bounds_min, const float *bounds_max) override
+	{
+		// Every chunk shares one quantization, so it comes from the bounds of the whole model
+		if (vertex_format == VertexFormat::Quantized) {
+			MeshVertex corners[2] = {};
+			memcpy(corners[0].position, bounds_min, sizeof(corners[0].position));
+			memcpy(corners[1].position, bounds_max, sizeof(corners[1].position));
+			vertex_quantization = ComputeVertexQuantization(corners, 2);
+		}
+		vertex_buffer = buffer_heap.CreateBuffer(std::max<uint64_t>(vertex_count, 1) * vertex_stride, L"Streamed vertex buffer");
+		index_buffer = buffer_heap.CreateBuffer(std::max<uint64_t>(index_count, 1) * sizeof(uint32_t), L"Streamed index buffer");
+
+		vertex_buffer_view.BufferLocation = vertex_buffer->GetGPUVirtualAddress();
+		vertex_buffer_view.StrideInBytes = vertex_stride;
+		vertex_buffer_view.SizeInBytes = static_cast<UINT>(vertex_count * vertex_stride);
+		index_buffer_view.BufferLocation = index_buffer->GetGPUVirtualAddress();
+		index_buffer_view.Format = DXGI_FORMAT_R32_UINT;
+		index_buffer_view.SizeInBytes = static_cast<UINT>(index_count * sizeof(uint32_t));
+
+		if (cpu_vertices != nullptr) {
+			cpu_vertices->assign(vertex_count, MeshVertex());
+		}
+		if (cpu_indices != nullptr) {
+			cpu_indices->assign(index_count, 0);
+		}
+	}
+
+	uint64_t GetUploadSize(uint64_t vertex_count, uint64_t index_count) const override
+	{
+		return vertex_count * vertex_stride + index_count * sizeof(uint32_t);
+	}
+
+	void UploadVertices(uint64_t first_vertex, const MeshVertex *vertices, size_t count) override
+	{
+		if (cpu_vertices != nullptr) {
+			std::copy(vertices, vertices + count, cpu_vertices->begin() + first_vertex);
+		}
+		if (vertex_format == VertexFormat::Quantized) {
+			encoded.resize(count);
+			EncodeVertices(vertices, count, vertex_quantization, encoded.data());
+			upload_batcher.Upload(vertex_buffer.Get(), first_vertex * vertex_stride, encoded.data(), count * vertex_stride);
+		} else {
+			upload_batcher.Upload(vertex_buffer.Get(), first_vertex * vertex_stride, vertices, count * vertex_stride);
+		}
+	}
+
+	void UploadIndices(uint64_t first_index, const uint32_t *indices, size_t count) override
+	{
+		if (cpu_indices != nullptr) {
+			std::copy(indices, indices + count, cpu_indices->begin() + first_index);
+		}
+		upload_batcher.Upload(index_buffer.Get(), first_index * sizeof(uint32_t), indices, count * sizeof(uint32_t));
+	}
+
+	// The direct queue waits for the copies on the GPU, so draws recorded from now on may use them
+	uint64_t Submit() override
+	{
+		ThrowIfFailed(direct_queue->Wait(copy_backend.GetFence(), upload_batcher.Flush()));
+		return ++submitted;
+	}
+
+	uint64_t GetCompletedValue() override { return submitted; }
+
+	// Valid after Reserve()
+	const PlacedBuffer &GetVertexBuffer() const { return vertex_buffer; }
+	const PlacedBuffer &GetIndexBuffer() const { return index_buffer; }
+	const D3D12_VERTEX_BUFFER_VIEW &GetVertexBufferView() const { return vertex_buffer_view; }
+	const D3D12_INDEX_BUFFER_VIEW &GetIndexBufferView() const { return index_buffer_view; }
+	const VertexQuantization &GetQuantization() const { return vertex_quantization; }
+
+private:
+	ID3D12CommandQueue *direct_queue;
+	D3D12BufferHeap &buffer_heap;
+	D3D12CopyBackend &copy_backend;
+	UploadBatcher &upload_batcher;
+	VertexFormat vertex_format;
+	UINT vertex_stride;
+	VertexQuantization vertex_quantization;
+	std::vector<QuantizedVertex> encoded;
+	std::vector<MeshVertex> *cpu_vertices;
+	std::vector<uint32_t> *cpu_indices;
+
+	PlacedBuffer vertex_buffer;
+	PlacedBuffer index_buffer;
+	D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view;
+	D3D12_INDEX_BUFFER_VIEW index_buffer_view;
+	uint64_t submitted;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "dx12_resource_heaps.h"
+#include "upload_ring.h"
+
+// Upload pages backed by persistently mapped buffers placed in an UPLOAD buffer heap
+class D3D12UploadPageSource : public UploadPageSource
+{
+public:
+	D3D12UploadPageSource(D3D12BufferHeap &heap) : heap(heap) {};
+
+	bool CreatePage(uint64_t size, UploadPage &page) override
+	{
+		PlacedBuffer buffer = heap.CreateBuffer(size, L"Upload ring page");
+		void *mapped = nullptr;
+		CD3DX12_RANGE readRange(0, 0);
+		if (FAILED(buffer->Map(0, &readRange, &mapped))) {
+			return false;
+		}
+
+		page.cpu_address = static_cast<uint8_t *>(mapped);
+		page.gpu_address = buffer->GetGPUVirtualAddress();
+		page.size = size;
+		page.resource = new PlacedBuffer(buffer);
+		return true;
+	}
+
+	void DestroyPage(UploadPage &page) override
+	{
+		PlacedBuffer *buffer = static_cast<PlacedBuffer *>(page.resource);
+		if (buffer != nullptr) {
+			(*buffer)->Unmap(0, nullptr);
+			delete buffer;
+		}
+		page = {};
+	}
+
+private:
+	D3D12BufferHeap &heap;
+};
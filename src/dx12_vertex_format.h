@@ -0,0 +1,35 @@
+#pragma once
+
+#include "dx12_labs.h"
+#include "shader_cache.h"
+#include "vertex_format.h"
+
+#include <vector>
+
+// Input layout of each vertex format, matching the VSMain variants of shaders.hlsl
+inline D3D12_INPUT_LAYOUT_DESC GetInputLayout(VertexFormat format)
+{
+	static const D3D12_INPUT_ELEMENT_DESC floatElements[] = {
+		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+	};
+	static const D3D12_INPUT_ELEMENT_DESC quantizedElements[] = {
+		{"POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+		{"COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
+	};
+	static_assert(sizeof(QuantizedVertex) == 12, "Input layout expects 12-byte quantized vertices");
+
+	if (format == VertexFormat::Quantized) {
+		return {quantizedElements, _countof(quantizedElements)};
+	}
+	return {floatElements, _countof(floatElements)};
+}
+
+// Defines that select the VSMain variant
+inline std::vector<ShaderDefine> GetVertexShaderDefines(VertexFormat format)
+{
+	if (format == VertexFormat::Quantized) {
+		return {{"QUANTIZED_VERTICES", "1"}};
+	}
+	return {};
+}
@@ -0,0 +1,35 @@
+#include "frame_ring.h"
+
+FrameRing::FrameRing(FenceTimeline &timeline, uint32_t frames_in_flight) :
+	timeline(timeline), slot_fences(frames_in_flight ? frames_in_flight : 1, 0), slot(0), next_value(1), frame_count(0), wait_count(0)
+{
+}
+
+uint32_t FrameRing::BeginFrame()
+{
+	slot = static_cast<uint32_t>(frame_count % slot_fences.size());
+
+	const uint64_t pending = slot_fences[slot];
+	if (pending != 0 && timeline.GetCompletedValue() < pending) {
+		wait_count++;
+		timeline.WaitForValue(pending);
+	}
+
+	return slot;
+}
+
+uint64_t FrameRing::EndFrame()
+{
+	const uint64_t value = next_value++;
+	timeline.Signal(value);
+	slot_fences[slot] = value;
+	frame_count++;
+	return value;
+}
+
+void FrameRing::WaitForIdle()
+{
+	if (next_value > 1) {
+		timeline.WaitForValue(next_value - 1);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// GPU timeline the CPU synchronizes with: a D3D12 fence on a queue, or a simulated queue
+class FenceTimeline
+{
+public:
+	virtual ~FenceTimeline() {};
+
+	// Enqueue a signal after all work submitted so far
+	virtual void Signal(uint64_t value) = 0;
+	virtual uint64_t GetCompletedValue() = 0;
+	// Block the CPU until the timeline reaches value
+	virtual void WaitForValue(uint64_t value) = 0;
+};
+
+// Ring of per-frame slots. A slot (command allocator, constant buffer slice, ...) is handed out
+// again only after the fence value signaled at the end of its previous frame has completed.
+class FrameRing
+{
+public:
+	FrameRing(FenceTimeline &timeline, uint32_t frames_in_flight);
+
+	// Waits for the slot's previous frame if needed and returns the slot index
+	uint32_t BeginFrame();
+	// Signals the fence value of the current frame and returns it
+	uint64_t EndFrame();
+	void WaitForIdle();
+
+	uint32_t GetFrameSlot() const { return slot; }
+	uint32_t GetFramesInFlight() const { return static_cast<uint32_t>(slot_fences.size()); }
+	// Fence value EndFrame will signal; work recorded in the current frame retires with it
+	uint64_t GetCurrentFenceValue() const { return next_value; }
+	uint64_t GetCompletedValue() { return timeline.GetCompletedValue(); }
+	uint64_t GetFrameCount() const { return frame_count; }
+	uint64_t GetWaitCount() const { return wait_count; }
+
+private:
+	FenceTimeline &timeline;
+	std::vector<uint64_t> slot_fences;
+	uint32_t slot;
+	uint64_t next_value;
+	uint64_t frame_count;
+	uint64_t wait_count;
+};
@@ -0,0 +1,162 @@
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+uint64_t SteadyClock::Now()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void SteadyClock::SleepUntil(uint64_t time)
+{
+	for (;;) {
+		const uint64_t now = Now();
+		if (now >= time) {
+			return;
+		}
+		if (time - now > spin_margin) {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(time - now - spin_margin));
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+FrameSchedulerSettings GetDefaultSchedulerSettings()
+{
+	FrameSchedulerSettings settings;
+	settings.update_rate = 120.0;
+	settings.max_updates_per_frame = 8;
+	settings.pacing = FramePacing::LowLatency;
+	settings.max_frame_rate = 144.0;
+	settings.latency_margin_ms = 1.0;
+	return settings;
+}
+
+FrameScheduler::FrameScheduler(SchedulerClock &clock, const FrameSchedulerSettings &settings) :
+	clock(clock), settings(settings), frame_index(0), frame_start(0), accumulator(0), deadline(0), slept(0), dropped(0)
+{
+	fixed_step = static_cast<uint64_t>(1e9 / std::max(1.0, settings.update_rate));
+	frame_period = settings.pacing != FramePacing::None && settings.max_frame_rate > 0.0
+		? static_cast<uint64_t>(1e9 / settings.max_frame_rate) : 0;
+	this->settings.max_updates_per_frame = std::max(1u, settings.max_updates_per_frame);
+	frame_times.reserve(history_size);
+	work_times.reserve(work_history_size);
+}
+
+uint64_t FrameScheduler::GetPacingTarget(uint64_t now)
+{
+	if (frame_period == 0) {
+		return now;
+	}
+
+	if (settings.pacing == FramePacing::Cap) {
+		return frame_start + frame_period;
+	}
+
+	// The slowest recent frame predicts the next one; start so that it finishes margin before the deadline
+	uint64_t predictedWork = 0;
+	for (uint64_t work : work_times) {
+		predictedWork = std::max(predictedWork, work);
+	}
+	predictedWork += static_cast<uint64_t>(settings.latency_margin_ms * 1e6);
+
+	deadline += frame_period;
+	if (deadline < now + predictedWork) {
+		// Fell behind; restart the deadline grid from here instead of trying to catch up
+		deadline = now + predictedWork;
+	}
+	return deadline - predictedWork;
+}
+
+FrameTiming FrameScheduler::BeginFrame()
+{
+	uint64_t now = clock.Now();
+	if (frame_index == 0) {
+		frame_start = now;
+		deadline = now;
+	}
+
+	const uint64_t target = GetPacingTarget(now);
+	if (frame_index > 0 && target > now) {
+		clock.SleepUntil(target);
+		const uint64_t woke = clock.Now();
+		slept += woke - now;
+		now = woke;
+	}
+
+	const uint64_t delta = frame_index > 0 ? now - frame_start : 0;
+	frame_start = now;
+	if (frame_index > 0) {
+		if (frame_times.size() < history_size) {
+			frame_times.push_back(delta);
+		} else {
+			frame_times[frame_index % history_size] = delta;
+		}
+	}
+
+	FrameTiming timing;
+	timing.frame_index = frame_index++;
+	timing.fixed_step = fixed_step * 1e-9;
+	timing.frame_delta = delta * 1e-9;
+
+	accumulator += delta;
+	uint64_t updates = accumulator / fixed_step;
+	if (updates > settings.max_updates_per_frame) {
+		dropped += (updates - settings.max_updates_per_frame) * fixed_step;
+		updates = settings.max_updates_per_frame;
+	}
+	accumulator -= std::min(accumulator, updates * fixed_step);
+	if (accumulator >= fixed_step) {
+		// Keep only the fraction of a step after dropping time
+		accumulator %= fixed_step;
+	}
+
+	timing.update_count = static_cast<uint32_t>(updates);
+	timing.alpha = static_cast<double>(accumulator) / fixed_step;
+	return timing;
+}
+
+void FrameScheduler::EndFrame()
+{
+	const uint64_t work = clock.Now() - frame_start;
+	if (work_times.size() < work_history_size) {
+		work_times.push_back(work);
+	} else {
+		work_times[frame_index % work_history_size] = work;
+	}
+}
+
+FrameTimeStats FrameScheduler::GetStats() const
+{
+	FrameTimeStats stats = {};
+	stats.frame_count = frame_times.size();
+	stats.slept_ms = slept * 1e-6;
+	stats.dropped_ms = dropped * 1e-6;
+
+	uint64_t work = 0;
+	for (uint64_t time : work_times) {
+		work += time;
+	}
+	stats.work_ms = work_times.empty() ? 0.0 : work * 1e-6 / work_times.size();
+
+	if (frame_times.empty()) {
+		return stats;
+	}
+
+	std::vector<uint64_t> sorted(frame_times);
+	std::sort(sorted.begin(), sorted.end());
+	uint64_t total = 0;
+	for (uint64_t time : sorted) {
+		total += time;
+	}
+	stats.min_ms = sorted.front() * 1e-6;
+	stats.max_ms = sorted.back() * 1e-6;
+	stats.avg_ms = total * 1e-6 / sorted.size();
+	stats.p99_ms = sorted[std::min(sorted.size() - 1, (sorted.size() * 99 + 99) / 100 - 1)] * 1e-6;
+	stats.fps = stats.avg_ms > 0.0 ? 1000.0 / stats.avg_ms : 0.0;
+	return stats;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Time source of the frame loop in nanoseconds. Benchmarks and tests inject a simulated clock.
+class SchedulerClock
+{
+public:
+	virtual ~SchedulerClock() {};
+
+	virtual uint64_t Now() = 0;
+	// Returns once Now() >= time
+	virtual void SleepUntil(uint64_t time) = 0;
+};
+
+// steady_clock; sleeps in the OS until spin_margin before the target and yields for the rest,
+// because OS sleeps overshoot by up to a scheduler tick
+class SteadyClock : public SchedulerClock
+{
+public:
+	static const uint64_t spin_margin = 2000000;
+
+	uint64_t Now() override;
+	void SleepUntil(uint64_t time) override;
+};
+
+enum class FramePacing
+{
+	// Render as fast as possible
+	None,
+	// Start frames at most max_frame_rate times per second
+	Cap,
+	// Like Cap, but start each frame as late as the recent work durations allow, so input is sampled
+	// just before the frame's deadline
+	LowLatency
+};
+
+struct FrameSchedulerSettings
+{
+	// Simulation steps per second
+	double update_rate;
+	// Catch-up limit; time beyond it is dropped instead of simulated (avoids the spiral of death)
+	uint32_t max_updates_per_frame;
+	FramePacing pacing;
+	double max_frame_rate;
+	// Extra head room on top of the predicted work for LowLatency pacing
+	double latency_margin_ms;
+};
+
+FrameSchedulerSettings GetDefaultSchedulerSettings();
+
+struct FrameTiming
+{
+	uint64_t frame_index;
+	// Number of fixed simulation steps to run before rendering this frame
+	uint32_t update_count;
+	// Length of one simulation step in seconds
+	double fixed_step;
+	// Fraction of a step the render time is past the last simulated step, for interpolation
+	double alpha;
+	// Seconds since the previous frame started
+	double frame_delta;
+};
+
+struct FrameTimeStats
+{
+	size_t frame_count;
+	double fps;
+	double min_ms;
+	double avg_ms;
+	double p99_ms;
+	double max_ms;
+	// Average time from BeginFrame to EndFrame
+	double work_ms;
+	// Totals since the scheduler started
+	double slept_ms;
+	double dropped_ms;
+};
+
+// Fixed-timestep simulation decoupled from rendering: BeginFrame paces the loop, then says how many
+// simulation steps to run and how far to interpolate between the last two simulated states.
+class FrameScheduler
+{
+public:
+	static const size_t history_size = 240;
+	static const size_t work_history_size = 8;
+
+	FrameScheduler(SchedulerClock &clock, const FrameSchedulerSettings &settings);
+
+	FrameTiming BeginFrame();
+	void EndFrame();
+
+	FrameTimeStats GetStats() const;
+	const FrameSchedulerSettings &GetSettings() const { return settings; }
+
+private:
+	uint64_t GetPacingTarget(uint64_t now);
+
+	SchedulerClock &clock;
+	FrameSchedulerSettings settings;
+	uint64_t fixed_step;
+	uint64_t frame_period;
+
+	uint64_t frame_index;
+	uint64_t frame_start;
+	uint64_t accumulator;
+	uint64_t deadline;
+
+	std::vector<uint64_t> frame_times;
+	std::vector<uint64_t> work_times;
+	uint64_t slept;
+	uint64_t dropped;
+};
@@ -0,0 +1,199 @@
+#include "frustum_cull.h"
+
+#include <algorithm>
+
+#ifdef FRUSTUM_CULL_SSE
+#include <emmintrin.h>
+#endif
+#ifdef FRUSTUM_CULL_AVX2
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	Plane MakePlane(float a, float b, float c, float d)
+	{
+		const float length = sqrtf(a * a + b * b + c * c);
+		const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+		return {a * scale, b * scale, c * scale, d * scale};
+	}
+
+	// Tests entries [begin, end) one at a time
+	size_t CullRange(const Frustum &frustum, const CullBounds &bounds, size_t begin, size_t end, uint32_t *visible, size_t count)
+	{
+		for (size_t i = begin; i < end; i++) {
+			bool inside = true;
+			for (const Plane &p : frustum.planes) {
+				const float distance = p.a * bounds.center_x[i] + p.b * bounds.center_y[i] + p.c * bounds.center_z[i] + p.d;
+				const float boxReach = fabsf(p.a) * bounds.extent_x[i] + fabsf(p.b) * bounds.extent_y[i] + fabsf(p.c) * bounds.extent_z[i];
+				inside &= distance + std::min(boxReach, bounds.radius[i]) >= 0.0f;
+			}
+			visible[count] = static_cast<uint32_t>(i);
+			count += inside ? 1 : 0;
+		}
+		return count;
+	}
+}
+
+Frustum ExtractFrustum(const Float4x4 &matrix)
+{
+	// Column j of a row-vector matrix produces clip coordinate j
+	const float (&m)[4][4] = matrix.m;
+	Frustum frustum;
+	frustum.planes[0] = MakePlane(m[0][3] + m[0][0], m[1][3] + m[1][0], m[2][3] + m[2][0], m[3][3] + m[3][0]);
+	frustum.planes[1] = MakePlane(m[0][3] - m[0][0], m[1][3] - m[1][0], m[2][3] - m[2][0], m[3][3] - m[3][0]);
+	frustum.planes[2] = MakePlane(m[0][3] + m[0][1], m[1][3] + m[1][1], m[2][3] + m[2][1], m[3][3] + m[3][1]);
+	frustum.planes[3] = MakePlane(m[0][3] - m[0][1], m[1][3] - m[1][1], m[2][3] - m[2][1], m[3][3] - m[3][1]);
+	frustum.planes[4] = MakePlane(m[0][2], m[1][2], m[2][2], m[3][2]);
+	frustum.planes[5] = MakePlane(m[0][3] - m[0][2], m[1][3] - m[1][2], m[2][3] - m[2][2], m[3][3] - m[3][2]);
+	return frustum;
+}
+
+void CullBounds::Clear()
+{
+	center_x.clear();
+	center_y.clear();
+	center_z.clear();
+	extent_x.clear();
+	extent_y.clear();
+	extent_z.clear();
+	radius.clear();
+}
+
+void CullBounds::Reserve(size_t count)
+{
+	center_x.reserve(count);
+	center_y.reserve(count);
+	center_z.reserve(count);
+	extent_x.reserve(count);
+	extent_y.reserve(count);
+	extent_z.reserve(count);
+	radius.reserve(count);
+}
+
+uint32_t CullBounds::Add(const float bounds_min[3], const float bounds_max[3])
+{
+	const float ex = 0.5f * (bounds_max[0] - bounds_min[0]);
+	const float ey = 0.5f * (bounds_max[1] - bounds_min[1]);
+	const float ez = 0.5f * (bounds_max[2] - bounds_min[2]);
+	center_x.push_back(0.5f * (bounds_min[0] + bounds_max[0]));
+	center_y.push_back(0.5f * (bounds_min[1] + bounds_max[1]));
+	center_z.push_back(0.5f * (bounds_min[2] + bounds_max[2]));
+	extent_x.push_back(ex);
+	extent_y.push_back(ey);
+	extent_z.push_back(ez);
+	radius.push_back(sqrtf(ex * ex + ey * ey + ez * ez));
+	return static_cast<uint32_t>(radius.size() - 1);
+}
+
+size_t CullScalar(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible)
+{
+	return CullRange(frustum, bounds, 0, bounds.GetCount(), visible, 0);
+}
+
+#ifdef FRUSTUM_CULL_SSE
+size_t CullSSE(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible)
+{
+	const size_t total = bounds.GetCount();
+	const size_t blockEnd = total & ~static_cast<size_t>(3);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+	size_t count = 0;
+
+	for (size_t i = 0; i < blockEnd; i += 4) {
+		const __m128 cx = _mm_loadu_ps(&bounds.center_x[i]);
+		const __m128 cy = _mm_loadu_ps(&bounds.center_y[i]);
+		const __m128 cz = _mm_loadu_ps(&bounds.center_z[i]);
+		const __m128 ex = _mm_loadu_ps(&bounds.extent_x[i]);
+		const __m128 ey = _mm_loadu_ps(&bounds.extent_y[i]);
+		const __m128 ez = _mm_loadu_ps(&bounds.extent_z[i]);
+		const __m128 r = _mm_loadu_ps(&bounds.radius[i]);
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for (const Plane &p : frustum.planes) {
+			const __m128 a = _mm_set1_ps(p.a);
+			const __m128 b = _mm_set1_ps(p.b);
+			const __m128 c = _mm_set1_ps(p.c);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, cx), _mm_mul_ps(b, cy)), _mm_add_ps(_mm_mul_ps(c, cz), _mm_set1_ps(p.d)));
+			__m128 boxReach = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_andnot_ps(signMask, a), ex),
+				_mm_mul_ps(_mm_andnot_ps(signMask, b), ey)),
+				_mm_mul_ps(_mm_andnot_ps(signMask, c), ez));
+			distance = _mm_add_ps(distance, _mm_min_ps(boxReach, r));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+
+		// Branchless compaction: always store, advance only for visible lanes
+		const int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++) {
+			visible[count] = static_cast<uint32_t>(i + lane);
+			count += (mask >> lane) & 1;
+		}
+	}
+
+	return CullRange(frustum, bounds, blockEnd, total, visible, count);
+}
+#endif
+
+#ifdef FRUSTUM_CULL_AVX2
+size_t CullAVX2(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible)
+{
+	const size_t total = bounds.GetCount();
+	const size_t blockEnd = total & ~static_cast<size_t>(7);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+	size_t count = 0;
+
+	for (size_t i = 0; i < blockEnd; i += 8) {
+		const __m256 cx = _mm256_loadu_ps(&bounds.center_x[i]);
+		const __m256 cy = _mm256_loadu_ps(&bounds.center_y[i]);
+		const __m256 cz = _mm256_loadu_ps(&bounds.center_z[i]);
+		const __m256 ex = _mm256_loadu_ps(&bounds.extent_x[i]);
+		const __m256 ey = _mm256_loadu_ps(&bounds.extent_y[i]);
+		const __m256 ez = _mm256_loadu_ps(&bounds.extent_z[i]);
+		const __m256 r = _mm256_loadu_ps(&bounds.radius[i]);
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for (const Plane &p : frustum.planes) {
+			const __m256 a = _mm256_set1_ps(p.a);
+			const __m256 b = _mm256_set1_ps(p.b);
+			const __m256 c = _mm256_set1_ps(p.c);
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, cx), _mm256_mul_ps(b, cy)), _mm256_add_ps(_mm256_mul_ps(c, cz), _mm256_set1_ps(p.d)));
+			__m256 boxReach = _mm256_add_ps(_mm256_add_ps(
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, a), ex),
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, b), ey)),
+				_mm256_mul_ps(_mm256_andnot_ps(signMask, c), ez));
+			distance = _mm256_add_ps(distance, _mm256_min_ps(boxReach, r));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		const int mask = _mm256_movemask_ps(inside);
+		for (int lane = 0; lane < 8; lane++) {
+			visible[count] = static_cast<uint32_t>(i + lane);
+			count += (mask >> lane) & 1;
+		}
+	}
+
+	return CullRange(frustum, bounds, blockEnd, total, visible, count);
+}
+#endif
+
+size_t CullFrustum(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible)
+{
+#if defined(FRUSTUM_CULL_AVX2)
+	return CullAVX2(frustum, bounds, visible);
+#elif defined(FRUSTUM_CULL_SSE)
+	return CullSSE(frustum, bounds, visible);
+#else
+	return CullScalar(frustum, bounds, visible);
+#endif
+}
+
+const char *GetCullKernelName()
+{
+#if defined(FRUSTUM_CULL_AVX2)
+	return "AVX2";
+#elif defined(FRUSTUM_CULL_SSE)
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
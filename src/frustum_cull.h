@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_math.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define FRUSTUM_CULL_SSE 1
+#endif
+#if defined(__AVX2__)
+#define FRUSTUM_CULL_AVX2 1
+#endif
+
+// Plane a*x + b*y + c*z + d = 0 with a unit normal pointing into the frustum
+struct Plane
+{
+	float a, b, c, d;
+};
+
+// Left, right, bottom, top, near, far
+struct Frustum
+{
+	Plane planes[6];
+};
+
+// Planes of a D3D clip space (0 <= z <= w) matrix in the row-vector convention. For world * view * projection
+// the planes are in object space, so object-space bounds are tested without transforming them.
+Frustum ExtractFrustum(const Float4x4 &matrix);
+
+// Bounding boxes and spheres in structure-of-arrays layout, one entry per drawable.
+// The sphere shares the box center, so each entry keeps only the sphere radius.
+struct CullBounds
+{
+	std::vector<float> center_x, center_y, center_z;
+	std::vector<float> extent_x, extent_y, extent_z;
+	std::vector<float> radius;
+
+	size_t GetCount() const { return radius.size(); }
+	void Clear();
+	void Reserve(size_t count);
+	// Returns the index of the new entry
+	uint32_t Add(const float bounds_min[3], const float bounds_max[3]);
+};
+
+// Each kernel writes the indices of the entries that intersect the frustum into visible, which must hold
+// bounds.GetCount() entries, and returns how many it wrote. An entry is culled when either its box or its
+// sphere is fully behind one plane, whichever reaches less far towards that plane.
+size_t CullScalar(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible);
+#ifdef FRUSTUM_CULL_SSE
+size_t CullSSE(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible);
+#endif
+#ifdef FRUSTUM_CULL_AVX2
+size_t CullAVX2(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible);
+#endif
+
+// Widest kernel the build targets
+size_t CullFrustum(const Frustum &frustum, const CullBounds &bounds, uint32_t *visible);
+const char *GetCullKernelName();
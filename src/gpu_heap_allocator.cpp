@@ -0,0 +1,499 @@
+#include "gpu_heap_allocator.h"
+
+#include <algorithm>
+#include <new>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	uint32_t FindLowestBit(uint64_t bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return index;
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+	}
+
+	uint32_t FindHighestBit(uint64_t bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, bits);
+		return index;
+#else
+		return 63 - static_cast<uint32_t>(__builtin_clzll(bits));
+#endif
+	}
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	uint64_t RoundUpToPowerOfTwo(uint64_t value)
+	{
+		return value <= 1 ? 1 : uint64_t(1) << (FindHighestBit(value - 1) + 1);
+	}
+}
+
+double GpuHeapAllocatorStats::GetFragmentation() const
+{
+	const uint64_t freeBytes = capacity - used;
+	return freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(largest_free) / static_cast<double>(freeBytes);
+}
+
+GpuHeapAllocator::GpuHeapAllocator(GpuHeapSource &source, uint64_t heap_size, uint64_t heap_alignment) :
+	source(source), live_heaps(0), first_level_bitmap(0), stats()
+{
+	this->heap_alignment = std::max(RoundUpToPowerOfTwo(heap_alignment), small_placement_alignment);
+	this->heap_size = AlignUp(std::max<uint64_t>(heap_size, 1), this->heap_alignment);
+	std::fill(std::begin(second_level_bitmap), std::end(second_level_bitmap), 0u);
+	for (auto &lists : free_lists) {
+		std::fill(std::begin(lists), std::end(lists), none);
+	}
+}
+
+GpuHeapAllocator::~GpuHeapAllocator()
+{
+	for (Heap &heap : heaps) {
+		if (heap.memory.heap != nullptr) {
+			source.DestroyHeap(heap.memory);
+		}
+	}
+}
+
+void GpuHeapAllocator::GetListIndex(uint64_t size, uint32_t &first, uint32_t &second)
+{
+	// Sizes are whole small pages; below 16 pages each size has its own list
+	const uint64_t pages = size / small_placement_alignment;
+	const uint32_t log = FindHighestBit(pages);
+	if (log < second_level_log) {
+		first = 0;
+		second = static_cast<uint32_t>(pages);
+	} else {
+		first = log - second_level_log + 1;
+		second = static_cast<uint32_t>(pages >> (log - second_level_log)) - second_level_count;
+	}
+}
+
+uint32_t GpuHeapAllocator::NewBlock()
+{
+	if (!unused_blocks.empty()) {
+		const uint32_t block = unused_blocks.back();
+		unused_blocks.pop_back();
+		return block;
+	}
+	blocks.push_back(Block());
+	return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+void GpuHeapAllocator::PushFree(uint32_t block)
+{
+	Block &b = blocks[block];
+	uint32_t first, second;
+	GetListIndex(b.size, first, second);
+	b.free = true;
+	b.user = nullptr;
+	b.prev_free = none;
+	b.next_free = free_lists[first][second];
+	if (b.next_free != none) {
+		blocks[b.next_free].prev_free = block;
+	}
+	free_lists[first][second] = block;
+	first_level_bitmap |= uint64_t(1) << first;
+	second_level_bitmap[first] |= 1u << second;
+	stats.free_block_count++;
+}
+
+void GpuHeapAllocator::RemoveFree(uint32_t block)
+{
+	Block &b = blocks[block];
+	uint32_t first, second;
+	GetListIndex(b.size, first, second);
+	if (b.prev_free != none) {
+		blocks[b.prev_free].next_free = b.next_free;
+	} else {
+		free_lists[first][second] = b.next_free;
+		if (b.next_free == none) {
+			second_level_bitmap[first] &= ~(1u << second);
+			if (second_level_bitmap[first] == 0) {
+				first_level_bitmap &= ~(uint64_t(1) << first);
+			}
+		}
+	}
+	if (b.next_free != none) {
+		blocks[b.next_free].prev_free = b.prev_free;
+	}
+	b.free = false;
+	b.prev_free = b.next_free = none;
+	stats.free_block_count--;
+}
+
+bool GpuHeapAllocator::Fits(const Block &block, uint64_t size, uint64_t alignment) const
+{
+	const uint64_t aligned = AlignUp(block.offset, alignment);
+	return !heaps[block.heap].draining && aligned + size <= block.offset + block.size;
+}
+
+uint32_t GpuHeapAllocator::FindFree(uint64_t size, uint64_t alignment) const
+{
+	// Look from the first list whose blocks are all large enough, so the head of the first non-empty list fits.
+	// Padding for an alignment above the small page is added to the size first.
+	uint64_t search = size + alignment - small_placement_alignment;
+	uint32_t first, second;
+	GetListIndex(search, first, second);
+	if (first > 0) {
+		search += (uint64_t(1) << (FindHighestBit(search / small_placement_alignment) - second_level_log)) * small_placement_alignment - 1;
+		search &= ~(small_placement_alignment - 1);
+		GetListIndex(search, first, second);
+	}
+	if (first >= first_level_count) {
+		return none;
+	}
+
+	uint32_t secondMap = second_level_bitmap[first] & (~0u << second);
+	for (;;) {
+		if (secondMap == 0) {
+			const uint64_t firstMap = first + 1 < first_level_count ? first_level_bitmap & (~uint64_t(0) << (first + 1)) : 0;
+			if (firstMap == 0) {
+				return none;
+			}
+			first = FindLowestBit(firstMap);
+			secondMap = second_level_bitmap[first];
+		}
+		second = FindLowestBit(secondMap);
+		secondMap &= secondMap - 1;
+		// Only blocks of draining heaps can fail to fit
+		for (uint32_t block = free_lists[first][second]; block != none; block = blocks[block].next_free) {
+			if (Fits(blocks[block], size, alignment)) {
+				return block;
+			}
+		}
+	}
+}
+
+uint32_t GpuHeapAllocator::AddHeap(uint64_t min_size)
+{
+	const uint64_t size = std::max(heap_size, AlignUp(min_size, heap_alignment));
+	GpuHeap memory = {};
+	if (!source.CreateHeap(size, heap_alignment, memory)) {
+		throw std::bad_alloc();
+	}
+
+	uint32_t heap = 0;
+	while (heap < heaps.size() && heaps[heap].memory.heap != nullptr) {
+		heap++;
+	}
+	if (heap == heaps.size()) {
+		heaps.push_back(Heap());
+	}
+	const uint32_t block = NewBlock();
+	blocks[block] = {0, size, 0, 0, heap, none, none, none, none, false, nullptr};
+	heaps[heap] = {memory, block, 0, 0, false};
+	PushFree(block);
+	live_heaps++;
+	stats.heap_count++;
+	stats.capacity += size;
+	stats.heaps_created++;
+	return block;
+}
+
+void GpuHeapAllocator::DestroyHeap(uint32_t heap)
+{
+	Heap &h = heaps[heap];
+	RemoveFree(h.first_block);
+	unused_blocks.push_back(h.first_block);
+	stats.heap_count--;
+	stats.capacity -= h.memory.size;
+	stats.heaps_destroyed++;
+	source.DestroyHeap(h.memory);
+	h = {};
+	h.first_block = none;
+	live_heaps--;
+}
+
+uint32_t GpuHeapAllocator::Place(uint32_t block, uint64_t size, uint64_t requested, uint64_t alignment, void *user)
+{
+	RemoveFree(block);
+	// Padding before the aligned offset and the tail after the allocation stay free
+	const uint64_t padding = AlignUp(blocks[block].offset, alignment) - blocks[block].offset;
+	if (padding > 0) {
+		const uint32_t head = NewBlock();
+		Block &b = blocks[block];
+		blocks[head] = {b.offset, padding, 0, 0, b.heap, b.prev_physical, block, none, none, false, nullptr};
+		if (b.prev_physical != none) {
+			blocks[b.prev_physical].next_physical = head;
+		} else {
+			heaps[b.heap].first_block = head;
+		}
+		b.prev_physical = head;
+		b.offset += padding;
+		b.size -= padding;
+		PushFree(head);
+	}
+	if (blocks[block].size > size) {
+		const uint32_t tail = NewBlock();
+		Block &b = blocks[block];
+		blocks[tail] = {b.offset + size, b.size - size, 0, 0, b.heap, block, b.next_physical, none, none, false, nullptr};
+		if (b.next_physical != none) {
+			blocks[b.next_physical].prev_physical = tail;
+		}
+		b.next_physical = tail;
+		b.size = size;
+		PushFree(tail);
+	}
+
+	Block &b = blocks[block];
+	b.requested = requested;
+	b.alignment = alignment;
+	b.user = user;
+	heaps[b.heap].used += size;
+	stats.requested += requested;
+	heaps[b.heap].allocation_count++;
+	stats.used += size;
+	stats.allocation_count++;
+	stats.allocations++;
+	return block;
+}
+
+GpuAllocation GpuHeapAllocator::Allocate(uint64_t size, uint64_t alignment, void *user)
+{
+	alignment = std::max(alignment, small_placement_alignment);
+	if (size == 0 || (alignment & (alignment - 1)) != 0 || alignment > heap_alignment) {
+		throw std::bad_alloc();
+	}
+	const uint64_t rounded = AlignUp(size, small_placement_alignment);
+
+	uint32_t block = FindFree(rounded, alignment);
+	if (block == none) {
+		block = AddHeap(rounded);
+	}
+	block = Place(block, rounded, size, alignment, user);
+	const Block &b = blocks[block];
+	return {b.heap, block, b.offset, size};
+}
+
+void GpuHeapAllocator::Free(const GpuAllocation &allocation)
+{
+	uint32_t block = allocation.block;
+	Heap &heap = heaps[blocks[block].heap];
+	heap.used -= blocks[block].size;
+	heap.allocation_count--;
+	stats.used -= blocks[block].size;
+	stats.requested -= blocks[block].requested;
+	stats.allocation_count--;
+	stats.frees++;
+
+	// Merge with free neighbours, keeping the lower block
+	const uint32_t next = blocks[block].next_physical;
+	if (next != none && blocks[next].free) {
+		RemoveFree(next);
+		blocks[block].size += blocks[next].size;
+		blocks[block].next_physical = blocks[next].next_physical;
+		if (blocks[next].next_physical != none) {
+			blocks[blocks[next].next_physical].prev_physical = block;
+		}
+		unused_blocks.push_back(next);
+	}
+	const uint32_t prev = blocks[block].prev_physical;
+	if (prev != none && blocks[prev].free) {
+		RemoveFree(prev);
+		blocks[prev].size += blocks[block].size;
+		blocks[prev].next_physical = blocks[block].next_physical;
+		if (blocks[block].next_physical != none) {
+			blocks[blocks[block].next_physical].prev_physical = prev;
+		}
+		unused_blocks.push_back(block);
+		block = prev;
+	}
+	PushFree(block);
+
+	if (heap.allocation_count == 0 && live_heaps > 1) {
+		DestroyHeap(blocks[block].heap);
+	}
+}
+
+size_t GpuHeapAllocator::Defragment(uint64_t max_bytes, std::vector<GpuAllocationMove> &moves)
+{
+	// Heaps are emptied sparsest first, while the others have room for what they hold and the budget lasts. All of
+	// them are marked before anything moves, so nothing moves into a heap that is emptied later.
+	std::vector<uint32_t> order;
+	uint64_t room = 0;
+	for (uint32_t heap = 0; heap < heaps.size(); heap++) {
+		heaps[heap].draining = false;
+		if (heaps[heap].memory.heap != nullptr) {
+			order.push_back(heap);
+			room += heaps[heap].memory.size - heaps[heap].used;
+		}
+	}
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return heaps[a].used < heaps[b].used; });
+
+	size_t drained = 0;
+	uint64_t planned = 0;
+	for (; drained < order.size(); drained++) {
+		Heap &h = heaps[order[drained]];
+		room -= h.memory.size - h.used;
+		if (h.allocation_count == 0 || planned + h.used > room || planned >= max_bytes) {
+			break;
+		}
+		h.draining = true;
+		planned += h.used;
+	}
+
+	const size_t first = moves.size();
+	uint64_t moved = 0;
+	std::vector<uint32_t> movable;
+	for (size_t i = 0; i < drained && moved < max_bytes; i++) {
+		Heap &h = heaps[order[i]];
+		// Largest first, while the other heaps still have large holes
+		movable.clear();
+		for (uint32_t block = h.first_block; block != none; block = blocks[block].next_physical) {
+			if (!blocks[block].free) {
+				movable.push_back(block);
+			}
+		}
+		std::sort(movable.begin(), movable.end(), [this](uint32_t a, uint32_t b) { return blocks[a].size > blocks[b].size; });
+
+		for (uint32_t block : movable) {
+			if (moved >= max_bytes) {
+				break;
+			}
+			const uint64_t size = blocks[block].size;
+			const uint32_t target = FindFree(size, blocks[block].alignment);
+			if (target == none) {
+				// The heap cannot be emptied; what already moved out leaves holes in it
+				h.draining = false;
+				break;
+			}
+			const uint32_t placed = Place(target, size, blocks[block].requested, blocks[block].alignment, blocks[block].user);
+			const Block &b = blocks[block];
+			const Block &p = blocks[placed];
+			moves.push_back({b.user, {b.heap, block, b.offset, b.requested}, {p.heap, placed, p.offset, p.requested}});
+			stats.moves++;
+			stats.moved_bytes += size;
+			moved += size;
+		}
+	}
+
+	// Heaps the pass did not get to stay available
+	for (size_t i = 0; i < drained; i++) {
+		Heap &h = heaps[order[i]];
+		bool movedFrom = false;
+		for (size_t m = first; m < moves.size() && !movedFrom; m++) {
+			movedFrom = moves[m].source.heap == order[i];
+		}
+		h.draining &= movedFrom;
+	}
+	return moves.size() - first;
+}
+
+GpuHeapStats GpuHeapAllocator::GetHeapStats(uint32_t heap) const
+{
+	const Heap &h = heaps[heap];
+	GpuHeapStats heapStats = {h.memory.size, h.used, h.allocation_count, 0, 0};
+	for (uint32_t block = h.first_block; block != none; block = blocks[block].next_physical) {
+		if (blocks[block].free) {
+			heapStats.free_block_count++;
+			heapStats.largest_free = std::max(heapStats.largest_free, blocks[block].size);
+		}
+	}
+	return heapStats;
+}
+
+GpuHeapAllocatorStats GpuHeapAllocator::GetStats() const
+{
+	GpuHeapAllocatorStats result = stats;
+	result.largest_free = 0;
+	if (first_level_bitmap != 0) {
+		// Sizes within a list differ, so the largest is found by walking the highest one
+		const uint32_t first = FindHighestBit(first_level_bitmap);
+		const uint32_t second = FindHighestBit(second_level_bitmap[first]);
+		for (uint32_t block = free_lists[first][second]; block != none; block = blocks[block].next_free) {
+			result.largest_free = std::max(result.largest_free, blocks[block].size);
+		}
+	}
+	return result;
+}
+
+bool GpuHeapAllocator::Validate(std::string &err) const
+{
+	uint64_t used = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeCount = 0;
+	uint32_t liveHeaps = 0;
+	for (uint32_t heap = 0; heap < heaps.size(); heap++) {
+		const Heap &h = heaps[heap];
+		if (h.memory.heap == nullptr) {
+			continue;
+		}
+		liveHeaps++;
+		uint64_t offset = 0;
+		uint64_t heapUsed = 0;
+		uint32_t heapAllocations = 0;
+		uint32_t prev = none;
+		for (uint32_t block = h.first_block; block != none; block = blocks[block].next_physical) {
+			const Block &b = blocks[block];
+			if (b.heap != heap || b.offset != offset || b.prev_physical != prev || b.size == 0 ||
+				b.size % small_placement_alignment != 0) {
+				err = "Broken address order in heap " + std::to_string(heap);
+				return false;
+			}
+			if (b.free && prev != none && blocks[prev].free) {
+				err = "Unmerged free neighbours in heap " + std::to_string(heap);
+				return false;
+			}
+			if (b.free) {
+				freeCount++;
+			} else {
+				heapUsed += b.size;
+				heapAllocations++;
+			}
+			offset += b.size;
+			prev = block;
+		}
+		if (offset != h.memory.size || heapUsed != h.used || heapAllocations != h.allocation_count) {
+			err = "Heap " + std::to_string(heap) + " does not add up";
+			return false;
+		}
+		used += heapUsed;
+		allocationCount += heapAllocations;
+	}
+
+	uint32_t listed = 0;
+	for (uint32_t first = 0; first < first_level_count; first++) {
+		if (((first_level_bitmap >> first) & 1) != (second_level_bitmap[first] != 0 ? 1u : 0u)) {
+			err = "First level bitmap disagrees at " + std::to_string(first);
+			return false;
+		}
+		for (uint32_t second = 0; second < second_level_count; second++) {
+			if (((second_level_bitmap[first] >> second) & 1) != (free_lists[first][second] != none ? 1u : 0u)) {
+				err = "Second level bitmap disagrees at " + std::to_string(first) + ", " + std::to_string(second);
+				return false;
+			}
+			uint32_t prev = none;
+			for (uint32_t block = free_lists[first][second]; block != none; block = blocks[block].next_free) {
+				uint32_t f, s;
+				GetListIndex(blocks[block].size, f, s);
+				if (!blocks[block].free || blocks[block].prev_free != prev || f != first || s != second) {
+					err = "Free list " + std::to_string(first) + ", " + std::to_string(second) + " is broken";
+					return false;
+				}
+				listed++;
+				prev = block;
+			}
+		}
+	}
+
+	if (listed != freeCount || freeCount != stats.free_block_count || used != stats.used ||
+		allocationCount != stats.allocation_count || liveHeaps != live_heaps || liveHeaps != stats.heap_count) {
+		err = "Statistics disagree with the blocks";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Placement alignments of D3D12: small textures, buffers and other resources, MSAA textures
+static const uint64_t small_placement_alignment = 4 * 1024;
+static const uint64_t default_placement_alignment = 64 * 1024;
+static const uint64_t msaa_placement_alignment = 4 * 1024 * 1024;
+
+// Block of device memory that resources are placed in, one ID3D12Heap in D3D12
+struct GpuHeap
+{
+	uint64_t size;
+	// Backend object (ID3D12Heap * for D3D12)
+	void *heap;
+};
+
+class GpuHeapSource
+{
+public:
+	virtual ~GpuHeapSource() {};
+
+	// alignment is the largest placement alignment the heap has to support
+	virtual bool CreateHeap(uint64_t size, uint64_t alignment, GpuHeap &heap) = 0;
+	virtual void DestroyHeap(GpuHeap &heap) = 0;
+};
+
+struct GpuAllocation
+{
+	uint32_t heap;
+	// Internal block, valid until the allocation is freed
+	uint32_t block;
+	uint64_t offset;
+	// As asked for; the block is rounded up to small_placement_alignment
+	uint64_t size;
+};
+
+// A live allocation that Defragment() placed elsewhere. The owner copies its data from source to destination,
+// switches to destination, and frees source once the GPU no longer reads it.
+struct GpuAllocationMove
+{
+	void *user;
+	GpuAllocation source;
+	GpuAllocation destination;
+};
+
+struct GpuHeapStats
+{
+	uint64_t size;
+	uint64_t used;
+	uint32_t allocation_count;
+	uint32_t free_block_count;
+	uint64_t largest_free;
+};
+
+struct GpuHeapAllocatorStats
+{
+	uint32_t heap_count;
+	uint64_t capacity;
+	// Bytes asked for, and what they occupy after rounding up to small_placement_alignment
+	uint64_t requested;
+	uint64_t used;
+	uint32_t allocation_count;
+	uint32_t free_block_count;
+	// Largest free block, bounding the biggest allocation that fits without a new heap
+	uint64_t largest_free;
+	uint64_t allocations;
+	uint64_t frees;
+	uint64_t heaps_created;
+	uint64_t heaps_destroyed;
+	uint64_t moves;
+	uint64_t moved_bytes;
+
+	// 0 when all free memory forms one block, towards 1 when it is scattered in small ones
+	double GetFragmentation() const;
+};
+
+// Places resources in heaps of heap_size bytes with a two-level segregated fit (TLSF) allocator: free blocks sit
+// in lists indexed by the power of two of their size and 16 steps within it, found through two bitmaps, so
+// Allocate and Free take constant time. Blocks of a heap are linked by address and a freed block merges with free
+// neighbours. Offsets honour the requested alignment, which may go up to heap_alignment; allocations larger than
+// heap_size get a heap of their own. A heap that becomes empty is destroyed unless it is the last one. Allocate
+// throws std::bad_alloc when the source fails or the alignment exceeds heap_alignment.
+class GpuHeapAllocator
+{
+public:
+	// heap_size is rounded up to heap_alignment
+	GpuHeapAllocator(GpuHeapSource &source, uint64_t heap_size, uint64_t heap_alignment = msaa_placement_alignment);
+	~GpuHeapAllocator();
+
+	GpuHeapAllocator(const GpuHeapAllocator &) = delete;
+	GpuHeapAllocator &operator=(const GpuHeapAllocator &) = delete;
+
+	// user is handed back by Defragment(), e.g. the resource to recreate
+	GpuAllocation Allocate(uint64_t size, uint64_t alignment = default_placement_alignment, void *user = nullptr);
+	void Free(const GpuAllocation &allocation);
+
+	// Empties the least used heaps into free space of the others, moving up to max_bytes: each move allocates the
+	// destination and keeps the source allocated until the owner frees it, after which the heap is destroyed.
+	// Allocations made before those frees avoid the heaps being emptied. Returns how many moves it appended.
+	size_t Defragment(uint64_t max_bytes, std::vector<GpuAllocationMove> &moves);
+
+	uint32_t GetHeapCount() const { return static_cast<uint32_t>(heaps.size()); }
+	// Null memory.heap for slots of destroyed heaps
+	const GpuHeap &GetHeap(uint32_t heap) const { return heaps[heap].memory; }
+	GpuHeapStats GetHeapStats(uint32_t heap) const;
+	GpuHeapAllocatorStats GetStats() const;
+
+	// Checks every invariant of the block lists, for fuzzing; false and a description when one is broken
+	bool Validate(std::string &err) const;
+
+private:
+	static constexpr uint32_t none = UINT32_MAX;
+	static const uint32_t second_level_log = 4;
+	static const uint32_t second_level_count = 1 << second_level_log;
+	static const uint32_t first_level_count = 64;
+
+	struct Block
+	{
+		uint64_t offset;
+		uint64_t size;
+		// Of allocated blocks: the size asked for and the alignment, kept for moves
+		uint64_t requested;
+		uint64_t alignment;
+		uint32_t heap;
+		uint32_t prev_physical;
+		uint32_t next_physical;
+		// Free list links, or none while allocated
+		uint32_t prev_free;
+		uint32_t next_free;
+		bool free;
+		void *user;
+	};
+
+	struct Heap
+	{
+		GpuHeap memory;
+		uint32_t first_block;
+		uint64_t used;
+		uint32_t allocation_count;
+		// Defragment() is emptying it; nothing new is placed in it
+		bool draining;
+	};
+
+	static void GetListIndex(uint64_t size, uint32_t &first, uint32_t &second);
+	uint32_t NewBlock();
+	void PushFree(uint32_t block);
+	void RemoveFree(uint32_t block);
+	// Free block that fits size at alignment, or none
+	uint32_t FindFree(uint64_t size, uint64_t alignment) const;
+	bool Fits(const Block &block, uint64_t size, uint64_t alignment) const;
+	uint32_t AddHeap(uint64_t min_size);
+	void DestroyHeap(uint32_t heap);
+	// Carves size bytes at alignment out of a free block; returns the allocated block
+	uint32_t Place(uint32_t block, uint64_t size, uint64_t requested, uint64_t alignment, void *user);
+
+	GpuHeapSource &source;
+	uint64_t heap_size;
+	uint64_t heap_alignment;
+	std::vector<Heap> heaps;
+	uint32_t live_heaps;
+	std::vector<Block> blocks;
+	std::vector<uint32_t> unused_blocks;
+	uint64_t first_level_bitmap;
+	uint32_t second_level_bitmap[first_level_count];
+	uint32_t free_lists[first_level_count][second_level_count];
+	GpuHeapAllocatorStats stats;
+};
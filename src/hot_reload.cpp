@@ -0,0 +1,227 @@
+#include "hot_reload.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+bool DiskFileSystem::GetStamp(const std::string &path, FileStamp &stamp)
+{
+	std::error_code error;
+	const uint64_t size = std::filesystem::file_size(path, error);
+	if (error) {
+		return false;
+	}
+	const auto modified = std::filesystem::last_write_time(path, error);
+	if (error) {
+		return false;
+	}
+
+	stamp.size = size;
+	stamp.modified = static_cast<int64_t>(modified.time_since_epoch().count());
+	return true;
+}
+
+bool DiskFileSystem::ReadFile(const std::string &path, std::string &content)
+{
+	std::ifstream input(path, std::ios::binary);
+	if (!input) {
+		return false;
+	}
+	content.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	return !input.bad();
+}
+
+bool FileWatcher::ReadStamp(const std::string &path, FileStamp &stamp)
+{
+	stamp = {};
+	return file_system.GetStamp(path, stamp);
+}
+
+uint32_t FileWatcher::Watch(const std::string &path)
+{
+	WatchedFile file = {};
+	file.path = path;
+	file.exists = ReadStamp(path, file.stamp);
+	files.push_back(file);
+	return static_cast<uint32_t>(files.size() - 1);
+}
+
+void FileWatcher::Poll(uint64_t now, std::vector<uint32_t> &changed)
+{
+	for (uint32_t id = 0; id < files.size(); id++) {
+		WatchedFile &file = files[id];
+		FileStamp stamp;
+		const bool exists = ReadStamp(file.path, stamp);
+		const bool same = exists == file.exists && (!exists || (stamp.size == file.stamp.size && stamp.modified == file.stamp.modified));
+
+		if (!file.pending) {
+			if (!same) {
+				file.pending = true;
+				file.pending_exists = exists;
+				file.pending_stamp = stamp;
+				file.pending_since = now;
+			}
+			continue;
+		}
+
+		const bool settled = exists == file.pending_exists &&
+			(!exists || (stamp.size == file.pending_stamp.size && stamp.modified == file.pending_stamp.modified));
+		if (!settled) {
+			// Still being written
+			file.pending_exists = exists;
+			file.pending_stamp = stamp;
+			file.pending_since = now;
+			continue;
+		}
+		if (now - file.pending_since < settle_time) {
+			continue;
+		}
+
+		file.pending = false;
+		file.exists = exists;
+		file.stamp = stamp;
+		// A deleted file is not a reload; it is picked up again when it comes back
+		if (exists && !same) {
+			changed.push_back(id);
+		}
+	}
+}
+
+void RetireQueue::Retire(uint64_t fence_value, std::function<void()> release)
+{
+	pending.push_back({fence_value, std::move(release)});
+}
+
+size_t RetireQueue::Collect(uint64_t completed_value)
+{
+	size_t count = 0;
+	while (!pending.empty() && pending.front().fence <= completed_value) {
+		if (pending.front().release) {
+			pending.front().release();
+		}
+		pending.pop_front();
+		count++;
+	}
+	return count;
+}
+
+void RetireQueue::ReleaseAll()
+{
+	Collect(UINT64_MAX);
+}
+
+HotReloader::HotReloader(FileSystem &file_system, SchedulerClock &clock, uint64_t settle_time) :
+	clock(clock), watcher(file_system, settle_time), stopping(false), stats()
+{
+}
+
+HotReloader::~HotReloader()
+{
+	Stop();
+}
+
+void HotReloader::AddReload(const std::string &name, const std::vector<std::string> &sources, BuildFunction build)
+{
+	reloads.push_back({name, std::move(build)});
+	for (const std::string &source : sources) {
+		watcher.Watch(source);
+		file_reloads.push_back(reloads.size() - 1);
+	}
+}
+
+void HotReloader::Start(uint64_t poll_interval)
+{
+	Stop();
+	stopping = false;
+	worker = std::thread(&HotReloader::WorkerMain, this, poll_interval);
+}
+
+void HotReloader::Stop()
+{
+	if (!worker.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void HotReloader::WorkerMain(uint64_t poll_interval)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping) {
+		lock.unlock();
+		PollOnce();
+		lock.lock();
+		wake.wait_for(lock, std::chrono::nanoseconds(poll_interval), [this]() { return stopping; });
+	}
+}
+
+void HotReloader::PollOnce()
+{
+	std::vector<uint32_t> changed;
+	watcher.Poll(clock.Now(), changed);
+
+	// Several sources of one asset changing together rebuild it once
+	std::vector<size_t> triggered;
+	for (uint32_t id : changed) {
+		if (std::find(triggered.begin(), triggered.end(), file_reloads[id]) == triggered.end()) {
+			triggered.push_back(file_reloads[id]);
+		}
+	}
+
+	for (size_t index : triggered) {
+		ApplyFunction apply;
+		std::string err;
+		const bool built = reloads[index].build(apply, err);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.builds++;
+		if (!built) {
+			// The old objects stay in use; the next change of the source retries
+			stats.failures++;
+			stats.last_error = reloads[index].name + ": " + err;
+			continue;
+		}
+
+		// A newer build of the same asset supersedes one that was never applied
+		auto previous = std::find_if(finished.begin(), finished.end(), [&](const Finished &item) { return item.reload == index; });
+		if (previous != finished.end()) {
+			previous->apply = std::move(apply);
+		} else {
+			finished.push_back({index, std::move(apply)});
+		}
+	}
+}
+
+size_t HotReloader::ApplyFinished()
+{
+	std::vector<Finished> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (finished.empty()) {
+			return 0;
+		}
+		ready.swap(finished);
+	}
+
+	for (Finished &item : ready) {
+		if (item.apply) {
+			item.apply();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.applied += ready.size();
+	return ready.size();
+}
+
+HotReloadStats HotReloader::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
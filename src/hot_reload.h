@@ -0,0 +1,153 @@
+#pragma once
+
+#include "frame_scheduler.h"
+#include "mapped_file.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Files the reloader watches and reads; implementations must be thread-safe
+class FileSystem
+{
+public:
+	virtual ~FileSystem() {};
+
+	virtual bool GetStamp(const std::string &path, FileStamp &stamp) = 0;
+	virtual bool ReadFile(const std::string &path, std::string &content) = 0;
+};
+
+// Stamps use the full file time resolution, unlike GetFileStamp's seconds
+class DiskFileSystem : public FileSystem
+{
+public:
+	bool GetStamp(const std::string &path, FileStamp &stamp) override;
+	bool ReadFile(const std::string &path, std::string &content) override;
+};
+
+// Polls file stamps. A change is reported once the stamp has stayed the same for settle_time, so an editor
+// that writes a file in several steps triggers one reload of the complete file.
+class FileWatcher
+{
+public:
+	FileWatcher(FileSystem &file_system, uint64_t settle_time) : file_system(file_system), settle_time(settle_time) {};
+
+	uint32_t Watch(const std::string &path);
+	// Appends the ids of files whose change settled by now
+	void Poll(uint64_t now, std::vector<uint32_t> &changed);
+
+	const std::string &GetPath(uint32_t id) const { return files[id].path; }
+
+private:
+	struct WatchedFile
+	{
+		std::string path;
+		bool exists;
+		FileStamp stamp;
+		// Last stamp seen while a change is settling
+		bool pending;
+		bool pending_exists;
+		FileStamp pending_stamp;
+		uint64_t pending_since;
+	};
+
+	bool ReadStamp(const std::string &path, FileStamp &stamp);
+
+	FileSystem &file_system;
+	uint64_t settle_time;
+	std::vector<WatchedFile> files;
+};
+
+// Objects the GPU may still use, released in order once the fence value they were retired with completes
+class RetireQueue
+{
+public:
+	// Fence values must not decrease. Destroying release drops what it captured (e.g. a ComPtr); it is also
+	// called first, for objects that need an explicit release
+	void Retire(uint64_t fence_value, std::function<void()> release);
+	size_t Collect(uint64_t completed_value);
+	// For shutdown, after the GPU is idle
+	void ReleaseAll();
+
+	size_t GetPendingCount() const { return pending.size(); }
+
+private:
+	struct Pending
+	{
+		uint64_t fence;
+		std::function<void()> release;
+	};
+
+	std::deque<Pending> pending;
+};
+
+struct HotReloadStats
+{
+	uint64_t builds;
+	uint64_t failures;
+	uint64_t applied;
+	std::string last_error;
+};
+
+// Watches the sources of reloadable assets on a worker thread. When a source settles, the asset's build
+// function runs on the worker and produces an apply function, which the render thread runs at its next
+// frame boundary in ApplyFinished(). The render thread never waits for a build; only the hand-over of
+// finished builds takes a lock.
+class HotReloader
+{
+public:
+	// Render thread: swaps the new objects in and retires the old ones
+	typedef std::function<void()> ApplyFunction;
+	// Worker thread: prepares new objects without touching anything the render thread uses
+	typedef std::function<bool(ApplyFunction &apply, std::string &err)> BuildFunction;
+
+	HotReloader(FileSystem &file_system, SchedulerClock &clock, uint64_t settle_time);
+	~HotReloader();
+
+	// Register everything before Start()
+	void AddReload(const std::string &name, const std::vector<std::string> &sources, BuildFunction build);
+
+	void Start(uint64_t poll_interval);
+	void Stop();
+	// One worker iteration: polls the sources and runs the builds they trigger. Public so tests can drive
+	// the worker deterministically on their own thread.
+	void PollOnce();
+
+	// Render thread, at a frame boundary; returns the number of applied reloads
+	size_t ApplyFinished();
+
+	HotReloadStats GetStats();
+
+private:
+	struct Reload
+	{
+		std::string name;
+		BuildFunction build;
+	};
+
+	struct Finished
+	{
+		size_t reload;
+		ApplyFunction apply;
+	};
+
+	void WorkerMain(uint64_t poll_interval);
+
+	SchedulerClock &clock;
+	FileWatcher watcher;
+	std::vector<Reload> reloads;
+	// Reload index of every watched file id
+	std::vector<size_t> file_reloads;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+	std::vector<Finished> finished;
+	HotReloadStats stats;
+	std::thread worker;
+};
@@ -0,0 +1,298 @@
+#include "job_system.h"
+#include "profiler.h"
+
+#include <string>
+
+struct Job
+{
+	std::function<void()> function;
+	JobCounter *counter;
+};
+
+namespace
+{
+	// Pool membership of the current thread
+	thread_local const JobSystem *current_system = nullptr;
+	thread_local int current_index = -1;
+
+	// Rounds of stealing before an idle worker sleeps
+	const int idle_spins = 64;
+}
+
+bool JobDeque::Push(Job *job)
+{
+	const int64_t b = bottom.load(std::memory_order_relaxed);
+	const int64_t t = top.load(std::memory_order_acquire);
+	if (b - t >= capacity) {
+		return false;
+	}
+	buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+	// Pairs with the acquire load of bottom in Steal, which publishes the job to the thief
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job *JobDeque::Pop()
+{
+	const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	int64_t t = top.load(std::memory_order_relaxed);
+
+	if (t > b) {
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+	if (t == b) {
+		// Last job: race the thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			job = nullptr;
+		}
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job *JobDeque::Steal()
+{
+	int64_t t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const int64_t b = bottom.load(std::memory_order_acquire);
+	if (t >= b) {
+		return nullptr;
+	}
+
+	Job *job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+		return nullptr;
+	}
+	return job;
+}
+
+JobSystem::JobSystem(unsigned thread_count) :
+	stopping(false), queued(0), sleepers(0), inline_runs(0), sleeps(0)
+{
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (unsigned i = 0; i < thread_count; i++) {
+		workers.push_back(std::make_unique<Worker>());
+		workers[i]->random = 0x9E3779B9u * (i + 1);
+		workers[i]->executed = 0;
+		workers[i]->stolen = 0;
+	}
+
+	current_system = this;
+	current_index = 0;
+	for (unsigned i = 1; i < thread_count; i++) {
+		workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, static_cast<int>(i));
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::unique_ptr<Worker> &worker : workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
+	}
+
+	if (current_system == this) {
+		current_system = nullptr;
+		current_index = -1;
+	}
+}
+
+int JobSystem::GetWorkerIndex() const
+{
+	return current_system == this ? current_index : -1;
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter *counter)
+{
+	if (counter != nullptr) {
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Job *job = new Job{std::move(function), counter};
+	const int index = GetWorkerIndex();
+	if (index < 0) {
+		std::lock_guard<std::mutex> lock(injected_mutex);
+		injected.push_back(job);
+	} else if (!workers[index]->deque.Push(job)) {
+		// Deque full: running it now keeps the order guarantees of a counter intact
+		inline_runs++;
+		Execute(job, index);
+		return;
+	}
+
+	queued.fetch_add(1, std::memory_order_seq_cst);
+	if (sleepers.load(std::memory_order_seq_cst) > 0) {
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		wake.notify_one();
+	}
+}
+
+Job *JobSystem::FindJob(int index)
+{
+	if (index >= 0) {
+		if (Job *job = workers[index]->deque.Pop()) {
+			return job;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(injected_mutex);
+		if (!injected.empty()) {
+			Job *job = injected.front();
+			injected.pop_front();
+			return job;
+		}
+	}
+
+	// Start at a random victim so thieves spread over the deques
+	const size_t count = workers.size();
+	uint32_t random = index >= 0 ? workers[index]->random : 0;
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	if (index >= 0) {
+		workers[index]->random = random;
+	}
+	for (size_t i = 0; i < count; i++) {
+		const size_t victim = (random + i) % count;
+		if (static_cast<int>(victim) == index) {
+			continue;
+		}
+		if (Job *job = workers[victim]->deque.Steal()) {
+			if (index >= 0) {
+				workers[index]->stolen.fetch_add(1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job *job, int index)
+{
+	job->function();
+	if (job->counter != nullptr) {
+		job->counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+	delete job;
+	if (index >= 0) {
+		workers[index]->executed.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+	const int index = GetWorkerIndex();
+	while (!counter.IsDone()) {
+		if (Job *job = FindJob(index)) {
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			Execute(job, index);
+		} else {
+			// The remaining jobs are running on other threads
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::WorkerMain(int index)
+{
+	current_system = this;
+	current_index = index;
+	const std::string name = "Job worker " + std::to_string(index);
+	PROFILE_THREAD(name.c_str());
+
+	int idle = 0;
+	while (!stopping.load(std::memory_order_relaxed)) {
+		if (Job *job = FindJob(index)) {
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			Execute(job, index);
+			idle = 0;
+			continue;
+		}
+
+		if (++idle < idle_spins) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		// Sleep until a job is queued; the recheck under the lock pairs with the notify in Run
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleepers.fetch_add(1, std::memory_order_seq_cst);
+		if (queued.load(std::memory_order_seq_cst) <= 0 && !stopping) {
+			sleeps++;
+			wake.wait_for(lock, std::chrono::milliseconds(10));
+		}
+		sleepers.fetch_sub(1, std::memory_order_seq_cst);
+		idle = 0;
+	}
+}
+
+JobSystemStats JobSystem::GetStats() const
+{
+	JobSystemStats stats = {};
+	for (const std::unique_ptr<Worker> &worker : workers) {
+		stats.executed += worker->executed.load(std::memory_order_relaxed);
+		stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+	}
+	stats.inline_runs = inline_runs.load(std::memory_order_relaxed);
+	stats.sleeps = sleeps.load(std::memory_order_relaxed);
+	return stats;
+}
+
+TaskGraph::TaskId TaskGraph::AddTask(const char *name, std::function<void()> function, std::initializer_list<TaskId> dependencies)
+{
+	const TaskId id = static_cast<TaskId>(tasks.size());
+	tasks.push_back({name, std::move(function), {}, static_cast<int>(dependencies.size())});
+	for (TaskId dependency : dependencies) {
+		tasks[dependency].successors.push_back(id);
+	}
+	return id;
+}
+
+void TaskGraph::Launch(JobSystem &jobs, TaskId id, JobCounter &counter)
+{
+	jobs.Run([this, &jobs, id, &counter]() {
+		{
+			PROFILE_SCOPE(tasks[id].name);
+			tasks[id].function();
+		}
+		for (TaskId successor : tasks[id].successors) {
+			if (remaining[successor].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				Launch(jobs, successor, counter);
+			}
+		}
+	}, &counter);
+}
+
+void TaskGraph::Run(JobSystem &jobs)
+{
+	if (remaining_size != tasks.size()) {
+		remaining.reset(new std::atomic<int>[tasks.size()]);
+		remaining_size = tasks.size();
+	}
+	for (size_t i = 0; i < tasks.size(); i++) {
+		remaining[i].store(tasks[i].dependency_count, std::memory_order_relaxed);
+	}
+
+	JobCounter counter;
+	for (TaskId id = 0; id < tasks.size(); id++) {
+		if (tasks[id].dependency_count == 0) {
+			Launch(jobs, id, counter);
+		}
+	}
+	jobs.Wait(counter);
+}
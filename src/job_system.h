@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Job;
+
+// Number of unfinished jobs; Wait() on it helps with other jobs instead of blocking
+class JobCounter
+{
+public:
+	JobCounter() : pending(0) {};
+
+	bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> pending;
+};
+
+// Chase-Lev work-stealing deque of fixed capacity. The owner pushes and pops at the bottom, other threads
+// steal from the top without locks.
+class JobDeque
+{
+public:
+	static const int64_t capacity = 4096;
+
+	JobDeque() : top(0), bottom(0)
+	{
+		for (std::atomic<Job *> &slot : buffer) {
+			slot.store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	// Owner only; false when full
+	bool Push(Job *job);
+	// Owner only; most recently pushed job first
+	Job *Pop();
+	// Any thread; oldest job first, nullptr when empty or when another thread won the race
+	Job *Steal();
+
+private:
+	alignas(64) std::atomic<int64_t> top;
+	alignas(64) std::atomic<int64_t> bottom;
+	alignas(64) std::atomic<Job *> buffer[capacity];
+};
+
+struct JobSystemStats
+{
+	uint64_t executed;
+	uint64_t stolen;
+	uint64_t inline_runs;
+	uint64_t sleeps;
+};
+
+// Fixed pool of worker threads with one deque each. The thread that creates the system is worker 0 and
+// takes part whenever it waits. Jobs queued from threads outside the pool go through a locked queue.
+class JobSystem
+{
+public:
+	// thread_count includes the creating thread; 0 uses every hardware thread
+	explicit JobSystem(unsigned thread_count = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem &) = delete;
+	JobSystem &operator=(const JobSystem &) = delete;
+
+	// counter may be null; otherwise it counts the job until it has finished
+	void Run(std::function<void()> function, JobCounter *counter);
+	// Runs queued jobs on the calling thread until counter reaches zero
+	void Wait(JobCounter &counter);
+
+	// Calls function(begin, end) on batches of at least min_batch indices across all threads and waits
+	template <typename Function>
+	void ParallelFor(size_t count, size_t min_batch, const Function &function);
+
+	unsigned GetThreadCount() const { return static_cast<unsigned>(workers.size()); }
+	JobSystemStats GetStats() const;
+
+private:
+	struct alignas(64) Worker
+	{
+		JobDeque deque;
+		std::thread thread;
+		uint32_t random;
+		std::atomic<uint64_t> executed;
+		std::atomic<uint64_t> stolen;
+	};
+
+	// Index of the calling thread in this system, -1 for outside threads
+	int GetWorkerIndex() const;
+	Job *FindJob(int index);
+	void Execute(Job *job, int index);
+	void WorkerMain(int index);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<bool> stopping;
+
+	// Jobs not yet picked up, for waking sleepers without missing a push
+	std::atomic<int64_t> queued;
+	std::atomic<int> sleepers;
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+
+	std::mutex injected_mutex;
+	std::deque<Job *> injected;
+
+	std::atomic<uint64_t> inline_runs;
+	std::atomic<uint64_t> sleeps;
+};
+
+template <typename Function>
+void JobSystem::ParallelFor(size_t count, size_t min_batch, const Function &function)
+{
+	if (count == 0) {
+		return;
+	}
+
+	// A few batches per thread so stealing can even out uneven batches
+	const size_t maxBatches = static_cast<size_t>(GetThreadCount()) * 4;
+	const size_t batches = std::min(maxBatches, std::max<size_t>(1, count / std::max<size_t>(1, min_batch)));
+	if (batches <= 1) {
+		function(static_cast<size_t>(0), count);
+		return;
+	}
+
+	const size_t batchSize = (count + batches - 1) / batches;
+	JobCounter counter;
+	for (size_t begin = batchSize; begin < count; begin += batchSize) {
+		const size_t end = std::min(count, begin + batchSize);
+		Run([&function, begin, end]() { function(begin, end); }, &counter);
+	}
+	function(static_cast<size_t>(0), batchSize);
+	Wait(counter);
+}
+
+// Dependency graph of named tasks, built once and run every frame. A task starts as soon as all tasks it
+// depends on have finished; tasks may use ParallelFor themselves.
+class TaskGraph
+{
+public:
+	typedef uint32_t TaskId;
+
+	TaskGraph() : remaining_size(0) {};
+
+	TaskId AddTask(const char *name, std::function<void()> function, std::initializer_list<TaskId> dependencies = {});
+	void Run(JobSystem &jobs);
+
+	size_t GetTaskCount() const { return tasks.size(); }
+
+private:
+	struct Task
+	{
+		const char *name;
+		std::function<void()> function;
+		std::vector<TaskId> successors;
+		int dependency_count;
+	};
+
+	void Launch(JobSystem &jobs, TaskId id, JobCounter &counter);
+
+	std::vector<Task> tasks;
+	// Unfinished dependencies per task during Run
+	std::unique_ptr<std::atomic<int>[]> remaining;
+	size_t remaining_size;
+};
@@ -0,0 +1,121 @@
+#include "mapped_file.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE fileMapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (fileMapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void *view = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(fileMapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	handle = file;
+	mapping = fileMapping;
+	data = static_cast<const uint8_t *>(view);
+	size = static_cast<size_t>(fileSize.QuadPart);
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || info.st_size == 0) {
+		close(file);
+		return false;
+	}
+
+	void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	data = static_cast<const uint8_t *>(view);
+	size = static_cast<size_t>(info.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(static_cast<HANDLE>(mapping));
+	CloseHandle(static_cast<HANDLE>(handle));
+#else
+	munmap(const_cast<uint8_t *>(data), size);
+#endif
+
+	data = nullptr;
+	size = 0;
+	handle = nullptr;
+	mapping = nullptr;
+}
+
+bool GetFileStamp(const std::string &path, FileStamp &stamp)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0) {
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+#endif
+
+	stamp.size = static_cast<uint64_t>(info.st_size);
+	stamp.modified = static_cast<int64_t>(info.st_mtime);
+	return true;
+}
+
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed)
+{
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file (Win32 file mapping or POSIX mmap)
+class MappedFile
+{
+public:
+	MappedFile() : data(nullptr), size(0), handle(nullptr), mapping(nullptr) {};
+	~MappedFile() { Close(); };
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool Open(const std::string &path);
+	void Close();
+
+	const uint8_t *GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	const uint8_t *data;
+	size_t size;
+	void *handle;
+	void *mapping;
+};
+
+struct FileStamp
+{
+	uint64_t size;
+	int64_t modified;
+};
+
+bool GetFileStamp(const std::string &path, FileStamp &stamp);
+
+// 64-bit FNV-1a
+uint64_t HashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull);
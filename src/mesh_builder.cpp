@@ -0,0 +1,408 @@
+#include "mesh_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	// Forsyth's tuning constants
+	const int max_cache = 32;
+	const float cache_decay_power = 1.5f;
+	const float last_triangle_score = 0.75f;
+	const float valence_boost_scale = 2.0f;
+	const float valence_boost_power = 0.5f;
+
+	float VertexScore(int cache_position, uint32_t active_triangles)
+	{
+		if (active_triangles == 0) {
+			return -1.0f;
+		}
+
+		float score = 0.0f;
+		if (cache_position >= 0) {
+			if (cache_position < 3) {
+				score = last_triangle_score;
+			} else {
+				const float scaler = 1.0f / (max_cache - 3);
+				score = powf(1.0f - (cache_position - 3) * scaler, cache_decay_power);
+			}
+		}
+
+		return score + valence_boost_scale * powf(static_cast<float>(active_triangles), -valence_boost_power);
+	}
+
+	struct WeldKey
+	{
+		uint32_t bits[3];
+		int material;
+
+		bool operator==(const WeldKey &other) const
+		{
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2] && material == other.material;
+		}
+	};
+
+	struct WeldKeyHash
+	{
+		size_t operator()(const WeldKey &key) const
+		{
+			uint64_t h = 14695981039346656037ull;
+			for (uint32_t b : key.bits) {
+				h = (h ^ b) * 1099511628211ull;
+			}
+			return static_cast<size_t>((h ^ static_cast<uint32_t>(key.material)) * 1099511628211ull);
+		}
+	};
+
+	uint32_t FloatBits(float value)
+	{
+		// Weld -0.0 and 0.0 together
+		if (value == 0.0f) {
+			value = 0.0f;
+		}
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	void CopyName(char (&destination)[32], const std::string &source)
+	{
+		size_t length = std::min(source.size(), sizeof(destination) - 1);
+		memcpy(destination, source.data(), length);
+		destination[length] = '\0';
+	}
+}
+
+uint32_t Mesh::GetIndexSize() const
+{
+	return vertices.size() <= 0xFFFF ? 2 : 4;
+}
+
+void Mesh::PackIndices(void *destination) const
+{
+	if (GetIndexSize() == 4) {
+		memcpy(destination, indices.data(), indices.size() * sizeof(uint32_t));
+		return;
+	}
+
+	uint16_t *packed = static_cast<uint16_t *>(destination);
+	for (size_t i = 0; i < indices.size(); i++) {
+		packed[i] = static_cast<uint16_t>(indices[i]);
+	}
+}
+
+std::string MeshStats::ToString() const
+{
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer),
+		"Mesh: %zu flat vertices (ACMR %.3f) -> %zu vertices, %zu indices (ACMR %.3f welded, %.3f optimized)\n",
+		flat_vertex_count, flat_acmr, welded_vertex_count, index_count, welded_acmr, optimized_acmr);
+	return buffer;
+}
+
+int MeshBuilder::AddMaterial(const std::string &name, const float diffuse[3])
+{
+	MeshMaterial material = {};
+	CopyName(material.name, name);
+	material.diffuse[0] = diffuse[0];
+	material.diffuse[1] = diffuse[1];
+	material.diffuse[2] = diffuse[2];
+	materials.push_back(material);
+	return static_cast<int>(materials.size()) - 1;
+}
+
+void MeshBuilder::BeginShape(const std::string &name)
+{
+	current_group = groups.size();
+	groups.push_back({name, {}});
+}
+
+void MeshBuilder::AddPolygon(const float *positions, size_t corner_count, int material)
+{
+	if (groups.empty()) {
+		BeginShape(std::string());
+	}
+
+	std::vector<Corner> &corners = groups[current_group].corners;
+	for (size_t i = 1; i + 1 < corner_count; i++) {
+		const size_t fan[3] = {0, i, i + 1};
+		for (size_t corner : fan) {
+			Corner c = {{positions[3 * corner + 0], positions[3 * corner + 1], positions[3 * corner + 2]}, material};
+			corners.push_back(c);
+		}
+	}
+}
+
+Mesh MeshBuilder::Build(bool optimize)
+{
+	Mesh mesh;
+	mesh.materials = materials;
+
+	std::unordered_map<WeldKey, uint32_t, WeldKeyHash> welded;
+	size_t corner_total = 0;
+
+	for (const Group &group : groups) {
+		corner_total += group.corners.size();
+
+		// Split the group into one shape per material, keeping the original triangle order
+		std::vector<int> group_materials;
+		for (size_t c = 0; c < group.corners.size(); c += 3) {
+			if (std::find(group_materials.begin(), group_materials.end(), group.corners[c].material) == group_materials.end()) {
+				group_materials.push_back(group.corners[c].material);
+			}
+		}
+
+		for (int material : group_materials) {
+			MeshShape shape = {};
+			CopyName(shape.name, group.name);
+			shape.index_offset = static_cast<uint32_t>(mesh.indices.size());
+			shape.material = material;
+			for (int k = 0; k < 3; k++) {
+				shape.bounds_min[k] = INFINITY;
+				shape.bounds_max[k] = -INFINITY;
+			}
+
+			const bool has_material = material >= 0 && material < static_cast<int>(materials.size());
+			for (size_t c = 0; c < group.corners.size(); c += 3) {
+				if (group.corners[c].material != material) {
+					continue;
+				}
+
+				for (size_t v = c; v < c + 3; v++) {
+					const Corner &corner = group.corners[v];
+					WeldKey key = {{FloatBits(corner.position[0]), FloatBits(corner.position[1]), FloatBits(corner.position[2])}, material};
+
+					auto found = welded.find(key);
+					if (found == welded.end()) {
+						MeshVertex vertex = {
+							{corner.position[0], corner.position[1], corner.position[2]},
+							{1.0f, 1.0f, 1.0f, 1.0f}
+						};
+						if (has_material) {
+							vertex.color[0] = materials[material].diffuse[0];
+							vertex.color[1] = materials[material].diffuse[1];
+							vertex.color[2] = materials[material].diffuse[2];
+						}
+						found = welded.emplace(key, static_cast<uint32_t>(mesh.vertices.size())).first;
+						mesh.vertices.push_back(vertex);
+					}
+					mesh.indices.push_back(found->second);
+
+					for (int k = 0; k < 3; k++) {
+						shape.bounds_min[k] = std::min(shape.bounds_min[k], corner.position[k]);
+						shape.bounds_max[k] = std::max(shape.bounds_max[k], corner.position[k]);
+					}
+				}
+			}
+
+			shape.index_count = static_cast<uint32_t>(mesh.indices.size()) - shape.index_offset;
+			mesh.shapes.push_back(shape);
+		}
+	}
+
+	stats = MeshStats();
+	stats.flat_vertex_count = corner_total;
+	stats.welded_vertex_count = mesh.vertices.size();
+	stats.index_count = mesh.indices.size();
+	// A non-indexed draw transforms every corner
+	stats.flat_acmr = corner_total ? 3.0 : 0.0;
+	stats.welded_acmr = ComputeACMR(mesh.indices.data(), mesh.indices.size(), cache_size);
+
+	if (optimize) {
+		// Optimize each shape separately so shape ranges stay valid for per-shape draws
+		std::vector<uint32_t> local_ids(mesh.vertices.size(), UINT32_MAX);
+		std::vector<uint32_t> global_ids;
+		for (const MeshShape &shape : mesh.shapes) {
+			uint32_t *range = mesh.indices.data() + shape.index_offset;
+
+			global_ids.clear();
+			for (uint32_t i = 0; i < shape.index_count; i++) {
+				uint32_t &local = local_ids[range[i]];
+				if (local == UINT32_MAX) {
+					local = static_cast<uint32_t>(global_ids.size());
+					global_ids.push_back(range[i]);
+				}
+				range[i] = local;
+			}
+
+			OptimizeVertexCache(range, shape.index_count, global_ids.size());
+
+			for (uint32_t i = 0; i < shape.index_count; i++) {
+				range[i] = global_ids[range[i]];
+			}
+			for (uint32_t id : global_ids) {
+				local_ids[id] = UINT32_MAX;
+			}
+		}
+
+		OptimizeVertexFetch(mesh.vertices, mesh.indices);
+	}
+
+	stats.optimized_acmr = ComputeACMR(mesh.indices.data(), mesh.indices.size(), cache_size);
+
+	return mesh;
+}
+
+double ComputeACMR(const uint32_t *indices, size_t index_count, uint32_t cache_size)
+{
+	if (index_count < 3) {
+		return 0.0;
+	}
+
+	uint32_t vertex_count = 0;
+	for (size_t i = 0; i < index_count; i++) {
+		vertex_count = std::max(vertex_count, indices[i] + 1);
+	}
+
+	// A vertex is cached while fewer than cache_size misses happened after it was inserted
+	std::vector<int64_t> inserted_at(vertex_count, INT64_MIN / 2);
+	int64_t misses = 0;
+	for (size_t i = 0; i < index_count; i++) {
+		int64_t &stamp = inserted_at[indices[i]];
+		if (misses - stamp >= cache_size) {
+			stamp = misses;
+			misses++;
+		}
+	}
+
+	return static_cast<double>(misses) / static_cast<double>(index_count / 3);
+}
+
+void OptimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count)
+{
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	// Vertex -> triangle adjacency; the first active_count entries of each list are live
+	std::vector<uint32_t> active_count(vertex_count, 0);
+	for (size_t i = 0; i < triangle_count * 3; i++) {
+		active_count[indices[i]]++;
+	}
+
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (size_t v = 0; v < vertex_count; v++) {
+		offsets[v + 1] = offsets[v] + active_count[v];
+	}
+
+	std::vector<uint32_t> adjacency(triangle_count * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangle_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; v++) {
+		vertex_score[v] = VertexScore(-1, active_count[v]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	int64_t best = -1;
+	float best_score = -1.0f;
+	for (size_t t = 0; t < triangle_count; t++) {
+		const uint32_t *tri = indices + 3 * t;
+		triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+		if (triangle_score[t] > best_score) {
+			best_score = triangle_score[t];
+			best = static_cast<int64_t>(t);
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triangle_count * 3);
+	uint32_t cache[max_cache + 3];
+	uint32_t next_cache[max_cache + 3];
+	int cache_count = 0;
+	size_t scan = 0;
+
+	while (output.size() < triangle_count * 3) {
+		if (best < 0) {
+			// Nothing useful in the cache: continue with the next untouched triangle
+			while (emitted[scan]) {
+				scan++;
+			}
+			best = static_cast<int64_t>(scan);
+		}
+
+		const uint32_t *tri = indices + 3 * best;
+		emitted[best] = true;
+		output.insert(output.end(), tri, tri + 3);
+
+		// Drop the triangle from each vertex adjacency list
+		for (int k = 0; k < 3; k++) {
+			const uint32_t v = tri[k];
+			uint32_t *list = adjacency.data() + offsets[v];
+			for (uint32_t i = 0; i < active_count[v]; i++) {
+				if (list[i] == static_cast<uint32_t>(best)) {
+					std::swap(list[i], list[active_count[v] - 1]);
+					break;
+				}
+			}
+			active_count[v]--;
+		}
+
+		// Move the triangle's vertices to the front of the cache
+		int next_count = 0;
+		for (int k = 0; k < 3; k++) {
+			next_cache[next_count++] = tri[k];
+		}
+		for (int i = 0; i < cache_count; i++) {
+			const uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				next_cache[next_count++] = v;
+			}
+		}
+
+		for (int i = 0; i < next_count; i++) {
+			const uint32_t v = next_cache[i];
+			cache_position[v] = i < max_cache ? i : -1;
+			vertex_score[v] = VertexScore(cache_position[v], active_count[v]);
+		}
+
+		best = -1;
+		best_score = -1.0f;
+		for (int i = 0; i < next_count; i++) {
+			const uint32_t v = next_cache[i];
+			const uint32_t *list = adjacency.data() + offsets[v];
+			for (uint32_t j = 0; j < active_count[v]; j++) {
+				const uint32_t t = list[j];
+				const uint32_t *adjacent = indices + 3 * t;
+				triangle_score[t] = vertex_score[adjacent[0]] + vertex_score[adjacent[1]] + vertex_score[adjacent[2]];
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+
+		cache_count = std::min(next_count, max_cache);
+		std::copy(next_cache, next_cache + cache_count, cache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices)
+{
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<MeshVertex> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t &index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU-side mesh data. Kept free of Windows/D3D12 headers so it builds on any platform.
+
+struct MeshVertex
+{
+	float position[3];
+	float color[4];
+};
+
+struct MeshMaterial
+{
+	char name[32];
+	float diffuse[3];
+};
+
+// Contiguous index range of one OBJ group drawn with one material
+struct MeshShape
+{
+	char name[32];
+	uint32_t index_offset;
+	uint32_t index_count;
+	int32_t material;
+	float bounds_min[3];
+	float bounds_max[3];
+};
+
+struct Mesh
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshShape> shapes;
+	std::vector<MeshMaterial> materials;
+
+	// 2 when every index fits into 16 bits, 4 otherwise
+	uint32_t GetIndexSize() const;
+	void PackIndices(void *destination) const;
+};
+
+struct MeshStats
+{
+	size_t flat_vertex_count = 0;
+	size_t welded_vertex_count = 0;
+	size_t index_count = 0;
+	double flat_acmr = 0.0;
+	double welded_acmr = 0.0;
+	double optimized_acmr = 0.0;
+
+	std::string ToString() const;
+};
+
+class MeshBuilder
+{
+public:
+	static const uint32_t cache_size = 16;
+
+	MeshBuilder() : current_group(0) {};
+
+	int AddMaterial(const std::string &name, const float diffuse[3]);
+	void BeginShape(const std::string &name);
+	// Polygon is triangulated as a fan
+	void AddPolygon(const float *positions, size_t corner_count, int material);
+
+	Mesh Build(bool optimize = true);
+	const MeshStats &GetStats() const { return stats; }
+
+private:
+	struct Corner
+	{
+		float position[3];
+		int material;
+	};
+
+	struct Group
+	{
+		std::string name;
+		std::vector<Corner> corners;
+	};
+
+	std::vector<MeshMaterial> materials;
+	std::vector<Group> groups;
+	size_t current_group;
+	MeshStats stats;
+};
+
+// Average cache miss ratio of a triangle list for a FIFO post-transform cache
+double ComputeACMR(const uint32_t *indices, size_t index_count, uint32_t cache_size);
+
+// Reorders triangles for post-transform cache locality (Forsyth's linear-speed algorithm)
+void OptimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count);
+
+// Renumbers vertices in first-use order so vertex fetch walks memory linearly
+void OptimizeVertexFetch(std::vector<MeshVertex> &vertices, std::vector<uint32_t> &indices);
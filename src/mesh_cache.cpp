@@ -0,0 +1,348 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
+
+namespace
+{
+	const char mesh_cache_magic[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+
+	uint64_t Align(uint64_t value)
+	{
+		return (value + mesh_cache_alignment - 1) & ~(mesh_cache_alignment - 1);
+	}
+
+	bool HashFile(const std::string &path, uint64_t &hash)
+	{
+		MappedFile source;
+		if (!source.Open(path)) {
+			return false;
+		}
+		hash = HashBytes(source.GetData(), source.GetSize());
+		return true;
+	}
+
+	bool SectionFits(const MeshCacheHeader &header, uint64_t offset, uint64_t count, uint64_t element_size)
+	{
+		return offset % mesh_cache_alignment == 0 && offset <= header.file_size &&
+			count * element_size <= header.file_size - offset;
+	}
+
+	template <typename Index>
+	bool IndicesFit(const Index *indices, uint32_t index_count, uint32_t vertex_count)
+	{
+		Index maxIndex = 0;
+		for (uint32_t i = 0; i < index_count; i++) {
+			maxIndex = std::max(maxIndex, indices[i]);
+		}
+		return index_count == 0 || maxIndex < vertex_count;
+	}
+
+	// Every shape draws a range of the index buffer and every index names a vertex
+	bool StreamsFit(const MeshCacheHeader &header, const uint8_t *base)
+	{
+		const MeshShape *shapes = reinterpret_cast<const MeshShape *>(base + header.shape_offset);
+		for (uint32_t i = 0; i < header.shape_count; i++) {
+			const MeshShape &shape = shapes[i];
+			if (shape.index_offset > header.index_count || shape.index_count > header.index_count - shape.index_offset ||
+				shape.material >= static_cast<int64_t>(header.material_count)) {
+				return false;
+			}
+		}
+
+		const uint8_t *indices = base + header.index_offset;
+		return header.index_size == 2 ?
+			IndicesFit(reinterpret_cast<const uint16_t *>(indices), header.index_count, header.vertex_count) :
+			IndicesFit(reinterpret_cast<const uint32_t *>(indices), header.index_count, header.vertex_count);
+	}
+}
+
+std::vector<std::string> FindMeshSources(const std::string &obj_path)
+{
+	std::vector<std::string> sources;
+	sources.push_back(obj_path.substr(obj_path.find_last_of("\\/") + 1));
+
+	std::ifstream obj(obj_path);
+	std::string line;
+	while (std::getline(obj, line)) {
+		std::istringstream tokens(line);
+		std::string keyword;
+		tokens >> keyword;
+		if (keyword != "mtllib") {
+			continue;
+		}
+
+		std::string library;
+		while (tokens >> library) {
+			sources.push_back(library);
+		}
+	}
+
+	return sources;
+}
+
+bool CookMeshCache(const std::string &cache_path, const Mesh &mesh, const std::string &source_dir,
+	const std::vector<std::string> &sources, std::string &err)
+{
+	std::vector<MeshCacheSource> stamps;
+	for (const std::string &source : sources) {
+		MeshCacheSource stamp = {};
+		if (source.size() >= sizeof(stamp.path)) {
+			err = "Source path is too long: " + source;
+			return false;
+		}
+		memcpy(stamp.path, source.c_str(), source.size());
+
+		FileStamp fileStamp;
+		if (!GetFileStamp(source_dir + source, fileStamp) || !HashFile(source_dir + source, stamp.hash)) {
+			err = "Cannot read mesh source: " + source_dir + source;
+			return false;
+		}
+		stamp.size = fileStamp.size;
+		stamp.modified = fileStamp.modified;
+		stamps.push_back(stamp);
+	}
+
+	std::vector<uint8_t> packedIndices(mesh.indices.size() * mesh.GetIndexSize());
+	mesh.PackIndices(packedIndices.data());
+
+	MeshCacheHeader header = {};
+	memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+	header.version = mesh_cache_version;
+	header.header_size = sizeof(MeshCacheHeader);
+	header.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+	header.index_count = static_cast<uint32_t>(mesh.indices.size());
+	header.index_size = mesh.GetIndexSize();
+	header.shape_count = static_cast<uint32_t>(mesh.shapes.size());
+	header.material_count = static_cast<uint32_t>(mesh.materials.size());
+	header.source_count = static_cast<uint32_t>(stamps.size());
+
+	header.vertex_offset = Align(sizeof(MeshCacheHeader));
+	header.index_offset = Align(header.vertex_offset + mesh.vertices.size() * sizeof(MeshVertex));
+	header.shape_offset = Align(header.index_offset + packedIndices.size());
+	header.material_offset = Align(header.shape_offset + mesh.shapes.size() * sizeof(MeshShape));
+	header.source_offset = Align(header.material_offset + mesh.materials.size() * sizeof(MeshMaterial));
+	header.file_size = header.source_offset + stamps.size() * sizeof(MeshCacheSource);
+
+	std::vector<uint8_t> blob(header.file_size, 0);
+	memcpy(blob.data(), &header, sizeof(header));
+	if (!mesh.vertices.empty()) {
+		memcpy(blob.data() + header.vertex_offset, mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex));
+	}
+	if (!packedIndices.empty()) {
+		memcpy(blob.data() + header.index_offset, packedIndices.data(), packedIndices.size());
+	}
+	if (!mesh.shapes.empty()) {
+		memcpy(blob.data() + header.shape_offset, mesh.shapes.data(), mesh.shapes.size() * sizeof(MeshShape));
+	}
+	if (!mesh.materials.empty()) {
+		memcpy(blob.data() + header.material_offset, mesh.materials.data(), mesh.materials.size() * sizeof(MeshMaterial));
+	}
+	memcpy(blob.data() + header.source_offset, stamps.data(), stamps.size() * sizeof(MeshCacheSource));
+
+	// Write to a temporary file first so a running renderer never maps a half-written blob
+	std::string tempPath = cache_path + ".tmp";
+	std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+	output.write(reinterpret_cast<const char *>(blob.data()), static_cast<std::streamsize>(blob.size()));
+	output.close();
+	if (!output) {
+		err = "Cannot write mesh cache: " + tempPath;
+		return false;
+	}
+
+#ifdef _WIN32
+	// Replaces in one step; rename() fails on Windows when the target exists
+	const bool replaced = MoveFileExA(tempPath.c_str(), cache_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	const bool replaced = std::rename(tempPath.c_str(), cache_path.c_str()) == 0;
+#endif
+	if (!replaced) {
+		std::remove(tempPath.c_str());
+		err = "Cannot replace mesh cache: " + cache_path;
+		return false;
+	}
+
+	return true;
+}
+
+MeshCacheCooker::MeshCacheCooker(ErrorFunction report_error) :
+	report_error(std::move(report_error)), cooking(false), stopping(false)
+{
+	worker = std::thread(&MeshCacheCooker::WorkerMain, this);
+}
+
+MeshCacheCooker::~MeshCacheCooker()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void MeshCacheCooker::Cook(const std::string &cache_path, std::shared_ptr<const Mesh> mesh, const std::string &source_dir,
+	const std::vector<std::string> &sources)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto queued = std::find_if(queue.begin(), queue.end(), [&](const Request &request) { return request.cache_path == cache_path; });
+		if (queued != queue.end()) {
+			*queued = {cache_path, std::move(mesh), source_dir, sources};
+		} else {
+			queue.push_back({cache_path, std::move(mesh), source_dir, sources});
+		}
+	}
+	wake.notify_all();
+}
+
+void MeshCacheCooker::WaitForIdle()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this]() { return queue.empty() && !cooking; });
+}
+
+void MeshCacheCooker::WorkerMain()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+		if (queue.empty()) {
+			return;
+		}
+		Request request = std::move(queue.front());
+		queue.erase(queue.begin());
+		cooking = true;
+		lock.unlock();
+
+		std::string err;
+		if (!CookMeshCache(request.cache_path, *request.mesh, request.source_dir, request.sources, err) && report_error) {
+			report_error(err);
+		}
+
+		lock.lock();
+		cooking = false;
+		idle.notify_all();
+	}
+}
+
+bool MeshCacheFile::Open(const std::string &cache_path, std::string &err)
+{
+	header = nullptr;
+	if (!file.Open(cache_path)) {
+		err = "Mesh cache not found: " + cache_path;
+		return false;
+	}
+
+	if (file.GetSize() < sizeof(MeshCacheHeader)) {
+		err = "Mesh cache is truncated";
+		return false;
+	}
+
+	const MeshCacheHeader *candidate = reinterpret_cast<const MeshCacheHeader *>(file.GetData());
+	if (memcmp(candidate->magic, mesh_cache_magic, sizeof(mesh_cache_magic)) != 0 ||
+		candidate->version != mesh_cache_version ||
+		candidate->header_size != sizeof(MeshCacheHeader) ||
+		candidate->file_size != file.GetSize()) {
+		err = "Mesh cache has an unknown format or version";
+		return false;
+	}
+
+	if ((candidate->index_size != 2 && candidate->index_size != 4) ||
+		!SectionFits(*candidate, candidate->vertex_offset, candidate->vertex_count, sizeof(MeshVertex)) ||
+		!SectionFits(*candidate, candidate->index_offset, candidate->index_count, candidate->index_size) ||
+		!SectionFits(*candidate, candidate->shape_offset, candidate->shape_count, sizeof(MeshShape)) ||
+		!SectionFits(*candidate, candidate->material_offset, candidate->material_count, sizeof(MeshMaterial)) ||
+		!SectionFits(*candidate, candidate->source_offset, candidate->source_count, sizeof(MeshCacheSource))) {
+		err = "Mesh cache sections are out of bounds";
+		return false;
+	}
+
+	if (!StreamsFit(*candidate, file.GetData())) {
+		err = "Mesh cache shapes or indices are out of range";
+		return false;
+	}
+
+	header = candidate;
+	return true;
+}
+
+bool MeshCacheFile::IsFresh(const std::string &source_dir, std::string &err) const
+{
+	if (header == nullptr || header->source_count == 0) {
+		err = "Mesh cache has no recorded sources";
+		return false;
+	}
+
+	const MeshCacheSource *sources = reinterpret_cast<const MeshCacheSource *>(file.GetData() + header->source_offset);
+	for (uint32_t i = 0; i < header->source_count; i++) {
+		const MeshCacheSource &source = sources[i];
+		std::string path = source_dir + std::string(source.path, strnlen(source.path, sizeof(source.path)));
+
+		FileStamp stamp;
+		if (!GetFileStamp(path, stamp)) {
+			err = "Mesh source is missing: " + path;
+			return false;
+		}
+		if (stamp.size == source.size && stamp.modified == source.modified) {
+			continue;
+		}
+
+		// Only the timestamp changed (e.g. a fresh checkout): fall back to the content hash
+		uint64_t hash;
+		if (stamp.size != source.size || !HashFile(path, hash) || hash != source.hash) {
+			err = "Mesh source changed: " + path;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+MeshView MeshCacheFile::GetView() const
+{
+	MeshView view = {};
+	if (header == nullptr) {
+		return view;
+	}
+
+	const uint8_t *base = file.GetData();
+	view.vertices = reinterpret_cast<const MeshVertex *>(base + header->vertex_offset);
+	view.vertex_count = header->vertex_count;
+	view.indices = base + header->index_offset;
+	view.index_count = header->index_count;
+	view.index_size = header->index_size;
+	view.shapes = reinterpret_cast<const MeshShape *>(base + header->shape_offset);
+	view.shape_count = header->shape_count;
+	view.materials = reinterpret_cast<const MeshMaterial *>(base + header->material_offset);
+	view.material_count = header->material_count;
+	return view;
+}
+
+MeshView GetMeshView(const Mesh &mesh, std::vector<uint8_t> &packed_indices)
+{
+	packed_indices.resize(mesh.indices.size() * mesh.GetIndexSize());
+	mesh.PackIndices(packed_indices.data());
+
+	MeshView view = {};
+	view.vertices = mesh.vertices.data();
+	view.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+	view.indices = packed_indices.data();
+	view.index_count = static_cast<uint32_t>(mesh.indices.size());
+	view.index_size = mesh.GetIndexSize();
+	view.shapes = mesh.shapes.data();
+	view.shape_count = static_cast<uint32_t>(mesh.shapes.size());
+	view.materials = mesh.materials.data();
+	view.material_count = static_cast<uint32_t>(mesh.materials.size());
+	return view;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "mesh_builder.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Non-owning view of mesh streams, either inside a Mesh or inside a mapped cache blob
+struct MeshView
+{
+	const MeshVertex *vertices;
+	uint32_t vertex_count;
+	const void *indices;
+	uint32_t index_count;
+	uint32_t index_size;
+	const MeshShape *shapes;
+	uint32_t shape_count;
+	const MeshMaterial *materials;
+	uint32_t material_count;
+};
+
+// Source file recorded in the blob; path is relative to the model directory
+struct MeshCacheSource
+{
+	char path[256];
+	uint64_t size;
+	int64_t modified;
+	uint64_t hash;
+};
+
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t file_size;
+
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t index_size;
+	uint32_t shape_count;
+	uint32_t material_count;
+	uint32_t source_count;
+
+	uint64_t vertex_offset;
+	uint64_t index_offset;
+	uint64_t shape_offset;
+	uint64_t material_offset;
+	uint64_t source_offset;
+};
+
+static const uint32_t mesh_cache_version = 1;
+static const uint64_t mesh_cache_alignment = 64;
+
+// Names of the source files an OBJ depends on: the OBJ itself plus its mtllib files
+std::vector<std::string> FindMeshSources(const std::string &obj_path);
+
+// Writes mesh streams and the stamps/hashes of its sources into a cache blob. The blob replaces cache_path,
+// which must not be mapped at the time, through cache_path + ".tmp"; cook one cache from one thread only.
+bool CookMeshCache(const std::string &cache_path, const Mesh &mesh, const std::string &source_dir,
+	const std::vector<std::string> &sources, std::string &err);
+
+// Owns every cook of a running program on one thread of its own, so two cooks never write the same
+// temporary file or race to replace the cache. A cook still queued for the same cache is superseded.
+class MeshCacheCooker
+{
+public:
+	// Called on the cooker's thread with the error of a failed cook
+	typedef std::function<void(const std::string &err)> ErrorFunction;
+
+	explicit MeshCacheCooker(ErrorFunction report_error);
+	// Finishes the queued cooks
+	~MeshCacheCooker();
+
+	MeshCacheCooker(const MeshCacheCooker &) = delete;
+	MeshCacheCooker &operator=(const MeshCacheCooker &) = delete;
+
+	void Cook(const std::string &cache_path, std::shared_ptr<const Mesh> mesh, const std::string &source_dir,
+		const std::vector<std::string> &sources);
+	void WaitForIdle();
+
+private:
+	struct Request
+	{
+		std::string cache_path;
+		std::shared_ptr<const Mesh> mesh;
+		std::string source_dir;
+		std::vector<std::string> sources;
+	};
+
+	void WorkerMain();
+
+	ErrorFunction report_error;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::vector<Request> queue;
+	bool cooking;
+	bool stopping;
+	std::thread worker;
+};
+
+class MeshCacheFile
+{
+public:
+	MeshCacheFile() : header(nullptr) {};
+
+	// Maps the blob and validates its layout, shape ranges and indices; no data is parsed or copied
+	bool Open(const std::string &cache_path, std::string &err);
+	void Close() { file.Close(); header = nullptr; }
+	// Compares recorded sources with the files on disk: size/mtime first, content hash when the stamp differs
+	bool IsFresh(const std::string &source_dir, std::string &err) const;
+	MeshView GetView() const;
+
+private:
+	MappedFile file;
+	const MeshCacheHeader *header;
+};
+
+MeshView GetMeshView(const Mesh &mesh, std::vector<uint8_t> &packed_indices);
@@ -0,0 +1,113 @@
+#include "mesh_cache.h"
+#include "obj_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::string DefaultCachePath(const std::string &obj_path)
+	{
+		std::string::size_type dot = obj_path.find_last_of('.');
+		std::string::size_type slash = obj_path.find_last_of("\\/");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return obj_path + ".meshcache";
+		}
+		return obj_path.substr(0, dot) + ".meshcache";
+	}
+
+	// Parse OBJ and build the mesh vs. map the blob and copy its streams, like the renderer's upload does
+	void Benchmark(const std::string &obj_path, const std::string &cache_path, int iterations)
+	{
+		std::string sourceDir = obj_path.substr(0, obj_path.find_last_of("\\/") + 1);
+		double objBest = 1e30, objTotal = 0.0, cacheBest = 1e30, cacheTotal = 0.0;
+		std::vector<uint8_t> upload;
+
+		for (int i = 0; i < iterations; i++) {
+			auto start = std::chrono::steady_clock::now();
+			Mesh mesh;
+			MeshStats stats;
+			std::string warn, err;
+			LoadObjMesh(obj_path, mesh, stats, warn, err);
+			double elapsed = MillisecondsSince(start);
+			objBest = std::min(objBest, elapsed);
+			objTotal += elapsed;
+
+			start = std::chrono::steady_clock::now();
+			MeshCacheFile cache;
+			if (!cache.Open(cache_path, err) || !cache.IsFresh(sourceDir, err)) {
+				std::cerr << err << std::endl;
+				return;
+			}
+			MeshView view = cache.GetView();
+			size_t vertexBytes = view.vertex_count * sizeof(MeshVertex);
+			size_t indexBytes = static_cast<size_t>(view.index_count) * view.index_size;
+			upload.resize(vertexBytes + indexBytes);
+			memcpy(upload.data(), view.vertices, vertexBytes);
+			memcpy(upload.data() + vertexBytes, view.indices, indexBytes);
+			elapsed = MillisecondsSince(start);
+			cacheBest = std::min(cacheBest, elapsed);
+			cacheTotal += elapsed;
+		}
+
+		std::cout << "OBJ load:   best " << objBest << " ms, avg " << objTotal / iterations << " ms" << std::endl;
+		std::cout << "Cache load: best " << cacheBest << " ms, avg " << cacheTotal / iterations << " ms" << std::endl;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <model.obj> [output.meshcache] [--bench iterations]" << std::endl;
+		return 1;
+	}
+
+	std::string objPath = argv[1];
+	std::string cachePath;
+	int iterations = 0;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+			iterations = std::max(1, atoi(argv[++i]));
+		} else {
+			cachePath = argv[i];
+		}
+	}
+	if (cachePath.empty()) {
+		cachePath = DefaultCachePath(objPath);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	Mesh mesh;
+	MeshStats stats;
+	std::string warn, err;
+	if (!LoadObjMesh(objPath, mesh, stats, warn, err)) {
+		std::cerr << "Cannot load " << objPath << ": " << err << std::endl;
+		return 1;
+	}
+	if (!warn.empty()) {
+		std::cerr << "Tinyobjloader warning: " << warn << std::endl;
+	}
+
+	std::string sourceDir = objPath.substr(0, objPath.find_last_of("\\/") + 1);
+	if (!CookMeshCache(cachePath, mesh, sourceDir, FindMeshSources(objPath), err)) {
+		std::cerr << err << std::endl;
+		return 1;
+	}
+
+	std::cout << stats.ToString();
+	std::cout << "Cooked " << cachePath << " in " << MillisecondsSince(start) << " ms" << std::endl;
+
+	if (iterations > 0) {
+		Benchmark(objPath, cachePath, iterations);
+	}
+
+	return 0;
+}
@@ -0,0 +1,474 @@
+#include "mesh_lod.h"
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	// Border planes weigh this much more than faces, so outlines move last
+	const double border_weight = 10.0;
+	// A collapse may not turn a triangle's normal by more than about 75 degrees
+	const float flip_cos_limit = 0.25f;
+
+	// Symmetric 4x4 matrix of summed plane equations, plus the summed weight to turn its value into a distance
+	struct Quadric
+	{
+		double a00, a01, a02, a11, a12, a22;
+		double b0, b1, b2;
+		double c;
+		double weight;
+	};
+
+	void AddPlane(Quadric &q, double nx, double ny, double nz, double d, double weight)
+	{
+		q.a00 += weight * nx * nx;
+		q.a01 += weight * nx * ny;
+		q.a02 += weight * nx * nz;
+		q.a11 += weight * ny * ny;
+		q.a12 += weight * ny * nz;
+		q.a22 += weight * nz * nz;
+		q.b0 += weight * nx * d;
+		q.b1 += weight * ny * d;
+		q.b2 += weight * nz * d;
+		q.c += weight * d * d;
+		q.weight += weight;
+	}
+
+	void AddQuadric(Quadric &q, const Quadric &other)
+	{
+		q.a00 += other.a00;
+		q.a01 += other.a01;
+		q.a02 += other.a02;
+		q.a11 += other.a11;
+		q.a12 += other.a12;
+		q.a22 += other.a22;
+		q.b0 += other.b0;
+		q.b1 += other.b1;
+		q.b2 += other.b2;
+		q.c += other.c;
+		q.weight += other.weight;
+	}
+
+	// Weighted mean squared distance of p to the planes of both quadrics
+	double Evaluate(const Quadric &q0, const Quadric &q1, const float *p)
+	{
+		const double x = p[0], y = p[1], z = p[2];
+		const double a00 = q0.a00 + q1.a00, a01 = q0.a01 + q1.a01, a02 = q0.a02 + q1.a02;
+		const double a11 = q0.a11 + q1.a11, a12 = q0.a12 + q1.a12, a22 = q0.a22 + q1.a22;
+		const double value = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+			2.0 * ((q0.b0 + q1.b0) * x + (q0.b1 + q1.b1) * y + (q0.b2 + q1.b2) * z) + q0.c + q1.c;
+		const double weight = q0.weight + q1.weight;
+		return weight > 0.0 ? std::max(value, 0.0) / weight : 0.0;
+	}
+
+	void TriangleNormal(const float *a, const float *b, const float *c, float *normal)
+	{
+		const float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+		const float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+		normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	// Unit normal in n[0..2] and area in n[3]; false for a degenerate triangle
+	bool PlaneNormal(const float *a, const float *b, const float *c, double *n)
+	{
+		float normal[3];
+		TriangleNormal(a, b, c, normal);
+		const double length = sqrt(static_cast<double>(normal[0]) * normal[0] + static_cast<double>(normal[1]) * normal[1] +
+			static_cast<double>(normal[2]) * normal[2]);
+		if (length == 0.0) {
+			return false;
+		}
+		n[0] = normal[0] / length;
+		n[1] = normal[1] / length;
+		n[2] = normal[2] / length;
+		n[3] = length * 0.5;
+		return true;
+	}
+
+	// Plane through a border edge, perpendicular to its only triangle
+	void AddBorderPlane(std::vector<Quadric> &quadrics, const std::vector<const float *> &positions, const uint32_t *triangle, uint32_t a, uint32_t b)
+	{
+		double n[4];
+		if (!PlaneNormal(positions[triangle[0]], positions[triangle[1]], positions[triangle[2]], n)) {
+			return;
+		}
+		const double ex = positions[b][0] - positions[a][0], ey = positions[b][1] - positions[a][1], ez = positions[b][2] - positions[a][2];
+		double px = ey * n[2] - ez * n[1], py = ez * n[0] - ex * n[2], pz = ex * n[1] - ey * n[0];
+		const double length = sqrt(px * px + py * py + pz * pz);
+		if (length == 0.0) {
+			return;
+		}
+		px /= length;
+		py /= length;
+		pz /= length;
+		const double d = -(px * positions[a][0] + py * positions[a][1] + pz * positions[a][2]);
+		const double weight = (ex * ex + ey * ey + ez * ez) * border_weight;
+		AddPlane(quadrics[a], px, py, pz, d, weight);
+		AddPlane(quadrics[b], px, py, pz, d, weight);
+	}
+
+	enum VertexKind : uint8_t
+	{
+		Interior,
+		Border,
+		Locked
+	};
+
+	struct Neighbour
+	{
+		uint32_t vertex;
+		// Triangles sharing the edge, and one of them
+		uint32_t uses;
+		uint32_t triangle;
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+		// Triangles it removes: 2 inside, 1 on a border
+		uint32_t removed;
+	};
+
+	struct PositionKey
+	{
+		uint32_t bits[3];
+
+		bool operator==(const PositionKey &other) const
+		{
+			return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+		}
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey &key) const
+		{
+			uint64_t h = 14695981039346656037ull;
+			for (uint32_t b : key.bits) {
+				h = (h ^ b) * 1099511628211ull;
+			}
+			return static_cast<size_t>(h);
+		}
+	};
+
+	uint32_t ReadIndex(const MeshView &mesh, size_t i)
+	{
+		return mesh.index_size == 2 ? static_cast<const uint16_t *>(mesh.indices)[i] : static_cast<const uint32_t *>(mesh.indices)[i];
+	}
+}
+
+void MeshLods::PackIndices(uint32_t index_size, void *destination) const
+{
+	if (index_size == 4) {
+		memcpy(destination, indices.data(), indices.size() * sizeof(uint32_t));
+		return;
+	}
+
+	uint16_t *packed = static_cast<uint16_t *>(destination);
+	for (size_t i = 0; i < indices.size(); i++) {
+		packed[i] = static_cast<uint16_t>(indices[i]);
+	}
+}
+
+size_t SimplifyMesh(const MeshVertex *vertices, const uint32_t *indices, size_t index_count,
+	const uint8_t *locked, size_t target_index_count, float max_error, uint32_t *destination, float &result_error,
+	MeshLodStats &stats)
+{
+	result_error = 0.0f;
+
+	// Work on the vertices this range uses, renumbered densely
+	std::vector<uint32_t> globals(indices, indices + index_count);
+	std::sort(globals.begin(), globals.end());
+	globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+	const uint32_t localCount = static_cast<uint32_t>(globals.size());
+
+	std::vector<uint32_t> triangles(index_count);
+	for (size_t i = 0; i < index_count; i++) {
+		triangles[i] = static_cast<uint32_t>(std::lower_bound(globals.begin(), globals.end(), indices[i]) - globals.begin());
+	}
+	std::vector<const float *> positions(localCount);
+	for (uint32_t v = 0; v < localCount; v++) {
+		positions[v] = vertices[globals[v]].position;
+	}
+
+	std::vector<Quadric> quadrics(localCount, Quadric());
+	std::vector<uint8_t> kinds(localCount);
+	std::vector<uint8_t> touched(localCount);
+	std::vector<uint32_t> remap(localCount);
+	std::vector<uint32_t> adjacencyStart(localCount + 1);
+	std::vector<uint32_t> adjacencyFill(localCount);
+	std::vector<uint32_t> adjacency;
+	std::vector<Neighbour> ring;
+	std::vector<Collapse> collapses;
+	std::vector<SortEntry> order;
+	std::vector<SortEntry> scratch;
+	bool firstPass = true;
+	const double errorLimit = static_cast<double>(max_error) * max_error;
+	double passError = 0.0;
+
+	while (triangles.size() > target_index_count) {
+		const size_t triangleCount = triangles.size() / 3;
+
+		// Triangles around each vertex
+		std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+		for (uint32_t v : triangles) {
+			adjacencyStart[v + 1]++;
+		}
+		for (uint32_t v = 0; v < localCount; v++) {
+			adjacencyStart[v + 1] += adjacencyStart[v];
+		}
+		adjacency.resize(triangles.size());
+		std::copy(adjacencyStart.begin(), adjacencyStart.end() - 1, adjacencyFill.begin());
+		for (size_t i = 0; i < triangles.size(); i++) {
+			adjacency[adjacencyFill[triangles[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// Quadrics come from the faces of the input; later passes keep accumulating them
+		if (firstPass) {
+			for (size_t i = 0; i < triangles.size(); i += 3) {
+				double n[4];
+				if (!PlaneNormal(positions[triangles[i]], positions[triangles[i + 1]], positions[triangles[i + 2]], n)) {
+					continue;
+				}
+				const float *p0 = positions[triangles[i]];
+				const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+				for (int corner = 0; corner < 3; corner++) {
+					AddPlane(quadrics[triangles[i + corner]], n[0], n[1], n[2], d, n[3]);
+				}
+			}
+		}
+
+		// Edges from the ring of each vertex: one triangle makes a border, more than two a non-manifold edge that
+		// stays put. Each edge is listed by its lower vertex.
+		for (uint32_t v = 0; v < localCount; v++) {
+			kinds[v] = locked && locked[globals[v]] ? Locked : Interior;
+		}
+		collapses.clear();
+		for (uint32_t a = 0; a < localCount; a++) {
+			ring.clear();
+			for (uint32_t k = adjacencyStart[a]; k < adjacencyStart[a + 1]; k++) {
+				const uint32_t *t = &triangles[adjacency[k] * 3];
+				for (int corner = 0; corner < 3; corner++) {
+					if (t[corner] == a) {
+						continue;
+					}
+					auto found = std::find_if(ring.begin(), ring.end(), [t, corner](const Neighbour &n) { return n.vertex == t[corner]; });
+					if (found == ring.end()) {
+						ring.push_back({t[corner], 1, adjacency[k]});
+					} else {
+						found->uses++;
+					}
+				}
+			}
+			for (const Neighbour &neighbour : ring) {
+				if (neighbour.uses > 2) {
+					kinds[a] = Locked;
+				} else if (neighbour.uses == 1) {
+					kinds[a] = std::max<uint8_t>(kinds[a], Border);
+					if (firstPass && a < neighbour.vertex) {
+						AddBorderPlane(quadrics, positions, &triangles[neighbour.triangle * 3], a, neighbour.vertex);
+					}
+				}
+				if (a < neighbour.vertex) {
+					collapses.push_back({a, neighbour.vertex, 0.0, neighbour.uses});
+				}
+			}
+		}
+		firstPass = false;
+
+		// Cheaper direction of every edge that may collapse at all
+		size_t candidateCount = 0;
+		for (const Collapse &edge : collapses) {
+			const bool borderEdge = edge.removed == 1;
+			Collapse best = {0, 0, -1.0, edge.removed};
+			for (int direction = 0; direction < 2; direction++) {
+				const uint32_t from = direction == 0 ? edge.from : edge.to, to = direction == 0 ? edge.to : edge.from;
+				// Border vertices slide along their border only
+				if (kinds[from] == Locked || (kinds[from] == Border && !borderEdge) || edge.removed > 2) {
+					continue;
+				}
+				const double cost = Evaluate(quadrics[from], quadrics[to], positions[to]);
+				if (best.cost < 0.0 || cost < best.cost) {
+					best.from = from;
+					best.to = to;
+					best.cost = cost;
+				}
+			}
+			if (best.cost >= 0.0 && best.cost <= errorLimit) {
+				collapses[candidateCount++] = best;
+			}
+		}
+		collapses.resize(candidateCount);
+
+		// Costs are non-negative, so their float bits sort like the values
+		order.resize(candidateCount);
+		scratch.resize(candidateCount);
+		for (size_t i = 0; i < candidateCount; i++) {
+			const float cost = static_cast<float>(collapses[i].cost);
+			uint32_t bits;
+			memcpy(&bits, &cost, sizeof(bits));
+			order[i] = {bits, static_cast<uint32_t>(i)};
+		}
+		RadixSort(order.data(), scratch.data(), candidateCount);
+
+		// Independent collapses in cost order; the two vertices of a collapse wait for the next pass. Looking further than
+		// twice the triangles still needed would take costly collapses that a later pass can avoid.
+		const size_t needed = triangleCount - target_index_count / 3;
+		const size_t considered = std::min(candidateCount, needed * 2);
+		size_t removed = 0;
+		size_t applied = 0;
+		std::fill(touched.begin(), touched.end(), 0);
+		for (uint32_t v = 0; v < localCount; v++) {
+			remap[v] = v;
+		}
+		for (size_t i = 0; i < considered && removed < needed; i++) {
+			const Collapse &collapse = collapses[order[i].item];
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			bool flips = false;
+			const float *target = positions[collapse.to];
+			for (uint32_t k = adjacencyStart[collapse.from]; k < adjacencyStart[collapse.from + 1] && !flips; k++) {
+				const uint32_t *t = &triangles[adjacency[k] * 3];
+				if (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to) {
+					continue;
+				}
+				const float *moved[3];
+				float before[3], after[3];
+				for (int corner = 0; corner < 3; corner++) {
+					moved[corner] = t[corner] == collapse.from ? target : positions[t[corner]];
+				}
+				TriangleNormal(positions[t[0]], positions[t[1]], positions[t[2]], before);
+				TriangleNormal(moved[0], moved[1], moved[2], after);
+				const float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+				const float lengths = sqrtf((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+					(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+				flips = dot <= flip_cos_limit * lengths;
+			}
+			if (flips) {
+				stats.flip_rejects++;
+				continue;
+			}
+
+			touched[collapse.from] = touched[collapse.to] = 1;
+			remap[collapse.from] = collapse.to;
+			AddQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			passError = std::max(passError, collapse.cost);
+			removed += collapse.removed;
+			applied++;
+		}
+		if (applied == 0) {
+			break;
+		}
+		stats.collapses += applied;
+
+		// Collapsed triangles become degenerate and drop out
+		size_t write = 0;
+		for (size_t i = 0; i < triangles.size(); i += 3) {
+			const uint32_t a = remap[triangles[i]], b = remap[triangles[i + 1]], c = remap[triangles[i + 2]];
+			if (a != b && b != c && a != c) {
+				triangles[write++] = a;
+				triangles[write++] = b;
+				triangles[write++] = c;
+			}
+		}
+		triangles.resize(write);
+	}
+
+	for (size_t i = 0; i < triangles.size(); i++) {
+		destination[i] = globals[triangles[i]];
+	}
+	result_error = static_cast<float>(sqrt(passError));
+	return triangles.size();
+}
+
+void BuildMeshLods(const MeshView &mesh, const MeshLodSettings &settings, MeshLods &lods)
+{
+	lods.levels.clear();
+	lods.first_level.clear();
+	lods.indices.clear();
+	lods.stats = {};
+
+	// Material boundaries: the builder welds per material, so a position shared by several vertices is a seam
+	std::vector<uint8_t> locked(mesh.vertex_count, 0);
+	std::unordered_map<PositionKey, uint32_t, PositionKeyHash> firstAtPosition;
+	firstAtPosition.reserve(mesh.vertex_count);
+	for (uint32_t v = 0; v < mesh.vertex_count; v++) {
+		PositionKey key;
+		for (int axis = 0; axis < 3; axis++) {
+			// -0.0 and 0.0 are the same place
+			const float value = mesh.vertices[v].position[axis] == 0.0f ? 0.0f : mesh.vertices[v].position[axis];
+			memcpy(&key.bits[axis], &value, sizeof(value));
+		}
+		auto inserted = firstAtPosition.emplace(key, v);
+		if (!inserted.second) {
+			locked[v] = 1;
+			locked[inserted.first->second] = 1;
+		}
+	}
+
+	// Vertices of several shapes would open cracks between them when one side moves
+	std::vector<uint32_t> owner(mesh.vertex_count, UINT32_MAX);
+	for (uint32_t s = 0; s < mesh.shape_count; s++) {
+		const MeshShape &shape = mesh.shapes[s];
+		for (uint32_t i = shape.index_offset; i < shape.index_offset + shape.index_count; i++) {
+			const uint32_t v = ReadIndex(mesh, i);
+			if (owner[v] != UINT32_MAX && owner[v] != s) {
+				locked[v] = 1;
+			}
+			owner[v] = s;
+		}
+	}
+
+	std::vector<uint32_t> source;
+	std::vector<uint32_t> simplified;
+	for (uint32_t s = 0; s < mesh.shape_count; s++) {
+		const MeshShape &shape = mesh.shapes[s];
+		lods.first_level.push_back(static_cast<uint32_t>(lods.levels.size()));
+		lods.levels.push_back({shape.index_offset, shape.index_count, 0.0f});
+		lods.stats.source_triangles += shape.index_count / 3;
+
+		source.resize(shape.index_count);
+		for (uint32_t i = 0; i < shape.index_count; i++) {
+			source[i] = ReadIndex(mesh, shape.index_offset + i);
+		}
+		simplified.resize(shape.index_count);
+
+		const float dx = shape.bounds_max[0] - shape.bounds_min[0];
+		const float dy = shape.bounds_max[1] - shape.bounds_min[1];
+		const float dz = shape.bounds_max[2] - shape.bounds_min[2];
+		const float errorBudget = settings.max_relative_error * sqrtf(dx * dx + dy * dy + dz * dz);
+		float error = 0.0f;
+
+		for (uint32_t level = 1; level < settings.max_levels; level++) {
+			if (source.size() / 3 < settings.min_triangles || error >= errorBudget) {
+				break;
+			}
+			const size_t target = static_cast<size_t>(source.size() / 3 * settings.reduction) * 3;
+			float levelError = 0.0f;
+			const size_t count = SimplifyMesh(mesh.vertices, source.data(), source.size(), locked.data(),
+				target, errorBudget - error, simplified.data(), levelError, lods.stats);
+			// A level that barely shrinks costs memory without saving work
+			if (count == 0 || count > source.size() * 9 / 10) {
+				break;
+			}
+
+			// Quadrics restart from each level, so the errors of the chain add up
+			error += levelError;
+			lods.levels.push_back({mesh.index_count + static_cast<uint32_t>(lods.indices.size()), static_cast<uint32_t>(count), error});
+			lods.indices.insert(lods.indices.end(), simplified.begin(), simplified.begin() + count);
+			lods.stats.lod_triangles += count / 3;
+			source.assign(simplified.begin(), simplified.begin() + count);
+		}
+	}
+	lods.first_level.push_back(static_cast<uint32_t>(lods.levels.size()));
+	lods.stats.level_count = static_cast<uint32_t>(lods.levels.size());
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh_cache.h"
+
+// Index range of one level of detail. error estimates the distance to the full-resolution surface in model
+// units, so it projects to pixels like any other length.
+struct MeshLodLevel
+{
+	uint32_t index_offset;
+	uint32_t index_count;
+	float error;
+};
+
+struct MeshLodSettings
+{
+	// Most levels per shape, including the full-resolution one
+	uint32_t max_levels = 8;
+	// Each level aims at this fraction of the previous level's triangles
+	float reduction = 0.5f;
+	// Collapses stop above this error, relative to the shape's bounding box diagonal
+	float max_relative_error = 0.05f;
+	// Shapes with fewer triangles are not simplified
+	uint32_t min_triangles = 32;
+};
+
+struct MeshLodStats
+{
+	uint64_t source_triangles;
+	// Triangles over all generated levels, the full-resolution ones excluded
+	uint64_t lod_triangles;
+	uint32_t level_count;
+	uint64_t collapses;
+	// Collapses refused because they would flip a triangle
+	uint64_t flip_rejects;
+};
+
+// LOD chains of all shapes of a mesh. Every level indexes the mesh's vertex buffer; the indices of the
+// generated levels go after the mesh's own, so index_offset values address the concatenated index buffer.
+struct MeshLods
+{
+	// Level 0 of each shape is its original range; errors grow along a chain
+	std::vector<MeshLodLevel> levels;
+	// Levels of shape i are levels[first_level[i], first_level[i + 1])
+	std::vector<uint32_t> first_level;
+	std::vector<uint32_t> indices;
+	MeshLodStats stats;
+
+	// Same layout as the mesh's packed indices, 2 or 4 bytes each
+	void PackIndices(uint32_t index_size, void *destination) const;
+};
+
+// Quadric error metric edge collapse (Garland and Heckbert). Vertices only collapse onto neighbouring
+// vertices, so no new vertices are made and the levels share one vertex buffer. Vertices flagged in locked
+// (per vertex, may be null) and on non-manifold edges never move; open borders only collapse along themselves.
+// Returns the number of indices written to destination, which must hold index_count entries.
+size_t SimplifyMesh(const MeshVertex *vertices, const uint32_t *indices, size_t index_count,
+	const uint8_t *locked, size_t target_index_count, float max_error, uint32_t *destination, float &result_error,
+	MeshLodStats &stats);
+
+// Builds a chain per shape, each level simplified from the previous one. Vertices on material boundaries (another
+// vertex has the same position) and vertices that several shapes use are locked, so shapes do not crack apart.
+void BuildMeshLods(const MeshView &mesh, const MeshLodSettings &settings, MeshLods &lods);
@@ -0,0 +1,53 @@
+// Before any include of tiny_obj_loader.h, so this translation unit gets the implementation
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "obj_mesh.h"
+#include "obj_parallel.h"
+
+bool LoadObjMesh(const std::string &path, Mesh &mesh, MeshStats &stats, std::string &warn, std::string &err)
+{
+	std::string baseDir = path.substr(0, path.find_last_of("\\/") + 1);
+
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+
+	if (!LoadObjParallel(&attrib, &shapes, &materials, &warn, &err, path.c_str(), baseDir.c_str())) {
+		return false;
+	}
+
+	BuildObjMesh(attrib, shapes, materials, mesh, stats);
+	return true;
+}
+
+void BuildObjMesh(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+	const std::vector<tinyobj::material_t> &materials, Mesh &mesh, MeshStats &stats)
+{
+	MeshBuilder builder;
+	for (const tinyobj::material_t &material : materials) {
+		builder.AddMaterial(material.name, material.diffuse);
+	}
+
+	std::vector<float> positions;
+	for (const tinyobj::shape_t &shape : shapes) {
+		builder.BeginShape(shape.name);
+
+		size_t index_offset = 0;
+		for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++) {
+			size_t fv = shape.mesh.num_face_vertices[f];
+
+			positions.clear();
+			for (size_t v = 0; v < fv; v++) {
+				tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
+				positions.push_back(attrib.vertices[3 * idx.vertex_index + 0]);
+				positions.push_back(attrib.vertices[3 * idx.vertex_index + 1]);
+				positions.push_back(attrib.vertices[3 * idx.vertex_index + 2]);
+			}
+			builder.AddPolygon(positions.data(), fv, shape.mesh.material_ids[f]);
+
+			index_offset += fv;
+		}
+	}
+
+	mesh = builder.Build();
+	stats = builder.GetStats();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "mesh_builder.h"
+#include "tiny_obj_loader.h"
+
+// Loads an OBJ (+MTL next to it) with the parallel parser and welds it into an indexed mesh
+bool LoadObjMesh(const std::string &path, Mesh &mesh, MeshStats &stats, std::string &warn, std::string &err);
+
+// Welds already parsed OBJ data into an indexed mesh; LoadObjMesh is parsing plus this step
+void BuildObjMesh(const tinyobj::attrib_t &attrib, const std::vector<tinyobj::shape_t> &shapes,
+	const std::vector<tinyobj::material_t> &materials, Mesh &mesh, MeshStats &stats);
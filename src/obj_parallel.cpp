@@ -0,0 +1,589 @@
+#include "obj_parallel.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <thread>
+
+namespace
+{
+	const size_t min_chunk_size = 256 * 1024;
+	const unsigned inherited_smoothing = UINT32_MAX;
+
+	// Face corner as written in the file; relative (negative) indices are resolved against the chunk start
+	// and get the global element count of all previous chunks added during the merge.
+	struct ObjCorner
+	{
+		int vertex;
+		int texcoord;
+		int normal;
+		uint8_t relative;
+	};
+
+	enum RelativeBits : uint8_t
+	{
+		relative_vertex = 1,
+		relative_texcoord = 2,
+		relative_normal = 4
+	};
+
+	struct ObjGroupEvent
+	{
+		size_t face;
+		std::string name;
+	};
+
+	// Per-thread arena: everything one chunk of lines produced
+	struct ObjChunk
+	{
+		std::vector<float> positions;
+		std::vector<float> colors;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+
+		std::vector<ObjCorner> corners;
+		// -1: material set before this chunk, otherwise index into material_names
+		std::vector<int> face_materials;
+		std::vector<unsigned> face_smoothing;
+
+		std::vector<std::string> material_names;
+		std::vector<ObjGroupEvent> groups;
+		std::vector<std::vector<std::string>> material_libraries;
+
+		int last_material = -1;
+		unsigned last_smoothing = inherited_smoothing;
+		// A face wrote a 0 index, which OBJ does not allow
+		bool zero_index = false;
+
+		// Filled in by the merge
+		size_t vertex_base = 0, normal_base = 0, texcoord_base = 0, face_base = 0;
+		std::vector<int> material_ids;
+		int inherited_material = -1;
+		unsigned inherited_smoothing_id = 0;
+	};
+
+	struct ShapeRange
+	{
+		std::string name;
+		size_t first_face;
+		size_t end_face;
+	};
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char *SkipSpace(const char *p, const char *end)
+	{
+		while (p < end && IsSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	inline const char *SkipToken(const char *p, const char *end)
+	{
+		while (p < end && !IsSpace(*p)) {
+			p++;
+		}
+		return p;
+	}
+
+	bool ParseReal(const char *&p, const char *end, float &value)
+	{
+		static const double powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		p = SkipSpace(p, end);
+		const char *start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		uint64_t mantissa = 0;
+		int significant = 0;
+		int exponent = 0;
+		bool anyDigit = false;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (significant < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+				significant += mantissa != 0;
+			} else {
+				exponent++;
+			}
+			anyDigit = true;
+			p++;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && *p >= '0' && *p <= '9') {
+				if (significant < 19) {
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+					significant += mantissa != 0;
+					exponent--;
+				}
+				anyDigit = true;
+				p++;
+			}
+		}
+		if (!anyDigit) {
+			p = start;
+			return false;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char *e = p + 1;
+			bool negativeExponent = false;
+			if (e < end && (*e == '+' || *e == '-')) {
+				negativeExponent = *e == '-';
+				e++;
+			}
+			if (e < end && *e >= '0' && *e <= '9') {
+				int written = 0;
+				while (e < end && *e >= '0' && *e <= '9') {
+					written = std::min(written * 10 + (*e - '0'), 100000);
+					e++;
+				}
+				exponent += negativeExponent ? -written : written;
+				p = e;
+			}
+		}
+
+		double result;
+		if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+			// Both operands are exact, so this is a single correctly rounded operation
+			result = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+		} else {
+			result = strtod(std::string(start, p).c_str(), nullptr);
+			negative = false;
+		}
+
+		value = static_cast<float>(negative ? -result : result);
+		return true;
+	}
+
+	bool ParseInt(const char *&p, const char *end, int &value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '+' || *p == '-')) {
+			negative = *p == '-';
+			p++;
+		}
+
+		if (p >= end || *p < '0' || *p > '9') {
+			return false;
+		}
+
+		int result = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			result = result * 10 + (*p - '0');
+			p++;
+		}
+		value = negative ? -result : result;
+		return true;
+	}
+
+	// OBJ indices are 1-based; negative ones count back from the last element seen so far
+	int FixIndex(int index, size_t local_count, uint8_t bit, uint8_t &relative)
+	{
+		if (index > 0) {
+			return index - 1;
+		}
+		if (index < 0) {
+			relative |= bit;
+			return static_cast<int>(local_count) + index;
+		}
+		return -1;
+	}
+
+	std::string RestOfLine(const char *p, const char *end)
+	{
+		p = SkipSpace(p, end);
+		const char *last = end;
+		while (last > p && IsSpace(last[-1])) {
+			last--;
+		}
+		return std::string(p, last);
+	}
+
+	void ParseChunk(const char *begin, const char *end, ObjChunk &chunk)
+	{
+		// Rough guess from typical OBJ line lengths so the arrays rarely reallocate
+		const size_t lineGuess = static_cast<size_t>(end - begin) / 32;
+		chunk.positions.reserve(lineGuess);
+		chunk.corners.reserve(lineGuess);
+
+		std::vector<ObjCorner> polygon;
+		int currentMaterial = -1;
+		unsigned currentSmoothing = inherited_smoothing;
+
+		const char *line = begin;
+		while (line < end) {
+			const char *lineEnd = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+			if (lineEnd == nullptr) {
+				lineEnd = end;
+			}
+
+			const char *p = SkipSpace(line, lineEnd);
+			const char *keywordEnd = SkipToken(p, lineEnd);
+			const size_t keywordLength = static_cast<size_t>(keywordEnd - p);
+
+			if (keywordLength == 1 && p[0] == 'v') {
+				float x = 0.0f, y = 0.0f, z = 0.0f;
+				ParseReal(keywordEnd, lineEnd, x);
+				ParseReal(keywordEnd, lineEnd, y);
+				ParseReal(keywordEnd, lineEnd, z);
+				chunk.positions.push_back(x);
+				chunk.positions.push_back(y);
+				chunk.positions.push_back(z);
+
+				float r = 1.0f, g = 1.0f, b = 1.0f;
+				if (!ParseReal(keywordEnd, lineEnd, r) || !ParseReal(keywordEnd, lineEnd, g) || !ParseReal(keywordEnd, lineEnd, b)) {
+					r = g = b = 1.0f;
+				}
+				chunk.colors.push_back(r);
+				chunk.colors.push_back(g);
+				chunk.colors.push_back(b);
+			} else if (keywordLength == 2 && p[0] == 'v' && p[1] == 'n') {
+				float x = 0.0f, y = 0.0f, z = 0.0f;
+				ParseReal(keywordEnd, lineEnd, x);
+				ParseReal(keywordEnd, lineEnd, y);
+				ParseReal(keywordEnd, lineEnd, z);
+				chunk.normals.push_back(x);
+				chunk.normals.push_back(y);
+				chunk.normals.push_back(z);
+			} else if (keywordLength == 2 && p[0] == 'v' && p[1] == 't') {
+				float u = 0.0f, v = 0.0f;
+				ParseReal(keywordEnd, lineEnd, u);
+				ParseReal(keywordEnd, lineEnd, v);
+				chunk.texcoords.push_back(u);
+				chunk.texcoords.push_back(v);
+			} else if (keywordLength == 1 && p[0] == 'f') {
+				polygon.clear();
+				const char *token = SkipSpace(keywordEnd, lineEnd);
+				while (token < lineEnd) {
+					int v = 0, vt = 0, vn = 0;
+					if (!ParseInt(token, lineEnd, v)) {
+						break;
+					}
+					bool zero = v == 0;
+					if (token < lineEnd && *token == '/') {
+						token++;
+						if (token < lineEnd && *token == '/') {
+							token++;
+							zero |= ParseInt(token, lineEnd, vn) && vn == 0;
+						} else {
+							zero |= ParseInt(token, lineEnd, vt) && vt == 0;
+							if (token < lineEnd && *token == '/') {
+								token++;
+								zero |= ParseInt(token, lineEnd, vn) && vn == 0;
+							}
+						}
+					}
+					chunk.zero_index |= zero;
+
+					ObjCorner corner = {};
+					corner.vertex = FixIndex(v, chunk.positions.size() / 3, relative_vertex, corner.relative);
+					corner.texcoord = FixIndex(vt, chunk.texcoords.size() / 2, relative_texcoord, corner.relative);
+					corner.normal = FixIndex(vn, chunk.normals.size() / 3, relative_normal, corner.relative);
+					polygon.push_back(corner);
+
+					token = SkipSpace(SkipToken(token, lineEnd), lineEnd);
+				}
+
+				// Triangle fan, same as tinyobj with triangulate = true
+				for (size_t k = 1; k + 1 < polygon.size(); k++) {
+					chunk.corners.push_back(polygon[0]);
+					chunk.corners.push_back(polygon[k]);
+					chunk.corners.push_back(polygon[k + 1]);
+					chunk.face_materials.push_back(currentMaterial);
+					chunk.face_smoothing.push_back(currentSmoothing);
+				}
+			} else if (keywordLength == 6 && memcmp(p, "usemtl", 6) == 0) {
+				const char *name = SkipSpace(keywordEnd, lineEnd);
+				std::string materialName(name, SkipToken(name, lineEnd));
+				auto found = std::find(chunk.material_names.begin(), chunk.material_names.end(), materialName);
+				currentMaterial = static_cast<int>(found - chunk.material_names.begin());
+				if (found == chunk.material_names.end()) {
+					chunk.material_names.push_back(materialName);
+				}
+			} else if (keywordLength == 6 && memcmp(p, "mtllib", 6) == 0) {
+				std::vector<std::string> libraries;
+				const char *name = SkipSpace(keywordEnd, lineEnd);
+				while (name < lineEnd) {
+					const char *nameEnd = SkipToken(name, lineEnd);
+					libraries.emplace_back(name, nameEnd);
+					name = SkipSpace(nameEnd, lineEnd);
+				}
+				chunk.material_libraries.push_back(libraries);
+			} else if (keywordLength == 1 && p[0] == 'g') {
+				// Multiple group names are joined with a space, as tinyobj does
+				std::string name;
+				const char *token = SkipSpace(keywordEnd, lineEnd);
+				while (token < lineEnd) {
+					const char *tokenEnd = SkipToken(token, lineEnd);
+					if (!name.empty()) {
+						name += ' ';
+					}
+					name.append(token, tokenEnd);
+					token = SkipSpace(tokenEnd, lineEnd);
+				}
+				chunk.groups.push_back({chunk.face_materials.size(), name});
+			} else if (keywordLength == 1 && p[0] == 'o') {
+				chunk.groups.push_back({chunk.face_materials.size(), RestOfLine(keywordEnd, lineEnd)});
+			} else if (keywordLength == 1 && p[0] == 's') {
+				const char *token = SkipSpace(keywordEnd, lineEnd);
+				int group = 0;
+				if (static_cast<size_t>(lineEnd - token) >= 3 && memcmp(token, "off", 3) == 0) {
+					currentSmoothing = 0;
+				} else if (ParseInt(token, lineEnd, group)) {
+					currentSmoothing = group < 0 ? 0 : static_cast<unsigned>(group);
+				}
+			}
+
+			line = lineEnd + 1;
+		}
+
+		chunk.last_material = currentMaterial;
+		chunk.last_smoothing = currentSmoothing;
+	}
+
+	template <typename Function>
+	void RunParallel(size_t task_count, unsigned thread_count, Function function)
+	{
+		std::atomic<size_t> next(0);
+		auto worker = [&]() {
+			for (size_t task = next++; task < task_count; task = next++) {
+				function(task);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned i = 1; i < std::min<size_t>(thread_count, task_count); i++) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+	}
+
+	int ResolveIndex(int index, uint8_t relative, uint8_t bit, size_t base)
+	{
+		return (relative & bit) ? index + static_cast<int>(base) : index;
+	}
+
+	// -1 is only valid for an element that was not written at all
+	bool IsIndexInRange(int index, uint8_t relative, uint8_t bit, size_t count, bool optional)
+	{
+		const int lowest = optional && !(relative & bit) ? -1 : 0;
+		return index >= lowest && index < static_cast<int64_t>(count);
+	}
+}
+
+bool LoadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+	std::vector<tinyobj::material_t> *materials, std::string *warn, std::string *err,
+	const char *filename, const char *mtl_basedir, unsigned thread_count)
+{
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	shapes->clear();
+
+	MappedFile file;
+	if (!file.Open(filename)) {
+		if (err) {
+			(*err) += "Cannot open file [" + std::string(filename) + "]\n";
+		}
+		return false;
+	}
+
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	// Split into line-aligned chunks, a few per thread to balance uneven lines
+	const char *data = reinterpret_cast<const char *>(file.GetData());
+	const size_t size = file.GetSize();
+	const size_t chunkTarget = std::max(min_chunk_size, size / (thread_count * 4) + 1);
+
+	std::vector<std::pair<const char *, const char *>> ranges;
+	for (size_t start = 0; start < size;) {
+		size_t stop = std::min(size, start + chunkTarget);
+		const void *newline = stop < size ? memchr(data + stop, '\n', size - stop) : nullptr;
+		stop = newline ? static_cast<size_t>(static_cast<const char *>(newline) - data) + 1 : size;
+		ranges.emplace_back(data + start, data + stop);
+		start = stop;
+	}
+
+	std::vector<ObjChunk> chunks(ranges.size());
+	RunParallel(chunks.size(), thread_count, [&](size_t i) {
+		ParseChunk(ranges[i].first, ranges[i].second, chunks[i]);
+	});
+
+	for (const ObjChunk &chunk : chunks) {
+		if (chunk.zero_index) {
+			if (err) {
+				(*err) += "Zero face index in [" + std::string(filename) + "]\n";
+			}
+			return false;
+		}
+	}
+
+	// Material libraries in file order
+	std::map<std::string, int> materialMap;
+	std::string baseDir = mtl_basedir ? mtl_basedir : "";
+	for (const ObjChunk &chunk : chunks) {
+		for (const std::vector<std::string> &libraries : chunk.material_libraries) {
+			bool found = false;
+			for (const std::string &library : libraries) {
+				std::ifstream stream(baseDir + library);
+				if (stream) {
+					std::string mtlWarn, mtlErr;
+					tinyobj::LoadMtl(&materialMap, materials, &stream, &mtlWarn, &mtlErr);
+					if (warn) {
+						(*warn) += mtlWarn;
+					}
+					if (err) {
+						(*err) += mtlErr;
+					}
+					found = true;
+					break;
+				}
+			}
+			if (!found && warn) {
+				(*warn) += "Failed to load material file(s). Use default material.\n";
+			}
+		}
+	}
+
+	// Element bases, carried-over material/smoothing state and shape boundaries
+	size_t vertexCount = 0, normalCount = 0, texcoordCount = 0, faceCount = 0;
+	int material = -1;
+	unsigned smoothing = 0;
+	std::vector<ShapeRange> shapeRanges;
+	ShapeRange current = {std::string(), 0, 0};
+
+	for (ObjChunk &chunk : chunks) {
+		chunk.vertex_base = vertexCount;
+		chunk.normal_base = normalCount;
+		chunk.texcoord_base = texcoordCount;
+		chunk.face_base = faceCount;
+		chunk.inherited_material = material;
+		chunk.inherited_smoothing_id = smoothing;
+
+		for (const std::string &name : chunk.material_names) {
+			auto found = materialMap.find(name);
+			chunk.material_ids.push_back(found != materialMap.end() ? found->second : -1);
+			if (found == materialMap.end() && warn) {
+				(*warn) += "material [ '" + name + "' ] not found in .mtl\n";
+			}
+		}
+
+		for (const ObjGroupEvent &group : chunk.groups) {
+			size_t face = chunk.face_base + group.face;
+			if (face > current.first_face) {
+				current.end_face = face;
+				shapeRanges.push_back(current);
+			}
+			current.name = group.name;
+			current.first_face = face;
+		}
+
+		vertexCount += chunk.positions.size() / 3;
+		normalCount += chunk.normals.size() / 3;
+		texcoordCount += chunk.texcoords.size() / 2;
+		faceCount += chunk.face_materials.size();
+		if (chunk.last_material >= 0) {
+			material = chunk.material_ids[chunk.last_material];
+		}
+		if (chunk.last_smoothing != inherited_smoothing) {
+			smoothing = chunk.last_smoothing;
+		}
+	}
+	if (faceCount > current.first_face) {
+		current.end_face = faceCount;
+		shapeRanges.push_back(current);
+	}
+
+	attrib->vertices.resize(vertexCount * 3);
+	attrib->colors.resize(vertexCount * 3);
+	attrib->normals.resize(normalCount * 3);
+	attrib->texcoords.resize(texcoordCount * 2);
+
+	shapes->resize(shapeRanges.size());
+	for (size_t s = 0; s < shapeRanges.size(); s++) {
+		tinyobj::shape_t &shape = (*shapes)[s];
+		const size_t faces = shapeRanges[s].end_face - shapeRanges[s].first_face;
+		shape.name = shapeRanges[s].name;
+		shape.mesh.indices.resize(faces * 3);
+		shape.mesh.num_face_vertices.assign(faces, 3);
+		shape.mesh.material_ids.resize(faces);
+		shape.mesh.smoothing_group_ids.resize(faces);
+	}
+
+	// Every chunk scatters its data into the final arrays in parallel and checks its indices against the totals
+	std::vector<uint8_t> outOfRange(chunks.size(), 0);
+	RunParallel(chunks.size(), thread_count, [&](size_t i) {
+		const ObjChunk &chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), attrib->vertices.begin() + chunk.vertex_base * 3);
+		std::copy(chunk.colors.begin(), chunk.colors.end(), attrib->colors.begin() + chunk.vertex_base * 3);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), attrib->normals.begin() + chunk.normal_base * 3);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib->texcoords.begin() + chunk.texcoord_base * 2);
+
+		const size_t chunkFaces = chunk.face_materials.size();
+		if (chunkFaces == 0) {
+			return;
+		}
+
+		size_t s = std::upper_bound(shapeRanges.begin(), shapeRanges.end(), chunk.face_base,
+			[](size_t face, const ShapeRange &range) { return face < range.end_face; }) - shapeRanges.begin();
+
+		for (size_t f = 0; f < chunkFaces; f++) {
+			const size_t face = chunk.face_base + f;
+			while (face >= shapeRanges[s].end_face) {
+				s++;
+			}
+
+			tinyobj::mesh_t &mesh = (*shapes)[s].mesh;
+			const size_t local = face - shapeRanges[s].first_face;
+			for (size_t k = 0; k < 3; k++) {
+				const ObjCorner &corner = chunk.corners[3 * f + k];
+				tinyobj::index_t &index = mesh.indices[3 * local + k];
+				index.vertex_index = ResolveIndex(corner.vertex, corner.relative, relative_vertex, chunk.vertex_base);
+				index.texcoord_index = ResolveIndex(corner.texcoord, corner.relative, relative_texcoord, chunk.texcoord_base);
+				index.normal_index = ResolveIndex(corner.normal, corner.relative, relative_normal, chunk.normal_base);
+				outOfRange[i] |= !IsIndexInRange(index.vertex_index, corner.relative, relative_vertex, vertexCount, false) ||
+					!IsIndexInRange(index.texcoord_index, corner.relative, relative_texcoord, texcoordCount, true) ||
+					!IsIndexInRange(index.normal_index, corner.relative, relative_normal, normalCount, true);
+			}
+
+			const int materialRef = chunk.face_materials[f];
+			mesh.material_ids[local] = materialRef < 0 ? chunk.inherited_material : chunk.material_ids[materialRef];
+			const unsigned smoothingRef = chunk.face_smoothing[f];
+			mesh.smoothing_group_ids[local] = smoothingRef == inherited_smoothing ? chunk.inherited_smoothing_id : smoothingRef;
+		}
+	});
+
+	if (std::find(outOfRange.begin(), outOfRange.end(), 1) != outOfRange.end()) {
+		if (err) {
+			(*err) += "Face index out of range in [" + std::string(filename) + "]\n";
+		}
+		shapes->clear();
+		return false;
+	}
+
+	return true;
+}
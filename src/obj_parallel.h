@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+
+// Drop-in replacement for tinyobj::LoadObj(..., triangulate = true) that parses the OBJ on several threads.
+// The file is split into line-aligned chunks, each chunk is parsed into its own arrays, and the chunks are
+// merged into the usual attrib/shape/material structures. MTL files are still read with tinyobj::LoadMtl.
+// thread_count == 0 uses every hardware thread.
+bool LoadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+	std::vector<tinyobj::material_t> *materials, std::string *warn, std::string *err,
+	const char *filename, const char *mtl_basedir = nullptr, unsigned thread_count = 0);
@@ -0,0 +1,352 @@
+#include "occlusion_cull.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifdef OCCLUSION_CULL_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// a * (x - x0) + b * (y - y0) >= 0 inside. Both triangles of a shared edge build it from the same vertex, one
+	// with a and b negated, so every pixel center gets exactly opposite values from them: no gaps, no cracks.
+	struct Edge
+	{
+		float a, b, x0, y0;
+	};
+
+	template <typename Vertex>
+	Edge MakeEdge(const Vertex &p, const Vertex &q)
+	{
+		if (p.x < q.x || (p.x == q.x && p.y < q.y)) {
+			return {p.y - q.y, q.x - p.x, p.x, p.y};
+		}
+		return {-(q.y - p.y), -(p.x - q.x), q.x, q.y};
+	}
+
+#ifdef OCCLUSION_CULL_SSE
+	float HorizontalMin(__m128 v)
+	{
+		v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(_mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+
+	float HorizontalMax(__m128 v)
+	{
+		v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(_mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2))));
+	}
+#endif
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height, bool use_simd) :
+	use_simd(use_simd), width((std::max(width, 1u) + 3) & ~3u), height(std::max(height, 1u))
+{
+	blocks_x = (this->width + block_size - 1) / block_size;
+	blocks_y = (this->height + block_size - 1) / block_size;
+	depth.resize(static_cast<size_t>(this->width) * this->height);
+	block_depth.resize(static_cast<size_t>(blocks_x) * blocks_y);
+	Clear();
+}
+
+void OcclusionBuffer::Clear()
+{
+	std::fill(depth.begin(), depth.end(), 1.0f);
+	std::fill(block_depth.begin(), block_depth.end(), 1.0f);
+}
+
+uint32_t OcclusionBuffer::RasterizeTriangles(const Float4x4 &view_proj, const MeshVertex *vertices, uint32_t vertex_count,
+	const uint32_t *indices, uint32_t index_count)
+{
+	const float (&m)[4][4] = view_proj.m;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+		ClipVertex v[3];
+		bool valid = true;
+		for (int k = 0; k < 3 && valid; k++) {
+			const uint32_t index = indices[i + k];
+			valid = index < vertex_count;
+			if (valid) {
+				const float *p = vertices[index].position;
+				v[k] = {p[0] * m[0][0] + p[1] * m[1][0] + p[2] * m[2][0] + m[3][0], p[0] * m[0][1] + p[1] * m[1][1] + p[2] * m[2][1] + m[3][1],
+					p[0] * m[0][2] + p[1] * m[1][2] + p[2] * m[2][2] + m[3][2], p[0] * m[0][3] + p[1] * m[1][3] + p[2] * m[2][3] + m[3][3]};
+			}
+		}
+		if (valid && RasterizeClipped(v)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+OcclusionBuffer::ScreenVertex OcclusionBuffer::ToScreen(const ClipVertex &v) const
+{
+	const float invW = 1.0f / v.w;
+	return {(v.x * invW * 0.5f + 0.5f) * width, (0.5f - v.y * invW * 0.5f) * height, v.z * invW};
+}
+
+bool OcclusionBuffer::RasterizeClipped(const ClipVertex *v)
+{
+	// Entirely outside one of the planes
+	if ((v[0].x < -v[0].w && v[1].x < -v[1].w && v[2].x < -v[2].w) || (v[0].x > v[0].w && v[1].x > v[1].w && v[2].x > v[2].w) ||
+		(v[0].y < -v[0].w && v[1].y < -v[1].w && v[2].y < -v[2].w) || (v[0].y > v[0].w && v[1].y > v[1].w && v[2].y > v[2].w) ||
+		(v[0].z < 0.0f && v[1].z < 0.0f && v[2].z < 0.0f) || (v[0].z > v[0].w && v[1].z > v[1].w && v[2].z > v[2].w)) {
+		return false;
+	}
+
+	// Near plane clipping leaves a triangle or a quad, in front of the eye
+	ScreenVertex polygon[4];
+	int count = 0;
+	for (int k = 0; k < 3; k++) {
+		const ClipVertex &a = v[k];
+		const ClipVertex &b = v[(k + 1) % 3];
+		if (a.z >= 0.0f) {
+			polygon[count++] = ToScreen(a);
+		}
+		if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+			const float t = a.z / (a.z - b.z);
+			polygon[count++] = ToScreen({a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.0f, a.w + (b.w - a.w) * t});
+		}
+	}
+
+	bool drawn = RasterizeTriangle(polygon[0], polygon[1], polygon[2]);
+	if (count == 4) {
+		drawn |= RasterizeTriangle(polygon[0], polygon[2], polygon[3]);
+	}
+	return drawn;
+}
+
+bool OcclusionBuffer::RasterizeTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2)
+{
+	// y grows downwards; order the vertices so the inside of every edge is positive
+	const ScreenVertex *a = &v0;
+	const ScreenVertex *b = &v1;
+	const ScreenVertex *c = &v2;
+	float area = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+	if (area < 0.0f) {
+		std::swap(b, c);
+		area = -area;
+	}
+	if (!(area > 0.0f)) {
+		return false;
+	}
+
+	// Pixels whose centers lie in the bounding box
+	const float minX = std::max(ceilf(std::min(a->x, std::min(b->x, c->x)) - 0.5f), 0.0f);
+	const float maxX = std::min(floorf(std::max(a->x, std::max(b->x, c->x)) - 0.5f), static_cast<float>(width - 1));
+	const float minY = std::max(ceilf(std::min(a->y, std::min(b->y, c->y)) - 0.5f), 0.0f);
+	const float maxY = std::min(floorf(std::max(a->y, std::max(b->y, c->y)) - 0.5f), static_cast<float>(height - 1));
+	if (!(minX <= maxX && minY <= maxY)) {
+		return false;
+	}
+
+	const Edge edges[3] = {MakeEdge(*a, *b), MakeEdge(*b, *c), MakeEdge(*c, *a)};
+	// Depth is a plane in screen space. Moving half a pixel from the center changes it by at most half of each
+	// slope, so adding that keeps the farthest depth within the pixel, but never beyond the farthest vertex.
+	const float dzdx = ((b->z - a->z) * (c->y - a->y) - (c->z - a->z) * (b->y - a->y)) / area;
+	const float dzdy = ((c->z - a->z) * (b->x - a->x) - (b->z - a->z) * (c->x - a->x)) / area;
+	const float zOffset = 0.5f * (fabsf(dzdx) + fabsf(dzdy));
+	const float zMax = std::max(a->z, std::max(b->z, c->z));
+
+	// Whole quads of four pixels; the width is a multiple of 4, so they never leave the row. Edges are evaluated
+	// at each pixel rather than stepped, which would round differently for the two triangles of an edge.
+	const uint32_t firstX = static_cast<uint32_t>(minX) & ~3u;
+	const uint32_t lastX = static_cast<uint32_t>(maxX);
+	for (uint32_t y = static_cast<uint32_t>(minY); y <= static_cast<uint32_t>(maxY); y++) {
+		const float centerY = static_cast<float>(y) + 0.5f;
+		const float row0 = edges[0].b * (centerY - edges[0].y0);
+		const float row1 = edges[1].b * (centerY - edges[1].y0);
+		const float row2 = edges[2].b * (centerY - edges[2].y0);
+		const float rowZ = a->z + dzdy * (centerY - a->y) + zOffset;
+		float *row = &depth[static_cast<size_t>(y) * width];
+
+#ifdef OCCLUSION_CULL_SSE
+		if (use_simd) {
+			const __m128 centers = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 zLimit = _mm_set1_ps(zMax);
+			for (uint32_t x = firstX; x <= lastX; x += 4) {
+				const __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), centers);
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[0].a), _mm_sub_ps(centerX, _mm_set1_ps(edges[0].x0))), _mm_set1_ps(row0));
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[1].a), _mm_sub_ps(centerX, _mm_set1_ps(edges[1].x0))), _mm_set1_ps(row1));
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edges[2].a), _mm_sub_ps(centerX, _mm_set1_ps(edges[2].x0))), _mm_set1_ps(row2));
+				const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(inside) == 0) {
+					continue;
+				}
+				const __m128 z = _mm_add_ps(_mm_set1_ps(rowZ), _mm_mul_ps(_mm_set1_ps(dzdx), _mm_sub_ps(centerX, _mm_set1_ps(a->x))));
+				const __m128 old = _mm_loadu_ps(row + x);
+				const __m128 nearer = _mm_min_ps(old, _mm_min_ps(z, zLimit));
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+			continue;
+		}
+#endif
+		// Same operations in the same order as the SSE kernel
+		for (uint32_t x = firstX; x <= (lastX | 3u); x++) {
+			const float centerX = static_cast<float>(x) + 0.5f;
+			const float e0 = edges[0].a * (centerX - edges[0].x0) + row0;
+			const float e1 = edges[1].a * (centerX - edges[1].x0) + row1;
+			const float e2 = edges[2].a * (centerX - edges[2].x0) + row2;
+			if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f) {
+				const float z = rowZ + dzdx * (centerX - a->x);
+				row[x] = std::min(row[x], std::min(z, zMax));
+			}
+		}
+	}
+	return true;
+}
+
+void OcclusionBuffer::Finish()
+{
+	for (uint32_t by = 0; by < blocks_y; by++) {
+		for (uint32_t bx = 0; bx < blocks_x; bx++) {
+			const uint32_t endX = std::min((bx + 1) * block_size, width);
+			const uint32_t endY = std::min((by + 1) * block_size, height);
+			float farthest = 0.0f;
+			for (uint32_t y = by * block_size; y < endY; y++) {
+				const float *row = &depth[static_cast<size_t>(y) * width];
+				for (uint32_t x = bx * block_size; x < endX; x++) {
+					farthest = std::max(farthest, row[x]);
+				}
+			}
+			block_depth[by * blocks_x + bx] = farthest;
+		}
+	}
+}
+
+bool OcclusionBuffer::ProjectBox(const Float4x4 &view_proj, const float *bounds_min, const float *bounds_max, float &min_x,
+	float &min_y, float &max_x, float &max_y, float &nearest) const
+{
+	const float (&m)[4][4] = view_proj.m;
+#ifdef OCCLUSION_CULL_SSE
+	if (use_simd) {
+		// Corners 0-3 and 4-7 differ only in z, so each half fills one register; same operations as the scalar loop
+		const __m128 x = _mm_set_ps(bounds_max[0], bounds_min[0], bounds_max[0], bounds_min[0]);
+		const __m128 y = _mm_set_ps(bounds_max[1], bounds_max[1], bounds_min[1], bounds_min[1]);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 half = _mm_set1_ps(0.5f);
+		__m128 minX = _mm_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+		__m128 maxX = _mm_set1_ps(-FLT_MAX), maxY = maxX;
+		for (const float z : {bounds_min[2], bounds_max[2]}) {
+			const __m128 zs = _mm_set1_ps(z);
+			__m128 clip[4];
+			for (int j = 0; j < 4; j++) {
+				clip[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[0][j])), _mm_mul_ps(y, _mm_set1_ps(m[1][j]))),
+					_mm_mul_ps(zs, _mm_set1_ps(m[2][j]))), _mm_set1_ps(m[3][j]));
+			}
+			if (_mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(clip[2], zero), _mm_cmpgt_ps(clip[3], zero))) != 0xF) {
+				return false;
+			}
+			const __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), clip[3]);
+			const __m128 sx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(clip[0], invW), half), half), _mm_set1_ps(static_cast<float>(width)));
+			const __m128 sy = _mm_mul_ps(_mm_sub_ps(half, _mm_mul_ps(_mm_mul_ps(clip[1], invW), half)), _mm_set1_ps(static_cast<float>(height)));
+			minX = _mm_min_ps(minX, sx);
+			maxX = _mm_max_ps(maxX, sx);
+			minY = _mm_min_ps(minY, sy);
+			maxY = _mm_max_ps(maxY, sy);
+			minZ = _mm_min_ps(minZ, _mm_mul_ps(clip[2], invW));
+		}
+		min_x = HorizontalMin(minX);
+		min_y = HorizontalMin(minY);
+		max_x = HorizontalMax(maxX);
+		max_y = HorizontalMax(maxY);
+		nearest = HorizontalMin(minZ);
+		return true;
+	}
+#endif
+	min_x = FLT_MAX;
+	min_y = FLT_MAX;
+	max_x = -FLT_MAX;
+	max_y = -FLT_MAX;
+	nearest = FLT_MAX;
+	for (int corner = 0; corner < 8; corner++) {
+		const float x = corner & 1 ? bounds_max[0] : bounds_min[0];
+		const float y = corner & 2 ? bounds_max[1] : bounds_min[1];
+		const float z = corner & 4 ? bounds_max[2] : bounds_min[2];
+		const float cw = x * m[0][3] + y * m[1][3] + z * m[2][3] + m[3][3];
+		const float cz = x * m[0][2] + y * m[1][2] + z * m[2][2] + m[3][2];
+		// Reaching the near plane: the box may cover any part of the screen
+		if (!(cz > 0.0f && cw > 0.0f)) {
+			return false;
+		}
+		const ScreenVertex s = ToScreen({x * m[0][0] + y * m[1][0] + z * m[2][0] + m[3][0], x * m[0][1] + y * m[1][1] + z * m[2][1] + m[3][1], cz, cw});
+		min_x = std::min(min_x, s.x);
+		max_x = std::max(max_x, s.x);
+		min_y = std::min(min_y, s.y);
+		max_y = std::max(max_y, s.y);
+		nearest = std::min(nearest, s.z);
+	}
+	return true;
+}
+
+bool OcclusionBuffer::IsOccluded(const Float4x4 &view_proj, const float *bounds_min, const float *bounds_max) const
+{
+	float minX, minY, maxX, maxY, nearest;
+	if (!ProjectBox(view_proj, bounds_min, bounds_max, minX, minY, maxX, maxY, nearest)) {
+		return false;
+	}
+
+	// Pixels the rectangle touches and one more around them, clamped to the buffer
+	const float left = std::max(floorf(minX) - 1.0f, 0.0f);
+	const float right = std::min(floorf(maxX) + 1.0f, static_cast<float>(width - 1));
+	const float top = std::max(floorf(minY) - 1.0f, 0.0f);
+	const float bottom = std::min(floorf(maxY) + 1.0f, static_cast<float>(height - 1));
+	if (!(left <= right && top <= bottom)) {
+		return false;
+	}
+	const uint32_t x0 = static_cast<uint32_t>(left), x1 = static_cast<uint32_t>(right);
+	const uint32_t y0 = static_cast<uint32_t>(top), y1 = static_cast<uint32_t>(bottom);
+
+	for (uint32_t by = y0 / block_size; by <= y1 / block_size; by++) {
+		for (uint32_t bx = x0 / block_size; bx <= x1 / block_size; bx++) {
+			if (block_depth[by * blocks_x + bx] < nearest) {
+				continue;
+			}
+			// Something in the block is as far as the box; look at the pixels the rectangle covers
+			const uint32_t firstX = std::max(x0, bx * block_size);
+			const uint32_t lastX = std::min(x1, bx * block_size + block_size - 1);
+			const uint32_t firstY = std::max(y0, by * block_size);
+			const uint32_t lastY = std::min(y1, by * block_size + block_size - 1);
+#ifdef OCCLUSION_CULL_SSE
+			if (use_simd) {
+				const __m128 boxDepth = _mm_set1_ps(nearest);
+				const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+				const __m128 first = _mm_set1_ps(static_cast<float>(firstX));
+				const __m128 last = _mm_set1_ps(static_cast<float>(lastX));
+				for (uint32_t y = firstY; y <= lastY; y++) {
+					const float *row = &depth[static_cast<size_t>(y) * width];
+					for (uint32_t x = firstX & ~3u; x <= lastX; x += 4) {
+						const __m128 column = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes);
+						const __m128 inRange = _mm_and_ps(_mm_cmpge_ps(column, first), _mm_cmple_ps(column, last));
+						if (_mm_movemask_ps(_mm_and_ps(inRange, _mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth))) != 0) {
+							return false;
+						}
+					}
+				}
+				continue;
+			}
+#endif
+			for (uint32_t y = firstY; y <= lastY; y++) {
+				const float *row = &depth[static_cast<size_t>(y) * width];
+				for (uint32_t x = firstX; x <= lastX; x++) {
+					if (row[x] >= nearest) {
+						return false;
+					}
+				}
+			}
+		}
+	}
+	return true;
+}
+
+const char *OcclusionBuffer::GetKernelName() const
+{
+#ifdef OCCLUSION_CULL_SSE
+	if (use_simd)
+		return "SSE";
+#endif
+	return "scalar";
+}
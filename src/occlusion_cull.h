@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_math.h"
+#include "mesh_builder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define OCCLUSION_CULL_SSE 1
+#endif
+
+struct OcclusionSettings
+{
+	// Depth buffer size in pixels; the width is rounded up to a multiple of 4. The defaults are tuned on the
+	// occlusion_cull benchmark's city: past a handful of the largest occluders, each one more costs more time
+	// than the draws it hides save.
+	uint32_t width = 128;
+	uint32_t height = 64;
+	// Occluders are the visible shapes that look largest from the camera, up to these budgets per frame
+	uint32_t max_occluders = 8;
+	uint32_t max_occluder_triangles = 2048;
+	// Shapes whose bounding sphere projects to a radius below this fraction of the viewport height never occlude
+	float min_occluder_size = 0.1f;
+};
+
+struct OcclusionStats
+{
+	uint32_t occluders;
+	uint32_t occluder_triangles;
+	// Visible shapes tested against the occluders, and those found hidden and dropped
+	uint32_t tested;
+	uint32_t culled;
+	double rasterize_ms;
+	double test_ms;
+};
+
+// Coarse CPU depth buffer for occlusion culling. Occluder triangles are rasterized into it at pixel centers,
+// four pixels at a time, each pixel keeping the farthest depth its triangle reaches across the pixel's area;
+// Finish() then takes the farthest depth of each 8x8 block. A box is occluded when its nearest depth lies behind
+// every pixel of its screen rectangle grown by one pixel, so the edge of an occluder that covers a pixel center
+// but not the whole pixel cannot hide it. A gap narrower than a pixel between two occluders can: what shows
+// through such a gap may be culled. The block depths settle most tests without reading pixels.
+class OcclusionBuffer
+{
+public:
+	static const uint32_t block_size = 8;
+
+	// use_simd picks the SSE kernels when the build has them; the scalar ones give the same results
+	OcclusionBuffer(uint32_t width, uint32_t height, bool use_simd = true);
+
+	// Everything at the far plane, nothing occluded
+	void Clear();
+	// Triangles indices[0, index_count) of vertices, transformed by view_proj and clipped at the near plane;
+	// either facing occludes. Triangles indexing past vertex_count are skipped. Returns how many it rasterized.
+	uint32_t RasterizeTriangles(const Float4x4 &view_proj, const MeshVertex *vertices, uint32_t vertex_count,
+		const uint32_t *indices, uint32_t index_count);
+	// After the last RasterizeTriangles of a frame, before the first IsOccluded
+	void Finish();
+	// True when the box certainly lies behind what was rasterized. Boxes crossing the near plane never are.
+	bool IsOccluded(const Float4x4 &view_proj, const float *bounds_min, const float *bounds_max) const;
+
+	uint32_t GetWidth() const { return width; }
+	uint32_t GetHeight() const { return height; }
+	// Row-major, width floats per row; z / w in [0, 1]
+	const std::vector<float> &GetDepth() const { return depth; }
+	// Kernel in use
+	const char *GetKernelName() const;
+
+private:
+	struct ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	struct ScreenVertex
+	{
+		float x, y, z;
+	};
+
+	// Clips at z = 0 and rasterizes the one or two triangles left; false when nothing reached the screen
+	bool RasterizeClipped(const ClipVertex *v);
+	bool RasterizeTriangle(const ScreenVertex &v0, const ScreenVertex &v1, const ScreenVertex &v2);
+	ScreenVertex ToScreen(const ClipVertex &v) const;
+	// Screen rectangle and nearest depth of a box's corners; false when a corner reaches the near plane
+	bool ProjectBox(const Float4x4 &view_proj, const float *bounds_min, const float *bounds_max, float &min_x, float &min_y,
+		float &max_x, float &max_y, float &nearest) const;
+
+	bool use_simd;
+	uint32_t width;
+	uint32_t height;
+	uint32_t blocks_x;
+	uint32_t blocks_y;
+	std::vector<float> depth;
+	// Farthest depth of each block
+	std::vector<float> block_depth;
+};
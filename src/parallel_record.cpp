@@ -0,0 +1,56 @@
+#include "parallel_record.h"
+
+#include <algorithm>
+
+void SplitDrawChunks(size_t batch_count, uint32_t min_batches, uint32_t max_chunks, std::vector<DrawChunk> &chunks)
+{
+	chunks.clear();
+	if (batch_count == 0) {
+		return;
+	}
+
+	const size_t chunkCount = std::max<size_t>(1, std::min<size_t>(max_chunks, batch_count / std::max(1u, min_batches)));
+	// Spread the remainder over the first chunks so sizes differ by at most one
+	const size_t baseSize = batch_count / chunkCount;
+	const size_t remainder = batch_count % chunkCount;
+	size_t first = 0;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const size_t size = baseSize + (i < remainder ? 1 : 0);
+		chunks.push_back({static_cast<uint32_t>(first), static_cast<uint32_t>(size)});
+		first += size;
+	}
+}
+
+void ParallelRecorder::Record(const ScenePipeline &scene, uint64_t constants_address, CommandListBackend &backend, JobSystem &jobs)
+{
+	SplitDrawChunks(scene.GetRenderQueue().GetBatches().size(), min_batches_per_chunk, max_chunks, chunks);
+	backend.BeginChunks(static_cast<uint32_t>(chunks.size()));
+
+	jobs.ParallelFor(chunks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t chunk = begin; chunk < end; chunk++) {
+			CommandSink &sink = backend.OpenChunk(static_cast<uint32_t>(chunk));
+			scene.RecordBatches(sink, constants_address, chunks[chunk].first_batch, chunks[chunk].batch_count);
+			backend.CloseChunk(static_cast<uint32_t>(chunk));
+		}
+	});
+}
+
+void RecordingCommandListBackend::BeginChunks(uint32_t chunk_count)
+{
+	if (chunks.size() < chunk_count) {
+		chunks.resize(chunk_count);
+	}
+	for (uint32_t i = 0; i < chunk_count; i++) {
+		chunks[i].Clear();
+	}
+	this->chunk_count = chunk_count;
+}
+
+void RecordingCommandListBackend::Submit()
+{
+	for (uint32_t i = 0; i < chunk_count; i++) {
+		const std::vector<RecordedCommand> &commands = chunks[i].GetCommands();
+		submitted.insert(submitted.end(), commands.begin(), commands.end());
+	}
+	submit_count++;
+}
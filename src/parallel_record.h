@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "command_sink.h"
+#include "job_system.h"
+#include "scene_pipeline.h"
+
+// Contiguous range of the render queue's batches recorded into one command list
+struct DrawChunk
+{
+	uint32_t first_batch;
+	uint32_t batch_count;
+};
+
+// At most max_chunks chunks of at least min_batches batches. Depends only on the counts, so a frame records
+// the same command lists whatever the number of threads.
+void SplitDrawChunks(size_t batch_count, uint32_t min_batches, uint32_t max_chunks, std::vector<DrawChunk> &chunks);
+
+// Command lists of one frame: a prologue recorded by the caller (barriers, clears), draw chunks recorded on
+// workers, and an epilogue recorded by the caller again. Submit() executes them in that order in one call.
+class CommandListBackend
+{
+public:
+	virtual ~CommandListBackend() {};
+
+	// Render thread
+	virtual void BeginChunks(uint32_t chunk_count) = 0;
+	// Any thread, each chunk by exactly one thread. Lists inherit no state, so the sink starts from scratch.
+	virtual CommandSink &OpenChunk(uint32_t chunk) = 0;
+	virtual void CloseChunk(uint32_t chunk) = 0;
+	// Render thread, after every chunk was closed
+	virtual void Submit() = 0;
+};
+
+// Splits the draws of a frame into chunks and records them in parallel on the job system
+class ParallelRecorder
+{
+public:
+	ParallelRecorder(uint32_t min_batches_per_chunk, uint32_t max_chunks) :
+		min_batches_per_chunk(min_batches_per_chunk), max_chunks(max_chunks) {};
+
+	// Returns after every chunk has been recorded and closed; submitting is up to the caller
+	void Record(const ScenePipeline &scene, uint64_t constants_address, CommandListBackend &backend, JobSystem &jobs);
+
+	const std::vector<DrawChunk> &GetChunks() const { return chunks; }
+
+private:
+	uint32_t min_batches_per_chunk;
+	uint32_t max_chunks;
+	std::vector<DrawChunk> chunks;
+};
+
+// Records chunks into RecordingCommandSinks; Submit() appends them in order to one stream
+class RecordingCommandListBackend : public CommandListBackend
+{
+public:
+	RecordingCommandListBackend() : chunk_count(0), submit_count(0) {};
+
+	void BeginChunks(uint32_t chunk_count) override;
+	CommandSink &OpenChunk(uint32_t chunk) override { return chunks[chunk]; }
+	void CloseChunk(uint32_t) override {};
+	void Submit() override;
+
+	void Clear() { submitted.clear(); }
+	const std::vector<RecordedCommand> &GetSubmitted() const { return submitted; }
+	uint64_t GetSubmitCount() const { return submit_count; }
+
+private:
+	std::vector<RecordingCommandSink> chunks;
+	uint32_t chunk_count;
+	std::vector<RecordedCommand> submitted;
+	uint64_t submit_count;
+};
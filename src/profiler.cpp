@@ -0,0 +1,282 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+
+namespace
+{
+	std::atomic<uint64_t> next_profiler_id(1);
+
+	struct ThreadBufferCache
+	{
+		uint64_t profiler;
+		ProfileThreadBuffer *buffer;
+	};
+
+	thread_local ThreadBufferCache thread_buffer_cache = {0, nullptr};
+
+	double ToMs(uint64_t ns)
+	{
+		return ns * 1e-6;
+	}
+
+	// Sorted durations in ns -> stats in ms
+	void Summarize(std::vector<uint64_t> &durations, double &min_ms, double &avg_ms, double &p99_ms, double &max_ms, double &total_ms)
+	{
+		if (durations.empty()) {
+			min_ms = avg_ms = p99_ms = max_ms = total_ms = 0.0;
+			return;
+		}
+		std::sort(durations.begin(), durations.end());
+		uint64_t total = 0;
+		for (uint64_t duration : durations) {
+			total += duration;
+		}
+		const size_t p99 = (durations.size() * 99 + 99) / 100 - 1;
+		min_ms = ToMs(durations.front());
+		max_ms = ToMs(durations.back());
+		p99_ms = ToMs(durations[std::min(p99, durations.size() - 1)]);
+		total_ms = ToMs(total);
+		avg_ms = total_ms / durations.size();
+	}
+
+	void WriteJsonString(std::ostream &stream, const char *text)
+	{
+		stream << '"';
+		for (const char *c = text; *c; c++) {
+			if (*c == '"' || *c == '\\') {
+				stream << '\\' << *c;
+			} else if (static_cast<unsigned char>(*c) < 0x20) {
+				stream << ' ';
+			} else {
+				stream << *c;
+			}
+		}
+		stream << '"';
+	}
+
+	void WriteCsvField(std::ostream &stream, const std::string &text)
+	{
+		if (text.find_first_of(",\"\n") == std::string::npos) {
+			stream << text;
+			return;
+		}
+		stream << '"';
+		for (char c : text) {
+			stream << c;
+			if (c == '"') {
+				stream << c;
+			}
+		}
+		stream << '"';
+	}
+}
+
+uint64_t ProfilerNow()
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+ProfileThreadBuffer::ProfileThreadBuffer(uint32_t thread_id) :
+	depth(0), events(new ProfileEvent[capacity]), write_index(0), read_index(0), dropped(0), thread_id(thread_id)
+{
+}
+
+void ProfileThreadBuffer::Push(const ProfileEvent &event)
+{
+	const uint64_t write = write_index.load(std::memory_order_relaxed);
+	if (write - read_index.load(std::memory_order_acquire) >= capacity) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	events[write & (capacity - 1)] = event;
+	write_index.store(write + 1, std::memory_order_release);
+}
+
+size_t ProfileThreadBuffer::Drain(std::vector<ProfileEvent> &events)
+{
+	const uint64_t read = read_index.load(std::memory_order_relaxed);
+	const uint64_t write = write_index.load(std::memory_order_acquire);
+	for (uint64_t i = read; i < write; i++) {
+		events.push_back(this->events[i & (capacity - 1)]);
+	}
+	read_index.store(write, std::memory_order_release);
+	return static_cast<size_t>(write - read);
+}
+
+Profiler::Profiler(size_t history_frames) :
+	id(next_profiler_id.fetch_add(1)), history_frames(history_frames ? history_frames : 1), frame_begin(ProfilerNow())
+{
+}
+
+Profiler &Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+ProfileThreadBuffer &Profiler::GetThreadBuffer()
+{
+	if (thread_buffer_cache.profiler == id) {
+		return *thread_buffer_cache.buffer;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const std::thread::id self = std::this_thread::get_id();
+	ProfileThreadBuffer *buffer = nullptr;
+	for (ThreadInfo &thread : threads) {
+		if (thread.owner == self) {
+			buffer = thread.buffer.get();
+		}
+	}
+	if (buffer == nullptr) {
+		// Thread ids start at 1; 0 is the frame track in traces
+		threads.push_back({std::make_unique<ProfileThreadBuffer>(static_cast<uint32_t>(threads.size() + 1)), self,
+			"Thread " + std::to_string(threads.size() + 1)});
+		buffer = threads.back().buffer.get();
+	}
+
+	thread_buffer_cache = {id, buffer};
+	return *buffer;
+}
+
+void Profiler::SetThreadName(const char *name)
+{
+	const uint32_t thread = GetThreadBuffer().GetThreadId();
+	std::lock_guard<std::mutex> lock(mutex);
+	threads[thread - 1].name = name;
+}
+
+void Profiler::EndFrame(uint64_t end_time)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Frame frame = {frame_begin, end_time, {}};
+	for (ThreadInfo &thread : threads) {
+		thread.buffer->Drain(frame.events);
+	}
+	frame.events.insert(frame.events.end(), gpu_events.begin(), gpu_events.end());
+	gpu_events.clear();
+
+	if (frames.size() == history_frames) {
+		frames.pop_front();
+	}
+	frames.push_back(std::move(frame));
+	frame_begin = end_time;
+}
+
+void Profiler::AddGpuEvent(const char *name, uint64_t begin, uint64_t end, uint32_t depth)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	gpu_events.push_back({name, begin, end, gpu_thread, depth});
+}
+
+void Profiler::Reset()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<ProfileEvent> discarded;
+	for (ThreadInfo &thread : threads) {
+		thread.buffer->Drain(discarded);
+	}
+	frames.clear();
+	gpu_events.clear();
+	frame_begin = ProfilerNow();
+}
+
+FrameStats Profiler::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	FrameStats stats = {};
+	stats.frame_count = frames.size();
+
+	std::vector<uint64_t> durations;
+	for (const Frame &frame : frames) {
+		durations.push_back(frame.end - frame.begin);
+	}
+	double total;
+	Summarize(durations, stats.min_ms, stats.avg_ms, stats.p99_ms, stats.max_ms, total);
+
+	std::map<std::pair<std::string, bool>, std::vector<uint64_t>> scopes;
+	for (const Frame &frame : frames) {
+		for (const ProfileEvent &event : frame.events) {
+			scopes[{event.name, event.thread == gpu_thread}].push_back(event.end - event.begin);
+		}
+	}
+
+	for (auto &scope : scopes) {
+		ScopeStats scopeStats = {};
+		scopeStats.name = scope.first.first;
+		scopeStats.gpu = scope.first.second;
+		scopeStats.count = scope.second.size();
+		Summarize(scope.second, scopeStats.min_ms, scopeStats.avg_ms, scopeStats.p99_ms, scopeStats.max_ms, scopeStats.total_ms);
+		scopeStats.per_frame_ms = scopeStats.total_ms / std::max<size_t>(1, frames.size());
+		stats.scopes.push_back(scopeStats);
+	}
+	std::sort(stats.scopes.begin(), stats.scopes.end(), [](const ScopeStats &a, const ScopeStats &b) { return a.total_ms > b.total_ms; });
+	return stats;
+}
+
+uint64_t Profiler::GetDroppedCount() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	uint64_t dropped = 0;
+	for (const ThreadInfo &thread : threads) {
+		dropped += thread.buffer->GetDroppedCount();
+	}
+	return dropped;
+}
+
+void Profiler::WriteChromeTrace(std::ostream &stream) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	const uint64_t origin = frames.empty() ? 0 : frames.front().begin;
+	// Trace timestamps are microseconds
+	auto micros = [origin](uint64_t ns) { return (static_cast<int64_t>(ns) - static_cast<int64_t>(origin)) * 1e-3; };
+
+	const std::ios_base::fmtflags flags = stream.flags();
+	const std::streamsize precision = stream.precision();
+	stream << std::fixed << std::setprecision(3);
+
+	stream << "{\"traceEvents\":[\n";
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n";
+	stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}},\n";
+	stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Frames\"}}";
+	for (const ThreadInfo &thread : threads) {
+		stream << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.buffer->GetThreadId() << ",\"args\":{\"name\":";
+		WriteJsonString(stream, thread.name.c_str());
+		stream << "}}";
+	}
+
+	uint64_t frameNumber = 0;
+	for (const Frame &frame : frames) {
+		stream << ",\n{\"name\":\"Frame " << frameNumber++ << "\",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":" << micros(frame.begin)
+			<< ",\"dur\":" << (frame.end - frame.begin) * 1e-3 << "}";
+		for (const ProfileEvent &event : frame.events) {
+			const bool gpu = event.thread == gpu_thread;
+			stream << ",\n{\"name\":";
+			WriteJsonString(stream, event.name);
+			stream << ",\"ph\":\"X\",\"pid\":" << (gpu ? 2 : 1) << ",\"tid\":" << (gpu ? 0 : event.thread)
+				<< ",\"ts\":" << micros(event.begin) << ",\"dur\":" << (event.end - event.begin) * 1e-3 << "}";
+		}
+	}
+	stream << "\n]}\n";
+
+	stream.flags(flags);
+	stream.precision(precision);
+}
+
+void Profiler::WriteCsv(std::ostream &stream) const
+{
+	const FrameStats stats = GetStats();
+	stream << "name,source,count,total_ms,min_ms,avg_ms,p99_ms,max_ms,per_frame_ms\n";
+	stream << "frame,cpu," << stats.frame_count << ',' << stats.avg_ms * stats.frame_count << ',' << stats.min_ms << ','
+		<< stats.avg_ms << ',' << stats.p99_ms << ',' << stats.max_ms << ',' << stats.avg_ms << '\n';
+	for (const ScopeStats &scope : stats.scopes) {
+		WriteCsvField(stream, scope.name);
+		stream << ',' << (scope.gpu ? "gpu" : "cpu") << ',' << scope.count << ',' << scope.total_ms << ',' << scope.min_ms << ','
+			<< scope.avg_ms << ',' << scope.p99_ms << ',' << scope.max_ms << ',' << scope.per_frame_ms << '\n';
+	}
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// CPU/GPU frame profiler. Scoped markers go into a per-thread single-producer ring without locks;
+// Profiler::EndFrame() drains every ring into a history of frames that can be summarized or exported
+// as Chrome trace JSON (chrome://tracing, Perfetto) and CSV.
+// Define ENABLE_PROFILER to compile the PROFILE_* macros in; without it they expand to nothing.
+
+// Nanoseconds on the steady clock. On Windows this is QueryPerformanceCounter, which is also the
+// CPU clock D3D12 clock calibration reports, so GPU timestamps convert onto the same timeline.
+uint64_t ProfilerNow();
+
+struct ProfileEvent
+{
+	// Must outlive the profiler; markers use string literals
+	const char *name;
+	uint64_t begin;
+	uint64_t end;
+	uint32_t thread;
+	uint32_t depth;
+};
+
+// Events of one thread. Only the owning thread pushes and only the profiler drains, so the ring
+// needs nothing stronger than acquire/release on the two indices. A full ring drops new events.
+class ProfileThreadBuffer
+{
+public:
+	static const uint32_t capacity = 1 << 14;
+
+	ProfileThreadBuffer(uint32_t thread_id);
+
+	ProfileThreadBuffer(const ProfileThreadBuffer &) = delete;
+	ProfileThreadBuffer &operator=(const ProfileThreadBuffer &) = delete;
+
+	void Push(const ProfileEvent &event);
+	// Appends everything pushed so far; returns the number of events
+	size_t Drain(std::vector<ProfileEvent> &events);
+
+	uint32_t GetThreadId() const { return thread_id; }
+	uint64_t GetDroppedCount() const { return dropped.load(std::memory_order_relaxed); }
+
+	// Nesting level of open scopes, touched by the owning thread only
+	uint32_t depth;
+
+private:
+	std::unique_ptr<ProfileEvent[]> events;
+	std::atomic<uint64_t> write_index;
+	std::atomic<uint64_t> read_index;
+	std::atomic<uint64_t> dropped;
+	uint32_t thread_id;
+};
+
+struct ScopeStats
+{
+	std::string name;
+	bool gpu;
+	uint64_t count;
+	double total_ms;
+	double min_ms;
+	double avg_ms;
+	double p99_ms;
+	double max_ms;
+	// Total divided by the number of frames in the history
+	double per_frame_ms;
+};
+
+struct FrameStats
+{
+	size_t frame_count;
+	double min_ms;
+	double avg_ms;
+	double p99_ms;
+	double max_ms;
+	std::vector<ScopeStats> scopes;
+};
+
+class Profiler
+{
+public:
+	static const size_t default_history_frames = 600;
+	// Thread id GPU events are reported under
+	static const uint32_t gpu_thread = 0xFFFFFFFF;
+
+	Profiler(size_t history_frames = default_history_frames);
+
+	Profiler(const Profiler &) = delete;
+	Profiler &operator=(const Profiler &) = delete;
+
+	// Process-wide instance the PROFILE_* macros use
+	static Profiler &Get();
+
+	// Ring of the calling thread, created on first use
+	ProfileThreadBuffer &GetThreadBuffer();
+	void SetThreadName(const char *name);
+
+	// Closes the current frame at the current time and collects the events of every thread
+	void EndFrame() { EndFrame(ProfilerNow()); }
+	void EndFrame(uint64_t end_time);
+	// GPU timestamps already converted to ProfilerNow() time; they usually arrive a few frames late
+	void AddGpuEvent(const char *name, uint64_t begin, uint64_t end, uint32_t depth = 0);
+
+	void Reset();
+	FrameStats GetStats() const;
+	uint64_t GetDroppedCount() const;
+
+	void WriteChromeTrace(std::ostream &stream) const;
+	// One row per scope plus a "frame" row for whole frames
+	void WriteCsv(std::ostream &stream) const;
+
+private:
+	struct Frame
+	{
+		uint64_t begin;
+		uint64_t end;
+		std::vector<ProfileEvent> events;
+	};
+
+	struct ThreadInfo
+	{
+		std::unique_ptr<ProfileThreadBuffer> buffer;
+		std::thread::id owner;
+		std::string name;
+	};
+
+	const uint64_t id;
+	const size_t history_frames;
+	mutable std::mutex mutex;
+	std::vector<ThreadInfo> threads;
+	std::deque<Frame> frames;
+	std::vector<ProfileEvent> gpu_events;
+	uint64_t frame_begin;
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char *name) : buffer(Profiler::Get().GetThreadBuffer()), name(name)
+	{
+		depth = buffer.depth++;
+		begin = ProfilerNow();
+	}
+
+	~ProfileScope()
+	{
+		const uint64_t end = ProfilerNow();
+		buffer.depth--;
+		buffer.Push({name, begin, end, buffer.GetThreadId(), depth});
+	}
+
+	ProfileScope(const ProfileScope &) = delete;
+	ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+	ProfileThreadBuffer &buffer;
+	const char *name;
+	uint64_t begin;
+	uint32_t depth;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::Get().SetThreadName(name)
+#define PROFILE_FRAME() Profiler::Get().EndFrame()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+#endif
@@ -0,0 +1,342 @@
+#include "render_graph.h"
+
+#include <algorithm>
+
+namespace
+{
+	const uint32_t write_states = static_cast<uint32_t>(ResourceState::RenderTarget) | static_cast<uint32_t>(ResourceState::DepthWrite) |
+		static_cast<uint32_t>(ResourceState::UnorderedAccess) | static_cast<uint32_t>(ResourceState::CopyDest);
+
+	// Uses of one resource that share a state: a single write, or a run of reads
+	struct Segment
+	{
+		uint32_t first;
+		uint32_t last;
+		ResourceState state;
+		bool read;
+		bool write;
+	};
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool HasWriteBits(ResourceState state)
+	{
+		return (static_cast<uint32_t>(state) & write_states) != 0;
+	}
+
+	RenderBarrier MakeBarrier(BarrierType type, BarrierSplit split, uint32_t resource, ResourceState before, ResourceState after)
+	{
+		return {type, split, resource, RenderGraph::no_resource, before, after};
+	}
+}
+
+bool IsWriteState(ResourceState state)
+{
+	const uint32_t bits = static_cast<uint32_t>(state);
+	return bits != 0 && (bits & write_states) == bits && (bits & (bits - 1)) == 0;
+}
+
+RenderGraph::ResourceId RenderGraph::ImportResource(const char *name, ResourceState initial_state, ResourceState final_state)
+{
+	resources.push_back({name, true, initial_state, final_state, 0, 1, 0, UINT32_MAX, UINT32_MAX});
+	compiled = false;
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::CreateTransient(const char *name, uint64_t size, uint64_t alignment)
+{
+	resources.push_back({name, false, ResourceState::Undefined, ResourceState::Undefined, size, std::max<uint64_t>(1, alignment), 0,
+		UINT32_MAX, UINT32_MAX});
+	compiled = false;
+	return static_cast<ResourceId>(resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::AddPass(const char *name, ExecuteFunction execute, bool has_side_effects)
+{
+	passes.push_back({name, std::move(execute), has_side_effects, {}, false});
+	compiled = false;
+	return static_cast<PassId>(passes.size() - 1);
+}
+
+void RenderGraph::Read(PassId pass, ResourceId resource, ResourceState state)
+{
+	passes[pass].accesses.push_back({resource, state, true, false});
+	compiled = false;
+}
+
+void RenderGraph::Write(PassId pass, ResourceId resource, ResourceState state)
+{
+	passes[pass].accesses.push_back({resource, state, false, true});
+	compiled = false;
+}
+
+bool RenderGraph::MergeAccesses(std::string &err)
+{
+	for (Pass &pass : passes) {
+		std::vector<Access> merged;
+		for (const Access &access : pass.accesses) {
+			if (access.resource >= resources.size()) {
+				err = pass.name + ": unknown resource";
+				return false;
+			}
+			if (access.write && !IsWriteState(access.state)) {
+				err = pass.name + ": " + resources[access.resource].name + " written in a read state";
+				return false;
+			}
+			const uint32_t bits = static_cast<uint32_t>(access.state);
+			if (access.read && (bits == 0 || (bits & (static_cast<uint32_t>(ResourceState::RenderTarget) |
+				static_cast<uint32_t>(ResourceState::CopyDest))) != 0)) {
+				err = pass.name + ": " + resources[access.resource].name + " read in a write-only state";
+				return false;
+			}
+
+			auto existing = std::find_if(merged.begin(), merged.end(), [&](const Access &other) { return other.resource == access.resource; });
+			if (existing == merged.end()) {
+				merged.push_back(access);
+				continue;
+			}
+			// A resource is in one state during a pass: read states combine, write states admit nothing else
+			if ((HasWriteBits(existing->state) || HasWriteBits(access.state)) && existing->state != access.state) {
+				err = pass.name + ": " + resources[access.resource].name + " accessed in conflicting states";
+				return false;
+			}
+			existing->state = existing->state | access.state;
+			existing->read |= access.read;
+			existing->write |= access.write;
+		}
+		pass.accesses.swap(merged);
+	}
+	return true;
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk backwards: a pass survives when something that survives, or leaves the frame, consumes its output
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass &pass = passes[i];
+		bool alive = pass.has_side_effects;
+		for (const Access &access : pass.accesses) {
+			alive |= access.write && (needed[access.resource] || resources[access.resource].imported);
+		}
+		pass.culled = !alive;
+		if (!alive) {
+			continue;
+		}
+		for (const Access &access : pass.accesses) {
+			if (access.write && !access.read) {
+				needed[access.resource] = false;
+			}
+		}
+		for (const Access &access : pass.accesses) {
+			if (access.read) {
+				needed[access.resource] = true;
+			}
+		}
+	}
+
+	executed.clear();
+	for (PassId id = 0; id < passes.size(); id++) {
+		if (!passes[id].culled) {
+			executed.push_back(id);
+		}
+	}
+}
+
+bool RenderGraph::PlanTransitions(std::vector<PendingBarrier> &pending, std::string &err)
+{
+	const uint32_t finalBatch = static_cast<uint32_t>(executed.size());
+	std::vector<std::vector<Segment>> segments(resources.size());
+	for (uint32_t index = 0; index < executed.size(); index++) {
+		for (const Access &access : passes[executed[index]].accesses) {
+			std::vector<Segment> &resourceSegments = segments[access.resource];
+			// Reads in read-only states share one transition into the union of their states
+			if (!HasWriteBits(access.state) && !resourceSegments.empty() && !HasWriteBits(resourceSegments.back().state)) {
+				resourceSegments.back().last = index;
+				resourceSegments.back().state = resourceSegments.back().state | access.state;
+			} else {
+				resourceSegments.push_back({index, index, access.state, access.read, access.write});
+			}
+		}
+	}
+
+	for (ResourceId id = 0; id < resources.size(); id++) {
+		Resource &resource = resources[id];
+		const std::vector<Segment> &resourceSegments = segments[id];
+		resource.first_use = resourceSegments.empty() ? UINT32_MAX : resourceSegments.front().first;
+		resource.last_use = resourceSegments.empty() ? UINT32_MAX : resourceSegments.back().last;
+
+		if (!resource.imported) {
+			if (resourceSegments.empty()) {
+				continue;
+			}
+			if (resourceSegments.front().read) {
+				err = resource.name + " is read by " + passes[executed[resourceSegments.front().first]].name + " before anything wrote it";
+				return false;
+			}
+			// Transients keep their last state across frames, so the first use transitions out of it
+			resource.initial_state = resourceSegments.back().state;
+			resource.final_state = resourceSegments.back().state;
+		}
+
+		// With nothing before the first use of an imported resource, its transition can begin with the frame
+		ResourceState state = resource.initial_state;
+		uint32_t readyBatch = resource.imported ? 0 : UINT32_MAX;
+		bool lastWrite = false;
+		for (const Segment &segment : resourceSegments) {
+			if (segment.state != state) {
+				if (use_split_barriers && readyBatch != UINT32_MAX && readyBatch < segment.first) {
+					pending.push_back({readyBatch, MakeBarrier(BarrierType::Transition, BarrierSplit::Begin, id, state, segment.state)});
+					pending.push_back({segment.first, MakeBarrier(BarrierType::Transition, BarrierSplit::End, id, state, segment.state)});
+				} else {
+					pending.push_back({segment.first, MakeBarrier(BarrierType::Transition, BarrierSplit::None, id, state, segment.state)});
+				}
+			} else if (state == ResourceState::UnorderedAccess && readyBatch != UINT32_MAX && (lastWrite || segment.write) &&
+				segment.first != resource.first_use) {
+				pending.push_back({segment.first, MakeBarrier(BarrierType::Uav, BarrierSplit::None, id, state, state)});
+			}
+			state = segment.state;
+			readyBatch = segment.last + 1;
+			lastWrite = segment.write;
+		}
+
+		if (resource.imported && state != resource.final_state) {
+			if (use_split_barriers && readyBatch < finalBatch) {
+				pending.push_back({readyBatch, MakeBarrier(BarrierType::Transition, BarrierSplit::Begin, id, state, resource.final_state)});
+				pending.push_back({finalBatch, MakeBarrier(BarrierType::Transition, BarrierSplit::End, id, state, resource.final_state)});
+			} else {
+				pending.push_back({finalBatch, MakeBarrier(BarrierType::Transition, BarrierSplit::None, id, state, resource.final_state)});
+			}
+		}
+	}
+	return true;
+}
+
+void RenderGraph::PlaceTransients(std::vector<PendingBarrier> &pending)
+{
+	std::vector<ResourceId> order;
+	heap_alignment = 1;
+	for (ResourceId id = 0; id < resources.size(); id++) {
+		if (!resources[id].imported && resources[id].first_use != UINT32_MAX) {
+			order.push_back(id);
+			heap_alignment = std::max(heap_alignment, resources[id].alignment);
+		}
+	}
+	// Largest first, each at the lowest offset free during its whole lifetime
+	std::stable_sort(order.begin(), order.end(), [&](ResourceId a, ResourceId b) { return resources[a].size > resources[b].size; });
+
+	auto livesOverlap = [&](const Resource &a, const Resource &b) { return a.first_use <= b.last_use && b.first_use <= a.last_use; };
+	auto memoryOverlaps = [&](const Resource &a, const Resource &b) { return a.offset < b.offset + b.size && b.offset < a.offset + a.size; };
+
+	std::vector<ResourceId> placed;
+	std::vector<ResourceId> blockers;
+	stats.transient_size = 0;
+	stats.transient_heap_size = 0;
+	for (ResourceId id : order) {
+		Resource &resource = resources[id];
+		blockers.clear();
+		for (ResourceId other : placed) {
+			if (livesOverlap(resource, resources[other])) {
+				blockers.push_back(other);
+			}
+		}
+		std::sort(blockers.begin(), blockers.end(), [&](ResourceId a, ResourceId b) { return resources[a].offset < resources[b].offset; });
+
+		uint64_t offset = 0;
+		for (ResourceId other : blockers) {
+			if (offset + resource.size <= resources[other].offset) {
+				break;
+			}
+			offset = std::max(offset, AlignUp(resources[other].offset + resources[other].size, resource.alignment));
+		}
+		resource.offset = offset;
+		placed.push_back(id);
+		stats.transient_size += resource.size;
+		stats.transient_heap_size = std::max(stats.transient_heap_size, offset + resource.size);
+	}
+
+	// Memory shared with another transient changes owner at the first use. The owner before is the latest one in
+	// this frame, or one from the previous frame when nothing here precedes it.
+	for (ResourceId id : placed) {
+		const Resource &resource = resources[id];
+		bool shared = false;
+		ResourceId before = no_resource;
+		for (ResourceId other : placed) {
+			if (other == id || !memoryOverlaps(resource, resources[other])) {
+				continue;
+			}
+			shared = true;
+			if (resources[other].last_use < resource.first_use && (before == no_resource || resources[other].last_use > resources[before].last_use)) {
+				before = other;
+			}
+		}
+		if (shared) {
+			RenderBarrier barrier = MakeBarrier(BarrierType::Aliasing, BarrierSplit::None, id, resource.initial_state, resource.initial_state);
+			barrier.before_resource = before;
+			pending.push_back({resource.first_use, barrier});
+		}
+	}
+}
+
+bool RenderGraph::Compile(std::string &err)
+{
+	compiled = false;
+	barriers.clear();
+	batch_offsets.clear();
+	stats = RenderGraphStats();
+	if (!MergeAccesses(err)) {
+		return false;
+	}
+	CullPasses();
+
+	std::vector<PendingBarrier> pending;
+	if (!PlanTransitions(pending, err)) {
+		return false;
+	}
+	PlaceTransients(pending);
+
+	// Aliasing barriers go first in a batch, ahead of the transitions of the resources taking over the memory
+	std::stable_sort(pending.begin(), pending.end(), [](const PendingBarrier &a, const PendingBarrier &b) {
+		if (a.batch != b.batch) {
+			return a.batch < b.batch;
+		}
+		return a.barrier.type == BarrierType::Aliasing && b.barrier.type != BarrierType::Aliasing;
+	});
+
+	const uint32_t batchCount = static_cast<uint32_t>(executed.size()) + 1;
+	size_t next = 0;
+	for (uint32_t batch = 0; batch < batchCount; batch++) {
+		batch_offsets.push_back(static_cast<uint32_t>(barriers.size()));
+		for (; next < pending.size() && pending[next].batch == batch; next++) {
+			const RenderBarrier &barrier = pending[next].barrier;
+			barriers.push_back(barrier);
+			stats.split_barrier_count += barrier.split == BarrierSplit::Begin ? 1 : 0;
+			stats.aliasing_barrier_count += barrier.type == BarrierType::Aliasing ? 1 : 0;
+			stats.uav_barrier_count += barrier.type == BarrierType::Uav ? 1 : 0;
+		}
+		stats.batch_count += barriers.size() > batch_offsets.back() ? 1 : 0;
+	}
+	batch_offsets.push_back(static_cast<uint32_t>(barriers.size()));
+
+	stats.pass_count = static_cast<uint32_t>(executed.size());
+	stats.culled_pass_count = static_cast<uint32_t>(passes.size() - executed.size());
+	stats.barrier_count = static_cast<uint32_t>(barriers.size());
+	compiled = true;
+	return true;
+}
+
+void RenderGraph::Execute(RenderGraphBackend &backend) const
+{
+	for (size_t batch = 0; batch <= executed.size(); batch++) {
+		const uint32_t count = batch_offsets[batch + 1] - batch_offsets[batch];
+		if (count > 0) {
+			backend.ResourceBarriers(&barriers[batch_offsets[batch]], count);
+		}
+		if (batch < executed.size() && passes[executed[batch]].execute) {
+			passes[executed[batch]].execute();
+		}
+	}
+}
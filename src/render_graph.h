@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Resource states a pass can declare. Read states combine, write states stand alone like in D3D12.
+enum class ResourceState : uint32_t
+{
+	// Contents are not needed
+	Undefined = 0,
+	RenderTarget = 1 << 0,
+	DepthWrite = 1 << 1,
+	UnorderedAccess = 1 << 2,
+	CopyDest = 1 << 3,
+	DepthRead = 1 << 4,
+	ShaderResource = 1 << 5,
+	CopySource = 1 << 6,
+	VertexIndex = 1 << 7,
+	Present = 1 << 8
+};
+
+inline ResourceState operator|(ResourceState a, ResourceState b)
+{
+	return static_cast<ResourceState>(static_cast<uint32_t>(a) | static_cast<uint32_t>(b));
+}
+
+bool IsWriteState(ResourceState state);
+
+enum class BarrierType : uint32_t
+{
+	Transition,
+	// The memory of a transient changes owner; before is the previous owner or no_resource
+	Aliasing,
+	// Orders unordered access writes between passes
+	Uav
+};
+
+// Split transitions begin right after the last use and end right before the next one
+enum class BarrierSplit : uint32_t
+{
+	None,
+	Begin,
+	End
+};
+
+struct RenderBarrier
+{
+	BarrierType type;
+	BarrierSplit split;
+	uint32_t resource;
+	uint32_t before_resource;
+	ResourceState state_before;
+	ResourceState state_after;
+};
+
+struct RenderGraphStats
+{
+	uint32_t pass_count;
+	uint32_t culled_pass_count;
+	uint32_t barrier_count;
+	// ResourceBarrier calls; every pass gets at most one batch before it, plus one after the last pass
+	uint32_t batch_count;
+	uint32_t split_barrier_count;
+	uint32_t aliasing_barrier_count;
+	uint32_t uav_barrier_count;
+	// Sum of the transients' sizes and the heap they share after aliasing
+	uint64_t transient_size;
+	uint64_t transient_heap_size;
+};
+
+// Receives the barrier batches of an executing graph
+class RenderGraphBackend
+{
+public:
+	virtual ~RenderGraphBackend() {};
+
+	virtual void ResourceBarriers(const RenderBarrier *barriers, uint32_t count) = 0;
+};
+
+// Passes declare what they read and write; Compile() culls passes nobody consumes, derives batched (and split)
+// barriers and packs transient resources with disjoint lifetimes into one heap. Compiling is CPU only, the
+// backend maps resource ids to device objects. Passes run in the order they were added.
+class RenderGraph
+{
+public:
+	typedef uint32_t ResourceId;
+	typedef uint32_t PassId;
+	typedef std::function<void()> ExecuteFunction;
+
+	static const ResourceId no_resource = UINT32_MAX;
+
+	RenderGraph(bool use_split_barriers = true) : use_split_barriers(use_split_barriers), compiled(false), heap_alignment(1), stats() {};
+
+	// External resource, e.g. the back buffer; it enters the frame in initial_state and leaves in final_state
+	ResourceId ImportResource(const char *name, ResourceState initial_state, ResourceState final_state);
+	// Lives only inside the frame and may share memory with other transients. Its contents are undefined at its
+	// first use, so the first writer of an aliased render target or depth buffer must clear or discard it.
+	ResourceId CreateTransient(const char *name, uint64_t size, uint64_t alignment);
+
+	// Passes with side effects and passes writing imported resources are never culled
+	PassId AddPass(const char *name, ExecuteFunction execute, bool has_side_effects = false);
+	void Read(PassId pass, ResourceId resource, ResourceState state);
+	void Write(PassId pass, ResourceId resource, ResourceState state);
+
+	bool Compile(std::string &err);
+	// Runs the surviving passes with their barrier batches; the graph must be compiled
+	void Execute(RenderGraphBackend &backend) const;
+
+	const RenderGraphStats &GetStats() const { return stats; }
+	const std::vector<RenderBarrier> &GetBarriers() const { return barriers; }
+	bool IsCulled(PassId pass) const { return passes[pass].culled; }
+	const std::string &GetPassName(PassId pass) const { return passes[pass].name; }
+	const std::string &GetResourceName(ResourceId resource) const { return resources[resource].name; }
+	size_t GetResourceCount() const { return resources.size(); }
+
+	// Placement of a transient inside the shared heap; unused transients get no memory
+	bool IsTransientUsed(ResourceId resource) const { return resources[resource].first_use != UINT32_MAX; }
+	uint64_t GetTransientOffset(ResourceId resource) const { return resources[resource].offset; }
+	uint64_t GetTransientSize(ResourceId resource) const { return resources[resource].size; }
+	// Executed pass indices of the first and last use
+	uint32_t GetFirstUse(ResourceId resource) const { return resources[resource].first_use; }
+	uint32_t GetLastUse(ResourceId resource) const { return resources[resource].last_use; }
+	uint64_t GetTransientHeapAlignment() const { return heap_alignment; }
+	// State a transient is created in: the state it is left in at the end of every frame
+	ResourceState GetTransientCreateState(ResourceId resource) const { return resources[resource].final_state; }
+
+private:
+	struct Access
+	{
+		ResourceId resource;
+		ResourceState state;
+		bool read;
+		bool write;
+	};
+
+	struct Pass
+	{
+		std::string name;
+		ExecuteFunction execute;
+		bool has_side_effects;
+		std::vector<Access> accesses;
+		bool culled;
+	};
+
+	struct Resource
+	{
+		std::string name;
+		bool imported;
+		ResourceState initial_state;
+		ResourceState final_state;
+		uint64_t size;
+		uint64_t alignment;
+		uint64_t offset;
+		// Lifetime in executed pass indices
+		uint32_t first_use;
+		uint32_t last_use;
+	};
+
+	// Barrier before executed pass batch, or after the last pass when batch equals the executed pass count
+	struct PendingBarrier
+	{
+		uint32_t batch;
+		RenderBarrier barrier;
+	};
+
+	bool MergeAccesses(std::string &err);
+	void CullPasses();
+	bool PlanTransitions(std::vector<PendingBarrier> &pending, std::string &err);
+	void PlaceTransients(std::vector<PendingBarrier> &pending);
+
+	bool use_split_barriers;
+	bool compiled;
+	std::vector<Pass> passes;
+	std::vector<Resource> resources;
+
+	// Compiled form
+	std::vector<PassId> executed;
+	std::vector<RenderBarrier> barriers;
+	// First barrier of each batch, executed.size() + 2 entries
+	std::vector<uint32_t> batch_offsets;
+	uint64_t heap_alignment;
+	RenderGraphStats stats;
+};
@@ -0,0 +1,113 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// Depth in [0, max_depth] mapped onto [0, 2^bits - 1]
+	uint64_t QuantizeDepth(float depth, float max_depth, uint32_t bits)
+	{
+		const float maxValue = static_cast<float>((1u << bits) - 1);
+		float normalized = max_depth > 0.0f ? depth / max_depth : 0.0f;
+		normalized = normalized > 0.0f ? (normalized < 1.0f ? normalized : 1.0f) : 0.0f;
+		return static_cast<uint64_t>(normalized * maxValue);
+	}
+
+	bool CanMerge(const DrawItem &a, const DrawItem &b)
+	{
+		return a.translucent == b.translucent && a.pipeline == b.pipeline && a.material == b.material && a.mesh == b.mesh;
+	}
+}
+
+uint64_t MakeSortKey(const DrawItem &item, float max_depth)
+{
+	const uint64_t pipeline = item.pipeline & 0x7F;
+	const uint64_t material = item.material & 0xFFFF;
+	const uint64_t mesh = item.mesh & 0xFFFF;
+
+	if (item.translucent) {
+		const uint64_t farFirst = 0xFFFFFF - QuantizeDepth(item.depth, max_depth, 24);
+		return 1ull << 63 | farFirst << 39 | pipeline << 32 | material << 16 | mesh;
+	}
+
+	const uint64_t bucket = QuantizeDepth(item.depth, max_depth, 6);
+	return pipeline << 56 | bucket << 50 | material << 34 | mesh << 18;
+}
+
+void RadixSort(SortEntry *entries, SortEntry *scratch, size_t count)
+{
+	// All eight histograms in one read of the keys
+	size_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++) {
+		const uint64_t key = entries[i].key;
+		for (int pass = 0; pass < 8; pass++) {
+			histograms[pass][(key >> (pass * 8)) & 0xFF]++;
+		}
+	}
+
+	SortEntry *source = entries;
+	SortEntry *destination = scratch;
+	for (int pass = 0; pass < 8; pass++) {
+		size_t (&histogram)[256] = histograms[pass];
+		if (count == 0 || histogram[(source[0].key >> (pass * 8)) & 0xFF] == count) {
+			continue;
+		}
+
+		size_t offset = 0;
+		for (size_t &bucket : histogram) {
+			const size_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			destination[histogram[(source[i].key >> (pass * 8)) & 0xFF]++] = source[i];
+		}
+		std::swap(source, destination);
+	}
+
+	if (source != entries) {
+		memcpy(entries, source, count * sizeof(SortEntry));
+	}
+}
+
+void RenderQueue::Clear()
+{
+	items.clear();
+	entries.clear();
+	batches.clear();
+	instances.clear();
+}
+
+void RenderQueue::Reserve(size_t count)
+{
+	items.reserve(count);
+	entries.reserve(count);
+	scratch.reserve(count);
+	batches.reserve(count);
+	instances.reserve(count);
+}
+
+void RenderQueue::Sort(float max_depth)
+{
+	entries.resize(items.size());
+	scratch.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++) {
+		entries[i] = {MakeSortKey(items[i], max_depth), static_cast<uint32_t>(i)};
+	}
+	RadixSort(entries.data(), scratch.data(), entries.size());
+
+	batches.clear();
+	instances.resize(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) {
+		const DrawItem &item = items[entries[i].item];
+		instances[i] = item.instance;
+		if (!batches.empty() && CanMerge(items[entries[i - 1].item], item)) {
+			batches.back().instance_count++;
+		} else {
+			batches.push_back({item.pipeline, item.material, item.mesh, static_cast<uint32_t>(i), 1, item.translucent});
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// One drawable instance submitted for a frame
+struct DrawItem
+{
+	uint32_t pipeline;
+	uint32_t material;
+	// Geometry range; items with equal pipeline, material and mesh can share an instanced draw
+	uint32_t mesh;
+	// Per-instance data index, passed through to the batch
+	uint32_t instance;
+	// View-space depth
+	float depth;
+	bool translucent;
+};
+
+// Adjacent items of the sorted queue that can be drawn with one instanced call.
+// Their instance indices are instances[first_instance, first_instance + instance_count).
+struct DrawBatch
+{
+	uint32_t pipeline;
+	uint32_t material;
+	uint32_t mesh;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	bool translucent;
+};
+
+struct SortEntry
+{
+	uint64_t key;
+	uint32_t item;
+};
+
+// Sort key layout, most significant bits first:
+//   opaque:      0 | pipeline:7 | depth bucket:6 (near first) | material:16 | mesh:16 | unused:18
+//   translucent: 1 | depth:24 (far first) | pipeline:7 | material:16 | mesh:16
+// Opaque items are grouped by state within coarse depth slices, translucent items are strictly back to front.
+// Wider ids are truncated, which only costs merging opportunities, never correctness of the depth order.
+uint64_t MakeSortKey(const DrawItem &item, float max_depth);
+
+// Stable LSD radix sort on the key, 8 bits per pass; passes where every key has the same byte are skipped.
+// scratch must hold count entries. The result ends up in entries.
+void RadixSort(SortEntry *entries, SortEntry *scratch, size_t count);
+
+class RenderQueue
+{
+public:
+	static const uint32_t opaque_depth_buckets = 64;
+
+	RenderQueue() {};
+
+	void Clear();
+	void Reserve(size_t count);
+	void Push(const DrawItem &item) { items.push_back(item); }
+
+	// Sorts the items pushed since Clear() and merges them into batches; depth is clamped to [0, max_depth]
+	void Sort(float max_depth);
+
+	const std::vector<DrawItem> &GetItems() const { return items; }
+	const std::vector<SortEntry> &GetSortedEntries() const { return entries; }
+	const std::vector<DrawBatch> &GetBatches() const { return batches; }
+	const std::vector<uint32_t> &GetInstances() const { return instances; }
+
+private:
+	std::vector<DrawItem> items;
+	std::vector<SortEntry> entries;
+	std::vector<SortEntry> scratch;
+	std::vector<DrawBatch> batches;
+	std::vector<uint32_t> instances;
+};
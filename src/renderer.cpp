@@ -1,57 +1,143 @@
 #include "pch.h"
 #include "renderer.h"
+#include "obj_mesh.h"
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#include <fstream>
+
+static_assert(sizeof(MeshVertex) == sizeof(ColorVertex), "Input layout expects ColorVertex-compatible vertices");
 
 void Renderer::OnInit() {
+	// The window thread becomes worker 0 and helps whenever it waits for a frame's jobs
+	jobs = std::make_unique<JobSystem>();
+	BuildFrameGraph();
+	BuildRenderGraph();
+
 	LoadPipeline();
 	LoadAssets();
 }
 
-void Renderer::OnUpdate() {
-	angle += deltaRotation;
-	eyePos += XMVECTOR({sinf(angle), 0.0f, cosf(angle)}) * deltaForward;
+void Renderer::OnUpdate(float step) {
+	PROFILE_SCOPE("OnUpdate");
+	previousAngle = angle;
+	previousEyePos = eyePos;
+
+	angle += deltaRotation * rotation_speed * step;
+	eyePos += XMVECTOR({sinf(angle), 0.0f, cosf(angle)}) * (deltaForward * move_speed * step);
+}
+
+void Renderer::BuildFrameGraph() {
+	// Culling and sorting depend on the camera; picking only needs the camera and the BVH, so it runs beside them.
+	// Occlusion culling tests what the frustum kept, and does nothing unless it is enabled.
+	const TaskGraph::TaskId camera = frame_graph.AddTask("Camera", [this]() { UpdateViewCamera(); });
+	const TaskGraph::TaskId cull = frame_graph.AddTask("Cull", [this]() { scene.Cull(); }, {camera});
+	const TaskGraph::TaskId occlusion = frame_graph.AddTask("Occlusion", [this]() { scene.CullOccluded(); }, {cull});
+	frame_graph.AddTask("Sort draws", [this]() { scene.SortDraws(); }, {occlusion});
+	frame_graph.AddTask("Pick", [this]() { frame_pick = scene.Pick(); }, {camera});
+}
+
+void Renderer::UpdateViewCamera() {
+	const float viewAngle = previousAngle + (angle - previousAngle) * view_alpha;
+	const XMVECTOR viewPos = XMVectorLerp(previousEyePos, eyePos, view_alpha);
+	lookAt = viewPos + XMVECTOR({sinf(viewAngle), 0.0f, cosf(viewAngle)});
+
+	XMFLOAT3 eye;
+	XMFLOAT3 target;
+	XMFLOAT3 up;
+	XMStoreFloat3(&eye, viewPos);
+	XMStoreFloat3(&target, lookAt);
+	XMStoreFloat3(&up, upDir);
+	scene.UpdateCamera({{eye.x, eye.y, eye.z}, {target.x, target.y, target.z}, {up.x, up.y, up.z},
+		60.0f / 180.0f * XM_PI, aspectRatio, 0.001f, far_plane});
+}
 
-	lookAt = eyePos + XMVECTOR({sinf(angle), 0.0f, cosf(angle)});
-	view = XMMatrixLookAtLH(eyePos, lookAt, upDir);
+void Renderer::PrepareScene(float alpha) {
+	PROFILE_SCOPE("PrepareScene");
+	view_alpha = alpha;
+	frame_graph.Run(*jobs);
 
-	worldViewProj = projection * view * world;
-	worldViewProj = XMMatrixTranspose(
-		XMMatrixTranspose(projection) *
-		XMMatrixTranspose(view) *
-		XMMatrixTranspose(world)
-	);
+	if (frame_pick != picked_shape) {
+		picked_shape = frame_pick;
+		std::string name = frame_pick >= 0 ? scene.GetShapes()[frame_pick].name : "nothing";
+		OutputDebugString((L"Picked " + std::wstring(name.begin(), name.end()) + L'\n').c_str());
+	}
 
-	memcpy(cbvDataBegin, &worldViewProj, sizeof(worldViewProj));
+	const OcclusionStats &occlusion = scene.GetOcclusionStats();
+	if (occlusion_culling && occlusion.culled != occlusion_culled) {
+		occlusion_culled = occlusion.culled;
+		OutputDebugStringA(("Occlusion culled " + std::to_string(occlusion.culled) + " of " + std::to_string(occlusion.tested) +
+			" shapes behind " + std::to_string(occlusion.occluders) + " occluders in " +
+			std::to_string(occlusion.rasterize_ms + occlusion.test_ms) + " ms\n").c_str());
+	}
 }
 
-void Renderer::OnRender() {
-	PopulateCommandList();
-	ID3D12CommandList *commandLists[] = {command_list.Get()};
-	command_queue->ExecuteCommandLists(_countof(commandLists), commandLists);
-	ThrowIfFailed(swap_chain->Present(0, 0));
-	WaitForPreviousFrame();
+void Renderer::OnRender(float alpha) {
+	{
+		PROFILE_SCOPE("OnRender");
+		// Frame boundary: swap in finished reloads before the scene is culled against them
+		hot_reloader->ApplyFinished();
+		UpdateStreaming();
+		PrepareScene(alpha);
+
+		// Only blocks when the GPU still uses the slot from frames_in_flight frames ago
+		{
+			PROFILE_SCOPE("Wait for frame slot");
+			frame_slot = frame_ring->BeginFrame();
+		}
+		upload_ring->Retire(frame_ring->GetCompletedValue());
+		descriptor_ring->Retire(frame_ring->GetCompletedValue());
+		retire_queue.Collect(frame_ring->GetCompletedValue());
+		gpu_profiler->BeginFrame(frame_slot);
+
+		PopulateCommandList();
+		// Prologue, draw chunks and epilogue in one submission
+		command_lists->Submit();
+		{
+			PROFILE_SCOPE("Present");
+			ThrowIfFailed(swap_chain->Present(0, 0));
+		}
+
+		const uint64_t frameFence = frame_ring->EndFrame();
+		upload_ring->Close(frameFence);
+		descriptor_ring->Close(frameFence);
+		frame_index = swap_chain->GetCurrentBackBufferIndex();
+	}
+	PROFILE_FRAME();
 }
 
 void Renderer::OnDestroy() {
-	WaitForPreviousFrame();
-	CloseHandle(fence_event);
+	hot_reloader->Stop();
+	StopStreaming();
+	// Finishes the queued cooks
+	cache_cooker.reset();
+	WaitForGpu();
+	retire_queue.ReleaseAll();
+	if (upload_batcher) {
+		upload_batcher->WaitForIdle();
+	}
+	upload_ring.reset();
+
+#ifdef ENABLE_PROFILER
+	// Open profile.json in chrome://tracing or ui.perfetto.dev
+	std::ofstream trace(GetBinPath(std::wstring(L"profile.json")));
+	Profiler::Get().WriteChromeTrace(trace);
+	std::ofstream csv(GetBinPath(std::wstring(L"profile.csv")));
+	Profiler::Get().WriteCsv(csv);
+#endif // ENABLE_PROFILER
 }
 
 void Renderer::OnKeyDown(UINT8 key) {
 	switch (key) {
 		case 0x41 - 'a' + 'd':
-			deltaRotation = 0.001f;
+			deltaRotation = 1.0f;
 			break;
 		case 0x41 - 'a' + 'a':
-			deltaRotation = -0.001f;
+			deltaRotation = -1.0f;
 			break;
 		case 0x41 - 'a' + 'w':
-			deltaForward = 0.001f;
+			deltaForward = 1.0f;
 			break;
 		case 0x41 - 'a' + 's':
-			deltaForward = -0.001f;
+			deltaForward = -1.0f;
 			break;
 		default:
 			break;
@@ -96,6 +182,12 @@ void Renderer::LoadPipeline() {
 	ThrowIfFailed(dxgiFactory->EnumAdapters1(0, &hardwareAdapter));
 	ThrowIfFailed(D3D12CreateDevice(hardwareAdapter.Get(), D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device)));
 
+	// Cached pipeline blobs are only valid for the adapter and driver that produced them
+	ThrowIfFailed(hardwareAdapter->GetDesc1(&adapter_descriptor));
+	if (FAILED(hardwareAdapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &driver_version))) {
+		driver_version.QuadPart = 0;
+	}
+
 	// Create a direct command queue
 	D3D12_COMMAND_QUEUE_DESC queueDescriptor = {};
 	queueDescriptor.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
@@ -125,35 +217,50 @@ void Renderer::LoadPipeline() {
 
 	frame_index = swap_chain->GetCurrentBackBufferIndex();
 
-	// Create descriptor heap for render target view
-	D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDescriptor = {};
-	rtvHeapDescriptor.NumDescriptors = frame_number;
-	rtvHeapDescriptor.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
-	rtvHeapDescriptor.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	ThrowIfFailed(device->CreateDescriptorHeap(&rtvHeapDescriptor, IID_PPV_ARGS(&rtv_heap)));
-	rtv_descriptor_size = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
-
-	// Create constant buffer
-	D3D12_DESCRIPTOR_HEAP_DESC cbvHeapDescriptor = {};
-	cbvHeapDescriptor.NumDescriptors = 1;
-	cbvHeapDescriptor.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	cbvHeapDescriptor.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(device->CreateDescriptorHeap(&cbvHeapDescriptor, IID_PPV_ARGS(&cbvHeap)));
+	// Render target views live in CPU-only heaps that grow a page at a time
+	rtv_pages = std::make_unique<D3D12DescriptorPageSource>(device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_RTV, false, L"RTV heap");
+	rtv_descriptors = std::make_unique<DescriptorAllocator>(*rtv_pages, rtv_page_capacity);
 
 	// Create render target view for each frame
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(rtv_heap->GetCPUDescriptorHandleForHeapStart());
 	for (unsigned int i = 0; i < frame_number; i++) {
 		ThrowIfFailed(swap_chain->GetBuffer(i, IID_PPV_ARGS(&render_targets[i])));
-		device->CreateRenderTargetView(render_targets[i].Get(), nullptr, rtvHandle);
+		render_target_views[i] = rtv_descriptors->Allocate();
+		device->CreateRenderTargetView(render_targets[i].Get(), nullptr, {static_cast<SIZE_T>(render_target_views[i].cpu_address)});
 		std::wstring rtName = L"Render target #";
 		rtName += std::to_wstring(i);
 		OutputDebugString(rtName.c_str());
 		render_targets[i]->SetName(L"Render target");
-		rtvHandle.Offset(1, rtv_descriptor_size);
 	}
 
-	// Create command allocator
-	ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&command_allocator)));
+	if (occlusion_culling) {
+		dsv_pages = std::make_unique<D3D12DescriptorPageSource>(device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_DSV, false, L"DSV heap");
+		dsv_descriptors = std::make_unique<DescriptorAllocator>(*dsv_pages, 1);
+		D3D12_CLEAR_VALUE clearValue = {};
+		clearValue.Format = depth_format;
+		clearValue.DepthStencil.Depth = 1.0f;
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(depth_format, GetWidth(), GetHeight(), 1, 1, 1, 0,
+				D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL | D3D12_RESOURCE_FLAG_DENY_SHADER_RESOURCE),
+			D3D12_RESOURCE_STATE_DEPTH_WRITE,
+			&clearValue,
+			IID_PPV_ARGS(&depth_buffer)));
+		depth_buffer->SetName(L"Depth buffer");
+		depth_view = dsv_descriptors->Allocate();
+		device->CreateDepthStencilView(depth_buffer.Get(), nullptr, {static_cast<SIZE_T>(depth_view.cpu_address)});
+	}
+
+	// Persistent CBV/SRV/UAV descriptors are staged on the CPU and copied into the shader-visible ring per frame
+	resource_pages = std::make_unique<D3D12DescriptorPageSource>(device.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, false, L"Resource descriptors");
+	resource_descriptors = std::make_unique<DescriptorAllocator>(*resource_pages, resource_page_capacity);
+	descriptor_ring = std::make_unique<D3D12DescriptorRing>(device.Get(), descriptor_ring_size);
+	scene_view = resource_descriptors->Allocate();
+
+	// Create a command allocator per frame slot
+	for (UINT i = 0; i < frame_number; i++) {
+		ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&command_allocators[i])));
+	}
 }
 
 void Renderer::LoadAssets() {
@@ -165,11 +272,12 @@ void Renderer::LoadAssets() {
 		rsFeatureData.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
 	}
 
-	CD3DX12_DESCRIPTOR_RANGE1 ranges[1];
 	CD3DX12_ROOT_PARAMETER1 rootParams[1];
 
-	ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	rootParams[0].InitAsDescriptorTable(1, &ranges[0], D3D12_SHADER_VISIBILITY_VERTEX);
+	// Constants live in the upload ring and are bound through a table in the descriptor ring
+	CD3DX12_DESCRIPTOR_RANGE1 sceneRange;
+	sceneRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+	rootParams[0].InitAsDescriptorTable(1, &sceneRange, D3D12_SHADER_VISIBILITY_VERTEX);
 
 	D3D12_ROOT_SIGNATURE_FLAGS rsFlags =
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT
@@ -191,216 +299,449 @@ void Renderer::LoadAssets() {
 	ThrowIfFailed(device->CreateRootSignature(0, signature->GetBufferPointer(),
 		signature->GetBufferSize(), IID_PPV_ARGS(&root_signature)));
 
-	// Create full PSO
-	ComPtr<ID3D10Blob> vertexShader;
-	ComPtr<ID3D10Blob> pixelShader;
+	// Create full PSO; bytecode and the serialized pipeline come from the shader cache when their keys match
+	root_signature_blob = signature;
+	std::wstring cacheDir = GetBinPath(std::wstring(L"shader_cache"));
+	cache_store = std::make_unique<DirectoryCacheStore>(std::string(cacheDir.begin(), cacheDir.end()), shader_cache_size);
+	shader_cache = std::make_unique<ShaderCache>(*cache_store, shader_compiler);
+
+	std::wstring wshaderPath = GetBinPath(std::wstring(L"shaders.hlsl"));
+	std::string shaderPath(wshaderPath.begin(), wshaderPath.end());
+	std::string shaderSource;
+	std::string shaderErr;
+	if (!file_system.ReadFile(shaderPath, shaderSource) || shaderSource.empty()) {
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+	}
+	pipeline_state = BuildPipelineState(shaderSource, shaderErr);
+	if (!pipeline_state) {
+		OutputDebugStringA(shaderErr.c_str());
+		ThrowIfFailed(E_FAIL);
+	}
+
+	// Create command list
+	ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, command_allocators[0].Get(), pipeline_state.Get(), IID_PPV_ARGS(&command_list)));
+	ThrowIfFailed(command_list->Close());
+	command_lists = std::make_unique<D3D12CommandListPool>(device.Get(), command_queue.Get(), frames_in_flight, max_draw_chunks);
+
+	// Load the model from the mesh cache, or from OBJ when the cache is missing or stale
+	std::wstring objDir = GetBinPath(std::wstring());
+	std::string objPath(objDir.begin(), objDir.end());
+	std::string inputfile = objPath + "CornellBox-Original.obj";
+	std::string cachefile = objPath + "CornellBox-Original.meshcache";
+
+	std::string cacheErr;
+
+	// The model streams in on background threads from the mesh cache, or from OBJ when the cache is missing or
+	// stale; the first frames draw whatever has arrived
+	buffer_heap = std::make_unique<D3D12BufferHeap>(device.Get(), D3D12_HEAP_TYPE_DEFAULT, buffer_heap_size, L"Buffer heap");
+	copy_backend = std::make_unique<D3D12CopyBackend>(device.Get(), staging_size);
+	upload_batcher = std::make_unique<UploadBatcher>(*copy_backend, staging_size);
+	if (stream_cache.Open(cachefile, cacheErr) && stream_cache.IsFresh(objPath, cacheErr)) {
+		stream_source = std::make_unique<MeshViewStreamSource>(stream_cache.GetView());
+		OutputDebugString(L"Streaming mesh from cache\n");
+	} else {
+		std::wstring wcacheErr(cacheErr.begin(), cacheErr.end());
+		wcacheErr = L"Mesh cache skipped: " + wcacheErr + L'\n';
+		OutputDebugString(wcacheErr.c_str());
+		stream_cache.Close();
+		stream_source = std::make_unique<ObjStreamSource>(inputfile);
+		cook_model_path = inputfile;
+		cook_cache_path = cachefile;
+		cook_sources = FindMeshSources(inputfile);
+	}
+	// The CPU copies also give the mesh cache its contents, so the OBJ is parsed only once
+	const bool keepStreamedMesh = occlusion_culling || !cook_model_path.empty();
+	stream_target = std::make_unique<D3D12StreamTarget>(command_queue.Get(), *buffer_heap, *copy_backend, *upload_batcher, vertex_format,
+		keepStreamedMesh ? &occluder_vertices : nullptr, keepStreamedMesh ? &occluder_indices : nullptr);
+	streamer = std::make_unique<AssetStreamer>(*stream_source, *stream_target, AssetStreamerSettings());
+	streamer->Start();
+	scene.SetLodSelection(static_cast<float>(height), lod_pixel_error);
+	scene.SetOcclusionCulling(occlusion_culling);
+
+	// Init upload ring for constants
+	upload_heap = std::make_unique<D3D12BufferHeap>(device.Get(), D3D12_HEAP_TYPE_UPLOAD, upload_heap_size, L"Upload heap");
+	upload_pages = std::make_unique<D3D12UploadPageSource>(*upload_heap);
+	upload_ring = std::make_unique<UploadRing>(*upload_pages, upload_page_size);
+
+	// Create synchronization objects
+	fence_timeline = std::make_unique<D3D12FenceTimeline>(device.Get(), command_queue.Get());
+	frame_ring = std::make_unique<FrameRing>(*fence_timeline, frames_in_flight);
+	gpu_profiler = std::make_unique<D3D12GpuProfiler>(device.Get(), command_queue.Get(), frames_in_flight);
+
+	// Every cook of the mesh cache goes through one thread, after the cache is no longer mapped
+	cache_cooker = std::make_unique<MeshCacheCooker>([](const std::string &err) {
+		OutputDebugStringA(("Mesh cache not cooked: " + err + "\n").c_str());
+	});
+
+	// Edits of the shader or the model are rebuilt on a worker and swapped in between frames
+	hot_reloader = std::make_unique<HotReloader>(file_system, reload_clock, reload_settle_time);
+	hot_reloader->AddReload("shaders.hlsl", {shaderPath}, [this, shaderPath](HotReloader::ApplyFunction &apply, std::string &err) {
+		std::string source;
+		if (!file_system.ReadFile(shaderPath, source)) {
+			err = "Cannot read " + shaderPath;
+			return false;
+		}
+		ComPtr<ID3D12PipelineState> pipeline = BuildPipelineState(source, err);
+		if (!pipeline) {
+			return false;
+		}
+		apply = [this, pipeline]() {
+			retire_queue.Retire(frame_ring->GetCurrentFenceValue(), [old = pipeline_state]() {});
+			pipeline_state = pipeline;
+			OutputDebugString(L"Reloaded shaders.hlsl\n");
+		};
+		return true;
+	});
+
+	std::vector<std::string> meshSources = FindMeshSources(inputfile);
+	for (std::string &source : meshSources) {
+		source = objPath + source;
+	}
+	hot_reloader->AddReload("CornellBox-Original.obj", meshSources, [this, inputfile, cachefile, objPath](HotReloader::ApplyFunction &apply, std::string &err) {
+		std::shared_ptr<Mesh> reloaded = std::make_shared<Mesh>();
+		MeshStats meshStats;
+		std::string warn;
+		if (!LoadObjMesh(inputfile, *reloaded, meshStats, warn, err)) {
+			return false;
+		}
+		const std::vector<std::string> sources = FindMeshSources(inputfile);
+
+		// Simplification is the slow part of a reload, so it stays on the worker
+		std::shared_ptr<std::vector<uint8_t>> packedIndices = std::make_shared<std::vector<uint8_t>>();
+		const MeshView meshView = GetMeshView(*reloaded, *packedIndices);
+		std::shared_ptr<MeshLods> lods = std::make_shared<MeshLods>();
+		BuildMeshLods(meshView, MeshLodSettings(), *lods);
+
+		apply = [this, reloaded, packedIndices, meshView, lods, cachefile, objPath, sources]() {
+			// The reloaded model replaces whatever part of the old one has streamed in; streaming may have the
+			// cache mapped, so it is cooked once that has stopped
+			StopStreaming();
+			cache_cooker->Cook(cachefile, reloaded, objPath, sources);
+			ApplyMesh(meshView, *lods);
+			OutputDebugString(L"Reloaded CornellBox-Original.obj\n");
+		};
+		return true;
+	});
+	hot_reloader->Start(reload_poll_interval);
+}
+
+void Renderer::ApplyMesh(const MeshView &meshView, const MeshLods &lods) {
+	scene.SetShapes(meshView.shapes, meshView.shape_count);
+	scene.SetLods(lods);
+	materials.assign(meshView.materials, meshView.materials + meshView.material_count);
+	index_count = meshView.index_count + static_cast<UINT>(lods.indices.size());
+
+	// Frames up to the one being recorded may still read the old buffers
+	if (vertex_buffer) {
+		retire_queue.Retire(frame_ring->GetCurrentFenceValue(), [oldVertices = vertex_buffer, oldIndices = index_buffer]() {});
+	}
+
+	const UINT vertexStride = static_cast<UINT>(GetVertexStride(vertex_format));
+	const UINT vertexBufferSize = vertexStride * meshView.vertex_count;
+	if (vertex_format == VertexFormat::Quantized) {
+		vertex_quantization = ComputeVertexQuantization(meshView.vertices, meshView.vertex_count);
+		std::vector<QuantizedVertex> encoded(meshView.vertex_count);
+		EncodeVertices(meshView.vertices, meshView.vertex_count, vertex_quantization, encoded.data());
+		vertex_buffer = CreateStaticBuffer(encoded.data(), vertexBufferSize, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, L"Vertex buffer");
+	} else {
+		vertex_buffer = CreateStaticBuffer(meshView.vertices, vertexBufferSize, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER, L"Vertex buffer");
+	}
+
+	vertex_buffer_view.BufferLocation = vertex_buffer->GetGPUVirtualAddress();
+	vertex_buffer_view.StrideInBytes = vertexStride;
+	vertex_buffer_view.SizeInBytes = vertexBufferSize;
+
+	// LOD levels index the same vertices, so they fit the mesh's index size
+	const UINT meshIndexSize = meshView.index_size * meshView.index_count;
+	const UINT indexBufferSize = meshView.index_size * index_count;
+	std::vector<uint8_t> indices(indexBufferSize);
+	memcpy(indices.data(), meshView.indices, meshIndexSize);
+	lods.PackIndices(meshView.index_size, indices.data() + meshIndexSize);
+	index_buffer = CreateStaticBuffer(indices.data(), indexBufferSize, D3D12_RESOURCE_STATE_INDEX_BUFFER, L"Index buffer");
+
+	// All static uploads go out in one submission; the direct queue waits for it on the GPU
+	ThrowIfFailed(command_queue->Wait(copy_backend->GetFence(), upload_batcher->Flush()));
+
+	index_buffer_view.BufferLocation = index_buffer->GetGPUVirtualAddress();
+	index_buffer_view.Format = meshView.index_size == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+	index_buffer_view.SizeInBytes = indexBufferSize;
+
+	// Occluders draw level 0, which is the mesh's own range
+	if (occlusion_culling) {
+		occluder_vertices.assign(meshView.vertices, meshView.vertices + meshView.vertex_count);
+		occluder_indices.resize(meshView.index_count);
+		for (UINT i = 0; i < meshView.index_count; i++) {
+			occluder_indices[i] = meshView.index_size == 2 ? static_cast<const uint16_t *>(meshView.indices)[i] :
+				static_cast<const uint32_t *>(meshView.indices)[i];
+		}
+		scene.SetOccluderGeometry(occluder_vertices.data(), meshView.vertex_count, occluder_indices.data(), meshView.index_count);
+	}
+}
+
+void Renderer::UpdateStreaming() {
+	if (!streamer) {
+		return;
+	}
+	PROFILE_SCOPE("UpdateStreaming");
+
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, eyePos);
+	if (streamer->Update({eye.x, eye.y, eye.z})) {
+		if (!vertex_buffer) {
+			vertex_buffer = stream_target->GetVertexBuffer();
+			index_buffer = stream_target->GetIndexBuffer();
+			vertex_buffer_view = stream_target->GetVertexBufferView();
+			index_buffer_view = stream_target->GetIndexBufferView();
+			vertex_quantization = stream_target->GetQuantization();
+			materials = streamer->GetMaterials();
+		}
+		scene.SetShapes(streamer->GetShapes().data(), streamer->GetShapes().size());
+		scene.SetLods(streamer->GetLods());
+		index_count = static_cast<UINT>(streamer->GetIndexCount());
+		if (occlusion_culling) {
+			scene.SetOccluderGeometry(occluder_vertices.data(), static_cast<uint32_t>(occluder_vertices.size()), occluder_indices.data(),
+				static_cast<uint32_t>(occluder_indices.size()));
+		}
+	}
+
+	const StreamState state = streamer->GetState();
+	if (state == StreamState::Opening || state == StreamState::Streaming) {
+		return;
+	}
+
+	const AssetStreamerStats stats = streamer->GetStats();
+	if (state == StreamState::Failed || stats.failed_chunks > 0) {
+		OutputDebugStringA(("Mesh streaming failed: " + stats.last_error + "\n").c_str());
+		if (stats.resident_chunks == 0) {
+			ThrowIfFailed(E_FAIL);
+		}
+	} else {
+		OutputDebugString(L"Mesh streaming finished\n");
+	}
+
+	// A streamed OBJ is cooked in the background from what was uploaded, so the next start streams from the cache
+	std::shared_ptr<Mesh> streamedMesh;
+	if (!cook_model_path.empty() && state == StreamState::Finished) {
+		streamedMesh = std::make_shared<Mesh>();
+		streamer->GetStreamedMesh(occluder_vertices.data(), occluder_indices.data(), *streamedMesh);
+	}
+	StopStreaming();
+	if (streamedMesh) {
+		const std::string objPath = cook_model_path.substr(0, cook_model_path.find_last_of("\\/") + 1);
+		cache_cooker->Cook(cook_cache_path, streamedMesh, objPath, cook_sources);
+	}
+	if (!occlusion_culling) {
+		std::vector<MeshVertex>().swap(occluder_vertices);
+		std::vector<uint32_t>().swap(occluder_indices);
+	}
+	cook_model_path.clear();
+}
+
+void Renderer::StopStreaming() {
+	// Joins the streaming threads; the buffers stay with the renderer, which retires them like any other
+	streamer.reset();
+	stream_target.reset();
+	stream_source.reset();
+	stream_cache.Close();
+}
 
+ComPtr<ID3D12PipelineState> Renderer::BuildPipelineState(const std::string &source, std::string &err) {
 	UINT compileFlags = 0;
 #ifdef DEBUG
 	compileFlags |= D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
 #endif // DEBUG
 
-	std::wstring shaderPath = GetBinPath(std::wstring(L"shaders.hlsl"));
-	ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, nullptr, "VSMain", "vs_5_0", compileFlags, 0, &vertexShader, &error));
-	ThrowIfFailed(D3DCompileFromFile(shaderPath.c_str(), nullptr, nullptr, "PSMain", "ps_5_0", compileFlags, 0, &pixelShader, &error));
-
-	D3D12_INPUT_ELEMENT_DESC inputElementDescriptors[] = {
-		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
-		{"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0}
-	};
+	std::vector<uint8_t> vertexShader;
+	std::vector<uint8_t> pixelShader;
+	if (!shader_cache->GetShader(source, {"shaders.hlsl", "VSMain", "vs_5_0", GetVertexShaderDefines(vertex_format), compileFlags}, vertexShader, err) ||
+		!shader_cache->GetShader(source, {"shaders.hlsl", "PSMain", "ps_5_0", {}, compileFlags}, pixelShader, err)) {
+		return nullptr;
+	}
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDescriptor = {};
-	psoDescriptor.InputLayout = {inputElementDescriptors, _countof(inputElementDescriptors)};
+	psoDescriptor.InputLayout = GetInputLayout(vertex_format);
 	psoDescriptor.pRootSignature = root_signature.Get();
-	psoDescriptor.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
-	psoDescriptor.PS = CD3DX12_SHADER_BYTECODE(pixelShader.Get());
+	psoDescriptor.VS = {vertexShader.data(), vertexShader.size()};
+	psoDescriptor.PS = {pixelShader.data(), pixelShader.size()};
 	psoDescriptor.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	psoDescriptor.RasterizerState.FillMode = D3D12_FILL_MODE_WIREFRAME;
 	psoDescriptor.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 	psoDescriptor.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	psoDescriptor.DepthStencilState.DepthEnable = false;
 	psoDescriptor.DepthStencilState.StencilEnable = false;
+	if (occlusion_culling) {
+		psoDescriptor.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
+		psoDescriptor.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+		psoDescriptor.DSVFormat = depth_format;
+	}
 	psoDescriptor.SampleMask = UINT_MAX;
 	psoDescriptor.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
 	psoDescriptor.NumRenderTargets = 1;
 	psoDescriptor.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 	psoDescriptor.SampleDesc.Count = 1;
 
-	ThrowIfFailed(device->CreateGraphicsPipelineState(&psoDescriptor, IID_PPV_ARGS(&pipeline_state)));
-
-	// Create command list
-	ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, command_allocator.Get(), pipeline_state.Get(), IID_PPV_ARGS(&command_list)));
-	ThrowIfFailed(command_list->Close());
+	return CreateCachedPipelineState(psoDescriptor, root_signature_blob.Get());
+}
 
-	// Create and upload vertex buffer
-	std::wstring objDir = GetBinPath(std::wstring());
-	std::string objPath(objDir.begin(), objDir.end());
-	std::string inputfile = objPath + "CornellBox-Original.obj";
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
+void Renderer::BuildRenderGraph() {
+	// The back buffer enters and leaves the frame ready for present; new passes declare what they use here
+	back_buffer = render_graph.ImportResource("Back buffer", ResourceState::Present, ResourceState::Present);
+	const RenderGraph::PassId scenePass = render_graph.AddPass("Scene", [this]() { RecordScenePass(); });
+	render_graph.Write(scenePass, back_buffer, ResourceState::RenderTarget);
+	if (occlusion_culling) {
+		depth = render_graph.ImportResource("Depth buffer", ResourceState::DepthWrite, ResourceState::DepthWrite);
+		render_graph.Write(scenePass, depth, ResourceState::DepthWrite);
+	}
 
-	std::string warn;
 	std::string err;
-
-	bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, inputfile.c_str());
-
-	if (!warn.empty()) {
-		std::wstring wwarn(warn.begin(), warn.end());
-		wwarn = L"Tinyobjloader warning: " + wwarn + L'\n';
-		OutputDebugString(wwarn.c_str());
-	}
-
-	if (!err.empty()) {
-		std::wstring werr(err.begin(), err.end());
-		werr = L"Tinyobjloader error: " + werr + L'\n';
-		OutputDebugString(werr.c_str());
-	}
-
-	if (!ret) {
-		ThrowIfFailed(-1);
-	}
-
-	// Loop over shapes
-	for (size_t s = 0; s < shapes.size(); s++) {
-		// Loop over faces(polygon)
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-			int fv = shapes[s].mesh.num_face_vertices[f];
-
-			// per-face material
-			int material_ids = shapes[s].mesh.material_ids[f];
-
-			// Loop over vertices in the face.
-			for (size_t v = 0; v < fv; v++) {
-				// access to vertex
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-				tinyobj::real_t vx = attrib.vertices[3 * idx.vertex_index + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * idx.vertex_index + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * idx.vertex_index + 2];
-				materials[material_ids].diffuse;
-				ColorVertex colorVertex = {
-					{vx, vy, vz},
-					{
-					materials[material_ids].diffuse[0],
-					materials[material_ids].diffuse[1],
-					materials[material_ids].diffuse[2],
-					1.0f
-					}
-				};
-				colorVertices.push_back(colorVertex);
-			}
-
-			index_offset += fv;
-		}
+	if (!render_graph.Compile(err)) {
+		OutputDebugStringA((err + "\n").c_str());
+		ThrowIfFailed(E_FAIL);
 	}
+}
 
-	ColorVertex triangleVertices[] = {
-		{{0.0f, 0.25f * aspectRatio, 0.0f}, {1.0f, 0.0f, 0.0f, 1.0f}},
-		{{0.25f, -0.25f * aspectRatio, 0.0f}, {0.0f, 1.0f, 0.0f, 1.0f}},
-		{{-0.25f, -0.25f * aspectRatio, 0.0f}, {0.0f, 0.0f, 1.0f, 1.0f}}
-	};
-
-	const UINT vertexBufferSize = sizeof(ColorVertex) * colorVertices.size();
-	ThrowIfFailed(device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&vertex_buffer)
-	));
-
-	UINT8 *vertexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	ThrowIfFailed(vertex_buffer->Map(0, &readRange, reinterpret_cast<void **>(&vertexDataBegin)));
-	memcpy(vertexDataBegin, colorVertices.data(), vertexBufferSize);
-	vertex_buffer->Unmap(0, nullptr);
-
-	vertex_buffer_view.BufferLocation = vertex_buffer->GetGPUVirtualAddress();
-	vertex_buffer_view.StrideInBytes = sizeof(ColorVertex);
-	vertex_buffer_view.SizeInBytes = vertexBufferSize;
+void Renderer::PopulateCommandList() {
+	PROFILE_SCOPE("PopulateCommandList");
 
-	// Init constant buffer
-	ThrowIfFailed(device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(1024 * 64),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&constantBuffer)
-	));
+	// Reset allocators and lists; the frame ring guarantees the slot's previous frame has retired
+	ThrowIfFailed(command_allocators[frame_slot]->Reset());
+	ThrowIfFailed(command_list->Reset(command_allocators[frame_slot].Get(), pipeline_state.Get()));
+	const UINT gpuFrameScope = gpu_profiler->BeginScope(command_list.Get(), "Frame");
 
-	D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDescriptor = {};
-	cbvDescriptor.BufferLocation = constantBuffer->GetGPUVirtualAddress();
-	cbvDescriptor.SizeInBytes = (sizeof(worldViewProj) + 255) & ~255;
-	device->CreateConstantBufferView(&cbvDescriptor, cbvHeap->GetCPUDescriptorHandleForHeapStart());
+	// Hand freshly uploaded static buffers over from the copy queue
+	if (!pending_barriers.empty()) {
+		command_list->ResourceBarrier(static_cast<UINT>(pending_barriers.size()), pending_barriers.data());
+		pending_barriers.clear();
+	}
 
-	ThrowIfFailed(constantBuffer->Map(0, &readRange, reinterpret_cast<void **>(&cbvDataBegin)));
-	memcpy(cbvDataBegin, &worldViewProj, sizeof(worldViewProj));
+	// Constants of this frame retire with the frame fence
+	// One SceneConstants slot per transform node, each at a constant buffer boundary, its world_view_proj written
+	// by the hierarchy
+	SceneConstants sceneConstants = {MatrixIdentity(), {}, {}};
+	for (int axis = 0; axis < 3; axis++) {
+		sceneConstants.position_scale[axis] = vertex_quantization.scale[axis];
+		sceneConstants.position_offset[axis] = vertex_quantization.offset[axis];
+	}
+	const size_t slotStride = (sizeof(sceneConstants) + UploadRing::default_alignment - 1) & ~(UploadRing::default_alignment - 1);
+	const size_t nodeCount = transforms.GetCount();
+	UploadAllocation constants = upload_ring->Allocate(nodeCount * slotStride);
+	for (size_t node = 0; node < nodeCount; node++) {
+		memcpy(constants.cpu_address + node * slotStride, &sceneConstants, sizeof(sceneConstants));
+	}
+	transforms.UpdateWorld();
+	transforms.WriteClipMatrices(scene.GetViewProj(), 0, nodeCount, false, constants.cpu_address + offsetof(SceneConstants, world_view_proj),
+		slotStride);
+
+	// The staging view is copied right away, so rewriting it next frame leaves this frame's table intact
+	D3D12_CONSTANT_BUFFER_VIEW_DESC sceneView = {constants.gpu_address + model_node * slotStride, static_cast<UINT>(slotStride)};
+	device->CreateConstantBufferView(&sceneView, {static_cast<SIZE_T>(scene_view.cpu_address)});
+	if (!descriptor_ring->CopyTable(scene_view, scene_table)) {
+		ThrowIfFailed(E_OUTOFMEMORY);
+	}
 
-	// Create synchronization objects
-	ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
-	fence_value = 1;
-	fence_event = CreateEvent(nullptr, false, false, nullptr);
-	if (fence_event == nullptr) {
-		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+	// Barriers come from the render graph; the scene pass moves recording on to the epilogue list
+	graph_backend.SetCommandList(command_list.Get());
+	graph_backend.SetResource(back_buffer, render_targets[frame_index].Get());
+	if (depth_buffer) {
+		graph_backend.SetResource(depth, depth_buffer.Get());
 	}
-}
+	render_graph.Execute(graph_backend);
 
-void Renderer::PopulateCommandList() {
-	// Reset allocators and lists
-	ThrowIfFailed(command_allocator->Reset());
-	ThrowIfFailed(command_list->Reset(command_allocator.Get(), pipeline_state.Get()));
-
-	// Set initial state
-	command_list->SetGraphicsRootSignature(root_signature.Get());
-	ID3D12DescriptorHeap *heaps[] = {cbvHeap.Get()};
-	command_list->SetDescriptorHeaps(_countof(heaps), heaps);
-	command_list->SetGraphicsRootDescriptorTable(0, cbvHeap->GetGPUDescriptorHandleForHeapStart());
-	command_list->RSSetViewports(1, &view_port);
-	command_list->RSSetScissorRects(1, &scissor_rect);
-
-	// Resource barrier from present to RT
-	command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-		render_targets[frame_index].Get(),
-		D3D12_RESOURCE_STATE_PRESENT,
-		D3D12_RESOURCE_STATE_RENDER_TARGET
-	));
+	ID3D12GraphicsCommandList *epilogue = graph_backend.GetCommandList();
+	gpu_profiler->EndScope(epilogue, gpuFrameScope);
+	gpu_profiler->EndFrame(epilogue);
+}
 
-	// Record commands
-	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(rtv_heap->GetCPUDescriptorHandleForHeapStart(), frame_index, rtv_descriptor_size);
-	command_list->OMSetRenderTargets(1, &rtvHandle, false, nullptr);
+void Renderer::RecordScenePass() {
+	const D3D12_CPU_DESCRIPTOR_HANDLE rtvHandle = {static_cast<SIZE_T>(render_target_views[frame_index].cpu_address)};
 	const float clearColor[] = {0.0f, 0.0f, 0.0f, 1.0f};
 	command_list->ClearRenderTargetView(rtvHandle, clearColor, 0, nullptr);
-	command_list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	command_list->IASetVertexBuffers(0, 1, &vertex_buffer_view);
-	command_list->DrawInstanced(colorVertices.size(), 1, 0, 0);
-
-	// Resource barrier from RT to present
-	command_list->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(
-		render_targets[frame_index].Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		D3D12_RESOURCE_STATE_PRESENT
-	));
-
-	// Close command list
+	const D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle = {static_cast<SIZE_T>(depth_view.cpu_address)};
+	const D3D12_CPU_DESCRIPTOR_HANDLE *depthHandle = depth_buffer ? &dsvHandle : nullptr;
+	if (depth_buffer) {
+		command_list->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
+	}
+	const UINT gpuDrawScope = gpu_profiler->BeginScope(command_list.Get(), "Draw shapes");
 	ThrowIfFailed(command_list->Close());
+
+	// Draws are recorded in chunks on the job system; each chunk list starts without state, so it sets its own
+	ID3D12PipelineState *pipelines[] = {pipeline_state.Get()};
+	command_lists->BeginFrame(frame_slot, command_list.Get(), pipelines, _countof(pipelines), [&](ID3D12GraphicsCommandList *list) {
+		ID3D12DescriptorHeap *heaps[] = {descriptor_ring->GetHeap()};
+		list->SetDescriptorHeaps(_countof(heaps), heaps);
+		list->SetGraphicsRootSignature(root_signature.Get());
+		list->RSSetViewports(1, &view_port);
+		list->RSSetScissorRects(1, &scissor_rect);
+		list->OMSetRenderTargets(1, &rtvHandle, false, depthHandle);
+		list->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		list->IASetVertexBuffers(0, 1, &vertex_buffer_view);
+		list->IASetIndexBuffer(&index_buffer_view);
+	});
+	{
+		PROFILE_SCOPE("Record draws");
+		draw_recorder.Record(scene, scene_table.ptr, *command_lists, *jobs);
+	}
+
+	ID3D12GraphicsCommandList *epilogue = command_lists->OpenEpilogue();
+	gpu_profiler->EndScope(epilogue, gpuDrawScope);
+	graph_backend.SetCommandList(epilogue);
+}
+
+void Renderer::WaitForGpu() {
+	PROFILE_SCOPE("WaitForGpu");
+	if (frame_ring) {
+		frame_ring->WaitForIdle();
+	}
 }
 
-void Renderer::WaitForPreviousFrame() {
-	// WAITING FOR THE FRAME TO COMPLETE BEFORE CONTINUING IS NOT BEST PRACTICE.
-	// Signal and increment the fence value.
-	const UINT64 prevFenceVal = fence_value;
-	ThrowIfFailed(command_queue->Signal(fence.Get(), prevFenceVal));
-	fence_value++;
+PlacedBuffer Renderer::CreateStaticBuffer(const void *data, UINT64 size, D3D12_RESOURCE_STATES state, LPCWSTR name) {
+	// Buffers start in COMMON so the copy queue can promote them implicitly; they decay back after the copy
+	PlacedBuffer buffer = buffer_heap->CreateBuffer(size, name);
+
+	upload_batcher->Upload(buffer.Get(), 0, data, size);
+	pending_barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(buffer.Get(), D3D12_RESOURCE_STATE_COMMON, state));
+	return buffer;
+}
 
-	if (fence->GetCompletedValue() < prevFenceVal) {
-		ThrowIfFailed(fence->SetEventOnCompletion(prevFenceVal, fence_event));
-		WaitForSingleObject(fence_event, INFINITE);
+ComPtr<ID3D12PipelineState> Renderer::CreateCachedPipelineState(D3D12_GRAPHICS_PIPELINE_STATE_DESC &descriptor, ID3DBlob *signature_blob) {
+	// Everything the driver compiles into the blob; the state structs contain no pointers
+	PipelineKeyBuilder key;
+	key.Add(descriptor.VS.pShaderBytecode, descriptor.VS.BytecodeLength);
+	key.Add(descriptor.PS.pShaderBytecode, descriptor.PS.BytecodeLength);
+	key.Add(signature_blob->GetBufferPointer(), signature_blob->GetBufferSize());
+	for (UINT i = 0; i < descriptor.InputLayout.NumElements; i++) {
+		const D3D12_INPUT_ELEMENT_DESC &element = descriptor.InputLayout.pInputElementDescs[i];
+		key.Add(std::string(element.SemanticName)).AddValue(element.SemanticIndex).AddValue(element.Format);
+		key.AddValue(element.InputSlot).AddValue(element.AlignedByteOffset).AddValue(element.InputSlotClass);
+		key.AddValue(element.InstanceDataStepRate);
+	}
+	key.AddValue(descriptor.StreamOutput.NumEntries).AddValue(descriptor.BlendState).AddValue(descriptor.SampleMask);
+	key.AddValue(descriptor.RasterizerState).AddValue(descriptor.DepthStencilState).AddValue(descriptor.IBStripCutValue);
+	key.AddValue(descriptor.PrimitiveTopologyType).AddValue(descriptor.NumRenderTargets).AddValue(descriptor.RTVFormats);
+	key.AddValue(descriptor.DSVFormat).AddValue(descriptor.SampleDesc).AddValue(descriptor.NodeMask).AddValue(descriptor.Flags);
+	key.AddValue(adapter_descriptor.VendorId).AddValue(adapter_descriptor.DeviceId).AddValue(adapter_descriptor.SubSysId);
+	key.AddValue(driver_version.QuadPart);
+
+	ComPtr<ID3D12PipelineState> pipeline;
+	std::vector<uint8_t> cachedBlob;
+	if (shader_cache->LoadPipeline(key.GetKey(), cachedBlob)) {
+		descriptor.CachedPSO = {cachedBlob.data(), cachedBlob.size()};
+		if (SUCCEEDED(device->CreateGraphicsPipelineState(&descriptor, IID_PPV_ARGS(&pipeline)))) {
+			descriptor.CachedPSO = {};
+			OutputDebugString(L"Pipeline state loaded from cache\n");
+			return pipeline;
+		}
+		// D3D12_ERROR_DRIVER_VERSION_MISMATCH and friends: rebuild and replace the blob
+		descriptor.CachedPSO = {};
+		shader_cache->RejectPipeline(key.GetKey());
 	}
 
-	frame_index = swap_chain->GetCurrentBackBufferIndex();
+	ThrowIfFailed(device->CreateGraphicsPipelineState(&descriptor, IID_PPV_ARGS(&pipeline)));
+	ComPtr<ID3DBlob> blob;
+	if (SUCCEEDED(pipeline->GetCachedBlob(&blob))) {
+		shader_cache->StorePipeline(key.GetKey(), blob->GetBufferPointer(), blob->GetBufferSize());
+	}
+	return pipeline;
 }
 
 std::wstring Renderer::GetBinPath(std::wstring shader_file) const {
@@ -2,38 +2,83 @@
 
 #include "dx12_labs.h"
 #include "win32_window.h"
+#include "mesh_cache.h"
+#include "dx12_fence_timeline.h"
+#include "dx12_upload_pages.h"
+#include "dx12_copy_queue.h"
+#include "scene_pipeline.h"
+#include "transform_hierarchy.h"
+#include "dx12_command_list_pool.h"
+#include "dx12_render_graph.h"
+#include "dx12_descriptor_heaps.h"
+#include "dx12_resource_heaps.h"
+#include "dx12_vertex_format.h"
+#include "dx12_stream_target.h"
+#include "asset_streamer.h"
+#include "profiler.h"
+#include "dx12_gpu_profiler.h"
+#include "dx12_shader_compiler.h"
+#include "hot_reload.h"
+#include "job_system.h"
 
+#include <memory>
+
+
+// Layout of ConstantBuffer in shaders.hlsl
+struct SceneConstants
+{
+	Float4x4 world_view_proj;
+	float position_scale[4];
+	float position_offset[4];
+};
 
 class Renderer {
 public:
-	Renderer(UINT width, UINT height) : width(width), height(height), title(L"DX12 renderer"), frame_index(0), rtv_descriptor_size(0) {
+	Renderer(UINT width, UINT height, UINT frames_in_flight = frame_number, VertexFormat vertex_format = VertexFormat::Float,
+		bool occlusion_culling = false) :
+		width(width), height(height), title(L"DX12 renderer"), vertex_format(vertex_format), occlusion_culling(occlusion_culling),
+		frame_index(0), draw_recorder(draw_chunk_batches, max_draw_chunks) {
 		view_port = CD3DX12_VIEWPORT(0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height));
 		scissor_rect = CD3DX12_RECT(0, 0, static_cast<LONG>(width), static_cast<LONG>(height));
 		vertex_buffer_view = {};
-		fence_value = 0;
-		fence_event = nullptr;
+		index_buffer_view = {};
+		index_count = 0;
+		vertex_quantization = {{1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+		adapter_descriptor = {};
+		driver_version = {};
+		this->frames_in_flight = frames_in_flight < 1 ? 1 : (frames_in_flight > frame_number ? frame_number : frames_in_flight);
+		frame_slot = 0;
+		picked_shape = -1;
+		frame_pick = -1;
+		model_node = transforms.Add(TransformHierarchy::no_parent, {0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f});
+		occlusion_culled = 0;
+		back_buffer = RenderGraph::no_resource;
+		depth = RenderGraph::no_resource;
+		depth_view = {};
+		scene_view = {};
+		scene_table = {};
+		view_alpha = 1.0f;
 		aspectRatio = static_cast<float>(width) / static_cast<float>(height);
-		colorVertices.clear();
 
 		deltaRotation = 0.0f;
 		deltaForward = 0.0f;
 		deltaZ = 0.0f;
 		deltaA = 0.0f;
 		angle = 0.0f;
+		previousAngle = angle;
 
-		worldViewProj = XMMatrixIdentity();
-		world = XMMatrixTranslation(0, 0, 0) * XMMatrixScaling(1, 1, 1);
-		view = XMMatrixIdentity();
 		eyePos = XMVECTOR({0, 1, -5});
-		projection = XMMatrixPerspectiveFovLH(60.0f / 180.0f * XM_PI, aspectRatio, 0.001f, 100.0f);
+		previousEyePos = eyePos;
 		upDir = {0.0f, 1.0f, 0.0f};
 		lookAt = eyePos + XMVECTOR({sinf(angle), 0.0f, cosf(angle)});
 	};
 	virtual ~Renderer() {};
 
 	virtual void OnInit();
-	virtual void OnUpdate();
-	virtual void OnRender();
+	// Advances the simulation by one fixed step of step seconds
+	virtual void OnUpdate(float step);
+	// alpha interpolates between the last two simulated states
+	virtual void OnRender(float alpha);
 	virtual void OnDestroy();
 
 	virtual void OnKeyDown(UINT8 key);
@@ -47,52 +92,174 @@ protected:
 	UINT width;
 	UINT height;
 	std::wstring title;
+	// Layout of the vertex buffer, fixed for the renderer's lifetime; pipelines and reloads follow it
+	VertexFormat vertex_format;
+	// Shapes hidden behind the largest visible ones are not drawn; this keeps a CPU copy of the geometry
+	bool occlusion_culling;
 
-	XMVECTOR eyePos;
+	XMVECTOR eyePos, previousEyePos;
+	// Input axes in [-1, 1], scaled by the speeds below
 	float deltaRotation, deltaForward, deltaZ, deltaA;
 
-	static const UINT frame_number = 2;
+	// Swap chain buffers and the maximum number of frames the CPU may record ahead of the GPU
+	static const UINT frame_number = 3;
+	static const UINT upload_page_size = 64 * 1024;
+	// Descriptors per page of the RTV and staging heaps, and in the shader-visible ring of the frames in flight
+	static const uint32_t rtv_page_capacity = 16;
+	static const uint32_t resource_page_capacity = 256;
+	static const uint32_t descriptor_ring_size = 4096;
+	static const DXGI_FORMAT depth_format = DXGI_FORMAT_D32_FLOAT;
+	static const UINT64 staging_size = 4 * 1024 * 1024;
+	static const UINT64 buffer_heap_size = 64 * 1024 * 1024;
+	static const UINT64 upload_heap_size = 4 * 1024 * 1024;
+	static constexpr float far_plane = 100.0f;
+	static const uint64_t shader_cache_size = 256 * 1024 * 1024;
+	static const uint64_t reload_poll_interval = 100000000;
+	static const uint64_t reload_settle_time = 200000000;
+	// Radians and units per second
+	static constexpr float rotation_speed = 1.0f;
+	static constexpr float move_speed = 1.5f;
+	// Draw recording is split into chunks of at least this many batches, recorded on worker threads
+	static const uint32_t draw_chunk_batches = 256;
+	static const uint32_t max_draw_chunks = 16;
+	// Shapes switch to a coarser LOD once its error projects below this many pixels
+	static constexpr float lod_pixel_error = 1.0f;
 
 	// Pipeline objects.
 	ComPtr<ID3D12Device> device;
+	DXGI_ADAPTER_DESC1 adapter_descriptor;
+	LARGE_INTEGER driver_version;
 	ComPtr<ID3D12CommandQueue> command_queue;
 	ComPtr<IDXGISwapChain3> swap_chain;
-	ComPtr<ID3D12DescriptorHeap> rtv_heap;
-	UINT rtv_descriptor_size;
 	ComPtr<ID3D12Resource> render_targets[frame_number];
-	ComPtr<ID3D12CommandAllocator> command_allocator;
+	std::unique_ptr<D3D12DescriptorPageSource> rtv_pages;
+	std::unique_ptr<DescriptorAllocator> rtv_descriptors;
+	DescriptorAllocation render_target_views[frame_number];
+	// Only with occlusion culling, whose view is filled and depth tested: a wireframe would show through the
+	// shapes that hide what it drops
+	std::unique_ptr<D3D12DescriptorPageSource> dsv_pages;
+	std::unique_ptr<DescriptorAllocator> dsv_descriptors;
+	ComPtr<ID3D12Resource> depth_buffer;
+	DescriptorAllocation depth_view;
+	std::unique_ptr<D3D12DescriptorPageSource> resource_pages;
+	std::unique_ptr<DescriptorAllocator> resource_descriptors;
+	// Descriptor tables of the frames in flight, retired by the frame fence
+	std::unique_ptr<D3D12DescriptorRing> descriptor_ring;
+	// CBV of this frame's scene constants, rewritten every frame and copied into the ring as the scene table
+	DescriptorAllocation scene_view;
+	ComPtr<ID3D12CommandAllocator> command_allocators[frame_number];
 	ComPtr<ID3D12PipelineState> pipeline_state;
+	// Prologue of each frame: barriers, clear and GPU scopes; the draws go to command_lists
 	ComPtr<ID3D12GraphicsCommandList> command_list;
+	std::unique_ptr<D3D12CommandListPool> command_lists;
+	ParallelRecorder draw_recorder;
+
+	// Passes of a frame and the barriers between them; the back buffer is bound every frame
+	RenderGraph render_graph;
+	D3D12RenderGraphBackend graph_backend;
+	RenderGraph::ResourceId back_buffer;
+	RenderGraph::ResourceId depth;
+	D3D12_GPU_DESCRIPTOR_HANDLE scene_table;
 
 	ComPtr<ID3D12RootSignature> root_signature;
+	ComPtr<ID3DBlob> root_signature_blob;
+	D3DShaderCompiler shader_compiler;
+	std::unique_ptr<DirectoryCacheStore> cache_store;
+	// Only LoadAssets and then the hot reload worker use the shader cache
+	std::unique_ptr<ShaderCache> shader_cache;
+
+	// Hot reload of shaders.hlsl and the model; replaced objects wait in retire_queue for the frame fence
+	DiskFileSystem file_system;
+	SteadyClock reload_clock;
+	std::unique_ptr<HotReloader> hot_reloader;
+	// Static buffers are placed in buffer_heap and upload ring pages in upload_heap; both outlive the buffers,
+	// including those waiting in retire_queue
+	std::unique_ptr<D3D12BufferHeap> buffer_heap;
+	std::unique_ptr<D3D12BufferHeap> upload_heap;
+	RetireQueue retire_queue;
 	CD3DX12_VIEWPORT view_port;
 	CD3DX12_RECT scissor_rect;
 
 	// Resources
-	ComPtr<ID3D12Resource> vertex_buffer;
+	std::unique_ptr<D3D12CopyBackend> copy_backend;
+	std::unique_ptr<UploadBatcher> upload_batcher;
+	std::vector<D3D12_RESOURCE_BARRIER> pending_barriers;
+	PlacedBuffer vertex_buffer;
 	D3D12_VERTEX_BUFFER_VIEW vertex_buffer_view;
-	std::vector<ColorVertex> colorVertices;
+	// Maps quantized positions back to model space; identity for float vertices
+	VertexQuantization vertex_quantization;
+	PlacedBuffer index_buffer;
+	D3D12_INDEX_BUFFER_VIEW index_buffer_view;
+	UINT index_count;
+	std::vector<MeshMaterial> materials;
+	// CPU copy of the vertex and index buffers that occluders are rasterized from, kept with occlusion culling and
+	// while an OBJ streams, to cook the mesh cache from
+	std::vector<MeshVertex> occluder_vertices;
+	std::vector<uint32_t> occluder_indices;
+
+	// The model loads on the streamer's threads and the scene grows as chunks arrive; all of it is released once
+	// the model is complete. stream_cache stays mapped while its view streams.
+	MeshCacheFile stream_cache;
+	std::unique_ptr<StreamSource> stream_source;
+	std::unique_ptr<D3D12StreamTarget> stream_target;
+	std::unique_ptr<AssetStreamer> streamer;
+	// An OBJ that streamed is cooked into the mesh cache in the background afterwards
+	std::string cook_model_path;
+	std::string cook_cache_path;
+	std::vector<std::string> cook_sources;
+	// The only writer of the mesh cache; streaming and model reloads hand their meshes to it
+	std::unique_ptr<MeshCacheCooker> cache_cooker;
+
+	// Culling, draw sorting and recording of the shapes
+	ScenePipeline scene;
+	// World matrices of the scene's objects; the model is one root node that stays at the origin, since culling
+	// and picking work in model space. Its clip matrix is written straight into the frame's constants.
+	TransformHierarchy transforms;
+	uint32_t model_node;
+	// Shape under the view direction, -1 when none
+	int picked_shape;
+	// Shapes occlusion culling dropped, last reported
+	uint32_t occlusion_culled;
+
+	// Per-frame CPU work runs as a task graph on the job system
+	std::unique_ptr<JobSystem> jobs;
+	TaskGraph frame_graph;
+	float view_alpha;
+	int frame_pick;
 
-	XMMATRIX worldViewProj;
-	XMMATRIX projection, view, world;
 	XMVECTOR upDir, lookAt;
 
-	ComPtr<ID3D12Resource> constantBuffer;
-	ComPtr<ID3D12DescriptorHeap> cbvHeap;
-	UINT8 *cbvDataBegin;
+	// Per-frame constants and other transient data, retired by the frame fence
+	std::unique_ptr<D3D12UploadPageSource> upload_pages;
+	std::unique_ptr<UploadRing> upload_ring;
 
 	// Synchronization objects.
 	UINT frame_index;
-	HANDLE fence_event;
-	ComPtr<ID3D12Fence> fence;
-	UINT64 fence_value;
+	UINT frames_in_flight;
+	UINT frame_slot;
+	std::unique_ptr<D3D12FenceTimeline> fence_timeline;
+	std::unique_ptr<FrameRing> frame_ring;
+	std::unique_ptr<D3D12GpuProfiler> gpu_profiler;
 
 	float aspectRatio;
-	float angle;
+	float angle, previousAngle;
 
 	void LoadPipeline();
 	void LoadAssets();
+	void BuildFrameGraph();
+	void UpdateViewCamera();
+	void PrepareScene(float alpha);
+	void BuildRenderGraph();
 	void PopulateCommandList();
-	void WaitForPreviousFrame();
+	void RecordScenePass();
+	void WaitForGpu();
+	// lods come from BuildMeshLods on the same view; their indices are uploaded after the mesh's own
+	void ApplyMesh(const MeshView &meshView, const MeshLods &lods);
+	// Once per frame before culling: uploads arrived chunks and hands the grown shape list to the scene
+	void UpdateStreaming();
+	void StopStreaming();
+	ComPtr<ID3D12PipelineState> BuildPipelineState(const std::string &source, std::string &err);
+	ComPtr<ID3D12PipelineState> CreateCachedPipelineState(D3D12_GRAPHICS_PIPELINE_STATE_DESC &descriptor, ID3DBlob *signature_blob);
+	PlacedBuffer CreateStaticBuffer(const void *data, UINT64 size, D3D12_RESOURCE_STATES state, LPCWSTR name);
 	std::wstring GetBinPath(std::wstring shader_file) const;
 };
\ No newline at end of file
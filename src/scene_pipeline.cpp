@@ -0,0 +1,227 @@
+#include "scene_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+	double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ScenePipeline::ScenePipeline() :
+	camera({{0.0f, 0.0f, -1.0f}, {0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, 1.0f, 1.0f, 0.1f, 100.0f}),
+	world(MatrixIdentity()), view(MatrixIdentity()), world_view(MatrixIdentity()), world_view_proj(MatrixIdentity()),
+	view_proj(MatrixIdentity()), lod_viewport_height(0.0f), lod_max_pixel_error(1.0f), lod_pixel_scale(0.0f), projection_scale(0.0f),
+	occlusion_enabled(false), occlusion_buffer(occlusion_settings.width, occlusion_settings.height), occlusion_stats(),
+	occluder_vertices(nullptr), occluder_vertex_count(0), occluder_indices(nullptr), occluder_index_count(0)
+{
+}
+
+void ScenePipeline::SetShapes(const MeshShape *shapes, size_t count)
+{
+	this->shapes.assign(shapes, shapes + count);
+
+	shape_bounds.Clear();
+	shape_bounds.Reserve(count);
+	std::vector<Aabb> shapeBoxes;
+	shapeBoxes.reserve(count);
+	lod_levels.clear();
+	lod_first.clear();
+	shape_radius.clear();
+	for (const MeshShape &shape : this->shapes) {
+		shape_bounds.Add(shape.bounds_min, shape.bounds_max);
+		lod_first.push_back(static_cast<uint32_t>(lod_levels.size()));
+		lod_levels.push_back({shape.index_offset, shape.index_count, 0.0f});
+		const Float3 extent = {shape.bounds_max[0] - shape.bounds_min[0], shape.bounds_max[1] - shape.bounds_min[1], shape.bounds_max[2] - shape.bounds_min[2]};
+		shape_radius.push_back(0.5f * sqrtf(Dot(extent, extent)));
+		shapeBoxes.push_back({{shape.bounds_min[0], shape.bounds_min[1], shape.bounds_min[2]},
+			{shape.bounds_max[0], shape.bounds_max[1], shape.bounds_max[2]}});
+	}
+	lod_first.push_back(static_cast<uint32_t>(lod_levels.size()));
+	shape_bvh.Build(shapeBoxes.data(), shapeBoxes.size());
+
+	visible_shapes.clear();
+	render_queue.Clear();
+	render_queue.Reserve(count);
+}
+
+void ScenePipeline::SetLods(const MeshLods &lods)
+{
+	lod_levels = lods.levels;
+	lod_first = lods.first_level;
+}
+
+void ScenePipeline::SetLodSelection(float viewport_height, float max_pixel_error)
+{
+	lod_viewport_height = viewport_height;
+	lod_max_pixel_error = max_pixel_error;
+	lod_pixel_scale = 0.5f * lod_viewport_height / tanf(0.5f * camera.fov_y);
+}
+
+void ScenePipeline::SetOccluderGeometry(const MeshVertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count)
+{
+	occluder_vertices = vertices;
+	occluder_vertex_count = vertex_count;
+	occluder_indices = indices;
+	occluder_index_count = index_count;
+}
+
+void ScenePipeline::SetOcclusionCulling(bool enabled, const OcclusionSettings &settings)
+{
+	occlusion_enabled = enabled;
+	if (settings.width != occlusion_settings.width || settings.height != occlusion_settings.height) {
+		occlusion_buffer = OcclusionBuffer(settings.width, settings.height);
+	}
+	occlusion_settings = settings;
+	occlusion_stats = {};
+}
+
+void ScenePipeline::UpdateCamera(const Camera &camera)
+{
+	this->camera = camera;
+	view = MatrixLookAtLH(camera.eye, camera.look_at, camera.up);
+	world_view = MatrixMultiply(world, view);
+	const Float4x4 projection = MatrixPerspectiveFovLH(camera.fov_y, camera.aspect, camera.near_z, camera.far_z);
+	world_view_proj = MatrixMultiply(world_view, projection);
+	view_proj = MatrixMultiply(view, projection);
+	// Projected size in pixels of a length l at view depth z is l * scale / z
+	lod_pixel_scale = 0.5f * lod_viewport_height * projection.m[1][1];
+	projection_scale = 0.5f * projection.m[1][1];
+}
+
+void ScenePipeline::Cull()
+{
+	// Planes of world * view * projection are in object space, where the shape bounds are
+	const Frustum frustum = ExtractFrustum(world_view_proj);
+
+	if (shape_bounds.GetCount() < bvh_cull_threshold) {
+		visible_shapes.resize(shape_bounds.GetCount());
+		visible_shapes.resize(CullFrustum(frustum, shape_bounds, visible_shapes.data()));
+	} else {
+		visible_shapes.clear();
+		shape_bvh.QueryFrustum(frustum, visible_shapes);
+	}
+}
+
+void ScenePipeline::CullOccluded()
+{
+	occlusion_stats = {};
+	if (!occlusion_enabled || occluder_vertices == nullptr) {
+		return;
+	}
+	auto start = std::chrono::steady_clock::now();
+
+	// Size is the bounding sphere's radius over the distance to its nearest point, so the walls around the
+	// camera come first
+	const float (&m)[4][4] = world_view.m;
+	occluder_candidates.clear();
+	for (uint32_t shapeIndex : visible_shapes) {
+		const float depth = shape_bounds.center_x[shapeIndex] * m[0][2] + shape_bounds.center_y[shapeIndex] * m[1][2] +
+			shape_bounds.center_z[shapeIndex] * m[2][2] + m[3][2];
+		const float distance = std::max(depth - shape_radius[shapeIndex], camera.near_z);
+		const float size = shape_radius[shapeIndex] * projection_scale / distance;
+		if (size >= occlusion_settings.min_occluder_size) {
+			occluder_candidates.push_back({size, shapeIndex});
+		}
+	}
+	std::sort(occluder_candidates.begin(), occluder_candidates.end(),
+		[](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) { return a.first > b.first; });
+
+	// Occluders draw their full-detail level, which is what the screen shows up close
+	occlusion_buffer.Clear();
+	for (const std::pair<float, uint32_t> &candidate : occluder_candidates) {
+		if (occlusion_stats.occluders == occlusion_settings.max_occluders) {
+			break;
+		}
+		const MeshShape &shape = shapes[candidate.second];
+		const uint32_t triangles = shape.index_count / 3;
+		if (occlusion_stats.occluder_triangles + triangles > occlusion_settings.max_occluder_triangles ||
+			static_cast<uint64_t>(shape.index_offset) + shape.index_count > occluder_index_count) {
+			continue;
+		}
+		occlusion_buffer.RasterizeTriangles(world_view_proj, occluder_vertices, occluder_vertex_count,
+			occluder_indices + shape.index_offset, shape.index_count);
+		occlusion_stats.occluders++;
+		occlusion_stats.occluder_triangles += triangles;
+	}
+	occlusion_buffer.Finish();
+	occlusion_stats.rasterize_ms = ElapsedMs(start);
+	if (occlusion_stats.occluders == 0) {
+		return;
+	}
+
+	start = std::chrono::steady_clock::now();
+	size_t kept = 0;
+	for (uint32_t shapeIndex : visible_shapes) {
+		const MeshShape &shape = shapes[shapeIndex];
+		if (!occlusion_buffer.IsOccluded(world_view_proj, shape.bounds_min, shape.bounds_max)) {
+			visible_shapes[kept++] = shapeIndex;
+		}
+	}
+	occlusion_stats.tested = static_cast<uint32_t>(visible_shapes.size());
+	occlusion_stats.culled = static_cast<uint32_t>(visible_shapes.size() - kept);
+	visible_shapes.resize(kept);
+	occlusion_stats.test_ms = ElapsedMs(start);
+}
+
+void ScenePipeline::SortDraws()
+{
+	// View depth of the bounds center is the third column of the world-view transform
+	const float (&m)[4][4] = world_view.m;
+	render_queue.Clear();
+	for (uint32_t shapeIndex : visible_shapes) {
+		const float depth = shape_bounds.center_x[shapeIndex] * m[0][2] + shape_bounds.center_y[shapeIndex] * m[1][2] +
+			shape_bounds.center_z[shapeIndex] * m[2][2] + m[3][2];
+		render_queue.Push({0, static_cast<uint32_t>(shapes[shapeIndex].material), SelectLod(shapeIndex, depth), 0, depth, false});
+	}
+	render_queue.Sort(camera.far_z);
+}
+
+uint32_t ScenePipeline::SelectLod(uint32_t shape, float depth) const
+{
+	uint32_t level = lod_first[shape];
+	if (lod_pixel_scale <= 0.0f) {
+		return level;
+	}
+	// Nearest point of the bounds, so a large shape does not coarsen while the camera is close to one end
+	const float distance = std::max(depth - shape_radius[shape], camera.near_z);
+	const float errorLimit = lod_max_pixel_error * distance / lod_pixel_scale;
+	while (level + 1 < lod_first[shape + 1] && lod_levels[level + 1].error <= errorLimit) {
+		level++;
+	}
+	return level;
+}
+
+void ScenePipeline::Record(CommandSink &sink, uint64_t constants_address) const
+{
+	RecordBatches(sink, constants_address, 0, render_queue.GetBatches().size());
+}
+
+void ScenePipeline::RecordBatches(CommandSink &sink, uint64_t constants_address, size_t first_batch, size_t batch_count) const
+{
+	sink.SetConstants(constants_address);
+
+	uint32_t pipeline = UINT32_MAX;
+	const std::vector<DrawBatch> &batches = render_queue.GetBatches();
+	for (size_t i = first_batch; i < first_batch + batch_count; i++) {
+		const DrawBatch &batch = batches[i];
+		if (batch.pipeline != pipeline) {
+			pipeline = batch.pipeline;
+			sink.SetPipeline(pipeline);
+		}
+		const MeshLodLevel &level = lod_levels[batch.mesh];
+		sink.DrawIndexedInstanced(level.index_count, batch.instance_count, level.index_offset, 0, batch.first_instance);
+	}
+}
+
+int ScenePipeline::Pick() const
+{
+	// World is identity, so the ray needs no transform into object space
+	RayHit hit;
+	const Float3 direction = Normalize(camera.look_at - camera.eye);
+	return shape_bvh.Raycast(camera.eye, direction, camera.far_z, hit) ? static_cast<int>(hit.object) : -1;
+}
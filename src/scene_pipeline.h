@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bvh.h"
+#include "command_sink.h"
+#include "cpu_math.h"
+#include "frustum_cull.h"
+#include "mesh_builder.h"
+#include "mesh_lod.h"
+#include "occlusion_cull.h"
+#include "render_queue.h"
+
+struct Camera
+{
+	Float3 eye;
+	Float3 look_at;
+	Float3 up;
+	float fov_y;
+	float aspect;
+	float near_z;
+	float far_z;
+};
+
+// CPU side of a frame, free of window and device: camera matrices, culling, draw sorting and
+// recording into a CommandSink. The renderer drives it every frame and benchmarks drive it headless.
+class ScenePipeline
+{
+public:
+	// Below this many shapes a flat SIMD pass is cheaper than walking the BVH
+	static const size_t bvh_cull_threshold = 1024;
+
+	ScenePipeline();
+
+	// Shapes become drawables; bounds and the BVH are built here. Each shape starts with one level, its own range.
+	void SetShapes(const MeshShape *shapes, size_t count);
+	// LOD chains for the current shapes, from BuildMeshLods on the same mesh
+	void SetLods(const MeshLods &lods);
+	// SortDraws picks the coarsest level whose error projects to at most max_pixel_error pixels on a viewport
+	// this many pixels high; a height of 0 always draws level 0
+	void SetLodSelection(float viewport_height, float max_pixel_error);
+
+	// CPU copy of the vertices and indices the shapes draw, for occluders; must stay valid while culling is on
+	void SetOccluderGeometry(const MeshVertex *vertices, uint32_t vertex_count, const uint32_t *indices, uint32_t index_count);
+	// Off by default; the settings take effect from the next CullOccluded()
+	void SetOcclusionCulling(bool enabled, const OcclusionSettings &settings = OcclusionSettings());
+
+	void UpdateCamera(const Camera &camera);
+	void Cull();
+	// Between Cull and SortDraws: rasterizes the visible shapes that look largest into the occlusion buffer and
+	// drops the visible shapes hidden behind them. Does nothing while occlusion culling is off.
+	void CullOccluded();
+	void SortDraws();
+	// Constants are bound once, then one draw per batch
+	void Record(CommandSink &sink, uint64_t constants_address) const;
+	// Same for a range of batches, as one self-contained command list of a parallel recording
+	void RecordBatches(CommandSink &sink, uint64_t constants_address, size_t first_batch, size_t batch_count) const;
+
+	// Nearest shape along the camera's view direction, -1 when none
+	int Pick() const;
+
+	const Camera &GetCamera() const { return camera; }
+	// world * view * projection, row-major like XMMATRIX
+	const Float4x4 &GetWorldViewProj() const { return world_view_proj; }
+	// view * projection, for objects that bring their own world matrix
+	const Float4x4 &GetViewProj() const { return view_proj; }
+	const std::vector<MeshShape> &GetShapes() const { return shapes; }
+	// DrawItem::mesh indexes these
+	const std::vector<MeshLodLevel> &GetLodLevels() const { return lod_levels; }
+	const std::vector<uint32_t> &GetVisibleShapes() const { return visible_shapes; }
+	const RenderQueue &GetRenderQueue() const { return render_queue; }
+	// Of the last CullOccluded()
+	const OcclusionStats &GetOcclusionStats() const { return occlusion_stats; }
+	const OcclusionBuffer &GetOcclusionBuffer() const { return occlusion_buffer; }
+
+private:
+	// Coarsest level of the shape that is accurate enough at this view depth
+	uint32_t SelectLod(uint32_t shape, float depth) const;
+
+	std::vector<MeshShape> shapes;
+	CullBounds shape_bounds;
+	Bvh shape_bvh;
+	std::vector<uint32_t> visible_shapes;
+	RenderQueue render_queue;
+
+	Camera camera;
+	Float4x4 world;
+	Float4x4 view;
+	Float4x4 world_view;
+	Float4x4 world_view_proj;
+	Float4x4 view_proj;
+
+	std::vector<MeshLodLevel> lod_levels;
+	// Levels of shape i are lod_levels[lod_first[i], lod_first[i + 1])
+	std::vector<uint32_t> lod_first;
+	// Half diagonal of each shape's bounds, to measure distance to its nearest point
+	std::vector<float> shape_radius;
+	float lod_viewport_height;
+	float lod_max_pixel_error;
+	// Pixels per model unit at view depth 1
+	float lod_pixel_scale;
+	// Viewport heights per model unit at view depth 1
+	float projection_scale;
+
+	bool occlusion_enabled;
+	OcclusionSettings occlusion_settings;
+	OcclusionBuffer occlusion_buffer;
+	OcclusionStats occlusion_stats;
+	const MeshVertex *occluder_vertices;
+	uint32_t occluder_vertex_count;
+	const uint32_t *occluder_indices;
+	uint32_t occluder_index_count;
+	// Visible shapes by projected size, largest first
+	std::vector<std::pair<float, uint32_t>> occluder_candidates;
+};
@@ -0,0 +1,311 @@
+#include "shader_cache.h"
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	const char cache_entry_magic[8] = {'S', 'H', 'D', 'R', 'C', 'A', 'C', 'H'};
+
+	// Kind in the top bits keeps shader and pipeline keys apart in one LRU
+	uint64_t GetEntryId(CacheEntryKind kind, uint64_t key)
+	{
+		return (key & 0x0FFFFFFFFFFFFFFFull) | (static_cast<uint64_t>(kind) << 60);
+	}
+
+	// Length prefix so adjacent fields cannot be shifted into each other
+	uint64_t HashField(const void *data, size_t size, uint64_t hash)
+	{
+		const uint64_t length = size;
+		hash = HashBytes(&length, sizeof(length), hash);
+		return HashBytes(data, size, hash);
+	}
+
+	uint64_t HashField(const std::string &text, uint64_t hash)
+	{
+		return HashField(text.data(), text.size(), hash);
+	}
+
+	double ElapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void CacheLru::Touch(uint64_t id, uint64_t size)
+{
+	Remove(id);
+	order.push_back({id, size});
+	entries[id] = std::prev(order.end());
+	total_size += size;
+}
+
+void CacheLru::Remove(uint64_t id)
+{
+	auto found = entries.find(id);
+	if (found == entries.end()) {
+		return;
+	}
+	total_size -= found->second->size;
+	order.erase(found->second);
+	entries.erase(found);
+}
+
+bool CacheLru::GetOldest(uint64_t &id) const
+{
+	if (order.empty()) {
+		return false;
+	}
+	id = order.front().id;
+	return true;
+}
+
+bool MemoryCacheStore::Load(CacheEntryKind kind, uint64_t key, std::vector<uint8_t> &data)
+{
+	const uint64_t id = GetEntryId(kind, key);
+	auto found = entries.find(id);
+	if (found == entries.end()) {
+		return false;
+	}
+	data = found->second;
+	lru.Touch(id, data.size());
+	return true;
+}
+
+bool MemoryCacheStore::Store(CacheEntryKind kind, uint64_t key, const void *data, size_t size)
+{
+	if (size > max_size) {
+		return false;
+	}
+
+	const uint64_t id = GetEntryId(kind, key);
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	entries[id].assign(bytes, bytes + size);
+	lru.Touch(id, size);
+
+	uint64_t oldest;
+	while (lru.GetTotalSize() > max_size && lru.GetOldest(oldest)) {
+		lru.Remove(oldest);
+		entries.erase(oldest);
+	}
+	return true;
+}
+
+void MemoryCacheStore::Remove(CacheEntryKind kind, uint64_t key)
+{
+	const uint64_t id = GetEntryId(kind, key);
+	lru.Remove(id);
+	entries.erase(id);
+}
+
+DirectoryCacheStore::DirectoryCacheStore(const std::string &directory, uint64_t max_size) :
+	directory(directory), max_size(max_size)
+{
+	namespace fs = std::filesystem;
+	std::error_code error;
+	fs::create_directories(directory, error);
+
+	// Rebuild the LRU order from the file times of the previous runs
+	struct Found
+	{
+		uint64_t id;
+		uint64_t size;
+		fs::file_time_type time;
+	};
+	std::vector<Found> found;
+	for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+		unsigned kind;
+		unsigned long long key;
+		const std::string name = it->path().filename().string();
+		if (sscanf(name.c_str(), "%u_%16llx.bin", &kind, &key) != 2) {
+			continue;
+		}
+		std::error_code fileError;
+		const uint64_t size = it->file_size(fileError);
+		const fs::file_time_type time = it->last_write_time(fileError);
+		if (!fileError) {
+			found.push_back({GetEntryId(static_cast<CacheEntryKind>(kind), key), size, time});
+		}
+	}
+	std::sort(found.begin(), found.end(), [](const Found &a, const Found &b) { return a.time < b.time; });
+	for (const Found &entry : found) {
+		lru.Touch(entry.id, entry.size);
+	}
+}
+
+std::string DirectoryCacheStore::GetPath(CacheEntryKind kind, uint64_t key) const
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%u_%016" PRIx64 ".bin", static_cast<unsigned>(kind), key);
+	return (std::filesystem::path(directory) / name).string();
+}
+
+bool DirectoryCacheStore::Load(CacheEntryKind kind, uint64_t key, std::vector<uint8_t> &data)
+{
+	const std::string path = GetPath(kind, key);
+	MappedFile file;
+	if (!file.Open(path)) {
+		return false;
+	}
+
+	CacheEntryHeader header;
+	bool valid = file.GetSize() >= sizeof(header);
+	if (valid) {
+		memcpy(&header, file.GetData(), sizeof(header));
+		valid = memcmp(header.magic, cache_entry_magic, sizeof(header.magic)) == 0 && header.version == cache_entry_version &&
+			header.kind == static_cast<uint32_t>(kind) && header.key == key &&
+			header.payload_size == file.GetSize() - sizeof(header) &&
+			HashBytes(file.GetData() + sizeof(header), header.payload_size) == header.payload_hash;
+	}
+	if (!valid) {
+		file.Close();
+		Remove(kind, key);
+		return false;
+	}
+
+	data.assign(file.GetData() + sizeof(header), file.GetData() + file.GetSize());
+	file.Close();
+
+	std::error_code error;
+	std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+	lru.Touch(GetEntryId(kind, key), sizeof(header) + data.size());
+	return true;
+}
+
+bool DirectoryCacheStore::Store(CacheEntryKind kind, uint64_t key, const void *data, size_t size)
+{
+	if (sizeof(CacheEntryHeader) + size > max_size) {
+		return false;
+	}
+
+	CacheEntryHeader header = {};
+	memcpy(header.magic, cache_entry_magic, sizeof(header.magic));
+	header.version = cache_entry_version;
+	header.kind = static_cast<uint32_t>(kind);
+	header.key = key;
+	header.payload_size = size;
+	header.payload_hash = HashBytes(data, size);
+
+	const std::string path = GetPath(kind, key);
+	const std::string tempPath = path + ".tmp";
+	std::ofstream output(tempPath, std::ios::binary | std::ios::trunc);
+	output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	output.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+	output.close();
+
+	std::error_code error;
+	if (!output) {
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	std::filesystem::rename(tempPath, path, error);
+	if (error) {
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	lru.Touch(GetEntryId(kind, key), sizeof(header) + size);
+	Evict();
+	return true;
+}
+
+void DirectoryCacheStore::Remove(CacheEntryKind kind, uint64_t key)
+{
+	std::error_code error;
+	std::filesystem::remove(GetPath(kind, key), error);
+	lru.Remove(GetEntryId(kind, key));
+}
+
+void DirectoryCacheStore::Evict()
+{
+	uint64_t oldest;
+	while (lru.GetTotalSize() > max_size && lru.GetOldest(oldest)) {
+		Remove(static_cast<CacheEntryKind>(oldest >> 60), oldest & 0x0FFFFFFFFFFFFFFFull);
+	}
+}
+
+uint64_t ComputeShaderKey(const std::string &source, const ShaderCompileRequest &request, const std::string &compiler_version)
+{
+	uint64_t hash = HashField(compiler_version, HashBytes(nullptr, 0));
+	hash = HashField(source, hash);
+	hash = HashField(request.entry_point, hash);
+	hash = HashField(request.target, hash);
+	for (const ShaderDefine &define : request.defines) {
+		hash = HashField(define.name, hash);
+		hash = HashField(define.value, hash);
+	}
+	hash = HashField(&request.flags, sizeof(request.flags), hash);
+	// Keys only use 60 bits so the stores can tag them with the entry kind
+	return hash & 0x0FFFFFFFFFFFFFFFull;
+}
+
+ShaderCache::ShaderCache(CacheStore &store, ShaderCompiler &compiler) :
+	store(store), compiler(compiler), compiler_version(compiler.GetVersion()), stats()
+{
+}
+
+bool ShaderCache::GetShader(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+	std::string &err)
+{
+	auto start = std::chrono::steady_clock::now();
+	const uint64_t key = ComputeShaderKey(source, request, compiler_version);
+	const bool hit = store.Load(CacheEntryKind::Shader, key, bytecode) && !bytecode.empty();
+	stats.lookup_ms += ElapsedMs(start);
+	if (hit) {
+		stats.shader_hits++;
+		return true;
+	}
+
+	stats.shader_misses++;
+	start = std::chrono::steady_clock::now();
+	bytecode.clear();
+	const bool compiled = compiler.Compile(source, request, bytecode, err);
+	stats.compile_ms += ElapsedMs(start);
+	if (!compiled) {
+		return false;
+	}
+
+	store.Store(CacheEntryKind::Shader, key, bytecode.data(), bytecode.size());
+	return true;
+}
+
+bool ShaderCache::LoadPipeline(uint64_t key, std::vector<uint8_t> &blob)
+{
+	auto start = std::chrono::steady_clock::now();
+	const bool hit = store.Load(CacheEntryKind::Pipeline, key & 0x0FFFFFFFFFFFFFFFull, blob) && !blob.empty();
+	stats.lookup_ms += ElapsedMs(start);
+	if (hit) {
+		stats.pipeline_hits++;
+	} else {
+		stats.pipeline_misses++;
+	}
+	return hit;
+}
+
+void ShaderCache::StorePipeline(uint64_t key, const void *blob, size_t size)
+{
+	store.Store(CacheEntryKind::Pipeline, key & 0x0FFFFFFFFFFFFFFFull, blob, size);
+}
+
+void ShaderCache::RejectPipeline(uint64_t key)
+{
+	stats.pipeline_rejects++;
+	store.Remove(CacheEntryKind::Pipeline, key & 0x0FFFFFFFFFFFFFFFull);
+}
+
+PipelineKeyBuilder &PipelineKeyBuilder::Add(const void *data, size_t size)
+{
+	hash = HashField(data, size, hash);
+	return *this;
+}
+
+uint64_t PipelineKeyBuilder::HashSeed()
+{
+	return HashBytes("pipeline", 8);
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ShaderDefine
+{
+	std::string name;
+	std::string value;
+};
+
+struct ShaderCompileRequest
+{
+	// Shown in compiler messages; the code itself is passed separately
+	std::string source_name;
+	std::string entry_point;
+	std::string target;
+	std::vector<ShaderDefine> defines;
+	uint32_t flags;
+};
+
+class ShaderCompiler
+{
+public:
+	virtual ~ShaderCompiler() {};
+
+	// Identifies the compiler build; part of every key so an upgrade invalidates old bytecode
+	virtual std::string GetVersion() const = 0;
+	virtual bool Compile(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+		std::string &err) = 0;
+};
+
+enum class CacheEntryKind : uint32_t
+{
+	Shader = 1,
+	Pipeline = 2
+};
+
+// Keys use the low 60 bits; the stores keep the entry kind in the rest
+class CacheStore
+{
+public:
+	virtual ~CacheStore() {};
+
+	// False when the entry is missing or fails validation
+	virtual bool Load(CacheEntryKind kind, uint64_t key, std::vector<uint8_t> &data) = 0;
+	virtual bool Store(CacheEntryKind kind, uint64_t key, const void *data, size_t size) = 0;
+	virtual void Remove(CacheEntryKind kind, uint64_t key) = 0;
+	virtual uint64_t GetSize() const = 0;
+};
+
+// Shared least-recently-used bookkeeping of the stores
+class CacheLru
+{
+public:
+	CacheLru() : total_size(0) {};
+
+	void Touch(uint64_t id, uint64_t size);
+	void Remove(uint64_t id);
+	// Oldest entry; false when empty
+	bool GetOldest(uint64_t &id) const;
+	uint64_t GetTotalSize() const { return total_size; }
+
+private:
+	struct Entry
+	{
+		uint64_t id;
+		uint64_t size;
+	};
+
+	std::list<Entry> order;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+	uint64_t total_size;
+};
+
+class MemoryCacheStore : public CacheStore
+{
+public:
+	explicit MemoryCacheStore(uint64_t max_size) : max_size(max_size) {};
+
+	bool Load(CacheEntryKind kind, uint64_t key, std::vector<uint8_t> &data) override;
+	bool Store(CacheEntryKind kind, uint64_t key, const void *data, size_t size) override;
+	void Remove(CacheEntryKind kind, uint64_t key) override;
+	uint64_t GetSize() const override { return lru.GetTotalSize(); }
+
+private:
+	uint64_t max_size;
+	CacheLru lru;
+	std::unordered_map<uint64_t, std::vector<uint8_t>> entries;
+};
+
+struct CacheEntryHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t kind;
+	uint64_t key;
+	uint64_t payload_size;
+	uint64_t payload_hash;
+};
+
+static const uint32_t cache_entry_version = 1;
+
+// One file per entry. Each file starts with a CacheEntryHeader that is checked on load, so truncated or
+// foreign files are treated as misses and deleted. Files are written to a temporary name and renamed.
+// Beyond max_size the least recently used files are removed; use is tracked through the file time.
+class DirectoryCacheStore : public CacheStore
+{
+public:
+	DirectoryCacheStore(const std::string &directory, uint64_t max_size);
+
+	bool Load(CacheEntryKind kind, uint64_t key, std::vector<uint8_t> &data) override;
+	bool Store(CacheEntryKind kind, uint64_t key, const void *data, size_t size) override;
+	void Remove(CacheEntryKind kind, uint64_t key) override;
+	uint64_t GetSize() const override { return lru.GetTotalSize(); }
+
+	std::string GetPath(CacheEntryKind kind, uint64_t key) const;
+
+private:
+	void Evict();
+
+	std::string directory;
+	uint64_t max_size;
+	CacheLru lru;
+};
+
+// Hash of everything that affects the bytecode: the code, entry point, target, defines in order, flags and
+// compiler version. #include is not followed, so compilers must reject includes.
+uint64_t ComputeShaderKey(const std::string &source, const ShaderCompileRequest &request, const std::string &compiler_version);
+
+struct ShaderCacheStats
+{
+	uint64_t shader_hits;
+	uint64_t shader_misses;
+	uint64_t pipeline_hits;
+	uint64_t pipeline_misses;
+	uint64_t pipeline_rejects;
+	double lookup_ms;
+	double compile_ms;
+};
+
+class ShaderCache
+{
+public:
+	ShaderCache(CacheStore &store, ShaderCompiler &compiler);
+
+	// Returns cached bytecode for the request or compiles and stores it
+	bool GetShader(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+		std::string &err);
+
+	// Serialized pipeline blobs are driver-specific; key them with ComputePipelineKey
+	bool LoadPipeline(uint64_t key, std::vector<uint8_t> &blob);
+	void StorePipeline(uint64_t key, const void *blob, size_t size);
+	// The driver refused a cached blob (e.g. after a driver update)
+	void RejectPipeline(uint64_t key);
+
+	const ShaderCacheStats &GetStats() const { return stats; }
+
+private:
+	CacheStore &store;
+	ShaderCompiler &compiler;
+	std::string compiler_version;
+	ShaderCacheStats stats;
+};
+
+// Incremental key of a pipeline: add the shader bytecode, serialized state and the adapter/driver identity
+class PipelineKeyBuilder
+{
+public:
+	PipelineKeyBuilder() : hash(HashSeed()) {};
+
+	PipelineKeyBuilder &Add(const void *data, size_t size);
+	PipelineKeyBuilder &Add(const std::string &text) { return Add(text.data(), text.size()); }
+	template <typename T>
+	PipelineKeyBuilder &AddValue(const T &value) { return Add(&value, sizeof(value)); }
+
+	uint64_t GetKey() const { return hash; }
+
+private:
+	static uint64_t HashSeed();
+
+	uint64_t hash;
+};
@@ -0,0 +1,570 @@
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#ifdef SOFT_RASTER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const int32_t subpixel_scale = 16;
+	const int32_t block_size = 8;
+	// Triangles may reach this many pixels past the viewport before they are clipped. Keeps snapped coordinates
+	// under 2^18 subpixels, so edge steps over a block fit in 32 bits.
+	const float guard_band_pixels = 8192.0f;
+	// Triangles per setup and binning job
+	const size_t bin_batch = 1024;
+	// A triangle clipped by all six planes
+	const int max_clip_vertices = 9;
+
+	// Outcode bits: the view frustum, then the planes the clipper handles
+	const uint32_t outside_left = 1;
+	const uint32_t outside_right = 2;
+	const uint32_t outside_bottom = 4;
+	const uint32_t outside_top = 8;
+	const uint32_t outside_near = 16;
+	const uint32_t outside_far = 32;
+	const uint32_t outside_guard_left = 64;
+	const uint32_t outside_guard_right = 128;
+	const uint32_t outside_guard_bottom = 256;
+	const uint32_t outside_guard_top = 512;
+	const uint32_t frustum_planes = 63;
+	const uint32_t clip_planes = outside_near | outside_far | outside_guard_left | outside_guard_right | outside_guard_bottom | outside_guard_top;
+
+#ifdef SOFT_RASTER_SSE
+	// Set bits of a 4-lane mask
+	const uint8_t lane_counts[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+#endif
+
+	// R8G8B8A8_UNORM conversion
+	uint32_t PackColor(const float *color)
+	{
+		uint32_t packed = 0;
+		for (int channel = 0; channel < 4; channel++) {
+			float c = color[channel] > 0.0f ? color[channel] : 0.0f;
+			c = c < 1.0f ? c : 1.0f;
+			packed |= static_cast<uint32_t>(c * 255.0f + 0.5f) << (channel * 8);
+		}
+		return packed;
+	}
+
+	int32_t FloorDiv(int32_t value, int32_t divisor)
+	{
+		return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+	}
+
+	template <typename Vertex>
+	uint32_t GetOutcode(const Vertex &v, float guard_x, float guard_y)
+	{
+		uint32_t code = 0;
+		code |= v.x < -v.w ? outside_left : 0;
+		code |= v.x > v.w ? outside_right : 0;
+		code |= v.y < -v.w ? outside_bottom : 0;
+		code |= v.y > v.w ? outside_top : 0;
+		code |= v.z < 0.0f ? outside_near : 0;
+		code |= v.z > v.w ? outside_far : 0;
+		code |= v.x < -guard_x * v.w ? outside_guard_left : 0;
+		code |= v.x > guard_x * v.w ? outside_guard_right : 0;
+		code |= v.y < -guard_y * v.w ? outside_guard_bottom : 0;
+		code |= v.y > guard_y * v.w ? outside_guard_top : 0;
+		return code;
+	}
+
+	template <typename Vertex>
+	float GetPlaneDistance(const Vertex &v, uint32_t plane, float guard_x, float guard_y)
+	{
+		switch (plane) {
+		case outside_near: return v.z;
+		case outside_far: return v.w - v.z;
+		case outside_guard_left: return v.x + guard_x * v.w;
+		case outside_guard_right: return guard_x * v.w - v.x;
+		case outside_guard_bottom: return v.y + guard_y * v.w;
+		default: return guard_y * v.w - v.y;
+		}
+	}
+
+	bool DepthTest(float z, float &depth, uint32_t &pixel, uint32_t color)
+	{
+		if (z < depth) {
+			depth = z;
+			pixel = color;
+			return true;
+		}
+		return false;
+	}
+}
+
+bool WritePpm(const std::string &path, const SoftwareImage &image, std::string &err)
+{
+	std::vector<uint8_t> rgb(static_cast<size_t>(image.width) * image.height * 3);
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		rgb[i * 3 + 0] = static_cast<uint8_t>(image.pixels[i]);
+		rgb[i * 3 + 1] = static_cast<uint8_t>(image.pixels[i] >> 8);
+		rgb[i * 3 + 2] = static_cast<uint8_t>(image.pixels[i] >> 16);
+	}
+
+	std::ofstream output(path, std::ios::binary | std::ios::trunc);
+	output << "P6\n" << image.width << " " << image.height << "\n255\n";
+	output.write(reinterpret_cast<const char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+	output.close();
+	if (!output) {
+		err = "Cannot write image: " + path;
+		return false;
+	}
+	return true;
+}
+
+bool ReadPpm(const std::string &path, SoftwareImage &image, std::string &err)
+{
+	std::ifstream input(path, std::ios::binary);
+	if (!input) {
+		err = "Image not found: " + path;
+		return false;
+	}
+	std::string magic;
+	uint32_t maxValue = 0;
+	image.width = 0;
+	image.height = 0;
+	input >> magic >> image.width >> image.height >> maxValue;
+	// Exactly one whitespace character separates the header from the pixels
+	input.get();
+	if (!input || magic != "P6" || maxValue != 255 || image.width == 0 || image.height == 0) {
+		err = "Not an 8-bit binary PPM: " + path;
+		return false;
+	}
+
+	std::vector<uint8_t> rgb(static_cast<size_t>(image.width) * image.height * 3);
+	input.read(reinterpret_cast<char *>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+	if (!input) {
+		err = "Truncated image: " + path;
+		return false;
+	}
+	image.pixels.resize(static_cast<size_t>(image.width) * image.height);
+	for (size_t i = 0; i < image.pixels.size(); i++) {
+		image.pixels[i] = rgb[i * 3] | (rgb[i * 3 + 1] << 8) | (rgb[i * 3 + 2] << 16) | 0xFF000000u;
+	}
+	return true;
+}
+
+ImageDifference CompareImages(const SoftwareImage &a, const SoftwareImage &b, uint32_t channel_tolerance)
+{
+	ImageDifference difference = {};
+	if (a.width != b.width || a.height != b.height) {
+		difference.different_pixels = std::max(a.pixels.size(), b.pixels.size());
+		difference.max_channel_difference = 255;
+		return difference;
+	}
+	for (size_t i = 0; i < a.pixels.size(); i++) {
+		uint32_t pixelDifference = 0;
+		for (int channel = 0; channel < 3; channel++) {
+			const int32_t ca = (a.pixels[i] >> (channel * 8)) & 0xFF;
+			const int32_t cb = (b.pixels[i] >> (channel * 8)) & 0xFF;
+			pixelDifference = std::max(pixelDifference, static_cast<uint32_t>(std::abs(ca - cb)));
+		}
+		difference.max_channel_difference = std::max(difference.max_channel_difference, pixelDifference);
+		difference.different_pixels += pixelDifference > channel_tolerance ? 1 : 0;
+	}
+	return difference;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(JobSystem &jobs, uint32_t width, uint32_t height) :
+	jobs(jobs), tiles_x((width + tile_size - 1) / tile_size), tiles_y((height + tile_size - 1) / tile_size),
+	guard_band_x(guard_band_pixels / (0.5f * width)), guard_band_y(guard_band_pixels / (0.5f * height)),
+	vertices(nullptr), vertex_count(0), indices(nullptr), index_count(0), index_size(4),
+	world_view_proj(MatrixIdentity()), group_count(0), tile_stats(tiles_x * tiles_y), stats()
+{
+	image.width = width;
+	image.height = height;
+	image.pixels.resize(static_cast<size_t>(width) * height);
+	depth.resize(image.pixels.size());
+	const float black[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+	Clear(black);
+}
+
+void SoftwareRasterizer::SetGeometry(const MeshVertex *vertices, uint32_t vertex_count, const void *indices, uint32_t index_count, uint32_t index_size)
+{
+	Flush();
+	this->vertices = vertices;
+	this->vertex_count = vertex_count;
+	this->indices = indices;
+	this->index_count = index_count;
+	this->index_size = index_size;
+}
+
+void SoftwareRasterizer::Clear(const float color[4])
+{
+	Flush();
+	std::fill(image.pixels.begin(), image.pixels.end(), PackColor(color));
+	std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRasterizer::SetConstants(uint64_t address)
+{
+	Float4x4 constants;
+	memcpy(&constants, reinterpret_cast<const void *>(static_cast<uintptr_t>(address)), sizeof(constants));
+	if (memcmp(&constants, &world_view_proj, sizeof(constants)) != 0) {
+		Flush();
+		world_view_proj = constants;
+	}
+}
+
+void SoftwareRasterizer::DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+	int32_t base_vertex, uint32_t)
+{
+	stats.draws++;
+	// Like the GPU, indices past the buffer draw nothing
+	if (instance_count == 0 || first_index >= this->index_count) {
+		return;
+	}
+	index_count = std::min(index_count, this->index_count - first_index) / 3 * 3;
+	if (index_count > 0) {
+		draws.push_back({first_index, index_count, base_vertex});
+	}
+}
+
+uint32_t SoftwareRasterizer::GetIndex(uint32_t i) const
+{
+	return index_size == 2 ? static_cast<const uint16_t *>(indices)[i] : static_cast<const uint32_t *>(indices)[i];
+}
+
+void SoftwareRasterizer::Flush()
+{
+	if (draws.empty()) {
+		return;
+	}
+
+	// VSMain: position * world_view_proj, for every vertex; draws of one mesh share most of them
+	clip_vertices.resize(vertex_count);
+	jobs.ParallelFor(vertex_count, 4096, [this](size_t begin, size_t end) {
+		const Float4x4 &m = world_view_proj;
+		for (size_t i = begin; i < end; i++) {
+			const float *p = vertices[i].position;
+			ClipVertex &v = clip_vertices[i];
+			v.x = p[0] * m.m[0][0] + p[1] * m.m[1][0] + p[2] * m.m[2][0] + m.m[3][0];
+			v.y = p[0] * m.m[0][1] + p[1] * m.m[1][1] + p[2] * m.m[2][1] + m.m[3][1];
+			v.z = p[0] * m.m[0][2] + p[1] * m.m[1][2] + p[2] * m.m[2][2] + m.m[3][2];
+			v.w = p[0] * m.m[0][3] + p[1] * m.m[1][3] + p[2] * m.m[2][3] + m.m[3][3];
+		}
+	});
+
+	draw_triangles.resize(draws.size() + 1);
+	draw_triangles[0] = 0;
+	for (size_t i = 0; i < draws.size(); i++) {
+		draw_triangles[i + 1] = draw_triangles[i] + draws[i].index_count / 3;
+	}
+	const size_t triangleCount = draw_triangles.back();
+
+	// Each group bins a contiguous range, so walking the groups in order keeps submission order per tile
+	group_count = static_cast<uint32_t>(std::min<size_t>(std::max<size_t>(1, triangleCount / bin_batch), jobs.GetThreadCount() * 4));
+	if (groups.size() < group_count) {
+		groups.resize(group_count);
+	}
+	jobs.ParallelFor(group_count, 1, [this, triangleCount](size_t begin, size_t end) {
+		for (size_t g = begin; g < end; g++) {
+			BinTriangles(triangleCount * g / group_count, triangleCount * (g + 1) / group_count, groups[g]);
+		}
+	});
+
+	jobs.ParallelFor(tile_stats.size(), 1, [this](size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; tile++) {
+			RasterizeTile(static_cast<uint32_t>(tile));
+		}
+	});
+
+	stats.triangles += triangleCount;
+	for (uint32_t g = 0; g < group_count; g++) {
+		stats.clipped_triangles += groups[g].clipped;
+		stats.culled_triangles += groups[g].culled;
+		stats.setup_triangles += groups[g].triangles.size();
+		for (const std::vector<uint32_t> &tile : groups[g].tiles) {
+			stats.bin_entries += tile.size();
+		}
+	}
+	for (const TileStats &tile : tile_stats) {
+		stats.covered_pixels += tile.covered;
+		stats.written_pixels += tile.written;
+	}
+	draws.clear();
+}
+
+void SoftwareRasterizer::BinTriangles(size_t first, size_t end, BinGroup &group) const
+{
+	group.triangles.clear();
+	group.tiles.resize(tile_stats.size());
+	for (std::vector<uint32_t> &tile : group.tiles) {
+		tile.clear();
+	}
+	group.clipped = 0;
+	group.culled = 0;
+
+	size_t drawIndex = std::upper_bound(draw_triangles.begin(), draw_triangles.end(), first) - draw_triangles.begin() - 1;
+	for (size_t t = first; t < end; t++) {
+		while (t >= draw_triangles[drawIndex + 1]) {
+			drawIndex++;
+		}
+		const Draw &draw = draws[drawIndex];
+		const uint32_t firstCorner = draw.first_index + static_cast<uint32_t>(t - draw_triangles[drawIndex]) * 3;
+
+		ClipVertex v[3];
+		uint32_t outcodes[3];
+		bool valid = true;
+		for (int corner = 0; corner < 3; corner++) {
+			const int64_t index = static_cast<int64_t>(GetIndex(firstCorner + corner)) + draw.base_vertex;
+			valid &= index >= 0 && index < vertex_count;
+			if (valid) {
+				v[corner] = clip_vertices[index];
+				outcodes[corner] = GetOutcode(v[corner], guard_band_x, guard_band_y);
+			}
+		}
+		if (!valid || (outcodes[0] & outcodes[1] & outcodes[2] & frustum_planes) != 0) {
+			group.culled++;
+			continue;
+		}
+
+		// Flat color: the vertices of a triangle all carry its material's color
+		const uint32_t color = PackColor(vertices[GetIndex(firstCorner) + draw.base_vertex].color);
+		if (((outcodes[0] | outcodes[1] | outcodes[2]) & clip_planes) != 0) {
+			group.clipped++;
+			ClipTriangle(v, color, group);
+		} else {
+			SetupTriangle(v, color, group);
+		}
+	}
+}
+
+void SoftwareRasterizer::ClipTriangle(const ClipVertex *v, uint32_t color, BinGroup &group) const
+{
+	ClipVertex polygons[2][max_clip_vertices];
+	int count = 3;
+	int current = 0;
+	std::copy(v, v + 3, polygons[0]);
+	for (uint32_t plane = outside_near; plane <= outside_guard_top && count >= 3; plane <<= 1) {
+		const ClipVertex *in = polygons[current];
+		ClipVertex *out = polygons[current ^ 1];
+		int outCount = 0;
+		for (int i = 0; i < count; i++) {
+			const ClipVertex &a = in[i];
+			const ClipVertex &b = in[(i + 1) % count];
+			const float da = GetPlaneDistance(a, plane, guard_band_x, guard_band_y);
+			const float db = GetPlaneDistance(b, plane, guard_band_x, guard_band_y);
+			if (da >= 0.0f) {
+				out[outCount++] = a;
+			}
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				// Always from the inside vertex, so the triangles sharing this edge get the same point
+				const ClipVertex &inside = da >= 0.0f ? a : b;
+				const ClipVertex &outside = da >= 0.0f ? b : a;
+				const float dIn = da >= 0.0f ? da : db;
+				const float dOut = da >= 0.0f ? db : da;
+				const float s = dIn / (dIn - dOut);
+				out[outCount++] = {inside.x + (outside.x - inside.x) * s, inside.y + (outside.y - inside.y) * s,
+					inside.z + (outside.z - inside.z) * s, inside.w + (outside.w - inside.w) * s};
+			}
+		}
+		count = outCount;
+		current ^= 1;
+	}
+
+	const ClipVertex *polygon = polygons[current];
+	if (count < 3) {
+		group.culled++;
+	}
+	for (int i = 1; i + 1 < count; i++) {
+		const ClipVertex triangle[3] = {polygon[0], polygon[i], polygon[i + 1]};
+		SetupTriangle(triangle, color, group);
+	}
+}
+
+void SoftwareRasterizer::SetupTriangle(const ClipVertex *v, uint32_t color, BinGroup &group) const
+{
+	// Viewport transform and snapping; y points down like D3D's viewport
+	int32_t x[3];
+	int32_t y[3];
+	float z[3];
+	for (int i = 0; i < 3; i++) {
+		const float inverseW = 1.0f / v[i].w;
+		const float sx = (v[i].x * inverseW * 0.5f + 0.5f) * image.width;
+		const float sy = (0.5f - v[i].y * inverseW * 0.5f) * image.height;
+		x[i] = static_cast<int32_t>(floorf(sx * subpixel_scale + 0.5f));
+		y[i] = static_cast<int32_t>(floorf(sy * subpixel_scale + 0.5f));
+		z[i] = v[i].z * inverseW;
+	}
+
+	// Culling is off in the renderer, so back faces are turned around instead of dropped
+	const int64_t area = static_cast<int64_t>(x[1] - x[0]) * (y[2] - y[0]) - static_cast<int64_t>(x[2] - x[0]) * (y[1] - y[0]);
+	if (area == 0) {
+		group.culled++;
+		return;
+	}
+	if (area < 0) {
+		std::swap(x[1], x[2]);
+		std::swap(y[1], y[2]);
+		std::swap(z[1], z[2]);
+	}
+
+	// Pixels whose centers, at 8 subpixels, lie in the bounds
+	const int32_t half = subpixel_scale / 2;
+	Triangle triangle;
+	triangle.min_x = std::max(0, FloorDiv(std::min({x[0], x[1], x[2]}) - half + subpixel_scale - 1, subpixel_scale));
+	triangle.min_y = std::max(0, FloorDiv(std::min({y[0], y[1], y[2]}) - half + subpixel_scale - 1, subpixel_scale));
+	triangle.max_x = std::min(static_cast<int32_t>(image.width) - 1, FloorDiv(std::max({x[0], x[1], x[2]}) - half, subpixel_scale));
+	triangle.max_y = std::min(static_cast<int32_t>(image.height) - 1, FloorDiv(std::max({y[0], y[1], y[2]}) - half, subpixel_scale));
+	if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y) {
+		group.culled++;
+		return;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		const int j = (i + 1) % 3;
+		triangle.a[i] = y[i] - y[j];
+		triangle.b[i] = x[j] - x[i];
+		triangle.c[i] = static_cast<int64_t>(x[i]) * y[j] - static_cast<int64_t>(y[i]) * x[j];
+		// Top-left rule: pixel centers exactly on an edge belong to it only if it is a left or a top edge
+		const bool topLeft = triangle.a[i] > 0 || (triangle.a[i] == 0 && triangle.b[i] > 0);
+		triangle.c[i] -= topLeft ? 0 : 1;
+	}
+
+	// z / w is linear in screen space; the plane is set up in pixels and evaluated at pixel centers
+	const float dx1 = static_cast<float>(x[1] - x[0]) / subpixel_scale;
+	const float dy1 = static_cast<float>(y[1] - y[0]) / subpixel_scale;
+	const float dx2 = static_cast<float>(x[2] - x[0]) / subpixel_scale;
+	const float dy2 = static_cast<float>(y[2] - y[0]) / subpixel_scale;
+	const float determinant = dx1 * dy2 - dx2 * dy1;
+	triangle.dz_dx = ((z[1] - z[0]) * dy2 - (z[2] - z[0]) * dy1) / determinant;
+	triangle.dz_dy = (dx1 * (z[2] - z[0]) - dx2 * (z[1] - z[0])) / determinant;
+	triangle.z = z[0] - triangle.dz_dx * (static_cast<float>(x[0]) / subpixel_scale - 0.5f)
+		- triangle.dz_dy * (static_cast<float>(y[0]) / subpixel_scale - 0.5f);
+	triangle.color = color;
+
+	const uint32_t index = static_cast<uint32_t>(group.triangles.size());
+	group.triangles.push_back(triangle);
+	for (int32_t ty = triangle.min_y / static_cast<int32_t>(tile_size); ty <= triangle.max_y / static_cast<int32_t>(tile_size); ty++) {
+		for (int32_t tx = triangle.min_x / static_cast<int32_t>(tile_size); tx <= triangle.max_x / static_cast<int32_t>(tile_size); tx++) {
+			group.tiles[ty * tiles_x + tx].push_back(index);
+		}
+	}
+}
+
+void SoftwareRasterizer::RasterizeTile(uint32_t tile)
+{
+	const int32_t tileX = static_cast<int32_t>(tile % tiles_x * tile_size);
+	const int32_t tileY = static_cast<int32_t>(tile / tiles_x * tile_size);
+	const int32_t tileMaxX = std::min(tileX + static_cast<int32_t>(tile_size), static_cast<int32_t>(image.width)) - 1;
+	const int32_t tileMaxY = std::min(tileY + static_cast<int32_t>(tile_size), static_cast<int32_t>(image.height)) - 1;
+	const int32_t width = static_cast<int32_t>(image.width);
+	uint64_t covered = 0;
+	uint64_t written = 0;
+
+	for (uint32_t g = 0; g < group_count; g++) {
+		const BinGroup &group = groups[g];
+		for (uint32_t index : group.tiles[tile]) {
+			const Triangle &triangle = group.triangles[index];
+			const int32_t minX = std::max(triangle.min_x, tileX);
+			const int32_t minY = std::max(triangle.min_y, tileY);
+			const int32_t maxX = std::min(triangle.max_x, tileMaxX);
+			const int32_t maxY = std::min(triangle.max_y, tileMaxY);
+
+			// 8x8 blocks aligned to the tile: edges that cover a whole block drop out, blocks outside an edge are skipped
+			for (int32_t blockY = minY & ~(block_size - 1); blockY <= maxY; blockY += block_size) {
+				for (int32_t blockX = minX & ~(block_size - 1); blockX <= maxX; blockX += block_size) {
+					int32_t edgeValue[3];
+					int32_t edgeStepX[3];
+					int32_t edgeStepY[3];
+					int partialEdges = 0;
+					bool outside = false;
+					for (int i = 0; i < 3; i++) {
+						const int64_t stepX = static_cast<int64_t>(triangle.a[i]) * subpixel_scale;
+						const int64_t stepY = static_cast<int64_t>(triangle.b[i]) * subpixel_scale;
+						const int64_t value = triangle.a[i] * (static_cast<int64_t>(blockX) * subpixel_scale + subpixel_scale / 2)
+							+ triangle.b[i] * (static_cast<int64_t>(blockY) * subpixel_scale + subpixel_scale / 2) + triangle.c[i];
+						const int64_t low = value + std::min<int64_t>(0, stepX * (block_size - 1)) + std::min<int64_t>(0, stepY * (block_size - 1));
+						const int64_t high = value + std::max<int64_t>(0, stepX * (block_size - 1)) + std::max<int64_t>(0, stepY * (block_size - 1));
+						if (high < 0) {
+							outside = true;
+							break;
+						}
+						if (low < 0) {
+							// The edge crosses the block, so the value is within a block's worth of steps of 0
+							edgeValue[partialEdges] = static_cast<int32_t>(value);
+							edgeStepX[partialEdges] = static_cast<int32_t>(stepX);
+							edgeStepY[partialEdges] = static_cast<int32_t>(stepY);
+							partialEdges++;
+						}
+					}
+					if (outside) {
+						continue;
+					}
+
+					const int32_t spanMinX = std::max(blockX, minX);
+					const int32_t spanMaxX = std::min(blockX + block_size - 1, maxX);
+					const int32_t spanMaxY = std::min(blockY + block_size - 1, maxY);
+					for (int32_t py = std::max(blockY, minY); py <= spanMaxY; py++) {
+						const float rowZ = triangle.z + triangle.dz_dy * static_cast<float>(py);
+						float *depthRow = &depth[static_cast<size_t>(py) * width];
+						uint32_t *pixelRow = &image.pixels[static_cast<size_t>(py) * width];
+						int32_t rowValue[3];
+						for (int i = 0; i < partialEdges; i++) {
+							rowValue[i] = edgeValue[i] + edgeStepY[i] * (py - blockY);
+						}
+
+						for (int32_t quadX = blockX; quadX <= spanMaxX; quadX += 4) {
+							if (quadX + 3 < spanMinX) {
+								continue;
+							}
+#ifdef SOFT_RASTER_SSE
+							// Four pixels at once; the last quad of a row whose width is not a multiple of 4 stays scalar,
+							// since its lanes would reach into the next row and another tile
+							if (quadX + 3 < width) {
+								const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+								const __m128i xs = _mm_add_epi32(_mm_set1_epi32(quadX), lanes);
+								__m128i mask = _mm_and_si128(_mm_cmpgt_epi32(xs, _mm_set1_epi32(spanMinX - 1)),
+									_mm_cmplt_epi32(xs, _mm_set1_epi32(spanMaxX + 1)));
+								for (int i = 0; i < partialEdges; i++) {
+									const int32_t e = rowValue[i] + edgeStepX[i] * (quadX - blockX);
+									const __m128i values = _mm_setr_epi32(e, e + edgeStepX[i], e + 2 * edgeStepX[i], e + 3 * edgeStepX[i]);
+									mask = _mm_and_si128(mask, _mm_cmpgt_epi32(values, _mm_set1_epi32(-1)));
+								}
+								const __m128 coverage = _mm_castsi128_ps(mask);
+								const int coveredLanes = _mm_movemask_ps(coverage);
+								if (coveredLanes == 0) {
+									continue;
+								}
+								const __m128 z = _mm_add_ps(_mm_set1_ps(rowZ), _mm_mul_ps(_mm_set1_ps(triangle.dz_dx), _mm_cvtepi32_ps(xs)));
+								const __m128 oldDepth = _mm_loadu_ps(depthRow + quadX);
+								const __m128 pass = _mm_and_ps(coverage, _mm_cmplt_ps(z, oldDepth));
+								const __m128i passMask = _mm_castps_si128(pass);
+								_mm_storeu_ps(depthRow + quadX, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, oldDepth)));
+								__m128i *pixels = reinterpret_cast<__m128i *>(pixelRow + quadX);
+								const __m128i oldPixels = _mm_loadu_si128(pixels);
+								_mm_storeu_si128(pixels, _mm_or_si128(_mm_and_si128(passMask, _mm_set1_epi32(static_cast<int32_t>(triangle.color))),
+									_mm_andnot_si128(passMask, oldPixels)));
+								covered += lane_counts[coveredLanes];
+								written += lane_counts[_mm_movemask_ps(pass)];
+								continue;
+							}
+#endif
+							for (int32_t px = std::max(quadX, spanMinX); px <= std::min(quadX + 3, spanMaxX); px++) {
+								bool inside = true;
+								for (int i = 0; i < partialEdges; i++) {
+									inside &= rowValue[i] + edgeStepX[i] * (px - blockX) >= 0;
+								}
+								if (inside) {
+									covered++;
+									const float z = rowZ + triangle.dz_dx * static_cast<float>(px);
+									written += DepthTest(z, depthRow[px], pixelRow[px], triangle.color) ? 1 : 0;
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	tile_stats[tile].covered = covered;
+	tile_stats[tile].written = written;
+}
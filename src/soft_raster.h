@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "command_sink.h"
+#include "cpu_math.h"
+#include "job_system.h"
+#include "mesh_builder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SOFT_RASTER_SSE 1
+#endif
+
+// RGBA8 pixels with red in the lowest byte, row 0 at the top, like the R8G8B8A8_UNORM back buffer
+struct SoftwareImage
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint32_t> pixels;
+};
+
+// Binary PPM (P6), which every image viewer opens and needs no library. Alpha is not stored; read images get 255.
+bool WritePpm(const std::string &path, const SoftwareImage &image, std::string &err);
+bool ReadPpm(const std::string &path, SoftwareImage &image, std::string &err);
+
+struct ImageDifference
+{
+	// Pixels with an RGB channel further off than the tolerance; all of them when the sizes differ
+	uint64_t different_pixels;
+	uint32_t max_channel_difference;
+};
+
+ImageDifference CompareImages(const SoftwareImage &a, const SoftwareImage &b, uint32_t channel_tolerance);
+
+struct SoftwareRasterStats
+{
+	uint64_t draws;
+	uint64_t triangles;
+	// Crossed the near or far plane or the guard band and went through the clipper
+	uint64_t clipped_triangles;
+	// Outside the frustum, zero area, or covering no pixel center
+	uint64_t culled_triangles;
+	// Triangles after clipping that were binned
+	uint64_t setup_triangles;
+	// Triangle and tile pairs
+	uint64_t bin_entries;
+	// Pixels inside a triangle, and those of them that passed the depth test
+	uint64_t covered_pixels;
+	uint64_t written_pixels;
+};
+
+// Draws the scene pass on the CPU for machines without a GPU: VSMain (position * world_view_proj) and PSMain
+// (the vertex color) of shaders.hlsl, with solid fill and a LESS depth test. Triangles are set up and binned into
+// 64x64 tiles in parallel, then each tile is rasterized by one worker in submission order, so the image does not
+// depend on the number of threads. Coverage follows D3D: pixel centers, 4 subpixel bits and the top-left rule.
+class SoftwareRasterizer : public CommandSink
+{
+public:
+	static const uint32_t tile_size = 64;
+
+	SoftwareRasterizer(JobSystem &jobs, uint32_t width, uint32_t height);
+
+	// The buffers draws index into, like the renderer's vertex and index buffers; index_size is 2 or 4.
+	// They have to stay valid until the draws were flushed.
+	void SetGeometry(const MeshVertex *vertices, uint32_t vertex_count, const void *indices, uint32_t index_count, uint32_t index_size);
+	// Depth goes back to 1
+	void Clear(const float color[4]);
+
+	// There is a single pipeline
+	void SetPipeline(uint32_t) override {};
+	// The address is a CPU pointer to the constants, world_view_proj first, so SceneConstants works as is.
+	// The matrix is copied; draws queued under a different matrix are flushed first.
+	void SetConstants(uint64_t address) override;
+	// Instances carry no data of their own in VSMain, so one copy stands for all of them
+	void DrawIndexedInstanced(uint32_t index_count, uint32_t instance_count, uint32_t first_index,
+		int32_t base_vertex, uint32_t first_instance) override;
+	// Rasterizes the queued draws and waits for them
+	void Flush();
+
+	const SoftwareImage &GetImage() const { return image; }
+	const std::vector<float> &GetDepth() const { return depth; }
+	const SoftwareRasterStats &GetStats() const { return stats; }
+	void ResetStats() { stats = {}; }
+
+private:
+	struct Draw
+	{
+		uint32_t first_index;
+		uint32_t index_count;
+		int32_t base_vertex;
+	};
+
+	struct ClipVertex
+	{
+		float x, y, z, w;
+	};
+
+	// Edge i is a[i] * x + b[i] * y + c[i] >= 0 inside, on 1/16 pixel coordinates; c includes the top-left bias.
+	// Depth at pixel (x, y) is z + dz_dx * x + dz_dy * y.
+	struct Triangle
+	{
+		int64_t c[3];
+		int32_t a[3];
+		int32_t b[3];
+		int32_t min_x, min_y, max_x, max_y;
+		float z, dz_dx, dz_dy;
+		uint32_t color;
+	};
+
+	// Setup and binning output of a contiguous range of triangles
+	struct BinGroup
+	{
+		std::vector<Triangle> triangles;
+		// Triangle indices per tile, in submission order
+		std::vector<std::vector<uint32_t>> tiles;
+		uint64_t clipped;
+		uint64_t culled;
+	};
+
+	struct alignas(64) TileStats
+	{
+		uint64_t covered;
+		uint64_t written;
+	};
+
+	uint32_t GetIndex(uint32_t i) const;
+	void SetupTriangle(const ClipVertex *v, uint32_t color, BinGroup &group) const;
+	void ClipTriangle(const ClipVertex *v, uint32_t color, BinGroup &group) const;
+	void BinTriangles(size_t first, size_t end, BinGroup &group) const;
+	void RasterizeTile(uint32_t tile);
+
+	JobSystem &jobs;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	// Clip space x and y limits, as a multiple of w, beyond which triangles are clipped
+	float guard_band_x;
+	float guard_band_y;
+
+	SoftwareImage image;
+	std::vector<float> depth;
+
+	const MeshVertex *vertices;
+	uint32_t vertex_count;
+	const void *indices;
+	uint32_t index_count;
+	uint32_t index_size;
+
+	Float4x4 world_view_proj;
+	std::vector<Draw> draws;
+	// First triangle of each draw, and the total as the last entry
+	std::vector<size_t> draw_triangles;
+
+	std::vector<ClipVertex> clip_vertices;
+	std::vector<BinGroup> groups;
+	uint32_t group_count;
+	std::vector<TileStats> tile_stats;
+	SoftwareRasterStats stats;
+};
@@ -0,0 +1,295 @@
+#include "transform_hierarchy.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// a * b for an a whose last column is (0, 0, 0, 1), as local and world matrices are. Same operations, in
+	// the same order, as MultiplyAffineSSE, so both produce the same bits.
+	void MultiplyAffineScalar(const Float4x4 &a, const Float4x4 &b, float *r)
+	{
+		for (int i = 0; i < 4; i++) {
+			for (int j = 0; j < 4; j++) {
+				float sum = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+				if (i == 3)
+					sum += b.m[3][j];
+				r[i * 4 + j] = sum;
+			}
+		}
+	}
+
+#ifdef TRANSFORM_SSE
+	void MultiplyAffineSSE(const Float4x4 &a, const Float4x4 &b, float *r)
+	{
+		const __m128 b0 = _mm_loadu_ps(b.m[0]);
+		const __m128 b1 = _mm_loadu_ps(b.m[1]);
+		const __m128 b2 = _mm_loadu_ps(b.m[2]);
+		const __m128 b3 = _mm_loadu_ps(b.m[3]);
+		for (int i = 0; i < 4; i++) {
+			__m128 sum = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a.m[i][0]), b0), _mm_mul_ps(_mm_set1_ps(a.m[i][1]), b1));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(a.m[i][2]), b2));
+			if (i == 3)
+				sum = _mm_add_ps(sum, b3);
+			_mm_storeu_ps(r + i * 4, sum);
+		}
+	}
+#endif
+}
+
+TransformHierarchy::TransformHierarchy(bool use_simd) : use_simd(use_simd), dirty_count(0), last_updated(0)
+{
+}
+
+void TransformHierarchy::Clear()
+{
+	translation_x.clear();
+	translation_y.clear();
+	translation_z.clear();
+	rotation_x.clear();
+	rotation_y.clear();
+	rotation_z.clear();
+	rotation_w.clear();
+	scale_x.clear();
+	scale_y.clear();
+	scale_z.clear();
+	parent.clear();
+	local_dirty.clear();
+	world_changed.clear();
+	world.clear();
+	dirty_count = 0;
+	last_updated = 0;
+}
+
+void TransformHierarchy::Reserve(size_t count)
+{
+	translation_x.reserve(count);
+	translation_y.reserve(count);
+	translation_z.reserve(count);
+	rotation_x.reserve(count);
+	rotation_y.reserve(count);
+	rotation_z.reserve(count);
+	rotation_w.reserve(count);
+	scale_x.reserve(count);
+	scale_y.reserve(count);
+	scale_z.reserve(count);
+	parent.reserve(count);
+	local_dirty.reserve(count);
+	world_changed.reserve(count);
+	world.reserve(count);
+}
+
+uint32_t TransformHierarchy::Add(uint32_t parent_node, const Float3 &translation, const Quaternion &rotation, const Float3 &scale)
+{
+	const uint32_t node = static_cast<uint32_t>(parent.size());
+	if (parent_node != no_parent && parent_node >= node)
+		parent_node = no_parent;
+	translation_x.push_back(translation.x);
+	translation_y.push_back(translation.y);
+	translation_z.push_back(translation.z);
+	rotation_x.push_back(rotation.x);
+	rotation_y.push_back(rotation.y);
+	rotation_z.push_back(rotation.z);
+	rotation_w.push_back(rotation.w);
+	scale_x.push_back(scale.x);
+	scale_y.push_back(scale.y);
+	scale_z.push_back(scale.z);
+	parent.push_back(parent_node);
+	local_dirty.push_back(1);
+	world_changed.push_back(0);
+	world.push_back(MatrixIdentity());
+	dirty_count++;
+	return node;
+}
+
+void TransformHierarchy::MarkDirty(uint32_t node)
+{
+	dirty_count += local_dirty[node] ? 0 : 1;
+	local_dirty[node] = 1;
+}
+
+void TransformHierarchy::SetTranslation(uint32_t node, const Float3 &translation)
+{
+	translation_x[node] = translation.x;
+	translation_y[node] = translation.y;
+	translation_z[node] = translation.z;
+	MarkDirty(node);
+}
+
+void TransformHierarchy::SetRotation(uint32_t node, const Quaternion &rotation)
+{
+	rotation_x[node] = rotation.x;
+	rotation_y[node] = rotation.y;
+	rotation_z[node] = rotation.z;
+	rotation_w[node] = rotation.w;
+	MarkDirty(node);
+}
+
+void TransformHierarchy::SetScale(uint32_t node, const Float3 &scale)
+{
+	scale_x[node] = scale.x;
+	scale_y[node] = scale.y;
+	scale_z[node] = scale.z;
+	MarkDirty(node);
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const Float3 &translation, const Quaternion &rotation, const Float3 &scale)
+{
+	SetTranslation(node, translation);
+	SetRotation(node, rotation);
+	SetScale(node, scale);
+}
+
+void TransformHierarchy::ComputeLocal(size_t first, size_t count, Float4x4 *local) const
+{
+	// Scale, then rotate (as MatrixRotationQuaternion), then translate: with row vectors the rows of the
+	// rotation are scaled and the translation becomes the last row
+#ifdef TRANSFORM_SSE
+	if (use_simd && count == 4) {
+		const __m128 x = _mm_loadu_ps(&rotation_x[first]);
+		const __m128 y = _mm_loadu_ps(&rotation_y[first]);
+		const __m128 z = _mm_loadu_ps(&rotation_z[first]);
+		const __m128 w = _mm_loadu_ps(&rotation_w[first]);
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 two = _mm_set1_ps(2.0f);
+		const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		const __m128 xw = _mm_mul_ps(x, w), yw = _mm_mul_ps(y, w), zw = _mm_mul_ps(z, w);
+
+		const __m128 sx = _mm_loadu_ps(&scale_x[first]);
+		const __m128 sy = _mm_loadu_ps(&scale_y[first]);
+		const __m128 sz = _mm_loadu_ps(&scale_z[first]);
+		// rows[r][c] holds element (r, c) of the four matrices
+		__m128 rows[4][4];
+		rows[0][0] = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))));
+		rows[0][1] = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_add_ps(xy, zw)));
+		rows[0][2] = _mm_mul_ps(sx, _mm_mul_ps(two, _mm_sub_ps(xz, yw)));
+		rows[1][0] = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_sub_ps(xy, zw)));
+		rows[1][1] = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))));
+		rows[1][2] = _mm_mul_ps(sy, _mm_mul_ps(two, _mm_add_ps(yz, xw)));
+		rows[2][0] = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_add_ps(xz, yw)));
+		rows[2][1] = _mm_mul_ps(sz, _mm_mul_ps(two, _mm_sub_ps(yz, xw)));
+		rows[2][2] = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))));
+		rows[3][0] = _mm_loadu_ps(&translation_x[first]);
+		rows[3][1] = _mm_loadu_ps(&translation_y[first]);
+		rows[3][2] = _mm_loadu_ps(&translation_z[first]);
+		rows[0][3] = rows[1][3] = rows[2][3] = _mm_setzero_ps();
+		rows[3][3] = one;
+
+		// Transposing row r's elements gives row r of each matrix
+		for (int r = 0; r < 4; r++) {
+			_MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+			for (int i = 0; i < 4; i++)
+				_mm_storeu_ps(local[i].m[r], rows[r][i]);
+		}
+		return;
+	}
+#endif
+	for (size_t i = 0; i < count; i++) {
+		const size_t n = first + i;
+		const float x = rotation_x[n], y = rotation_y[n], z = rotation_z[n], w = rotation_w[n];
+		const float sx = scale_x[n], sy = scale_y[n], sz = scale_z[n];
+		float (&m)[4][4] = local[i].m;
+		m[0][0] = sx * (1.0f - 2.0f * (y * y + z * z));
+		m[0][1] = sx * (2.0f * (x * y + z * w));
+		m[0][2] = sx * (2.0f * (x * z - y * w));
+		m[0][3] = 0.0f;
+		m[1][0] = sy * (2.0f * (x * y - z * w));
+		m[1][1] = sy * (1.0f - 2.0f * (x * x + z * z));
+		m[1][2] = sy * (2.0f * (y * z + x * w));
+		m[1][3] = 0.0f;
+		m[2][0] = sz * (2.0f * (x * z + y * w));
+		m[2][1] = sz * (2.0f * (y * z - x * w));
+		m[2][2] = sz * (1.0f - 2.0f * (x * x + y * y));
+		m[2][3] = 0.0f;
+		m[3][0] = translation_x[n];
+		m[3][1] = translation_y[n];
+		m[3][2] = translation_z[n];
+		m[3][3] = 1.0f;
+	}
+}
+
+size_t TransformHierarchy::UpdateWorld()
+{
+	const size_t count = parent.size();
+	if (dirty_count == 0) {
+		// Nothing moved: only the marks of the last update need clearing
+		if (last_updated != 0)
+			memset(world_changed.data(), 0, count);
+		last_updated = 0;
+		return 0;
+	}
+
+	size_t updated = 0;
+	for (size_t first = 0; first < count; first += 4) {
+		const size_t block = std::min<size_t>(4, count - first);
+		// A parent precedes its children, so its mark is final by the time they read it
+		bool any = false;
+		for (size_t i = first; i < first + block; i++) {
+			const uint32_t p = parent[i];
+			const uint8_t changed = local_dirty[i] | (p != no_parent ? world_changed[p] : 0);
+			world_changed[i] = changed;
+			any |= changed != 0;
+		}
+		if (!any)
+			continue;
+
+		Float4x4 local[4];
+		ComputeLocal(first, block, local);
+		for (size_t i = 0; i < block; i++) {
+			const size_t n = first + i;
+			if (!world_changed[n])
+				continue;
+			const uint32_t p = parent[n];
+			if (p == no_parent) {
+				world[n] = local[i];
+			} else {
+#ifdef TRANSFORM_SSE
+				if (use_simd)
+					MultiplyAffineSSE(local[i], world[p], &world[n].m[0][0]);
+				else
+#endif
+					MultiplyAffineScalar(local[i], world[p], &world[n].m[0][0]);
+			}
+			local_dirty[n] = 0;
+			updated++;
+		}
+	}
+	dirty_count = 0;
+	last_updated = updated;
+	return updated;
+}
+
+size_t TransformHierarchy::WriteClipMatrices(const Float4x4 &view_proj, size_t first, size_t end, bool changed_only,
+	void *slots, size_t slot_stride) const
+{
+	uint8_t *base = static_cast<uint8_t *>(slots);
+	end = std::min(end, parent.size());
+	size_t written = 0;
+	for (size_t n = first; n < end; n++) {
+		if (changed_only && !world_changed[n])
+			continue;
+		float *slot = reinterpret_cast<float *>(base + n * slot_stride);
+#ifdef TRANSFORM_SSE
+		if (use_simd)
+			MultiplyAffineSSE(world[n], view_proj, slot);
+		else
+#endif
+			MultiplyAffineScalar(world[n], view_proj, slot);
+		written++;
+	}
+	return written;
+}
+
+const char *TransformHierarchy::GetKernelName() const
+{
+#ifdef TRANSFORM_SSE
+	if (use_simd)
+		return "SSE";
+#endif
+	return "scalar";
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_math.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define TRANSFORM_SSE 1
+#endif
+
+// Scene graph transforms in structure-of-arrays layout: each node's local translation, rotation and scale live
+// in one array per component, and world matrices in a dense array beside them. Nodes are added after their
+// parent, so one front-to-back pass meets every parent before its children. Setting a local transform marks
+// the node dirty; UpdateWorld() carries the mark down to the subtree and recomputes only the marked nodes.
+class TransformHierarchy
+{
+public:
+	static const uint32_t no_parent = UINT32_MAX;
+
+	// use_simd picks the SSE kernels when the build has them; the scalar ones give the same results
+	explicit TransformHierarchy(bool use_simd = true);
+
+	void Clear();
+	void Reserve(size_t count);
+	// Returns the index of the new node, which starts dirty. A parent that is not added yet makes it a root.
+	uint32_t Add(uint32_t parent, const Float3 &translation, const Quaternion &rotation, const Float3 &scale);
+
+	void SetTranslation(uint32_t node, const Float3 &translation);
+	// Rotations must be unit quaternions
+	void SetRotation(uint32_t node, const Quaternion &rotation);
+	void SetScale(uint32_t node, const Float3 &scale);
+	void SetLocal(uint32_t node, const Float3 &translation, const Quaternion &rotation, const Float3 &scale);
+
+	size_t GetCount() const { return parent.size(); }
+	uint32_t GetParent(uint32_t node) const { return parent[node]; }
+
+	// Recomputes the world matrices of dirty nodes and their descendants; returns how many it recomputed
+	size_t UpdateWorld();
+	// Valid after UpdateWorld()
+	const Float4x4 &GetWorld(uint32_t node) const { return world[node]; }
+	// Whether the last UpdateWorld() recomputed the node
+	bool WorldChanged(uint32_t node) const { return world_changed[node] != 0; }
+
+	// Writes world * view_proj of the nodes in [first, end) to slots + node * slot_stride, e.g. the per-object
+	// constants of an upload page. With changed_only, nodes the last UpdateWorld() did not recompute are skipped,
+	// which is right while view_proj stays the same. Ranges touch disjoint slots, so callers can split the nodes
+	// across jobs. Returns how many matrices it wrote.
+	size_t WriteClipMatrices(const Float4x4 &view_proj, size_t first, size_t end, bool changed_only, void *slots,
+		size_t slot_stride) const;
+
+	// Kernel in use
+	const char *GetKernelName() const;
+
+private:
+	void MarkDirty(uint32_t node);
+	// Local matrices of the nodes [first, first + count), count <= 4
+	void ComputeLocal(size_t first, size_t count, Float4x4 *local) const;
+
+	bool use_simd;
+	std::vector<float> translation_x, translation_y, translation_z;
+	std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+	std::vector<float> scale_x, scale_y, scale_z;
+	std::vector<uint32_t> parent;
+	std::vector<uint8_t> local_dirty;
+	std::vector<uint8_t> world_changed;
+	std::vector<Float4x4> world;
+	size_t dirty_count;
+	size_t last_updated;
+};
@@ -0,0 +1,117 @@
+#include "upload_batcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+UploadBatcher::UploadBatcher(CopyBackend &backend, uint64_t staging_size) :
+	backend(backend), staging_size(staging_size), head(0), tail(0), used(0), batch_bytes(0), batch_copies(0), last_fence(0), stats()
+{
+}
+
+bool UploadBatcher::TryAllocate(uint64_t size, uint64_t &offset)
+{
+	size = (size + staging_alignment - 1) & ~(staging_alignment - 1);
+
+	if (used == 0) {
+		head = tail = 0;
+	} else if (used == staging_size) {
+		return false;
+	}
+
+	if (head >= tail) {
+		// Free space is [head, end) and [0, tail)
+		if (staging_size - head >= size) {
+			offset = head;
+			head += size;
+			used += size;
+			batch_bytes += size;
+			return true;
+		}
+		if (tail >= size) {
+			const uint64_t padding = staging_size - head;
+			offset = 0;
+			head = size;
+			used += padding + size;
+			batch_bytes += padding + size;
+			return true;
+		}
+		return false;
+	}
+
+	// Free space is [head, tail)
+	if (tail - head >= size) {
+		offset = head;
+		head += size;
+		used += size;
+		batch_bytes += size;
+		return true;
+	}
+	return false;
+}
+
+void UploadBatcher::RetireCompleted()
+{
+	const uint64_t completed = backend.GetCompletedValue();
+	while (!submissions.empty() && submissions.front().fence <= completed) {
+		tail = (tail + submissions.front().bytes) % staging_size;
+		used -= submissions.front().bytes;
+		submissions.pop_front();
+	}
+}
+
+void UploadBatcher::Upload(void *destination, uint64_t destination_offset, const void *data, uint64_t size)
+{
+	stats.uploads++;
+	const uint8_t *source = static_cast<const uint8_t *>(data);
+	// Chunks of a quarter ring keep several submissions in flight for big uploads
+	const uint64_t maxChunk = std::max<uint64_t>(staging_alignment, (staging_size / 4) & ~(staging_alignment - 1));
+
+	while (size > 0) {
+		const uint64_t chunk = std::min(size, maxChunk);
+
+		RetireCompleted();
+		uint64_t offset;
+		while (!TryAllocate(chunk, offset)) {
+			if (batch_copies > 0) {
+				Flush();
+			} else {
+				stats.stalls++;
+				backend.WaitForValue(submissions.front().fence);
+			}
+			RetireCompleted();
+		}
+
+		memcpy(backend.GetStagingMemory() + offset, source, chunk);
+		backend.CopyToBuffer(destination, destination_offset, offset, chunk);
+		batch_copies++;
+		stats.copies++;
+		stats.bytes += chunk;
+
+		source += chunk;
+		destination_offset += chunk;
+		size -= chunk;
+	}
+}
+
+uint64_t UploadBatcher::Flush()
+{
+	if (batch_copies == 0) {
+		return last_fence;
+	}
+
+	last_fence = backend.Submit();
+	submissions.push_back({batch_bytes, last_fence});
+	batch_bytes = 0;
+	batch_copies = 0;
+	stats.submissions++;
+	return last_fence;
+}
+
+void UploadBatcher::WaitForIdle()
+{
+	Flush();
+	if (last_fence != 0) {
+		backend.WaitForValue(last_fence);
+	}
+	RetireCompleted();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// Copy engine the batcher records into: a D3D12 copy queue or a mock
+class CopyBackend
+{
+public:
+	virtual ~CopyBackend() {};
+
+	// Persistently mapped staging buffer of the size the batcher was created with
+	virtual uint8_t *GetStagingMemory() = 0;
+	virtual void CopyToBuffer(void *destination, uint64_t destination_offset, uint64_t staging_offset, uint64_t size) = 0;
+	// Submits all copies recorded since the last call and returns the fence value signaled after them
+	virtual uint64_t Submit() = 0;
+	virtual uint64_t GetCompletedValue() = 0;
+	virtual void WaitForValue(uint64_t value) = 0;
+};
+
+struct UploadBatcherStats
+{
+	uint64_t uploads;
+	uint64_t copies;
+	uint64_t bytes;
+	uint64_t submissions;
+	// Times the CPU had to wait for the copy queue to free staging space
+	uint64_t stalls;
+};
+
+// Streams static data through a reusable staging ring. Uploads are batched into one submission
+// until Flush() or until the staging ring runs out of space; staging space of a submission is
+// reused after its fence value completes. Uploads bigger than the ring are split into chunks.
+class UploadBatcher
+{
+public:
+	static const uint64_t staging_alignment = 16;
+
+	UploadBatcher(CopyBackend &backend, uint64_t staging_size);
+
+	void Upload(void *destination, uint64_t destination_offset, const void *data, uint64_t size);
+	// Returns the fence value after which every upload so far is visible, 0 if nothing was ever submitted
+	uint64_t Flush();
+	void WaitForIdle();
+
+	uint64_t GetLastFenceValue() const { return last_fence; }
+	const UploadBatcherStats &GetStats() const { return stats; }
+
+private:
+	struct Submission
+	{
+		uint64_t bytes;
+		uint64_t fence;
+	};
+
+	bool TryAllocate(uint64_t size, uint64_t &offset);
+	void RetireCompleted();
+
+	CopyBackend &backend;
+	uint64_t staging_size;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t used;
+	// Staging bytes (including wrap padding) consumed by copies not yet submitted
+	uint64_t batch_bytes;
+	uint64_t batch_copies;
+	uint64_t last_fence;
+	std::deque<Submission> submissions;
+	UploadBatcherStats stats;
+};
@@ -0,0 +1,138 @@
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <new>
+
+namespace
+{
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+}
+
+UploadRing::UploadRing(UploadPageSource &source, uint64_t page_size) :
+	source(source), page_size(AlignUp(page_size, default_alignment)), current(0), offset(0), completed(0), stats()
+{
+}
+
+UploadRing::~UploadRing()
+{
+	for (std::unique_ptr<Page> &page : pages) {
+		source.DestroyPage(page->memory);
+	}
+	for (std::unique_ptr<Page> &page : large_pages) {
+		source.DestroyPage(page->memory);
+	}
+}
+
+UploadRing::Page *UploadRing::CreatePage(uint64_t size)
+{
+	std::unique_ptr<Page> page(new Page());
+	if (!source.CreatePage(size, page->memory)) {
+		throw std::bad_alloc();
+	}
+	page->fence = 0;
+	stats.capacity += page->memory.size;
+
+	if (size > page_size) {
+		large_pages.push_back(std::move(page));
+		return large_pages.back().get();
+	}
+
+	// New pages go right after the current one so ring order stays the allocation order
+	const size_t position = pages.empty() ? 0 : current + 1;
+	pages.insert(pages.begin() + position, std::move(page));
+	current = position;
+	offset = 0;
+	return pages[current].get();
+}
+
+void UploadRing::Use(Page *page)
+{
+	if (page->fence != open_fence) {
+		page->fence = open_fence;
+		open_pages.push_back(page);
+	}
+}
+
+UploadAllocation UploadRing::Allocate(uint64_t size, uint64_t alignment)
+{
+	alignment = std::max(alignment, static_cast<uint64_t>(1));
+	const uint64_t alignedSize = AlignUp(size, default_alignment);
+
+	Page *page = nullptr;
+	uint64_t start = 0;
+
+	if (AlignUp(alignedSize, alignment) > page_size) {
+		page = CreatePage(AlignUp(alignedSize, alignment));
+	} else {
+		if (!pages.empty()) {
+			start = AlignUp(offset, alignment);
+		}
+
+		if (pages.empty() || start + alignedSize > pages[current]->memory.size) {
+			// Wrap to the next page in the ring, or grow when it is still in flight
+			const size_t next = pages.empty() ? 0 : (current + 1) % pages.size();
+			if (!pages.empty() && next != current && IsRetired(*pages[next])) {
+				stats.padding_bytes += pages[current]->memory.size - offset;
+				current = next;
+				offset = 0;
+			} else {
+				if (!pages.empty()) {
+					stats.padding_bytes += pages[current]->memory.size - offset;
+				}
+				CreatePage(page_size);
+			}
+			start = 0;
+		}
+
+		page = pages[current].get();
+		stats.padding_bytes += start - offset;
+		offset = start + alignedSize;
+	}
+
+	Use(page);
+	stats.allocated_bytes += size;
+	stats.padding_bytes += alignedSize - size;
+	stats.allocation_count++;
+
+	UploadAllocation allocation;
+	allocation.cpu_address = page->memory.cpu_address + start;
+	allocation.gpu_address = page->memory.gpu_address + start;
+	allocation.offset = start;
+	allocation.size = size;
+	allocation.resource = page->memory.resource;
+	return allocation;
+}
+
+void UploadRing::Close(uint64_t fence_value)
+{
+	for (Page *page : open_pages) {
+		page->fence = fence_value;
+	}
+	open_pages.clear();
+}
+
+void UploadRing::Retire(uint64_t completed_value)
+{
+	completed = std::max(completed, completed_value);
+
+	for (size_t i = 0; i < large_pages.size();) {
+		if (IsRetired(*large_pages[i])) {
+			stats.capacity -= large_pages[i]->memory.size;
+			source.DestroyPage(large_pages[i]->memory);
+			large_pages[i] = std::move(large_pages.back());
+			large_pages.pop_back();
+		} else {
+			i++;
+		}
+	}
+}
+
+UploadRingStats UploadRing::GetStats() const
+{
+	UploadRingStats result = stats;
+	result.page_count = pages.size() + large_pages.size();
+	return result;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Persistently mapped CPU-writable, GPU-readable memory block
+struct UploadPage
+{
+	uint8_t *cpu_address;
+	uint64_t gpu_address;
+	uint64_t size;
+	// Backend object (ID3D12Resource * for D3D12)
+	void *resource;
+};
+
+class UploadPageSource
+{
+public:
+	virtual ~UploadPageSource() {};
+
+	virtual bool CreatePage(uint64_t size, UploadPage &page) = 0;
+	virtual void DestroyPage(UploadPage &page) = 0;
+};
+
+struct UploadAllocation
+{
+	uint8_t *cpu_address;
+	uint64_t gpu_address;
+	uint64_t offset;
+	uint64_t size;
+	void *resource;
+};
+
+struct UploadRingStats
+{
+	size_t page_count;
+	uint64_t capacity;
+	uint64_t allocated_bytes;
+	uint64_t padding_bytes;
+	uint64_t allocation_count;
+};
+
+// Linear sub-allocator over a ring of upload pages. Allocations made between two Close() calls
+// retire together with the fence value passed to Close(); a page is written again only after
+// Retire() has seen that value complete. When the next page is still in flight a new page is
+// inserted into the ring, so the ring grows to the working set of frames in flight.
+class UploadRing
+{
+public:
+	static const uint64_t default_alignment = 256;
+
+	UploadRing(UploadPageSource &source, uint64_t page_size);
+	~UploadRing();
+
+	UploadRing(const UploadRing &) = delete;
+	UploadRing &operator=(const UploadRing &) = delete;
+
+	// size must be non-zero, alignment a power of two; throws std::bad_alloc when the source fails
+	UploadAllocation Allocate(uint64_t size, uint64_t alignment = default_alignment);
+	void Close(uint64_t fence_value);
+	void Retire(uint64_t completed_value);
+
+	UploadRingStats GetStats() const;
+
+private:
+	static const uint64_t open_fence = UINT64_MAX;
+
+	struct Page
+	{
+		UploadPage memory;
+		uint64_t fence;
+	};
+
+	bool IsRetired(const Page &page) const { return page.fence != open_fence && page.fence <= completed; }
+	Page *CreatePage(uint64_t size);
+	void Use(Page *page);
+
+	UploadPageSource &source;
+	uint64_t page_size;
+	std::vector<std::unique_ptr<Page>> pages;
+	// Oversized allocations get a page of their own, destroyed once retired
+	std::vector<std::unique_ptr<Page>> large_pages;
+	std::vector<Page *> open_pages;
+	size_t current;
+	uint64_t offset;
+	uint64_t completed;
+	UploadRingStats stats;
+};
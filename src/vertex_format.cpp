@@ -0,0 +1,184 @@
+#include "vertex_format.h"
+
+#include <cstring>
+
+#ifdef VERTEX_FORMAT_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	const float unorm16_max = 65535.0f;
+	const float unorm8_max = 255.0f;
+
+	// Same operations, in the same order, as the SSE kernels, so both produce the same bits
+	uint16_t QuantizePosition(float value, float offset, float inverse_scale)
+	{
+		float q = (value - offset) * inverse_scale + 0.5f;
+		q = q > 0.0f ? q : 0.0f;
+		q = q < unorm16_max ? q : unorm16_max;
+		return static_cast<uint16_t>(static_cast<int32_t>(q));
+	}
+
+	uint8_t QuantizeColor(float value)
+	{
+		float c = value > 0.0f ? value : 0.0f;
+		c = c < 1.0f ? c : 1.0f;
+		return static_cast<uint8_t>(static_cast<int32_t>(c * unorm8_max + 0.5f));
+	}
+
+	void GetInverseScale(const VertexQuantization &quantization, float *inverse_scale)
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			inverse_scale[axis] = unorm16_max / quantization.scale[axis];
+		}
+	}
+
+	void GetStep(const VertexQuantization &quantization, float *step)
+	{
+		for (int axis = 0; axis < 3; axis++) {
+			step[axis] = quantization.scale[axis] / unorm16_max;
+		}
+	}
+}
+
+VertexQuantization ComputeVertexQuantization(const MeshVertex *vertices, size_t count)
+{
+	VertexQuantization quantization = {{1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+	if (count == 0) {
+		return quantization;
+	}
+
+	float boundsMin[3] = {vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]};
+	float boundsMax[3] = {boundsMin[0], boundsMin[1], boundsMin[2]};
+	for (size_t i = 1; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			boundsMin[axis] = vertices[i].position[axis] < boundsMin[axis] ? vertices[i].position[axis] : boundsMin[axis];
+			boundsMax[axis] = vertices[i].position[axis] > boundsMax[axis] ? vertices[i].position[axis] : boundsMax[axis];
+		}
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		quantization.offset[axis] = boundsMin[axis];
+		// A flat axis keeps scale 1; all its values quantize to 0
+		quantization.scale[axis] = boundsMax[axis] > boundsMin[axis] ? boundsMax[axis] - boundsMin[axis] : 1.0f;
+	}
+	return quantization;
+}
+
+size_t GetVertexStride(VertexFormat format)
+{
+	return format == VertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(MeshVertex);
+}
+
+void EncodeVerticesScalar(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded)
+{
+	float inverseScale[3];
+	GetInverseScale(quantization, inverseScale);
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			encoded[i].position[axis] = QuantizePosition(vertices[i].position[axis], quantization.offset[axis], inverseScale[axis]);
+		}
+		encoded[i].position[3] = 0xFFFF;
+		for (int channel = 0; channel < 4; channel++) {
+			encoded[i].color[channel] = QuantizeColor(vertices[i].color[channel]);
+		}
+	}
+}
+
+void DecodeVerticesScalar(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices)
+{
+	float step[3];
+	GetStep(quantization, step);
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			vertices[i].position[axis] = static_cast<float>(encoded[i].position[axis]) * step[axis] + quantization.offset[axis];
+		}
+		for (int channel = 0; channel < 4; channel++) {
+			vertices[i].color[channel] = static_cast<float>(encoded[i].color[channel]) * (1.0f / unorm8_max);
+		}
+	}
+}
+
+#ifdef VERTEX_FORMAT_SSE
+void EncodeVerticesSSE(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded)
+{
+	float inverseScale[3];
+	GetInverseScale(quantization, inverseScale);
+	const __m128 offset = _mm_setr_ps(quantization.offset[0], quantization.offset[1], quantization.offset[2], 0.0f);
+	const __m128 scale = _mm_setr_ps(inverseScale[0], inverseScale[1], inverseScale[2], 0.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 positionMax = _mm_set1_ps(unorm16_max);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 colorMax = _mm_set1_ps(unorm8_max);
+	// SSE2 has no unsigned 32 to 16 bit pack: shift into the signed range, pack, flip the sign bit back
+	const __m128i bias = _mm_set1_epi32(0x8000);
+	const __m128i signFlip = _mm_set1_epi16(static_cast<short>(0x8000));
+	const __m128i xyzMask = _mm_setr_epi32(-1, -1, -1, 0);
+	const __m128i wOne = _mm_setr_epi32(0, 0, 0, 0xFFFF);
+
+	for (size_t i = 0; i < count; i++) {
+		// The fourth lane reads color[0] and is replaced by w
+		__m128 p = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vertices[i].position), offset), scale), half);
+		p = _mm_min_ps(_mm_max_ps(p, zero), positionMax);
+		__m128i q = _mm_or_si128(_mm_and_si128(_mm_cvttps_epi32(p), xyzMask), wOne);
+		q = _mm_sub_epi32(q, bias);
+		q = _mm_xor_si128(_mm_packs_epi32(q, q), signFlip);
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(encoded[i].position), q);
+
+		__m128 c = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(vertices[i].color), zero), one);
+		__m128i ci = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(c, colorMax), half));
+		ci = _mm_packus_epi16(_mm_packs_epi32(ci, ci), ci);
+		const int32_t packed = _mm_cvtsi128_si32(ci);
+		memcpy(encoded[i].color, &packed, sizeof(packed));
+	}
+}
+
+void DecodeVerticesSSE(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices)
+{
+	float step[3];
+	GetStep(quantization, step);
+	const __m128 scale = _mm_setr_ps(step[0], step[1], step[2], 0.0f);
+	const __m128 offset = _mm_setr_ps(quantization.offset[0], quantization.offset[1], quantization.offset[2], 0.0f);
+	const __m128 colorScale = _mm_set1_ps(1.0f / unorm8_max);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (size_t i = 0; i < count; i++) {
+		const __m128i q = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(encoded[i].position)), zero);
+		// The fourth lane spills into color[0], which the color store below overwrites
+		_mm_storeu_ps(vertices[i].position, _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(q), scale), offset));
+
+		int32_t packed;
+		memcpy(&packed, encoded[i].color, sizeof(packed));
+		const __m128i c = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		_mm_storeu_ps(vertices[i].color, _mm_mul_ps(_mm_cvtepi32_ps(c), colorScale));
+	}
+}
+#endif
+
+void EncodeVertices(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded)
+{
+#ifdef VERTEX_FORMAT_SSE
+	EncodeVerticesSSE(vertices, count, quantization, encoded);
+#else
+	EncodeVerticesScalar(vertices, count, quantization, encoded);
+#endif
+}
+
+void DecodeVertices(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices)
+{
+#ifdef VERTEX_FORMAT_SSE
+	DecodeVerticesSSE(encoded, count, quantization, vertices);
+#else
+	DecodeVerticesScalar(encoded, count, quantization, vertices);
+#endif
+}
+
+const char *GetVertexKernelName()
+{
+#ifdef VERTEX_FORMAT_SSE
+	return "SSE";
+#else
+	return "scalar";
+#endif
+}
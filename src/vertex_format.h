@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mesh_builder.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define VERTEX_FORMAT_SSE 1
+#endif
+
+// Vertex layout uploaded to the GPU, chosen when the renderer starts
+enum class VertexFormat
+{
+	// MeshVertex as is, 28 bytes
+	Float,
+	// QuantizedVertex, 12 bytes
+	Quantized
+};
+
+// R16G16B16A16_UNORM position and R8G8B8A8_UNORM color. The shader gets the position in [0, 1] per axis and
+// maps it back with the mesh's VertexQuantization; w is stored as 1.
+struct QuantizedVertex
+{
+	uint16_t position[4];
+	uint8_t color[4];
+};
+
+// position = unorm * scale + offset, per axis. The bounding box of the mesh spans the 16-bit range, so the
+// error per axis is at most half a step, scale / 65535 / 2.
+struct VertexQuantization
+{
+	float scale[3];
+	float offset[3];
+};
+
+VertexQuantization ComputeVertexQuantization(const MeshVertex *vertices, size_t count);
+
+size_t GetVertexStride(VertexFormat format);
+
+// Colors are clamped to [0, 1] and rounded to 8 bits
+void EncodeVerticesScalar(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded);
+void DecodeVerticesScalar(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices);
+#ifdef VERTEX_FORMAT_SSE
+void EncodeVerticesSSE(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded);
+void DecodeVerticesSSE(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices);
+#endif
+
+// Widest kernel the build targets
+void EncodeVertices(const MeshVertex *vertices, size_t count, const VertexQuantization &quantization, QuantizedVertex *encoded);
+void DecodeVertices(const QuantizedVertex *encoded, size_t count, const VertexQuantization &quantization, MeshVertex *vertices);
+const char *GetVertexKernelName();
@@ -1,6 +1,7 @@
 #include "pch.h"
 
 #include "win32_window.h"
+#include "frame_scheduler.h"
 
 HWND Win32Window::hwnd = nullptr;
 
@@ -34,15 +35,43 @@ int Win32Window::Run(Renderer *pRenderer, HINSTANCE hInstance, int nCmdShow) {
 	pRenderer->OnInit();
 	ShowWindow(hwnd, nCmdShow);
 
-	// Main sample loop.
+	// Sleep() and the scheduler's waits use the default ~15.6 ms timer tick otherwise
+	timeBeginPeriod(1);
+
+	SteadyClock clock;
+	FrameScheduler scheduler(clock, GetDefaultSchedulerSettings());
+	uint64_t lastTitleUpdate = clock.Now();
+
+	// Main sample loop. Messages are drained first so input is as fresh as possible, then the simulation
+	// catches up in fixed steps and one frame is rendered.
 	MSG msg = {};
 	while (msg.message != WM_QUIT) {
-		if (PeekMessage(&msg, hwnd, 0, 0, PM_REMOVE)) {
+		// WM_QUIT is a thread message, so the filter must not be the window
+		if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
 			TranslateMessage(&msg);
 			DispatchMessage(&msg);
+			continue;
+		}
+
+		const FrameTiming timing = scheduler.BeginFrame();
+		for (uint32_t i = 0; i < timing.update_count; ++i) {
+			pRenderer->OnUpdate(static_cast<float>(timing.fixed_step));
+		}
+		pRenderer->OnRender(static_cast<float>(timing.alpha));
+		scheduler.EndFrame();
+
+		if (clock.Now() - lastTitleUpdate > 1000000000) {
+			lastTitleUpdate = clock.Now();
+			const FrameTimeStats stats = scheduler.GetStats();
+			wchar_t title[256];
+			swprintf_s(title, L"%s - %.0f fps, avg %.2f ms, p99 %.2f ms, work %.2f ms", pRenderer->GetTitle(),
+				stats.fps, stats.avg_ms, stats.p99_ms, stats.work_ms);
+			SetWindowText(hwnd, title);
 		}
 	}
 
+	timeEndPeriod(1);
+
 	pRenderer->OnDestroy();
 
 	// Return this part of the WM_QUIT message to Windows.
@@ -61,10 +90,8 @@ LRESULT Win32Window::WindowProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM l
 			return 0;
 
 		case WM_PAINT:
-			if (pRender) {
-				pRender->OnUpdate();
-				pRender->OnRender();
-			}
+			// Frames are driven by the loop in Run; only validate the region so WM_PAINT stops arriving
+			ValidateRect(hWnd, nullptr);
 			return 0;
 
 		case WM_KEYDOWN:
@@ -3,10 +3,17 @@
 #include "renderer.h"
 #include "win32_window.h"
 
+#include <cstring>
+
 
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, INT nCmdShow) {
 	try {
-		Renderer render(1280, 720);
+		// Three frames in flight; 28-byte vertices unless --quantized-vertices asks for the 12-byte layout.
+		// --occlusion-culling skips shapes hidden behind the nearest ones, and draws filled and depth tested instead
+		// of wireframe, where the hidden shapes would show.
+		const VertexFormat vertexFormat = strstr(lpCmdLine, "--quantized-vertices") ? VertexFormat::Quantized : VertexFormat::Float;
+		const bool occlusionCulling = strstr(lpCmdLine, "--occlusion-culling") != nullptr;
+		Renderer render(1280, 720, 3, vertexFormat, occlusionCulling);
 		return Win32Window::Run(&render, hInstance, nCmdShow);
 	} catch (com_exception e) {
 		OutputDebugString(L"Exception:\n");
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+typedef void (*TestFunction)();
+
+struct Test
+{
+	const char *name;
+	TestFunction function;
+};
+
+std::vector<Test> &GetTests();
+
+struct TestRegistrar
+{
+	TestRegistrar(const char *name, TestFunction function)
+	{
+		GetTests().push_back({name, function});
+	}
+};
+
+#define REGISTER_TEST(name, function) static TestRegistrar function##_registrar(name, function)
+
+// Prints the name of a failed check and fails the running test; returns condition so a test can stop early
+bool Check(const char *name, bool condition);
@@ -0,0 +1,303 @@
+#include "test.h"
+#include "asset_streamer.h"
+#include "mesh_builder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	// Buffers in memory and a fence under the test's control: uploads of a frame become drawable latency
+	// frames after it ended, like a copy queue running behind the CPU
+	class MockStreamTarget : public StreamTarget
+	{
+	public:
+		explicit MockStreamTarget(uint64_t latency) :
+			latency(latency), next_fence(1), completed(0), max_submit_bytes(0), submit_bytes(0), max_chunk_bytes(0), chunk_bytes(0) {};
+
+		void Reserve(uint64_t vertex_count, uint64_t index_count, const float *, const float *) override
+		{
+			vertices.resize(vertex_count);
+			indices.resize(index_count);
+		}
+
+		uint64_t GetUploadSize(uint64_t vertex_count, uint64_t index_count) const override
+		{
+			return vertex_count * sizeof(MeshVertex) + index_count * sizeof(uint32_t);
+		}
+
+		void UploadVertices(uint64_t first_vertex, const MeshVertex *data, size_t count) override
+		{
+			std::copy(data, data + count, vertices.begin() + first_vertex);
+			submit_bytes += count * sizeof(MeshVertex);
+			// The streamer uploads each chunk's vertices, then its indices
+			chunk_bytes = count * sizeof(MeshVertex);
+		}
+
+		void UploadIndices(uint64_t first_index, const uint32_t *data, size_t count) override
+		{
+			std::copy(data, data + count, indices.begin() + first_index);
+			submit_bytes += count * sizeof(uint32_t);
+			chunk_bytes += count * sizeof(uint32_t);
+			max_chunk_bytes = std::max(max_chunk_bytes, chunk_bytes);
+		}
+
+		uint64_t Submit() override
+		{
+			max_submit_bytes = std::max(max_submit_bytes, submit_bytes);
+			submit_bytes = 0;
+			return next_fence++;
+		}
+
+		uint64_t GetCompletedValue() override { return completed; }
+
+		void EndFrame()
+		{
+			frame_fences.push_back(next_fence - 1);
+			if (frame_fences.size() > latency) {
+				completed = frame_fences[frame_fences.size() - 1 - latency];
+			}
+		}
+
+		const std::vector<MeshVertex> &GetVertices() const { return vertices; }
+		const std::vector<uint32_t> &GetIndices() const { return indices; }
+		uint64_t GetMaxSubmitBytes() const { return max_submit_bytes; }
+		uint64_t GetMaxChunkBytes() const { return max_chunk_bytes; }
+
+	private:
+		uint64_t latency;
+		uint64_t next_fence;
+		uint64_t completed;
+		std::vector<uint64_t> frame_fences;
+		std::vector<MeshVertex> vertices;
+		std::vector<uint32_t> indices;
+		uint64_t max_submit_bytes;
+		uint64_t submit_bytes;
+		uint64_t max_chunk_bytes;
+		uint64_t chunk_bytes;
+	};
+
+	const Float3 eye = {-5.0f, 8.0f, -5.0f};
+
+	// A grid of tiles, one group each with a quarter-step height field, so every position prints exactly.
+	// Returns the sum of every triangle corner, which welding and reordering leave alone.
+	double WriteSyntheticScene(const std::string &path, uint32_t tiles_per_side, uint32_t side, size_t &triangle_count)
+	{
+		const std::string mtlName = path.substr(0, path.size() - 3) + "mtl";
+		std::ofstream mtl(mtlName, std::ios::binary);
+		for (int m = 0; m < 4; m++) {
+			mtl << "newmtl tile_" << m << "\nKd " << 0.2 + 0.2 * m << " 0.5 " << 0.8 - 0.2 * m << "\n";
+		}
+		mtl.close();
+
+		std::ofstream obj(path, std::ios::binary);
+		obj << "mtllib " << std::filesystem::path(mtlName).filename().string() << "\n";
+		double sum = 0.0;
+		triangle_count = 0;
+		char line[128];
+		for (uint32_t tile = 0; tile < tiles_per_side * tiles_per_side; tile++) {
+			obj << "g tile_" << tile << "\nusemtl tile_" << tile % 4 << "\n";
+			std::vector<double> corners;
+			for (uint32_t z = 0; z < side; z++) {
+				for (uint32_t x = 0; x < side; x++) {
+					const float p[3] = {(tile % tiles_per_side) * 10.0f + x, ((x * 7 + z * 3 + tile) % 5) * 0.25f, (tile / tiles_per_side) * 10.0f + z};
+					snprintf(line, sizeof(line), "v %.2f %.2f %.2f\n", p[0], p[1], p[2]);
+					obj << line;
+					corners.push_back(static_cast<double>(p[0]) + p[1] + p[2]);
+				}
+			}
+			// Relative indices, so every tile is self-contained like an exported group; quads are fanned
+			const long long count = static_cast<long long>(side * side);
+			for (uint32_t z = 0; z + 1 < side; z++) {
+				for (uint32_t x = 0; x + 1 < side; x++) {
+					const long long a = static_cast<long long>(z * side + x) - count;
+					const long long d = a + side;
+					snprintf(line, sizeof(line), "f %lld %lld %lld %lld\n", a, d, d + 1, a + 1);
+					obj << line;
+					const size_t i = static_cast<size_t>(z * side + x);
+					sum += 2.0 * corners[i] + 2.0 * corners[i + side + 1] + corners[i + side] + corners[i + 1];
+					triangle_count += 2;
+				}
+			}
+		}
+		return sum;
+	}
+
+	double SumCorners(const MockStreamTarget &target, const std::vector<MeshShape> &shapes, uint64_t vertex_count, bool &valid)
+	{
+		double sum = 0.0;
+		valid = true;
+		for (const MeshShape &shape : shapes) {
+			for (uint32_t i = shape.index_offset; i < shape.index_offset + shape.index_count; i++) {
+				const uint32_t index = target.GetIndices()[i];
+				if (index >= vertex_count) {
+					valid = false;
+					return 0.0;
+				}
+				const float *p = target.GetVertices()[index].position;
+				sum += static_cast<double>(p[0]) + p[1] + p[2];
+			}
+		}
+		return sum;
+	}
+
+	// Without threads, LoadOnce() picks chunks nearest first; with no copy latency each one is drawable right away
+	void TestPriority()
+	{
+		const float white[3] = {1.0f, 1.0f, 1.0f};
+		MeshBuilder builder;
+		const int material = builder.AddMaterial("white", white);
+		for (int tile = 0; tile < 64; tile++) {
+			builder.BeginShape("tile_" + std::to_string(tile));
+			const float x = (tile % 8) * 10.0f;
+			const float z = (tile / 8) * 10.0f;
+			const float corners[12] = {x, 0.0f, z, x + 9.0f, 0.0f, z, x + 9.0f, 0.0f, z + 9.0f, x, 0.0f, z + 9.0f};
+			builder.AddPolygon(corners, 4, material);
+		}
+		const Mesh mesh = builder.Build();
+		std::vector<uint8_t> packed;
+		MeshViewStreamSource source(GetMeshView(mesh, packed));
+		MockStreamTarget target(0);
+		AssetStreamerSettings settings;
+		settings.thread_count = 0;
+		settings.build_lods = false;
+		AssetStreamer streamer(source, target, settings);
+
+		const float p[3] = {eye.x, eye.y, eye.z};
+		std::vector<float> distances;
+		std::vector<MeshShape> previous;
+		while (streamer.LoadOnce()) {
+			streamer.Update(eye);
+			target.EndFrame();
+			if (!streamer.Update(eye)) {
+				continue;
+			}
+			// Shapes are reported in chunk order; the new one is where the lists first differ
+			const std::vector<MeshShape> &shapes = streamer.GetShapes();
+			size_t added = 0;
+			while (added < previous.size() && memcmp(&previous[added], &shapes[added], sizeof(MeshShape)) == 0) {
+				added++;
+			}
+			float distance = 0.0f;
+			for (int axis = 0; axis < 3; axis++) {
+				const float d = std::max(std::max(shapes[added].bounds_min[axis] - p[axis], p[axis] - shapes[added].bounds_max[axis]), 0.0f);
+				distance += d * d;
+			}
+			distances.push_back(distance);
+			previous = shapes;
+		}
+
+		Check("every shape streamed", streamer.GetState() == StreamState::Finished && streamer.GetShapes().size() == mesh.shapes.size());
+		Check("nearest shapes first", distances.size() == mesh.shapes.size() && std::is_sorted(distances.begin(), distances.end()));
+	}
+
+	// An OBJ cut into small chunks, streamed two frames behind the copy queue within a small budget
+	void TestObjStream()
+	{
+		const std::string path = (std::filesystem::temp_directory_path() / "asset_streamer_test.obj").string();
+		size_t triangleCount = 0;
+		const double expectedSum = WriteSyntheticScene(path, 4, 9, triangleCount);
+
+		ObjStreamSource source(path, 2048);
+		MockStreamTarget target(2);
+		AssetStreamerSettings settings;
+		settings.thread_count = 0;
+		settings.frame_upload_budget = 8 * 1024;
+		AssetStreamer streamer(source, target, settings);
+
+		bool drawnBeforeCopy = false;
+		int frame = 0;
+		for (; frame < 1000 && streamer.GetState() != StreamState::Finished && streamer.GetState() != StreamState::Failed; frame++) {
+			for (int load = 0; load < 2; load++) {
+				streamer.LoadOnce();
+			}
+			const uint64_t uploadedBefore = streamer.GetStats().uploaded_bytes;
+			streamer.Update(eye);
+			// The first uploads cannot be drawable in the frame they were submitted
+			drawnBeforeCopy |= uploadedBefore == 0 && !streamer.GetShapes().empty();
+			target.EndFrame();
+		}
+		const AssetStreamerStats stats = streamer.GetStats();
+
+		Check("finished", streamer.GetState() == StreamState::Finished && stats.failed_chunks == 0);
+		Check("several chunks per group", stats.chunk_count > 16);
+		Check("drawable after the copy", !drawnBeforeCopy);
+		// Only a chunk bigger than the budget goes over it, and then alone
+		Check("frame budget", target.GetMaxSubmitBytes() == stats.max_frame_bytes &&
+			stats.max_frame_bytes <= std::max(settings.frame_upload_budget, target.GetMaxChunkBytes()));
+		Check("every triangle", stats.triangles == triangleCount);
+
+		bool valid = false;
+		const double sum = SumCorners(target, streamer.GetShapes(), streamer.GetVertexCount(), valid);
+		Check("indices in range", valid);
+		Check("same geometry as the file", std::fabs(sum - expectedSum) <= 1e-9 * std::max(1.0, std::fabs(expectedSum)));
+
+		// What the renderer cooks into the mesh cache: the same triangles, without the generated levels
+		Mesh mesh;
+		streamer.GetStreamedMesh(target.GetVertices().data(), target.GetIndices().data(), mesh);
+		double meshSum = 0.0;
+		bool meshValid = mesh.shapes.size() == streamer.GetShapes().size();
+		for (uint32_t index : mesh.indices) {
+			meshValid &= index < mesh.vertices.size();
+			if (meshValid) {
+				const float *p = mesh.vertices[index].position;
+				meshSum += static_cast<double>(p[0]) + p[1] + p[2];
+			}
+		}
+		Check("streamed mesh", meshValid && mesh.indices.size() == triangleCount * 3 && mesh.vertices.size() <= streamer.GetVertexCount() &&
+			mesh.materials.size() == 4);
+		Check("streamed mesh geometry", std::fabs(meshSum - expectedSum) <= 1e-9 * std::max(1.0, std::fabs(expectedSum)));
+
+		std::remove(path.c_str());
+		std::remove((path.substr(0, path.size() - 3) + "mtl").c_str());
+	}
+
+	// Cancelling keeps what is drawable, lets submitted uploads complete and loads nothing more
+	void TestCancel()
+	{
+		const std::string path = (std::filesystem::temp_directory_path() / "asset_streamer_cancel.obj").string();
+		size_t triangleCount = 0;
+		WriteSyntheticScene(path, 4, 9, triangleCount);
+
+		ObjStreamSource source(path, 2048);
+		MockStreamTarget target(2);
+		AssetStreamerSettings settings;
+		settings.thread_count = 0;
+		settings.max_loaded_chunks = 4;
+		settings.frame_upload_budget = 4 * 1024;
+		AssetStreamer streamer(source, target, settings);
+
+		for (int frame = 0; frame < 1000 && streamer.GetStats().resident_chunks == 0; frame++) {
+			streamer.LoadOnce();
+			streamer.LoadOnce();
+			streamer.Update(eye);
+			target.EndFrame();
+		}
+		streamer.LoadOnce();
+		streamer.Update(eye);
+		const AssetStreamerStats before = streamer.GetStats();
+		streamer.Cancel();
+
+		Check("nothing left to load", !streamer.LoadOnce());
+		for (int frame = 0; frame < 4; frame++) {
+			target.EndFrame();
+			streamer.Update(eye);
+		}
+		const AssetStreamerStats after = streamer.GetStats();
+		Check("cancelled", streamer.GetState() == StreamState::Cancelled);
+		Check("loading stopped", after.loaded_chunks == before.loaded_chunks);
+		Check("submitted uploads completed", after.resident_chunks > before.resident_chunks);
+		Check("drawable part kept", after.resident_chunks < after.chunk_count && streamer.GetShapes().size() >= after.resident_chunks);
+
+		std::remove(path.c_str());
+		std::remove((path.substr(0, path.size() - 3) + "mtl").c_str());
+	}
+}
+
+REGISTER_TEST("asset_streamer_priority", TestPriority);
+REGISTER_TEST("asset_streamer_obj", TestObjStream);
+REGISTER_TEST("asset_streamer_cancel", TestCancel);
@@ -0,0 +1,123 @@
+#include "test.h"
+#include "frame_ring.h"
+
+#include <algorithm>
+
+namespace
+{
+	// The test decides when the GPU finishes; a CPU wait finishes the GPU work up to the awaited value
+	class ManualTimeline : public FenceTimeline
+	{
+	public:
+		ManualTimeline() : signaled(0), completed(0), wait_count(0) {};
+
+		void Signal(uint64_t value) override { signaled = value; }
+		uint64_t GetCompletedValue() override { return completed; }
+
+		void WaitForValue(uint64_t value) override
+		{
+			wait_count++;
+			waited.push_back(value);
+			Complete(value);
+		}
+
+		void Complete(uint64_t value) { completed = std::max(completed, std::min(value, signaled)); }
+		uint64_t GetInFlight() const { return signaled - completed; }
+
+		uint64_t signaled;
+		uint64_t completed;
+		uint64_t wait_count;
+		std::vector<uint64_t> waited;
+	};
+
+	void TestSlotRotation()
+	{
+		for (uint32_t framesInFlight : {0u, 1u, 2u, 3u}) {
+			ManualTimeline timeline;
+			FrameRing ring(timeline, framesInFlight);
+			const uint32_t slots = std::max(1u, framesInFlight);
+			bool rotates = true;
+			for (uint32_t frame = 0; frame < 10; frame++) {
+				rotates &= ring.BeginFrame() == frame % slots && ring.GetFrameSlot() == frame % slots;
+				rotates &= ring.GetCurrentFenceValue() == frame + 1 && ring.EndFrame() == frame + 1;
+				timeline.Complete(timeline.signaled);
+			}
+			Check("slots rotate", rotates);
+			Check("frames in flight", ring.GetFramesInFlight() == slots);
+			Check("frame count", ring.GetFrameCount() == 10);
+		}
+	}
+
+	// A GPU that never finishes on its own: the CPU runs frames_in_flight frames ahead, then waits every frame for
+	// the slot's previous frame
+	void TestStalledGpu()
+	{
+		for (uint32_t framesInFlight = 1; framesInFlight <= 3; framesInFlight++) {
+			ManualTimeline timeline;
+			FrameRing ring(timeline, framesInFlight);
+			uint64_t maxInFlight = 0;
+			bool waitsForSlot = true;
+			for (uint32_t frame = 0; frame < 12; frame++) {
+				const uint64_t waitsBefore = timeline.wait_count;
+				ring.BeginFrame();
+				if (frame >= framesInFlight) {
+					// Frame f reuses the slot of frame f - framesInFlight, which signaled f - framesInFlight + 1
+					waitsForSlot &= timeline.wait_count == waitsBefore + 1 && timeline.waited.back() == frame - framesInFlight + 1;
+				} else {
+					waitsForSlot &= timeline.wait_count == waitsBefore;
+				}
+				ring.EndFrame();
+				maxInFlight = std::max(maxInFlight, timeline.GetInFlight());
+			}
+			Check("waits for the slot's previous frame", waitsForSlot);
+			Check("wait count", ring.GetWaitCount() == 12 - framesInFlight && timeline.wait_count == ring.GetWaitCount());
+			Check("frames overlap", maxInFlight == framesInFlight);
+		}
+	}
+
+	// A GPU one frame behind the CPU: one frame in flight waits every frame, more never wait
+	void TestGpuOneFrameBehind()
+	{
+		for (uint32_t framesInFlight = 1; framesInFlight <= 3; framesInFlight++) {
+			ManualTimeline timeline;
+			FrameRing ring(timeline, framesInFlight);
+			for (uint32_t frame = 0; frame < 12; frame++) {
+				ring.BeginFrame();
+				const uint64_t value = ring.EndFrame();
+				timeline.Complete(value - 1);
+			}
+			Check("waits only on a pending fence", ring.GetWaitCount() == (framesInFlight == 1 ? 11u : 0u));
+		}
+	}
+
+	void TestGpuKeepsUp()
+	{
+		ManualTimeline timeline;
+		FrameRing ring(timeline, 2);
+		for (int frame = 0; frame < 12; frame++) {
+			ring.BeginFrame();
+			timeline.Complete(ring.EndFrame());
+		}
+		Check("no waits", ring.GetWaitCount() == 0 && timeline.wait_count == 0);
+	}
+
+	void TestWaitForIdle()
+	{
+		ManualTimeline timeline;
+		FrameRing ring(timeline, 3);
+		ring.WaitForIdle();
+		Check("nothing to wait for", timeline.wait_count == 0);
+		for (int frame = 0; frame < 2; frame++) {
+			ring.BeginFrame();
+			ring.EndFrame();
+		}
+		ring.WaitForIdle();
+		Check("waits for the last frame", timeline.waited.size() == 1 && timeline.waited[0] == 2 && ring.GetCompletedValue() == 2);
+	}
+}
+
+REGISTER_TEST("frame_ring_slot_rotation", TestSlotRotation);
+REGISTER_TEST("frame_ring_stalled_gpu", TestStalledGpu);
+REGISTER_TEST("frame_ring_gpu_one_frame_behind", TestGpuOneFrameBehind);
+REGISTER_TEST("frame_ring_gpu_keeps_up", TestGpuKeepsUp);
+REGISTER_TEST("frame_ring_wait_for_idle", TestWaitForIdle);
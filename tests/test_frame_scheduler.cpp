@@ -0,0 +1,132 @@
+#include "test.h"
+#include "frame_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Sleeps return immediately and move time forward
+	class SimulatedClock : public SchedulerClock
+	{
+	public:
+		SimulatedClock() : now(1000000000) {};
+
+		uint64_t Now() override { return now; }
+		void SleepUntil(uint64_t time) override { now = std::max(now, time); }
+		void Advance(uint64_t duration) { now += duration; }
+
+	private:
+		uint64_t now;
+	};
+
+	FrameSchedulerSettings MakeSettings(FramePacing pacing, double frameRate)
+	{
+		FrameSchedulerSettings settings = GetDefaultSchedulerSettings();
+		settings.pacing = pacing;
+		settings.max_frame_rate = frameRate;
+		return settings;
+	}
+
+	// A body moving at 1 unit/s must end up at the elapsed time whatever the render cost
+	void TestRateIndependence()
+	{
+		const double workMs[] = {0.5, 4.0, 16.7, 33.3, 45.0};
+		for (double work : workMs) {
+			SimulatedClock clock;
+			FrameScheduler scheduler(clock, MakeSettings(FramePacing::None, 0.0));
+			const uint64_t start = clock.Now();
+
+			double previous = 0.0;
+			double position = 0.0;
+			double rendered = 0.0;
+			uint64_t updates = 0;
+			bool alphaInRange = true;
+			while (clock.Now() - start < 10000000000ull) {
+				const FrameTiming timing = scheduler.BeginFrame();
+				for (uint32_t i = 0; i < timing.update_count; i++) {
+					previous = position;
+					position += timing.fixed_step;
+				}
+				updates += timing.update_count;
+				alphaInRange &= timing.alpha >= 0.0 && timing.alpha < 1.0;
+				rendered = previous + (position - previous) * timing.alpha;
+				clock.Advance(static_cast<uint64_t>(work * 1e6));
+				scheduler.EndFrame();
+			}
+
+			// The rendered position trails the last frame start by one step through interpolation
+			const double step = 1.0 / scheduler.GetSettings().update_rate;
+			const double elapsed = (clock.Now() - start) * 1e-9 - work * 1e-3;
+			Check("position follows time", std::fabs(rendered - (elapsed - step)) < 1e-3);
+			Check("one update per step", std::fabs(updates - elapsed / step) <= 1.0);
+			Check("alpha in [0, 1)", alphaInRange);
+			Check("nothing dropped", scheduler.GetStats().dropped_ms == 0.0);
+		}
+	}
+
+	// One long hitch: the catch-up is clamped and the rest of the time is dropped
+	void TestCatchUp()
+	{
+		SimulatedClock clock;
+		const FrameSchedulerSettings settings = MakeSettings(FramePacing::None, 0.0);
+		FrameScheduler scheduler(clock, settings);
+
+		uint32_t maxUpdates = 0;
+		uint32_t hitchUpdates = 0;
+		for (int frame = 0; frame < 200; frame++) {
+			const FrameTiming timing = scheduler.BeginFrame();
+			maxUpdates = std::max(maxUpdates, timing.update_count);
+			if (frame == 101) {
+				hitchUpdates = timing.update_count;
+			}
+			clock.Advance(frame == 100 ? 500000000 : 5000000);
+			scheduler.EndFrame();
+		}
+
+		const FrameTimeStats stats = scheduler.GetStats();
+		const double expectedDropMs = 500.0 - settings.max_updates_per_frame * 1000.0 / settings.update_rate;
+		Check("catch-up clamped", hitchUpdates == settings.max_updates_per_frame && maxUpdates <= settings.max_updates_per_frame);
+		Check("rest dropped", std::fabs(stats.dropped_ms - expectedDropMs) < 1000.0 / settings.update_rate);
+		Check("hitch in the stats", std::fabs(stats.max_ms - 500.0) < 1e-6);
+	}
+
+	// Alternating 2 and 3 ms of work under a 60 fps cap; latency is frame start to the end of its 16.7 ms slot
+	void TestPacing()
+	{
+		double latency[3] = {};
+		double sleptMs[3] = {};
+		double avgMs[3] = {};
+		const FramePacing modes[] = {FramePacing::None, FramePacing::Cap, FramePacing::LowLatency};
+		for (int mode = 0; mode < 3; mode++) {
+			SimulatedClock clock;
+			FrameScheduler scheduler(clock, MakeSettings(modes[mode], 60.0));
+			const int frameCount = 600;
+			uint64_t slotEnd = 0;
+			for (int frame = 0; frame < frameCount; frame++) {
+				scheduler.BeginFrame();
+				const uint64_t start = clock.Now();
+				if (frame == 0) {
+					slotEnd = start;
+				}
+				clock.Advance(frame % 2 ? 3000000 : 2000000);
+				slotEnd = std::max(slotEnd + 16666666, clock.Now());
+				latency[mode] += (slotEnd - start) * 1e-6 / frameCount;
+				scheduler.EndFrame();
+			}
+			const FrameTimeStats stats = scheduler.GetStats();
+			sleptMs[mode] = stats.slept_ms;
+			avgMs[mode] = stats.avg_ms;
+		}
+
+		Check("none does not sleep", sleptMs[0] == 0.0 && avgMs[0] < 3.0);
+		Check("cap holds 60 fps", std::fabs(avgMs[1] - 1000.0 / 60.0) < 0.05);
+		Check("low latency holds 60 fps", std::fabs(avgMs[2] - 1000.0 / 60.0) < 0.05);
+		// Starting late leaves less time between sampling input and the frame's deadline
+		Check("low latency starts frames later", latency[2] < latency[1] - 5.0);
+	}
+}
+
+REGISTER_TEST("frame_scheduler_rate_independence", TestRateIndependence);
+REGISTER_TEST("frame_scheduler_catch_up", TestCatchUp);
+REGISTER_TEST("frame_scheduler_pacing", TestPacing);
@@ -0,0 +1,220 @@
+#include "test.h"
+#include "gpu_heap_allocator.h"
+
+#include <algorithm>
+#include <new>
+#include <random>
+#include <string>
+
+namespace
+{
+	// Heaps are plain numbers; nothing is ever placed in them
+	class FakeGpuHeapSource : public GpuHeapSource
+	{
+	public:
+		FakeGpuHeapSource() : next_heap(1), live_heaps(0), live_bytes(0), fail(false) {};
+
+		bool CreateHeap(uint64_t size, uint64_t alignment, GpuHeap &heap) override
+		{
+			if (fail || size % alignment != 0) {
+				return false;
+			}
+			heap.size = size;
+			heap.heap = reinterpret_cast<void *>(next_heap++);
+			live_heaps++;
+			live_bytes += size;
+			return true;
+		}
+
+		void DestroyHeap(GpuHeap &heap) override
+		{
+			live_heaps--;
+			live_bytes -= heap.size;
+			heap = {};
+		}
+
+		uintptr_t next_heap;
+		int live_heaps;
+		uint64_t live_bytes;
+		bool fail;
+	};
+
+	bool CheckValid(const GpuHeapAllocator &allocator)
+	{
+		std::string err;
+		const bool valid = allocator.Validate(err);
+		return Check(valid ? "valid" : err.c_str(), valid);
+	}
+
+	// Live allocations of one heap never overlap and stay inside it
+	bool CheckPlacement(const GpuHeapAllocator &allocator, std::vector<GpuAllocation> allocations)
+	{
+		std::sort(allocations.begin(), allocations.end(), [](const GpuAllocation &a, const GpuAllocation &b) {
+			return a.heap != b.heap ? a.heap < b.heap : a.offset < b.offset;
+		});
+		bool ok = true;
+		for (size_t i = 0; i < allocations.size(); i++) {
+			const GpuAllocation &a = allocations[i];
+			ok &= a.offset + a.size <= allocator.GetHeap(a.heap).size && allocator.GetHeap(a.heap).heap != nullptr;
+			if (i > 0 && allocations[i - 1].heap == a.heap) {
+				ok &= allocations[i - 1].offset + allocations[i - 1].size <= a.offset;
+			}
+		}
+		return Check("placement", ok);
+	}
+
+	void TestAllocator()
+	{
+		const uint64_t heapSize = 16 * 1024 * 1024;
+		FakeGpuHeapSource source;
+		{
+			GpuHeapAllocator allocator(source, heapSize);
+			const GpuAllocation small = allocator.Allocate(256, small_placement_alignment);
+			const GpuAllocation buffer = allocator.Allocate(100000);
+			const GpuAllocation msaa = allocator.Allocate(5 * 1024 * 1024, msaa_placement_alignment);
+			Check("small alignment", small.offset % small_placement_alignment == 0);
+			Check("buffer alignment", buffer.offset % default_placement_alignment == 0);
+			Check("msaa alignment", msaa.offset % msaa_placement_alignment == 0);
+			Check("one heap", allocator.GetStats().heap_count == 1 && source.live_heaps == 1);
+			Check("requested", allocator.GetStats().requested == 256 + 100000 + 5 * 1024 * 1024);
+			CheckPlacement(allocator, {small, buffer, msaa});
+			CheckValid(allocator);
+
+			// Larger than a heap: a heap of its own, destroyed with it
+			const GpuAllocation large = allocator.Allocate(40 * 1024 * 1024);
+			Check("dedicated heap", large.heap != small.heap && allocator.GetHeap(large.heap).size >= 40 * 1024 * 1024);
+			allocator.Free(large);
+			Check("dedicated heap released", allocator.GetStats().heap_count == 1 && source.live_heaps == 1);
+
+			// Freeing everything merges the heap back into one block
+			allocator.Free(buffer);
+			allocator.Free(small);
+			allocator.Free(msaa);
+			const GpuHeapStats heapStats = allocator.GetHeapStats(small.heap);
+			Check("merged", heapStats.used == 0 && heapStats.free_block_count == 1 && heapStats.largest_free == heapSize);
+			Check("last heap kept", source.live_heaps == 1);
+			CheckValid(allocator);
+
+			bool threw = false;
+			try {
+				allocator.Allocate(4096, 8 * 1024 * 1024);
+			} catch (const std::bad_alloc &) {
+				threw = true;
+			}
+			Check("alignment above the heap's", threw);
+			threw = false;
+			source.fail = true;
+			try {
+				allocator.Allocate(2 * heapSize);
+			} catch (const std::bad_alloc &) {
+				threw = true;
+			}
+			source.fail = false;
+			Check("source failure", threw);
+			CheckValid(allocator);
+		}
+		Check("heaps released", source.live_heaps == 0);
+	}
+
+	// Sizes of buffers and textures: mostly small, a tail up to 8 MiB
+	uint64_t RandomSize(std::mt19937 &random)
+	{
+		const uint32_t bucket = random() % 100;
+		if (bucket < 60) {
+			return 1 + random() % (256 * 1024);
+		}
+		if (bucket < 95) {
+			return 1 + random() % (2 * 1024 * 1024);
+		}
+		return 1 + random() % (8 * 1024 * 1024);
+	}
+
+	uint64_t RandomAlignment(std::mt19937 &random)
+	{
+		const uint32_t kind = random() % 20;
+		return kind == 0 ? msaa_placement_alignment : kind < 5 ? small_placement_alignment : default_placement_alignment;
+	}
+
+	struct Live
+	{
+		GpuAllocation allocation;
+		uint64_t alignment;
+		// Stands for the contents, which moves must carry along
+		uint32_t tag;
+	};
+
+	// Random allocations, frees and defragmentation passes, with every invariant checked as it goes
+	void TestFuzz()
+	{
+		bool ok = true;
+		const size_t operations = 200000;
+		FakeGpuHeapSource source;
+		GpuHeapAllocator allocator(source, 32 * 1024 * 1024);
+		std::mt19937 random(17);
+		std::vector<Live> live;
+		// Sources of moves, freed a few steps later as if after a fence
+		std::vector<GpuAllocation> retiring;
+		std::vector<GpuAllocationMove> moves;
+		uint32_t nextTag = 0;
+		size_t moveCount = 0;
+
+		for (size_t i = 0; i < operations && ok; i++) {
+			const uint32_t op = random() % 100;
+			if (op < 52 || live.empty()) {
+				const uint64_t alignment = RandomAlignment(random);
+				Live l = {allocator.Allocate(RandomSize(random), alignment, reinterpret_cast<void *>(uintptr_t(nextTag) + 1)), alignment, nextTag};
+				nextTag++;
+				ok &= Check("fuzz alignment", l.allocation.offset % alignment == 0);
+				live.push_back(l);
+			} else if (op < 99) {
+				const size_t victim = random() % live.size();
+				allocator.Free(live[victim].allocation);
+				live[victim] = live.back();
+				live.pop_back();
+			} else {
+				for (const GpuAllocation &allocation : retiring) {
+					allocator.Free(allocation);
+				}
+				retiring.clear();
+				moves.clear();
+				allocator.Defragment(64 * 1024 * 1024, moves);
+				for (const GpuAllocationMove &move : moves) {
+					const uint32_t tag = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(move.user) - 1);
+					auto found = std::find_if(live.begin(), live.end(), [&](const Live &l) { return l.tag == tag; });
+					ok &= Check("move of a live allocation", found != live.end() && found->allocation.block == move.source.block);
+					if (found == live.end()) {
+						break;
+					}
+					ok &= Check("move keeps size and alignment", move.destination.size == found->allocation.size &&
+						move.destination.offset % found->alignment == 0 && move.destination.heap != move.source.heap);
+					found->allocation = move.destination;
+					retiring.push_back(move.source);
+				}
+				moveCount += moves.size();
+			}
+
+			if (i % 997 == 0) {
+				ok &= CheckValid(allocator);
+				std::vector<GpuAllocation> placed;
+				for (const Live &l : live) {
+					placed.push_back(l.allocation);
+				}
+				placed.insert(placed.end(), retiring.begin(), retiring.end());
+				ok &= CheckPlacement(allocator, placed);
+			}
+		}
+
+		for (const GpuAllocation &allocation : retiring) {
+			allocator.Free(allocation);
+		}
+		for (const Live &l : live) {
+			allocator.Free(l.allocation);
+		}
+		CheckValid(allocator);
+		Check("defragmented", moveCount > 0);
+		Check("empty after fuzzing", allocator.GetStats().used == 0 && allocator.GetStats().requested == 0 && source.live_heaps == 1);
+	}
+}
+
+REGISTER_TEST("gpu_heap_allocator_placement", TestAllocator);
+REGISTER_TEST("gpu_heap_allocator_fuzz", TestFuzz);
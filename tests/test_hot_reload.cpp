@@ -0,0 +1,247 @@
+#include "test.h"
+#include "hot_reload.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+
+namespace
+{
+	const uint64_t ms = 1000000;
+
+	// In-memory files; every write bumps the stamp like an editor save would
+	class FakeFileSystem : public FileSystem
+	{
+	public:
+		FakeFileSystem() : write_count(0) {};
+
+		bool GetStamp(const std::string &path, FileStamp &stamp) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = files.find(path);
+			if (found == files.end()) {
+				return false;
+			}
+			stamp = found->second.stamp;
+			return true;
+		}
+
+		bool ReadFile(const std::string &path, std::string &content) override
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto found = files.find(path);
+			if (found == files.end()) {
+				return false;
+			}
+			content = found->second.content;
+			return true;
+		}
+
+		void Write(const std::string &path, const std::string &content)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			files[path] = {content, {content.size(), static_cast<int64_t>(++write_count)}};
+		}
+
+		void Delete(const std::string &path)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			files.erase(path);
+		}
+
+	private:
+		struct File
+		{
+			std::string content;
+			FileStamp stamp;
+		};
+
+		std::mutex mutex;
+		std::map<std::string, File> files;
+		int64_t write_count;
+	};
+
+	class SimulatedClock : public SchedulerClock
+	{
+	public:
+		SimulatedClock() : now(0) {};
+
+		uint64_t Now() override { return now; }
+		void SleepUntil(uint64_t time) override { now = std::max(now, time); }
+		void Advance(uint64_t duration) { now += duration; }
+
+	private:
+		uint64_t now;
+	};
+
+	// Stands in for a GPU object; counts live instances so retirement can be checked
+	struct GpuObject
+	{
+		explicit GpuObject(const std::string &content, int &live) : content(content), live(live) { live++; }
+		~GpuObject() { live--; }
+
+		std::string content;
+		int &live;
+	};
+
+	void TestWatcher()
+	{
+		FakeFileSystem files;
+		files.Write("a.hlsl", "v1");
+		files.Write("b.obj", "v1");
+		FileWatcher watcher(files, 200 * ms);
+		watcher.Watch("a.hlsl");
+		watcher.Watch("b.obj");
+		watcher.Watch("missing.mtl");
+
+		std::vector<uint32_t> changed;
+		uint64_t now = 0;
+		auto poll = [&](uint64_t advance) {
+			now += advance;
+			changed.clear();
+			watcher.Poll(now, changed);
+			return changed.size();
+		};
+
+		Check("unchanged", poll(100 * ms) == 0);
+		// Saved in three steps 50 ms apart: one change, reported 200 ms after the last write
+		files.Write("a.hlsl", "v2 partial");
+		Check("first write settling", poll(50 * ms) == 0);
+		files.Write("a.hlsl", "v2 more");
+		Check("second write settling", poll(50 * ms) == 0);
+		files.Write("a.hlsl", "v2 done");
+		Check("last write settling", poll(50 * ms) == 0);
+		Check("not settled yet", poll(100 * ms) == 0);
+		Check("settled once", poll(150 * ms) == 1 && changed[0] == 0);
+		Check("reported once", poll(300 * ms) == 0);
+
+		// Deleted and written back; a file appearing counts as a change
+		files.Delete("b.obj");
+		Check("deleted", poll(300 * ms) == 0);
+		Check("still deleted", poll(300 * ms) == 0);
+		files.Write("b.obj", "v3");
+		files.Write("missing.mtl", "new");
+		Check("reappeared settling", poll(100 * ms) == 0);
+		Check("reappeared and created", poll(300 * ms) == 2);
+	}
+
+	// The fence stands in for the GPU: objects go once the fence value they were retired with completed
+	void TestRetireQueue()
+	{
+		int live = 0;
+		int released = 0;
+		RetireQueue queue;
+		for (int frame = 1; frame <= 10; frame++) {
+			std::shared_ptr<GpuObject> object = std::make_shared<GpuObject>("frame", live);
+			queue.Retire(frame, [object, &released]() { released++; });
+		}
+
+		Check("kept while in flight", queue.Collect(0) == 0 && live == 10);
+		Check("released up to the fence", queue.Collect(4) == 4 && live == 6 && released == 4);
+		Check("fence unchanged", queue.Collect(4) == 0 && queue.GetPendingCount() == 6);
+		queue.ReleaseAll();
+		Check("released at shutdown", live == 0 && released == 10 && queue.GetPendingCount() == 0);
+	}
+
+	// Both sources of one asset change together and build it once
+	void TestCoalescing()
+	{
+		FakeFileSystem files;
+		files.Write("model.obj", "v0");
+		files.Write("model.mtl", "v0");
+		SimulatedClock clock;
+		int builds = 0;
+
+		HotReloader reloader(files, clock, 100 * ms);
+		reloader.AddReload("model", {"model.obj", "model.mtl"}, [&](HotReloader::ApplyFunction &apply, std::string &) {
+			builds++;
+			apply = []() {};
+			return true;
+		});
+
+		files.Write("model.obj", "v1");
+		files.Write("model.mtl", "v1");
+		for (int i = 0; i < 5; i++) {
+			reloader.PollOnce();
+			clock.Advance(50 * ms);
+		}
+		Check("one build", builds == 1);
+		Check("one apply", reloader.ApplyFinished() == 1 && reloader.GetStats().applied == 1);
+	}
+
+	// The render loop with the worker driven on this thread and a fence running two frames behind: a rebuilt
+	// object is swapped in at a frame boundary, the old one lives until the fence passes that frame, and a
+	// failed build keeps the current object
+	void TestDeferredSwap()
+	{
+		FakeFileSystem files;
+		files.Write("shaders.hlsl", "v0");
+		SimulatedClock clock;
+		int live = 0;
+		std::shared_ptr<GpuObject> current = std::make_shared<GpuObject>("v0", live);
+		RetireQueue retired;
+		uint64_t frameFence = 0;
+		uint64_t completedFence = 0;
+
+		HotReloader reloader(files, clock, 20 * ms);
+		reloader.AddReload("shaders.hlsl", {"shaders.hlsl"}, [&](HotReloader::ApplyFunction &apply, std::string &err) {
+			std::string content;
+			files.ReadFile("shaders.hlsl", content);
+			if (content.find("error") != std::string::npos) {
+				err = "syntax error";
+				return false;
+			}
+			std::shared_ptr<GpuObject> built = std::make_shared<GpuObject>(content, live);
+			apply = [&, built]() {
+				retired.Retire(frameFence, [old = current]() {});
+				current = built;
+			};
+			return true;
+		});
+
+		// Runs frames of 10 ms; returns the frame at which the current object became content, or -1
+		auto runFrames = [&](int count, const std::string &content) {
+			int swappedAt = -1;
+			for (int frame = 0; frame < count; frame++) {
+				reloader.PollOnce();
+				reloader.ApplyFinished();
+				retired.Collect(completedFence);
+				if (swappedAt < 0 && current->content == content) {
+					swappedAt = frame;
+				}
+				frameFence++;
+				completedFence = frameFence > 2 ? frameFence - 2 : 0;
+				clock.Advance(10 * ms);
+			}
+			return swappedAt;
+		};
+
+		runFrames(3, "v0");
+		files.Write("shaders.hlsl", "v1");
+		const int swapped = runFrames(10, "v1");
+		Check("swapped after settling", swapped >= 2 && swapped <= 4);
+		Check("old object kept until the fence passes", live == 1 && retired.GetPendingCount() == 0);
+
+		files.Write("shaders.hlsl", "error");
+		runFrames(10, "error");
+		Check("failed build keeps the current object", current->content == "v1" && live == 1);
+		const HotReloadStats failedStats = reloader.GetStats();
+		Check("failure reported", failedStats.failures == 1 && failedStats.last_error == "shaders.hlsl: syntax error");
+
+		// Retired in the frame it was replaced, released two frames later
+		files.Write("shaders.hlsl", "v2");
+		int pendingFrames = 0;
+		for (int frame = 0; frame < 10; frame++) {
+			runFrames(1, "v2");
+			pendingFrames += retired.GetPendingCount() > 0;
+		}
+		Check("swapped again", current->content == "v2" && live == 1);
+		Check("released after two frames", pendingFrames == 2);
+		Check("builds", reloader.GetStats().builds == 3 && reloader.GetStats().applied == 2);
+	}
+}
+
+REGISTER_TEST("hot_reload_watcher", TestWatcher);
+REGISTER_TEST("hot_reload_retire_queue", TestRetireQueue);
+REGISTER_TEST("hot_reload_coalescing", TestCoalescing);
+REGISTER_TEST("hot_reload_deferred_swap", TestDeferredSwap);
@@ -0,0 +1,145 @@
+#include "test.h"
+#include "job_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace
+{
+	// One owner pushing and popping while thieves steal: every job must come out exactly once
+	void TestDeque()
+	{
+		const int jobCount = 200000;
+		const unsigned thiefCount = 3;
+		JobDeque deque;
+		std::unique_ptr<std::atomic<int>[]> seen(new std::atomic<int>[jobCount + 1]);
+		for (int i = 0; i <= jobCount; i++) {
+			seen[i] = 0;
+		}
+
+		// Jobs are never dereferenced, so their ids stand in for pointers
+		auto toJob = [](int id) { return reinterpret_cast<Job *>(static_cast<uintptr_t>(id) * 16); };
+		auto toId = [](Job *job) { return static_cast<int>(reinterpret_cast<uintptr_t>(job) / 16); };
+
+		std::atomic<bool> done(false);
+		std::vector<std::thread> thieves;
+		for (unsigned t = 0; t < thiefCount; t++) {
+			thieves.emplace_back([&]() {
+				while (!done) {
+					if (Job *job = deque.Steal()) {
+						seen[toId(job)]++;
+					}
+				}
+			});
+		}
+
+		int next = 1;
+		while (next <= jobCount) {
+			for (int i = 0; i < 8 && next <= jobCount; i++) {
+				if (deque.Push(toJob(next))) {
+					next++;
+				}
+			}
+			for (int i = 0; i < 3; i++) {
+				if (Job *job = deque.Pop()) {
+					seen[toId(job)]++;
+				}
+			}
+		}
+		while (Job *job = deque.Pop()) {
+			seen[toId(job)]++;
+		}
+		done = true;
+		for (std::thread &thief : thieves) {
+			thief.join();
+		}
+
+		int wrong = 0;
+		for (int i = 1; i <= jobCount; i++) {
+			wrong += seen[i] != 1;
+		}
+		Check("every job exactly once", wrong == 0);
+	}
+
+	void TestParallelFor()
+	{
+		JobSystem jobs(std::max(4u, std::thread::hardware_concurrency()));
+		const size_t counts[] = {0, 1, 7, 1000, 100003};
+		const size_t batches[] = {1, 16, 4096};
+		for (size_t count : counts) {
+			for (size_t batch : batches) {
+				std::vector<std::atomic<int>> hits(count);
+				for (std::atomic<int> &hit : hits) {
+					hit = 0;
+				}
+				jobs.ParallelFor(count, batch, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						hits[i]++;
+					}
+				});
+				Check("every index once", std::all_of(hits.begin(), hits.end(), [](const std::atomic<int> &hit) { return hit == 1; }));
+			}
+		}
+
+		// Jobs queued from a thread outside the pool
+		std::atomic<int> outside(0);
+		std::thread external([&]() {
+			JobCounter counter;
+			for (int i = 0; i < 100; i++) {
+				jobs.Run([&]() { outside++; }, &counter);
+			}
+			jobs.Wait(counter);
+		});
+		external.join();
+		Check("jobs from outside the pool", outside == 100);
+	}
+
+	// Every task must start after all its dependencies finished; tasks nest ParallelFor
+	void TestTaskGraph()
+	{
+		JobSystem jobs(std::max(4u, std::thread::hardware_concurrency()));
+		std::atomic<int> clock(0);
+		std::vector<int> started(8, -1);
+		std::vector<int> finished(8, -1);
+		std::atomic<int> work(0);
+
+		TaskGraph graph;
+		auto task = [&](int index) {
+			return [&, index]() {
+				started[index] = clock++;
+				jobs.ParallelFor(10000, 100, [&](size_t begin, size_t end) { work += static_cast<int>(end - begin); });
+				finished[index] = clock++;
+			};
+		};
+		const TaskGraph::TaskId input = graph.AddTask("input", task(0));
+		const TaskGraph::TaskId update = graph.AddTask("update", task(1), {input});
+		const TaskGraph::TaskId cull = graph.AddTask("cull", task(2), {update});
+		const TaskGraph::TaskId pick = graph.AddTask("pick", task(3), {update});
+		const TaskGraph::TaskId sort = graph.AddTask("sort", task(4), {cull});
+		const TaskGraph::TaskId record = graph.AddTask("record", task(5), {sort, pick});
+		graph.AddTask("submit", task(6), {record});
+		graph.AddTask("audio", task(7));
+
+		const int dependencies[][2] = {{1, 0}, {2, 1}, {3, 1}, {4, 2}, {5, 4}, {5, 3}, {6, 5}};
+		int misordered = 0;
+		int incomplete = 0;
+		for (int frame = 0; frame < 100; frame++) {
+			std::fill(started.begin(), started.end(), -1);
+			std::fill(finished.begin(), finished.end(), -1);
+			work = 0;
+			graph.Run(jobs);
+			for (const int (&dependency)[2] : dependencies) {
+				misordered += started[dependency[0]] < finished[dependency[1]] ? 1 : 0;
+			}
+			incomplete += work != 80000;
+		}
+		Check("dependencies finish first", misordered == 0);
+		Check("nested work done", incomplete == 0);
+	}
+}
+
+REGISTER_TEST("job_system_deque", TestDeque);
+REGISTER_TEST("job_system_parallel_for", TestParallelFor);
+REGISTER_TEST("job_system_task_graph", TestTaskGraph);
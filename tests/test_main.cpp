@@ -0,0 +1,62 @@
+#include "test.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace
+{
+	size_t failed_checks = 0;
+}
+
+std::vector<Test> &GetTests()
+{
+	static std::vector<Test> tests;
+	return tests;
+}
+
+bool Check(const char *name, bool condition)
+{
+	if (!condition) {
+		std::cout << "  " << name << ": FAILED" << std::endl;
+		failed_checks++;
+	}
+	return condition;
+}
+
+int main(int argc, char **argv)
+{
+	std::string filter;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--list") == 0) {
+			for (const Test &test : GetTests()) {
+				std::cout << test.name << std::endl;
+			}
+			return 0;
+		} else if (argv[i][0] == '-') {
+			std::cout << "Usage: " << argv[0] << " [name filter] [--list]" << std::endl;
+			return 1;
+		} else {
+			filter = argv[i];
+		}
+	}
+
+	size_t run = 0;
+	std::vector<const char *> failed;
+	for (const Test &test : GetTests()) {
+		if (!filter.empty() && strstr(test.name, filter.c_str()) == nullptr) {
+			continue;
+		}
+		const size_t failedBefore = failed_checks;
+		test.function();
+		run++;
+		const bool ok = failed_checks == failedBefore;
+		std::cout << (ok ? "ok      " : "FAILED  ") << test.name << std::endl;
+		if (!ok) {
+			failed.push_back(test.name);
+		}
+	}
+
+	std::cout << run - failed.size() << " of " << run << " tests passed" << std::endl;
+	return failed.empty() ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+#include "test.h"
+#include "mesh_builder.h"
+
+#include <algorithm>
+#include <array>
+#include <random>
+
+namespace
+{
+	const float white[3] = {1.0f, 1.0f, 1.0f};
+	const float red[3] = {1.0f, 0.0f, 0.0f};
+
+	void AddQuad(MeshBuilder &builder, float x0, float z0, float x1, float z1, int material)
+	{
+		const float corners[12] = {x0, 0.0f, z0, x1, 0.0f, z0, x1, 0.0f, z1, x0, 0.0f, z1};
+		builder.AddPolygon(corners, 4, material);
+	}
+
+	// Triangles as sorted corner positions, so meshes can be compared whatever their vertex and triangle order
+	std::vector<std::array<float, 9>> GetTriangles(const Mesh &mesh)
+	{
+		std::vector<std::array<float, 9>> triangles;
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+			std::array<std::array<float, 3>, 3> corners;
+			for (int k = 0; k < 3; k++) {
+				const float *position = mesh.vertices[mesh.indices[i + k]].position;
+				corners[k] = {position[0], position[1], position[2]};
+			}
+			// Rotate the lowest corner first; the winding stays the same
+			const int first = static_cast<int>(std::min_element(corners.begin(), corners.end()) - corners.begin());
+			std::array<float, 9> triangle;
+			for (int k = 0; k < 3; k++) {
+				std::copy(corners[(first + k) % 3].begin(), corners[(first + k) % 3].end(), triangle.begin() + 3 * k);
+			}
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void TestWeld()
+	{
+		// Two triangles of a quad share two corners
+		{
+			MeshBuilder builder;
+			const int material = builder.AddMaterial("white", white);
+			AddQuad(builder, 0.0f, 0.0f, 1.0f, 1.0f, material);
+			const Mesh mesh = builder.Build(false);
+			Check("quad vertices", mesh.vertices.size() == 4 && builder.GetStats().flat_vertex_count == 6);
+			Check("quad indices", mesh.indices.size() == 6 && builder.GetStats().index_count == 6);
+		}
+		// A 4x4 grid: every inner corner is shared by up to six triangles, -0 and 0 weld together
+		{
+			MeshBuilder builder;
+			const int material = builder.AddMaterial("white", white);
+			builder.BeginShape("grid");
+			for (int z = 0; z < 4; z++) {
+				for (int x = 0; x < 4; x++) {
+					AddQuad(builder, x == 0 && z % 2 == 0 ? -0.0f : static_cast<float>(x), static_cast<float>(z), x + 1.0f, z + 1.0f, material);
+				}
+			}
+			const Mesh mesh = builder.Build();
+			Check("grid vertices", mesh.vertices.size() == 25 && builder.GetStats().welded_vertex_count == 25);
+			Check("grid shape", mesh.shapes.size() == 1 && mesh.shapes[0].index_offset == 0 && mesh.shapes[0].index_count == 96);
+			Check("grid bounds", mesh.shapes[0].bounds_min[0] == 0.0f && mesh.shapes[0].bounds_max[0] == 4.0f &&
+				mesh.shapes[0].bounds_max[2] == 4.0f);
+		}
+		// Corners at the same position with different materials keep their own colors
+		{
+			MeshBuilder builder;
+			const int whiteMaterial = builder.AddMaterial("white", white);
+			const int redMaterial = builder.AddMaterial("red", red);
+			builder.BeginShape("two materials");
+			AddQuad(builder, 0.0f, 0.0f, 1.0f, 1.0f, whiteMaterial);
+			AddQuad(builder, 1.0f, 0.0f, 2.0f, 1.0f, redMaterial);
+			AddQuad(builder, 2.0f, 0.0f, 3.0f, 1.0f, whiteMaterial);
+			const Mesh mesh = builder.Build(false);
+			// The white quads are welded within their material only: 4 + 4 white, 4 red
+			Check("material vertices", mesh.vertices.size() == 12);
+			Check("shape per material", mesh.shapes.size() == 2 && mesh.shapes[0].material == whiteMaterial &&
+				mesh.shapes[0].index_count == 12 && mesh.shapes[1].material == redMaterial && mesh.shapes[1].index_count == 6);
+			bool colors = true;
+			for (const MeshShape &shape : mesh.shapes) {
+				for (uint32_t i = shape.index_offset; i < shape.index_offset + shape.index_count; i++) {
+					colors &= mesh.vertices[mesh.indices[i]].color[1] == (shape.material == redMaterial ? 0.0f : 1.0f);
+				}
+			}
+			Check("material colors", colors);
+		}
+	}
+
+	void TestVertexCacheOrder()
+	{
+		Check("one triangle", ComputeACMR(std::vector<uint32_t>({0, 1, 2}).data(), 3, MeshBuilder::cache_size) == 3.0);
+		Check("repeated triangle", ComputeACMR(std::vector<uint32_t>({0, 1, 2, 2, 1, 0}).data(), 6, MeshBuilder::cache_size) == 1.5);
+
+		// A 64x64 grid with its quads in random order: welding alone leaves most corners out of the cache
+		const int side = 64;
+		std::vector<std::pair<int, int>> quads;
+		for (int z = 0; z < side; z++) {
+			for (int x = 0; x < side; x++) {
+				quads.push_back({x, z});
+			}
+		}
+		std::mt19937 random(5);
+		std::shuffle(quads.begin(), quads.end(), random);
+
+		MeshBuilder unoptimized;
+		MeshBuilder optimized;
+		for (MeshBuilder *builder : {&unoptimized, &optimized}) {
+			const int material = builder->AddMaterial("white", white);
+			for (const std::pair<int, int> &quad : quads) {
+				AddQuad(*builder, static_cast<float>(quad.first), static_cast<float>(quad.second), quad.first + 1.0f, quad.second + 1.0f, material);
+			}
+		}
+		const Mesh before = unoptimized.Build(false);
+		const Mesh after = optimized.Build(true);
+		const MeshStats &stats = optimized.GetStats();
+
+		Check("flat ACMR", stats.flat_acmr == 3.0);
+		Check("welded ACMR", stats.welded_acmr == ComputeACMR(before.indices.data(), before.indices.size(), MeshBuilder::cache_size));
+		// A regular grid reaches about 0.7 with a 16-entry cache; shuffled it stays above 1.5
+		Check("ACMR drops after reordering", stats.welded_acmr > 1.5 && stats.optimized_acmr < 0.8 &&
+			stats.optimized_acmr == ComputeACMR(after.indices.data(), after.indices.size(), MeshBuilder::cache_size));
+		Check("same triangles", GetTriangles(before) == GetTriangles(after));
+
+		// Vertices come in first-use order
+		uint32_t next = 0;
+		bool fetchOrder = true;
+		for (uint32_t index : after.indices) {
+			fetchOrder &= index <= next;
+			next = std::max(next, index + 1);
+		}
+		Check("vertex fetch order", fetchOrder && next == after.vertices.size());
+	}
+
+	void TestIndexSize()
+	{
+		// 21845 separate triangles are exactly 65535 vertices, the most 16-bit indices can address
+		MeshBuilder builder;
+		const int material = builder.AddMaterial("white", white);
+		for (int t = 0; t < 21845; t++) {
+			const float x = static_cast<float>(t);
+			const float corners[9] = {x, 0.0f, 0.0f, x, 1.0f, 0.0f, x + 0.5f, 0.0f, 1.0f};
+			builder.AddPolygon(corners, 3, material);
+		}
+		const Mesh small = builder.Build(false);
+		std::vector<uint16_t> packed16(small.indices.size() + 1, 0xABCD);
+		small.PackIndices(packed16.data());
+		Check("65535 vertices use 16-bit indices", small.vertices.size() == 65535 && small.GetIndexSize() == 2);
+		Check("16-bit packing", std::equal(small.indices.begin(), small.indices.end(), packed16.begin()) && packed16.back() == 0xABCD);
+
+		// One more vertex needs 32 bits
+		const float corners[9] = {0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f};
+		builder.AddPolygon(corners, 3, material);
+		const Mesh large = builder.Build(false);
+		std::vector<uint32_t> packed32(large.indices.size());
+		large.PackIndices(packed32.data());
+		Check("65536 vertices use 32-bit indices", large.vertices.size() == 65536 && large.GetIndexSize() == 4);
+		Check("32-bit packing", packed32 == large.indices && *std::max_element(packed32.begin(), packed32.end()) == 65535);
+	}
+}
+
+REGISTER_TEST("mesh_builder_weld", TestWeld);
+REGISTER_TEST("mesh_builder_vertex_cache", TestVertexCacheOrder);
+REGISTER_TEST("mesh_builder_index_size", TestIndexSize);
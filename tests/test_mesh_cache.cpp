@@ -0,0 +1,145 @@
+#include "test.h"
+#include "mesh_cache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const float white[3] = {1.0f, 1.0f, 1.0f};
+
+	std::shared_ptr<const Mesh> BuildQuads(int quad_count)
+	{
+		MeshBuilder builder;
+		const int material = builder.AddMaterial("white", white);
+		for (int i = 0; i < quad_count; i++) {
+			const float x = static_cast<float>(i);
+			const float corners[12] = {x, 0.0f, 0.0f, x + 1.0f, 0.0f, 0.0f, x + 1.0f, 0.0f, 1.0f, x, 0.0f, 1.0f};
+			builder.AddPolygon(corners, 4, material);
+		}
+		return std::make_shared<Mesh>(builder.Build());
+	}
+
+	struct CacheFiles
+	{
+		CacheFiles()
+		{
+			dir = (std::filesystem::temp_directory_path() / "mesh_cache_test").string() + "/";
+			std::filesystem::create_directories(dir);
+			std::ofstream(dir + "model.obj") << "v 0 0 0\n";
+			cache = dir + "model.meshcache";
+		}
+
+		~CacheFiles()
+		{
+			std::error_code error;
+			std::filesystem::remove_all(dir, error);
+		}
+
+		std::string dir;
+		std::string cache;
+	};
+
+	uint32_t ReadVertexCount(const std::string &cache, const std::string &dir)
+	{
+		MeshCacheFile file;
+		std::string err;
+		if (!file.Open(cache, err) || !file.IsFresh(dir, err)) {
+			return 0;
+		}
+		return file.GetView().vertex_count;
+	}
+
+	void TestCookReplaces()
+	{
+		CacheFiles files;
+		std::string err;
+		Check("first cook", CookMeshCache(files.cache, *BuildQuads(1), files.dir, {"model.obj"}, err));
+		Check("first cache", ReadVertexCount(files.cache, files.dir) == 4);
+		// The existing cache is replaced in one step and no temporary file stays behind
+		Check("second cook", CookMeshCache(files.cache, *BuildQuads(2), files.dir, {"model.obj"}, err));
+		Check("replaced", ReadVertexCount(files.cache, files.dir) == 6);
+		Check("temporary file gone", !std::filesystem::exists(files.cache + ".tmp"));
+		Check("missing source", !CookMeshCache(files.cache, *BuildQuads(1), files.dir, {"missing.mtl"}, err) && !err.empty());
+	}
+
+	// Rewrites one field of a cooked cache; the magic, version and section extents stay valid
+	template <typename Patch>
+	void PatchCache(const std::string &cache, Patch patch)
+	{
+		std::ifstream in(cache, std::ios::binary);
+		std::vector<char> blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+		const MeshCacheHeader &header = *reinterpret_cast<const MeshCacheHeader *>(blob.data());
+		patch(header, reinterpret_cast<uint8_t *>(blob.data()));
+		std::ofstream(cache, std::ios::binary | std::ios::trunc).write(blob.data(), blob.size());
+	}
+
+	void TestCorruptedCache()
+	{
+		CacheFiles files;
+		std::string err;
+		MeshCacheFile file;
+		auto cook = [&]() { return CookMeshCache(files.cache, *BuildQuads(4), files.dir, {"model.obj"}, err); };
+
+		Check("cook", cook() && file.Open(files.cache, err));
+		file.Close();
+
+		PatchCache(files.cache, [](const MeshCacheHeader &header, uint8_t *blob) {
+			reinterpret_cast<MeshShape *>(blob + header.shape_offset)->index_count = header.index_count + 3;
+		});
+		Check("shape past the indices", !file.Open(files.cache, err) && !err.empty());
+
+		Check("recook", cook());
+		PatchCache(files.cache, [](const MeshCacheHeader &header, uint8_t *blob) {
+			reinterpret_cast<MeshShape *>(blob + header.shape_offset)->index_offset = UINT32_MAX;
+		});
+		Check("shape offset overflow", !file.Open(files.cache, err));
+
+		Check("recook", cook());
+		PatchCache(files.cache, [](const MeshCacheHeader &header, uint8_t *blob) {
+			uint8_t *last = blob + header.index_offset + (header.index_count - 1) * header.index_size;
+			if (header.index_size == 2) {
+				*reinterpret_cast<uint16_t *>(last) = static_cast<uint16_t>(header.vertex_count);
+			} else {
+				*reinterpret_cast<uint32_t *>(last) = header.vertex_count;
+			}
+		});
+		Check("index past the vertices", !file.Open(files.cache, err) && !err.empty());
+
+		Check("recook", cook());
+		PatchCache(files.cache, [](const MeshCacheHeader &header, uint8_t *blob) {
+			reinterpret_cast<MeshShape *>(blob + header.shape_offset)->material = static_cast<int32_t>(header.material_count);
+		});
+		Check("unknown material", !file.Open(files.cache, err));
+	}
+
+	void TestCooker()
+	{
+		CacheFiles files;
+		std::vector<std::string> errors;
+		{
+			MeshCacheCooker cooker([&errors](const std::string &err) { errors.push_back(err); });
+			for (int quads = 1; quads <= 8; quads++) {
+				cooker.Cook(files.cache, BuildQuads(quads), files.dir, {"model.obj"});
+			}
+			cooker.WaitForIdle();
+			// Whatever was superseded on the way, the newest mesh ends up in the cache
+			Check("newest mesh cooked", ReadVertexCount(files.cache, files.dir) == 18 && errors.empty());
+
+			cooker.Cook(files.dir + "other.meshcache", BuildQuads(1), files.dir, {"missing.mtl"});
+			cooker.WaitForIdle();
+			Check("error reported", errors.size() == 1 && errors[0].find("missing.mtl") != std::string::npos);
+
+			// Queued cooks finish when the cooker is destroyed
+			cooker.Cook(files.cache, BuildQuads(3), files.dir, {"model.obj"});
+		}
+		Check("finished on destruction", ReadVertexCount(files.cache, files.dir) == 8);
+	}
+}
+
+REGISTER_TEST("mesh_cache_cook", TestCookReplaces);
+REGISTER_TEST("mesh_cache_corrupted", TestCorruptedCache);
+REGISTER_TEST("mesh_cache_cooker", TestCooker);
@@ -0,0 +1,93 @@
+#include "test.h"
+#include "obj_mesh.h"
+#include "obj_parallel.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	const char *triangle = "v 0 0 0\nv 1 0 0\nv 1 0 1\nvt 0 0\nvn 0 1 0\n";
+
+	struct ObjFile
+	{
+		explicit ObjFile(const std::string &content)
+		{
+			path = (std::filesystem::temp_directory_path() / "obj_parallel_test.obj").string();
+			std::ofstream(path, std::ios::binary) << content;
+		}
+
+		~ObjFile()
+		{
+			std::error_code error;
+			std::filesystem::remove(path, error);
+		}
+
+		std::string path;
+	};
+
+	bool Load(const std::string &content, std::string &err, unsigned thread_count = 1)
+	{
+		ObjFile file(content);
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn;
+		err.clear();
+		return LoadObjParallel(&attrib, &shapes, &materials, &warn, &err, file.path.c_str(), nullptr, thread_count);
+	}
+
+	// A strip of quads long enough to be split into several chunks; every face refers back relatively
+	std::string BuildStrip(int quad_count)
+	{
+		std::ostringstream obj;
+		obj << "v 0 0 0\nv 0 0 1\n";
+		for (int i = 1; i <= quad_count; i++) {
+			obj << "v " << i << " 0 0\nv " << i << " 0 1\nf -4 -3 -1 -2\n";
+		}
+		return obj.str();
+	}
+
+	void TestValidIndices()
+	{
+		std::string err;
+		Check("absolute", Load(std::string(triangle) + "f 1 2 3\n", err));
+		Check("relative", Load(std::string(triangle) + "f -3 -2 -1\n", err));
+		Check("texcoords and normals", Load(std::string(triangle) + "f 1/1/1 2/1/1 3/1/1\nf 1//1 2//1 3//1\n", err));
+		Check("split file", Load(BuildStrip(20000), err, 4));
+	}
+
+	void TestMalformedIndices()
+	{
+		const char *faces[] = {
+			"f 1 2 9\n",
+			"f 0 1 2\n",
+			"f -4 -3 -2\n",
+			"f 1/0 2/1 3/1\n",
+			"f 1/2 2/1 3/1\n",
+			"f 1//2 2//1 3//1\n",
+			"f 1/1/-2 2/1/1 3/1/1\n",
+		};
+		for (const char *face : faces) {
+			std::string err;
+			Check(face, !Load(std::string(triangle) + face, err) && !err.empty());
+		}
+
+		// Out of range in a chunk in the middle of the file
+		std::string strip = BuildStrip(20000);
+		strip.insert(strip.find('\n', strip.size() / 2) + 1, "f 1 2 100000\n");
+		std::string err;
+		Check("split file", !Load(strip, err, 4) && err.find("out of range") != std::string::npos);
+
+		// The mesh loader, and with it the cook tool, fails instead of reading past the positions
+		ObjFile file(std::string(triangle) + "f 1 2 9\n");
+		Mesh mesh;
+		MeshStats stats;
+		std::string warn;
+		Check("mesh load fails", !LoadObjMesh(file.path, mesh, stats, warn, err));
+	}
+}
+
+REGISTER_TEST("obj_parallel_valid_indices", TestValidIndices);
+REGISTER_TEST("obj_parallel_malformed_indices", TestMalformedIndices);
@@ -0,0 +1,110 @@
+#include "test.h"
+#include "parallel_record.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Shapes on a grid of small boxes in front of the camera, materials cycling so pipelines and constants vary
+	void BuildGridScene(size_t shape_count, std::vector<MeshShape> &shapes)
+	{
+		const size_t side = std::max<size_t>(1, static_cast<size_t>(std::sqrt(static_cast<double>(shape_count))));
+		shapes.resize(shape_count);
+		for (size_t i = 0; i < shape_count; i++) {
+			MeshShape &shape = shapes[i];
+			memset(&shape, 0, sizeof(shape));
+			shape.index_offset = static_cast<uint32_t>(i * 36);
+			shape.index_count = 36;
+			shape.material = static_cast<int32_t>(i % 17);
+			const float x = static_cast<float>(i % side) * 1.5f - side * 0.75f;
+			const float z = static_cast<float>(i / side) * 1.5f + 2.0f;
+			const float min[3] = {x - 0.5f, -0.5f, z - 0.5f};
+			for (int axis = 0; axis < 3; axis++) {
+				shape.bounds_min[axis] = min[axis];
+				shape.bounds_max[axis] = min[axis] + 1.0f;
+			}
+		}
+	}
+
+	bool IsSameCommand(const RecordedCommand &a, const RecordedCommand &b)
+	{
+		return a.type == b.type && a.address == b.address && memcmp(a.args, b.args, sizeof(a.args)) == 0;
+	}
+
+	std::vector<RecordedCommand> GetDraws(const std::vector<RecordedCommand> &commands)
+	{
+		std::vector<RecordedCommand> draws;
+		std::copy_if(commands.begin(), commands.end(), std::back_inserter(draws),
+			[](const RecordedCommand &command) { return command.type == CommandType::DrawIndexedInstanced; });
+		return draws;
+	}
+
+	bool IsSameStream(const std::vector<RecordedCommand> &a, const std::vector<RecordedCommand> &b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), IsSameCommand);
+	}
+
+	void TestSplit()
+	{
+		std::vector<DrawChunk> chunks;
+		const size_t counts[] = {0, 1, 255, 256, 257, 1000, 40000};
+		for (size_t count : counts) {
+			SplitDrawChunks(count, 256, 16, chunks);
+			size_t covered = 0;
+			bool contiguous = true;
+			bool minimum = true;
+			for (const DrawChunk &chunk : chunks) {
+				contiguous &= chunk.first_batch == covered && chunk.batch_count != 0;
+				minimum &= chunks.size() == 1 || chunk.batch_count >= 256;
+				covered += chunk.batch_count;
+			}
+			Check("chunks contiguous", contiguous);
+			Check("chunks hold the minimum", minimum);
+			Check("every batch covered", covered == count);
+			Check("at most max chunks", chunks.size() <= 16);
+		}
+	}
+
+	// The submitted stream depends only on the scene, never on the thread count or scheduling, and carries
+	// the draws of serial recording in the same order
+	void TestDeterminism()
+	{
+		std::vector<MeshShape> shapes;
+		BuildGridScene(5000, shapes);
+		ScenePipeline scene;
+		scene.SetShapes(shapes.data(), shapes.size());
+		const float side = std::sqrt(5000.0f) * 1.5f;
+		scene.UpdateCamera({{0.0f, 4.0f, 0.0f}, {0.0f, 0.0f, side * 0.5f}, {0.0f, 1.0f, 0.0f}, 1.5f, 16.0f / 9.0f, 0.1f, side * 2.0f});
+		scene.Cull();
+		scene.SortDraws();
+
+		RecordingCommandSink serialSink;
+		scene.Record(serialSink, 0x1000);
+		const std::vector<RecordedCommand> serialDraws = GetDraws(serialSink.GetCommands());
+		Check("scene has draws", serialDraws.size() > 1000);
+
+		ParallelRecorder recorder(256, 64);
+		RecordingCommandListBackend backend;
+		std::vector<RecordedCommand> reference;
+		for (unsigned threads : {1u, 2u, 3u, 8u}) {
+			JobSystem jobs(threads);
+			for (int frame = 0; frame < 5; frame++) {
+				backend.Clear();
+				recorder.Record(scene, 0x1000, backend, jobs);
+				backend.Submit();
+				if (reference.empty()) {
+					reference = backend.GetSubmitted();
+				}
+				Check("same stream for every thread count", IsSameStream(backend.GetSubmitted(), reference));
+			}
+			Check("several chunks", recorder.GetChunks().size() > 1);
+			Check("draws match serial", IsSameStream(GetDraws(backend.GetSubmitted()), serialDraws));
+		}
+		Check("one submit per frame", backend.GetSubmitCount() == 20);
+	}
+}
+
+REGISTER_TEST("parallel_record_split", TestSplit);
+REGISTER_TEST("parallel_record_determinism", TestDeterminism);
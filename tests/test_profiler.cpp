@@ -0,0 +1,167 @@
+#include "test.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	const uint64_t ms = 1000000;
+
+	size_t CountOccurrences(const std::string &text, const std::string &pattern)
+	{
+		size_t count = 0;
+		for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + pattern.size())) {
+			count++;
+		}
+		return count;
+	}
+
+	// A full ring drops new events and counts them; draining makes room again
+	void TestRingDrops()
+	{
+		Profiler profiler;
+		ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+		for (uint32_t i = 0; i < ProfileThreadBuffer::capacity + 10; i++) {
+			buffer.Push({"event", i, i + 1, buffer.GetThreadId(), 0});
+		}
+		Check("overflow dropped", profiler.GetDroppedCount() == 10);
+
+		profiler.EndFrame();
+		FrameStats stats = profiler.GetStats();
+		Check("ring collected", stats.scopes.size() == 1 && stats.scopes[0].count == ProfileThreadBuffer::capacity);
+
+		buffer.Push({"event", 0, 1, buffer.GetThreadId(), 0});
+		profiler.EndFrame();
+		stats = profiler.GetStats();
+		Check("room after draining", stats.scopes[0].count == ProfileThreadBuffer::capacity + 1 && profiler.GetDroppedCount() == 10);
+	}
+
+	// Producers on several threads, one collector; every event is either collected or counted as dropped
+	void TestThreads()
+	{
+		const unsigned threadCount = 4;
+		const int eventsPerThread = 100000;
+		Profiler profiler(1 << 20);
+		std::atomic<unsigned> running(threadCount);
+
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < threadCount; t++) {
+			threads.emplace_back([&]() {
+				ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+				for (int i = 0; i < eventsPerThread; i++) {
+					const uint64_t now = ProfilerNow();
+					buffer.Push({"worker", now, now + 1, buffer.GetThreadId(), 0});
+				}
+				running--;
+			});
+		}
+		while (running > 0) {
+			profiler.EndFrame();
+		}
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		profiler.EndFrame();
+
+		const FrameStats stats = profiler.GetStats();
+		const uint64_t collected = stats.scopes.empty() ? 0 : stats.scopes[0].count;
+		Check("collected or dropped", collected + profiler.GetDroppedCount() == static_cast<uint64_t>(threadCount) * eventsPerThread);
+	}
+
+	// Frames on a simulated 16 ms clock with a 20 ms spike in the first of every 10
+	void RecordFrames(Profiler &profiler, int frame_count, const char *record_name)
+	{
+		ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+		profiler.Reset();
+		// The first frame begins at the reset
+		uint64_t clock = ProfilerNow();
+		for (int frame = 0; frame < frame_count; frame++) {
+			const uint64_t frameBegin = clock;
+			const uint64_t recordTime = frame % 10 == 0 ? 20 * ms : ms / 2;
+			buffer.Push({"Update", clock, clock + ms / 5, buffer.GetThreadId(), 1});
+			clock += ms / 5;
+			buffer.Push({record_name, clock, clock + recordTime, buffer.GetThreadId(), 1});
+			clock += recordTime;
+			buffer.Push({"Render", frameBegin, clock, buffer.GetThreadId(), 0});
+			profiler.AddGpuEvent("Draw", clock + ms / 10, clock + 2 * ms);
+			clock = frameBegin + std::max<uint64_t>(16 * ms, clock - frameBegin);
+			profiler.EndFrame(clock);
+		}
+	}
+
+	void TestStats()
+	{
+		Profiler profiler(100);
+		RecordFrames(profiler, 100, "Record");
+		const FrameStats stats = profiler.GetStats();
+		Check("frame count", stats.frame_count == 100);
+		Check("frame times", std::fabs(stats.min_ms - 16.0) < 1e-6 && std::fabs(stats.max_ms - 20.2) < 1e-3 &&
+			std::fabs(stats.avg_ms - (90 * 16.0 + 10 * 20.2) / 100) < 1e-3);
+
+		auto find = [&](const char *name, bool gpu) {
+			auto found = std::find_if(stats.scopes.begin(), stats.scopes.end(),
+				[&](const ScopeStats &scope) { return scope.name == name && scope.gpu == gpu; });
+			return found != stats.scopes.end() ? &*found : nullptr;
+		};
+		const ScopeStats *record = find("Record", false);
+		const ScopeStats *draw = find("Draw", true);
+		Check("scopes", stats.scopes.size() == 4 && record && draw && find("Update", false) && find("Render", false));
+		Check("record", record && record->count == 100 && std::fabs(record->max_ms - 20.0) < 1e-6 && std::fabs(record->min_ms - 0.5) < 1e-6);
+		Check("gpu", draw && std::fabs(draw->per_frame_ms - 1.9) < 1e-6);
+
+		RecordFrames(profiler, 150, "Record");
+		Check("history bounded", profiler.GetStats().frame_count == 100);
+	}
+
+	void TestChromeTrace()
+	{
+		Profiler profiler(10);
+		profiler.SetThreadName("Main \"render\" thread");
+		RecordFrames(profiler, 10, "Record \"chunk\" C:\\path\ttab\nline");
+		std::ostringstream trace;
+		profiler.WriteChromeTrace(trace);
+		const std::string json = trace.str();
+
+		// A frame span plus four events per frame
+		Check("spans", CountOccurrences(json, "\"ph\":\"X\"") == 10 * 5);
+		Check("balanced", CountOccurrences(json, "{") == CountOccurrences(json, "}") && CountOccurrences(json, "[") == CountOccurrences(json, "]"));
+		Check("quotes escaped", json.find("\"Main \\\"render\\\" thread\"") != std::string::npos);
+		Check("backslash escaped", json.find("\"Record \\\"chunk\\\" C:\\\\path tab line\"") != std::string::npos);
+		Check("no control characters", std::none_of(json.begin(), json.end(),
+			[](char c) { return static_cast<unsigned char>(c) < 0x20 && c != '\n'; }));
+		Check("gpu process", CountOccurrences(json, "\"pid\":2,\"tid\":0") == 10);
+	}
+
+	void TestCsv()
+	{
+		Profiler profiler(10);
+		ProfileThreadBuffer &buffer = profiler.GetThreadBuffer();
+		const char *names[] = {"plain", "a,b", "say \"hi\"", "two\nlines"};
+		for (const char *name : names) {
+			buffer.Push({name, 0, ms, buffer.GetThreadId(), 0});
+		}
+		profiler.EndFrame();
+		std::ostringstream stream;
+		profiler.WriteCsv(stream);
+		const std::string csv = stream.str();
+
+		Check("header", csv.compare(0, 18, "name,source,count,") == 0);
+		Check("frame row", csv.find("\nframe,cpu,1,") != std::string::npos);
+		Check("plain unquoted", csv.find("\nplain,cpu,1,") != std::string::npos);
+		Check("comma quoted", csv.find("\n\"a,b\",cpu,1,") != std::string::npos);
+		Check("quotes doubled", csv.find("\n\"say \"\"hi\"\"\",cpu,1,") != std::string::npos);
+		Check("newline quoted", csv.find("\n\"two\nlines\",cpu,1,") != std::string::npos);
+		// Header, frame row and one row per scope, plus the newline inside the quoted field
+		Check("rows", CountOccurrences(csv, "\n") == 2 + 4 + 1);
+	}
+}
+
+REGISTER_TEST("profiler_ring_drops", TestRingDrops);
+REGISTER_TEST("profiler_threads", TestThreads);
+REGISTER_TEST("profiler_stats", TestStats);
+REGISTER_TEST("profiler_chrome_trace", TestChromeTrace);
+REGISTER_TEST("profiler_csv", TestCsv);
@@ -0,0 +1,160 @@
+#include "test.h"
+#include "render_graph.h"
+
+#include <string>
+
+namespace
+{
+	const uint64_t mib = 1024 * 1024;
+	const uint64_t texture_alignment = 64 * 1024;
+
+	class CountingBackend : public RenderGraphBackend
+	{
+	public:
+		CountingBackend() : batch_count(0), barrier_count(0) {};
+
+		void ResourceBarriers(const RenderBarrier *, uint32_t count) override
+		{
+			batch_count++;
+			barrier_count += count;
+		}
+
+		uint32_t batch_count;
+		uint32_t barrier_count;
+	};
+
+	// The renderer's current frame: one pass drawing into the back buffer
+	void TestPresentGraph()
+	{
+		RenderGraph graph;
+		const RenderGraph::ResourceId backBuffer = graph.ImportResource("Back buffer", ResourceState::Present, ResourceState::Present);
+		const RenderGraph::PassId scene = graph.AddPass("Scene", nullptr);
+		graph.Write(scene, backBuffer, ResourceState::RenderTarget);
+
+		std::string err;
+		Check("compile", graph.Compile(err));
+		const RenderGraphStats &stats = graph.GetStats();
+		Check("two transitions", stats.barrier_count == 2 && stats.batch_count == 2 && stats.split_barrier_count == 0);
+	}
+
+	// Shadow, G-buffer, SSAO, lighting, motion blur, bloom and tonemap, plus a debug view nobody consumes
+	void TestDeferredGraph()
+	{
+		RenderGraph graph;
+		std::vector<int> order;
+		auto pass = [&](const char *name, int index) { return graph.AddPass(name, [&order, index]() { order.push_back(index); }); };
+
+		const RenderGraph::ResourceId backBuffer = graph.ImportResource("Back buffer", ResourceState::Present, ResourceState::Present);
+		const RenderGraph::ResourceId shadow = graph.CreateTransient("Shadow map", 16 * mib, texture_alignment);
+		const RenderGraph::ResourceId depth = graph.CreateTransient("Depth", 8 * mib, texture_alignment);
+		const RenderGraph::ResourceId albedo = graph.CreateTransient("Albedo", 8 * mib, texture_alignment);
+		const RenderGraph::ResourceId normal = graph.CreateTransient("Normal", 8 * mib, texture_alignment);
+		const RenderGraph::ResourceId ssao = graph.CreateTransient("SSAO", 4 * mib, texture_alignment);
+		const RenderGraph::ResourceId hdr = graph.CreateTransient("HDR", 16 * mib, texture_alignment);
+		const RenderGraph::ResourceId debug = graph.CreateTransient("Debug view", 8 * mib, texture_alignment);
+		const RenderGraph::ResourceId motion = graph.CreateTransient("Motion blur", 16 * mib, texture_alignment);
+		const RenderGraph::ResourceId bloom = graph.CreateTransient("Bloom", 4 * mib, texture_alignment);
+
+		const RenderGraph::PassId shadowPass = pass("Shadow", 0);
+		graph.Write(shadowPass, shadow, ResourceState::DepthWrite);
+		const RenderGraph::PassId gbufferPass = pass("G-buffer", 1);
+		graph.Write(gbufferPass, depth, ResourceState::DepthWrite);
+		graph.Write(gbufferPass, albedo, ResourceState::RenderTarget);
+		graph.Write(gbufferPass, normal, ResourceState::RenderTarget);
+		const RenderGraph::PassId ssaoPass = pass("SSAO", 2);
+		graph.Read(ssaoPass, depth, ResourceState::ShaderResource);
+		graph.Read(ssaoPass, normal, ResourceState::ShaderResource);
+		graph.Write(ssaoPass, ssao, ResourceState::UnorderedAccess);
+		const RenderGraph::PassId blurPass = pass("SSAO blur", 3);
+		graph.Read(blurPass, ssao, ResourceState::UnorderedAccess);
+		graph.Write(blurPass, ssao, ResourceState::UnorderedAccess);
+		const RenderGraph::PassId lightingPass = pass("Lighting", 4);
+		graph.Read(lightingPass, shadow, ResourceState::ShaderResource);
+		graph.Read(lightingPass, depth, ResourceState::ShaderResource);
+		graph.Read(lightingPass, albedo, ResourceState::ShaderResource);
+		graph.Read(lightingPass, normal, ResourceState::ShaderResource);
+		graph.Read(lightingPass, ssao, ResourceState::ShaderResource);
+		graph.Write(lightingPass, hdr, ResourceState::RenderTarget);
+		const RenderGraph::PassId debugPass = pass("Debug view", 5);
+		graph.Read(debugPass, albedo, ResourceState::ShaderResource);
+		graph.Write(debugPass, debug, ResourceState::RenderTarget);
+		const RenderGraph::PassId motionPass = pass("Motion blur", 6);
+		graph.Read(motionPass, hdr, ResourceState::ShaderResource);
+		graph.Read(motionPass, depth, ResourceState::ShaderResource);
+		graph.Write(motionPass, motion, ResourceState::RenderTarget);
+		const RenderGraph::PassId bloomPass = pass("Bloom", 7);
+		graph.Read(bloomPass, motion, ResourceState::ShaderResource);
+		graph.Write(bloomPass, bloom, ResourceState::UnorderedAccess);
+		const RenderGraph::PassId tonemapPass = pass("Tonemap", 8);
+		graph.Read(tonemapPass, motion, ResourceState::ShaderResource | ResourceState::CopySource);
+		graph.Read(tonemapPass, bloom, ResourceState::ShaderResource);
+		graph.Write(tonemapPass, backBuffer, ResourceState::RenderTarget);
+
+		std::string err;
+		Check("compile", graph.Compile(err));
+		const RenderGraphStats &stats = graph.GetStats();
+
+		Check("debug view culled", graph.IsCulled(debugPass) && !graph.IsTransientUsed(debug) && stats.culled_pass_count == 1);
+		// Into and out of the frame's state for the back buffer and each of the 8 used transients; reads in a row
+		// share one transition, the SSAO passes need a UAV barrier, and the back buffer, shadow map and albedo are
+		// idle long enough to split their transitions
+		Check("transitions", stats.barrier_count - stats.aliasing_barrier_count - stats.uav_barrier_count - stats.split_barrier_count == 18);
+		Check("uav barrier", stats.uav_barrier_count == 1);
+		Check("split barriers", stats.split_barrier_count == 3);
+		Check("batches", stats.batch_count == stats.pass_count + 1);
+		// Motion blur and bloom fit where shadow map, depth, G-buffer and SSAO lived: 60 of 80 MiB
+		Check("aliasing", stats.transient_size == 80 * mib && stats.transient_heap_size == 60 * mib && stats.aliasing_barrier_count > 0);
+
+		// Transients alive at the same time must not share memory
+		for (RenderGraph::ResourceId a = 1; a < graph.GetResourceCount(); a++) {
+			for (RenderGraph::ResourceId b = a + 1; b < graph.GetResourceCount(); b++) {
+				if (!graph.IsTransientUsed(a) || !graph.IsTransientUsed(b)) {
+					continue;
+				}
+				const bool memoryOverlaps = graph.GetTransientOffset(a) < graph.GetTransientOffset(b) + graph.GetTransientSize(b) &&
+					graph.GetTransientOffset(b) < graph.GetTransientOffset(a) + graph.GetTransientSize(a);
+				const bool shareLifetime = graph.GetFirstUse(a) <= graph.GetLastUse(b) && graph.GetFirstUse(b) <= graph.GetLastUse(a);
+				Check(("overlap " + graph.GetResourceName(a) + " / " + graph.GetResourceName(b)).c_str(), !(memoryOverlaps && shareLifetime));
+			}
+			if (graph.IsTransientUsed(a)) {
+				Check("alignment", graph.GetTransientOffset(a) % texture_alignment == 0);
+			}
+		}
+
+		CountingBackend backend;
+		graph.Execute(backend);
+		Check("execute order", order == std::vector<int>({0, 1, 2, 3, 4, 6, 7, 8}));
+		Check("execute batches", backend.batch_count == stats.batch_count && backend.barrier_count == stats.barrier_count);
+	}
+
+	void TestErrors()
+	{
+		std::string err;
+		{
+			RenderGraph graph;
+			const RenderGraph::ResourceId texture = graph.CreateTransient("Texture", mib, texture_alignment);
+			const RenderGraph::PassId pass = graph.AddPass("Reader", nullptr, true);
+			graph.Read(pass, texture, ResourceState::ShaderResource);
+			Check("read before write", !graph.Compile(err));
+		}
+		{
+			RenderGraph graph;
+			const RenderGraph::ResourceId texture = graph.CreateTransient("Texture", mib, texture_alignment);
+			const RenderGraph::PassId pass = graph.AddPass("Writer", nullptr, true);
+			graph.Write(pass, texture, ResourceState::RenderTarget);
+			graph.Read(pass, texture, ResourceState::ShaderResource);
+			Check("conflicting states", !graph.Compile(err));
+		}
+		{
+			RenderGraph graph;
+			const RenderGraph::ResourceId texture = graph.CreateTransient("Texture", mib, texture_alignment);
+			const RenderGraph::PassId pass = graph.AddPass("Writer", nullptr, true);
+			graph.Write(pass, texture, ResourceState::ShaderResource);
+			Check("write in read state", !graph.Compile(err));
+		}
+	}
+}
+
+REGISTER_TEST("render_graph_present", TestPresentGraph);
+REGISTER_TEST("render_graph_deferred", TestDeferredGraph);
+REGISTER_TEST("render_graph_errors", TestErrors);
@@ -0,0 +1,202 @@
+#include "test.h"
+#include "mapped_file.h"
+#include "shader_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+	// Deterministic "bytecode" derived from the key inputs; counts compiles so hits and misses can be checked
+	class StubShaderCompiler : public ShaderCompiler
+	{
+	public:
+		StubShaderCompiler() : compile_count(0) {};
+
+		std::string GetVersion() const override { return "stub-1"; }
+
+		bool Compile(const std::string &source, const ShaderCompileRequest &request, std::vector<uint8_t> &bytecode,
+			std::string &err) override
+		{
+			compile_count++;
+			if (source.find("#error") != std::string::npos) {
+				err = request.source_name + ": #error";
+				return false;
+			}
+
+			uint64_t hash = HashBytes(source.data(), source.size());
+			hash = HashBytes(request.entry_point.data(), request.entry_point.size(), hash);
+			for (const ShaderDefine &define : request.defines) {
+				hash = HashBytes(define.value.data(), define.value.size(), hash);
+			}
+
+			bytecode.resize(2048 + hash % 2048);
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				bytecode[i] = static_cast<uint8_t>(hash >> (i % 8 * 8)) ^ static_cast<uint8_t>(i);
+			}
+			return true;
+		}
+
+		int GetCompileCount() const { return compile_count; }
+
+	private:
+		int compile_count;
+	};
+
+	const char *stub_source = "float4 PSMain(float4 color : COLOR) : SV_TARGET { return color * SCALE; }";
+
+	std::vector<ShaderCompileRequest> MakePermutations(size_t count)
+	{
+		std::vector<ShaderCompileRequest> requests;
+		for (size_t i = 0; i < count; i++) {
+			requests.push_back({"stub.hlsl", i % 2 ? "PSMain" : "VSMain", i % 2 ? "ps_5_0" : "vs_5_0",
+				{{"SCALE", std::to_string(i / 2)}, {"USE_FOG", i % 3 ? "1" : "0"}}, 0});
+		}
+		return requests;
+	}
+
+	bool RunPermutations(ShaderCache &cache, const std::vector<ShaderCompileRequest> &requests)
+	{
+		std::vector<uint8_t> bytecode;
+		std::string err;
+		bool ok = true;
+		for (const ShaderCompileRequest &request : requests) {
+			ok &= cache.GetShader(stub_source, request, bytecode, err);
+		}
+		return ok;
+	}
+
+	struct CacheDirectory
+	{
+		explicit CacheDirectory(const char *name) : path((std::filesystem::temp_directory_path() / name).string())
+		{
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		~CacheDirectory()
+		{
+			std::error_code error;
+			std::filesystem::remove_all(path, error);
+		}
+
+		std::string path;
+	};
+
+	// Every input of the key must change it, and nothing else may
+	void TestKeys()
+	{
+		const ShaderCompileRequest base = {"a.hlsl", "PSMain", "ps_5_0", {{"A", "1"}, {"B", "2"}}, 0};
+		const uint64_t key = ComputeShaderKey(stub_source, base, "v1");
+
+		ShaderCompileRequest renamed = base;
+		renamed.source_name = "b.hlsl";
+		Check("source name ignored", ComputeShaderKey(stub_source, renamed, "v1") == key);
+
+		ShaderCompileRequest variants[5] = {base, base, base, base, base};
+		variants[0].entry_point = "VSMain";
+		variants[1].target = "ps_5_1";
+		variants[2].defines[1].value = "3";
+		std::swap(variants[3].defines[0], variants[3].defines[1]);
+		variants[4].flags = 1;
+		for (const ShaderCompileRequest &variant : variants) {
+			Check("request changes the key", ComputeShaderKey(stub_source, variant, "v1") != key);
+		}
+		Check("source changes the key", ComputeShaderKey(std::string(stub_source) + " ", base, "v1") != key);
+		Check("compiler version changes the key", ComputeShaderKey(stub_source, base, "v2") != key);
+	}
+
+	void TestMemoryStore()
+	{
+		const std::vector<ShaderCompileRequest> requests = MakePermutations(32);
+		StubShaderCompiler compiler;
+		MemoryCacheStore store(64 * 1024 * 1024);
+		ShaderCache cache(store, compiler);
+
+		Check("cold", RunPermutations(cache, requests) && compiler.GetCompileCount() == 32);
+		Check("warm", RunPermutations(cache, requests) && compiler.GetCompileCount() == 32);
+		Check("stats", cache.GetStats().shader_hits == 32 && cache.GetStats().shader_misses == 32);
+	}
+
+	void TestDirectoryStore()
+	{
+		CacheDirectory directory("shader_cache_test");
+		const std::vector<ShaderCompileRequest> requests = MakePermutations(32);
+		StubShaderCompiler compiler;
+		{
+			DirectoryCacheStore store(directory.path, 256 * 1024 * 1024);
+			ShaderCache cache(store, compiler);
+			Check("cold", RunPermutations(cache, requests) && compiler.GetCompileCount() == 32);
+		}
+
+		// A new process: the store rebuilds its index from the directory
+		DirectoryCacheStore store(directory.path, 256 * 1024 * 1024);
+		ShaderCache cache(store, compiler);
+		Check("hits after restart", RunPermutations(cache, requests) && compiler.GetCompileCount() == 32 &&
+			cache.GetStats().shader_hits == 32);
+
+		// Corrupt one payload byte: the entry is rejected, recompiled and replaced
+		std::vector<uint8_t> bytecode;
+		std::string err;
+		const std::string path = store.GetPath(CacheEntryKind::Shader, ComputeShaderKey(stub_source, requests[0], compiler.GetVersion()));
+		{
+			std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(sizeof(CacheEntryHeader) + 10);
+			file.put('\x5A' ^ static_cast<char>(file.peek()));
+		}
+		Check("corrupted entry recompiled", cache.GetShader(stub_source, requests[0], bytecode, err) && compiler.GetCompileCount() == 33);
+		Check("corrupted entry replaced", cache.GetShader(stub_source, requests[0], bytecode, err) && compiler.GetCompileCount() == 33);
+
+		// Compile errors are reported and not cached
+		Check("compile error reported", !cache.GetShader("#error broken", requests[0], bytecode, err) && !err.empty());
+		Check("compile error not cached", !cache.GetShader("#error broken", requests[0], bytecode, err) && compiler.GetCompileCount() == 35);
+
+		// Pipelines refused by the driver are dropped
+		const uint8_t blob[64] = {1, 2, 3};
+		const uint64_t pipelineKey = PipelineKeyBuilder().Add(blob, sizeof(blob)).AddValue(42).GetKey();
+		cache.StorePipeline(pipelineKey, blob, sizeof(blob));
+		std::vector<uint8_t> loaded;
+		Check("pipeline stored", cache.LoadPipeline(pipelineKey, loaded) && loaded.size() == sizeof(blob));
+		cache.RejectPipeline(pipelineKey);
+		Check("rejected pipeline dropped", !cache.LoadPipeline(pipelineKey, loaded));
+	}
+
+	// A store smaller than the working set keeps the most recently used entries within its budget
+	void TestEviction()
+	{
+		CacheDirectory directory("shader_cache_evict_test");
+		const std::vector<ShaderCompileRequest> requests = MakePermutations(64);
+		const uint64_t budget = 64 * 1024;
+		StubShaderCompiler compiler;
+		DirectoryCacheStore store(directory.path, budget);
+		ShaderCache cache(store, compiler);
+
+		std::vector<uint8_t> bytecode;
+		std::string err;
+		uint64_t maxSize = 0;
+		for (int pass = 0; pass < 2; pass++) {
+			for (const ShaderCompileRequest &request : requests) {
+				cache.GetShader(stub_source, request, bytecode, err);
+				// The first request is used all the time and must survive
+				cache.GetShader(stub_source, requests[0], bytecode, err);
+				maxSize = std::max(maxSize, store.GetSize());
+			}
+		}
+
+		std::error_code error;
+		uint64_t diskSize = 0;
+		for (std::filesystem::directory_iterator it(directory.path, error), end; !error && it != end; it.increment(error)) {
+			diskSize += it->file_size();
+		}
+		Check("within budget", maxSize <= budget);
+		Check("size matches disk", diskSize == store.GetSize());
+		Check("recently used entry kept", cache.GetStats().shader_hits >= requests.size() * 2 - 1);
+		Check("others evicted", cache.GetStats().shader_misses > requests.size());
+	}
+}
+
+REGISTER_TEST("shader_cache_keys", TestKeys);
+REGISTER_TEST("shader_cache_memory_store", TestMemoryStore);
+REGISTER_TEST("shader_cache_directory_store", TestDirectoryStore);
+REGISTER_TEST("shader_cache_eviction", TestEviction);
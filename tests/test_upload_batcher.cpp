@@ -0,0 +1,177 @@
+#include "test.h"
+#include "upload_batcher.h"
+
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// Copies execute only when their submission "completes", so reusing staging space too early corrupts the result
+	class MockCopyBackend : public CopyBackend
+	{
+	public:
+		MockCopyBackend(uint64_t staging_size, size_t latency) : staging(staging_size), latency(latency), next_fence(1), completed(0) {};
+
+		uint8_t *GetStagingMemory() override { return staging.data(); }
+
+		void CopyToBuffer(void *destination, uint64_t destination_offset, uint64_t staging_offset, uint64_t size) override
+		{
+			recording.push_back({static_cast<std::vector<uint8_t> *>(destination), destination_offset, staging_offset, size});
+		}
+
+		uint64_t Submit() override
+		{
+			in_flight.push_back({next_fence, recording});
+			recording.clear();
+			// Older submissions finish as new ones arrive
+			while (in_flight.size() > latency) {
+				Execute();
+			}
+			return next_fence++;
+		}
+
+		uint64_t GetCompletedValue() override { return completed; }
+
+		void WaitForValue(uint64_t value) override
+		{
+			while (completed < value && !in_flight.empty()) {
+				Execute();
+			}
+		}
+
+		size_t GetRecordedCount() const { return recording.size(); }
+
+	private:
+		struct Copy
+		{
+			std::vector<uint8_t> *destination;
+			uint64_t destination_offset;
+			uint64_t staging_offset;
+			uint64_t size;
+		};
+
+		struct Batch
+		{
+			uint64_t fence;
+			std::vector<Copy> copies;
+		};
+
+		void Execute()
+		{
+			for (const Copy &copy : in_flight.front().copies) {
+				memcpy(copy.destination->data() + copy.destination_offset, staging.data() + copy.staging_offset, copy.size);
+			}
+			completed = in_flight.front().fence;
+			in_flight.pop_front();
+		}
+
+		std::vector<uint8_t> staging;
+		std::vector<Copy> recording;
+		std::deque<Batch> in_flight;
+		size_t latency;
+		uint64_t next_fence;
+		uint64_t completed;
+	};
+
+	std::vector<uint8_t> MakeData(size_t size, uint32_t seed)
+	{
+		std::mt19937 random(seed);
+		std::vector<uint8_t> data(size);
+		for (uint8_t &byte : data) {
+			byte = static_cast<uint8_t>(random());
+		}
+		return data;
+	}
+
+	// Small uploads share one submission until Flush
+	void TestBatching()
+	{
+		MockCopyBackend backend(64 * 1024, 2);
+		UploadBatcher batcher(backend, 64 * 1024);
+		Check("nothing submitted", batcher.Flush() == 0 && batcher.GetStats().submissions == 0);
+
+		std::vector<std::vector<uint8_t>> sources;
+		std::vector<std::vector<uint8_t>> destinations(10, std::vector<uint8_t>(100));
+		for (uint32_t i = 0; i < 10; i++) {
+			sources.push_back(MakeData(100, i));
+			batcher.Upload(&destinations[i], 0, sources[i].data(), sources[i].size());
+		}
+		Check("batched", batcher.GetStats().copies == 10 && batcher.GetStats().submissions == 0 && backend.GetRecordedCount() == 10);
+		Check("one submission", batcher.Flush() == 1 && batcher.GetStats().submissions == 1);
+		Check("empty flush", batcher.Flush() == 1 && batcher.GetLastFenceValue() == 1);
+
+		batcher.WaitForIdle();
+		Check("uploaded", destinations == sources);
+	}
+
+	// An upload bigger than the staging ring is split into quarter-ring chunks
+	void TestLargeUpload()
+	{
+		MockCopyBackend backend(4096, 2);
+		UploadBatcher batcher(backend, 4096);
+		const std::vector<uint8_t> source = MakeData(10000, 1);
+		std::vector<uint8_t> destination(source.size());
+		batcher.Upload(&destination, 0, source.data(), source.size());
+		batcher.WaitForIdle();
+		Check("chunks", batcher.GetStats().copies == 10 && batcher.GetStats().bytes == source.size());
+		Check("uploaded", destination == source);
+	}
+
+	// A copy queue that never finishes on its own: the batcher must wait before writing staging space again
+	void TestStall()
+	{
+		MockCopyBackend backend(4096, 1000);
+		UploadBatcher batcher(backend, 4096);
+		const std::vector<uint8_t> first = MakeData(4096, 1);
+		const std::vector<uint8_t> second = MakeData(1024, 2);
+		std::vector<uint8_t> firstDestination(first.size());
+		std::vector<uint8_t> secondDestination(second.size());
+		batcher.Upload(&firstDestination, 0, first.data(), first.size());
+		batcher.Flush();
+		Check("no stall while space is left", batcher.GetStats().stalls == 0);
+
+		batcher.Upload(&secondDestination, 0, second.data(), second.size());
+		Check("stalled", batcher.GetStats().stalls == 1);
+		batcher.WaitForIdle();
+		Check("staging not overwritten", firstDestination == first && secondDestination == second);
+	}
+
+	// Random sizes and offsets through small rings, with the copy queue 0 to 3 submissions behind
+	void TestRandomUploads()
+	{
+		for (uint64_t stagingSize : {4096ull, 64ull * 1024}) {
+			for (size_t latency = 0; latency <= 3; latency++) {
+				MockCopyBackend backend(stagingSize, latency);
+				UploadBatcher batcher(backend, stagingSize);
+				std::mt19937 random(7);
+				std::uniform_int_distribution<int> sizeDistribution(1, 20000);
+				std::vector<std::vector<uint8_t>> sources;
+				std::vector<std::vector<uint8_t>> destinations(500);
+				for (size_t i = 0; i < destinations.size(); i++) {
+					const size_t offset = random() % 64;
+					sources.push_back(MakeData(sizeDistribution(random), static_cast<uint32_t>(i)));
+					destinations[i].resize(offset + sources[i].size());
+					batcher.Upload(&destinations[i], offset, sources[i].data(), sources[i].size());
+					if (i % 50 == 0) {
+						batcher.Flush();
+					}
+				}
+				batcher.WaitForIdle();
+
+				size_t corrupted = 0;
+				for (size_t i = 0; i < destinations.size(); i++) {
+					const size_t offset = destinations[i].size() - sources[i].size();
+					corrupted += memcmp(destinations[i].data() + offset, sources[i].data(), sources[i].size()) != 0;
+				}
+				Check("no corrupted uploads", corrupted == 0);
+			}
+		}
+	}
+}
+
+REGISTER_TEST("upload_batcher_batching", TestBatching);
+REGISTER_TEST("upload_batcher_large_upload", TestLargeUpload);
+REGISTER_TEST("upload_batcher_stall", TestStall);
+REGISTER_TEST("upload_batcher_random_uploads", TestRandomUploads);
@@ -0,0 +1,145 @@
+#include "test.h"
+#include "upload_ring.h"
+
+#include <algorithm>
+#include <random>
+
+namespace
+{
+	// Pages in plain CPU memory with made-up GPU addresses
+	class HeapPageSource : public UploadPageSource
+	{
+	public:
+		HeapPageSource() : next_gpu_address(0x100000000ull), live_pages(0) {};
+
+		bool CreatePage(uint64_t size, UploadPage &page) override
+		{
+			page.cpu_address = new uint8_t[size];
+			page.gpu_address = next_gpu_address;
+			page.size = size;
+			page.resource = page.cpu_address;
+			next_gpu_address += (size + 0xFFFF) & ~0xFFFFull;
+			live_pages++;
+			return true;
+		}
+
+		void DestroyPage(UploadPage &page) override
+		{
+			delete[] page.cpu_address;
+			page = {};
+			live_pages--;
+		}
+
+		int GetLivePages() const { return live_pages; }
+
+	private:
+		uint64_t next_gpu_address;
+		int live_pages;
+	};
+
+	// Filling a page moves on to the next one; once its frame completed, the first page is written again from the start
+	void TestWrapAround()
+	{
+		HeapPageSource source;
+		UploadRing ring(source, 4096);
+		const UploadAllocation first = ring.Allocate(256);
+		for (int i = 1; i < 16; i++) {
+			ring.Allocate(256);
+		}
+		const UploadAllocation second = ring.Allocate(256);
+		Check("full page moves on", second.resource != first.resource && second.offset == 0);
+		ring.Close(1);
+		ring.Retire(1);
+
+		for (int i = 1; i < 16; i++) {
+			ring.Allocate(256);
+		}
+		const UploadAllocation wrapped = ring.Allocate(256);
+		Check("wraps to the retired page", wrapped.resource == first.resource && wrapped.offset == 0 &&
+			wrapped.gpu_address == first.gpu_address);
+		Check("no page added", ring.GetStats().page_count == 2);
+	}
+
+	// Pages still in flight are never written; the ring grows instead, and oversized pages are released once retired
+	void TestRetirement()
+	{
+		HeapPageSource source;
+		UploadRing ring(source, 4096);
+		const UploadAllocation first = ring.Allocate(4096);
+		ring.Close(1);
+		const UploadAllocation second = ring.Allocate(4096);
+		ring.Close(2);
+		const UploadAllocation third = ring.Allocate(4096);
+		Check("in-flight pages skipped", first.resource != second.resource && third.resource != first.resource &&
+			third.resource != second.resource && ring.GetStats().page_count == 3);
+		ring.Close(3);
+
+		ring.Retire(1);
+		Check("retired page reused", ring.Allocate(4096).resource == first.resource);
+		ring.Close(4);
+
+		const UploadAllocation large = ring.Allocate(10000);
+		Check("oversized page", large.offset == 0 && ring.GetStats().page_count == 4 && source.GetLivePages() == 4);
+		ring.Close(5);
+		ring.Retire(4);
+		Check("oversized page kept in flight", source.GetLivePages() == 4);
+		ring.Retire(5);
+		Check("oversized page released", source.GetLivePages() == 3 && ring.GetStats().capacity == 3 * 4096);
+
+		const UploadAllocation aligned = ring.Allocate(100, 1024);
+		Check("alignment", aligned.gpu_address % 1024 == 0 && aligned.offset % 1024 == 0);
+	}
+
+	struct LiveAllocation
+	{
+		void *resource;
+		uint64_t offset;
+		uint64_t size;
+		uint64_t fence;
+	};
+
+	// Random sizes with the GPU 1 to 3 frames behind: no allocation may overlap one whose frame has not completed
+	void TestRandomFrames()
+	{
+		for (int latency = 1; latency <= 3; latency++) {
+			HeapPageSource source;
+			UploadRing ring(source, 4096);
+			std::mt19937 random(42);
+			std::uniform_int_distribution<int> countDistribution(1, 64);
+			std::uniform_int_distribution<int> sizeDistribution(1, 1024);
+			std::vector<LiveAllocation> live;
+			size_t misaligned = 0;
+			size_t overlaps = 0;
+
+			for (int frame = 1; frame <= 2000; frame++) {
+				const uint64_t completed = frame > latency ? static_cast<uint64_t>(frame - latency) : 0;
+				ring.Retire(completed);
+				live.erase(std::remove_if(live.begin(), live.end(),
+					[&](const LiveAllocation &a) { return a.fence <= completed; }), live.end());
+
+				const int count = countDistribution(random);
+				for (int i = 0; i < count; i++) {
+					const uint64_t size = static_cast<uint64_t>(sizeDistribution(random)) * (i % 17 == 0 ? 16 : 1);
+					const UploadAllocation allocation = ring.Allocate(size);
+					misaligned += allocation.gpu_address % UploadRing::default_alignment != 0;
+					for (const LiveAllocation &other : live) {
+						overlaps += other.resource == allocation.resource &&
+							allocation.offset < other.offset + other.size && other.offset < allocation.offset + allocation.size;
+					}
+					live.push_back({allocation.resource, allocation.offset, allocation.size, static_cast<uint64_t>(frame)});
+				}
+
+				ring.Close(static_cast<uint64_t>(frame));
+			}
+
+			Check("aligned", misaligned == 0);
+			Check("no overlap with frames in flight", overlaps == 0);
+			// The ring grows to the frames in flight, not with the frame count
+			Check("bounded growth", ring.GetStats().page_count < 64);
+		}
+	}
+}
+
+REGISTER_TEST("upload_ring_wrap_around", TestWrapAround);
+REGISTER_TEST("upload_ring_retirement", TestRetirement);
+REGISTER_TEST("upload_ring_random_frames", TestRandomFrames);